@@ -43,6 +43,7 @@
 #include "edify/expr.h"
 #include "otautil/paths.h"
 #include "otautil/print_sha1.h"
+#include "otautil/storage_benchmark.h"
 
 using namespace std::string_literals;
 
@@ -66,6 +67,75 @@ bool LoadFileContents(const std::string& filename, FileContents* file) {
   return true;
 }
 
+// Reads the first |partition.size| bytes of the given partition in windows of the tuned read size
+// and computes their SHA-1 into |digest|, without ever holding more than one window in memory.
+// Fails early if the device is smaller than the expected size.
+static bool HashPartition(const Partition& partition, uint8_t* digest) {
+  // Reads are issued at window-aligned offsets; the window is a multiple of any sane block size.
+  const size_t window_size = std::max<size_t>(IoTuning::Get().parameters().read_chunk_size, 4096);
+
+  android::base::unique_fd dev(open(partition.name.c_str(), O_RDONLY | O_CLOEXEC));
+  if (dev == -1) {
+    PLOG(ERROR) << "Failed to open eMMC partition \"" << partition << "\"";
+    return false;
+  }
+
+  off64_t device_size = lseek64(dev, 0, SEEK_END);
+  if (device_size == -1) {
+    PLOG(ERROR) << "Failed to get the size of " << partition;
+    return false;
+  }
+  if (static_cast<uint64_t>(device_size) < partition.size) {
+    LOG(ERROR) << "Partition " << partition << " is smaller than expected (" << device_size
+               << " bytes)";
+    return false;
+  }
+
+  // Advisory only; the device may not support it.
+  posix_fadvise(dev, 0, partition.size, POSIX_FADV_SEQUENTIAL);
+
+  SHA_CTX ctx;
+  SHA1_Init(&ctx);
+  std::vector<unsigned char> buffer(std::min(partition.size, window_size));
+  for (size_t offset = 0; offset < partition.size; offset += buffer.size()) {
+    size_t to_read = std::min(buffer.size(), partition.size - offset);
+    size_t next = offset + to_read;
+    if (next < partition.size) {
+      // Start fetching the next window while we hash the current one.
+      posix_fadvise(dev, next, std::min(window_size, partition.size - next),
+                    POSIX_FADV_WILLNEED);
+    }
+    if (!android::base::ReadFullyAtOffset(dev, buffer.data(), to_read, offset)) {
+      PLOG(ERROR) << "Failed to read " << to_read << " bytes at " << offset << " for partition "
+                  << partition;
+      return false;
+    }
+    SHA1_Update(&ctx, buffer.data(), to_read);
+  }
+  SHA1_Final(digest, &ctx);
+  return true;
+}
+
+// Returns whether the first |partition.size| bytes of the given partition match the expected hash.
+// Unlike ReadPartitionToBuffer(), it doesn't keep the contents around.
+static bool PartitionHasHash(const Partition& partition) {
+  uint8_t expected_sha1[SHA_DIGEST_LENGTH];
+  if (ParseSha1(partition.hash, expected_sha1) != 0) {
+    LOG(ERROR) << "Failed to parse target hash \"" << partition.hash << "\"";
+    return false;
+  }
+
+  uint8_t sha1[SHA_DIGEST_LENGTH];
+  if (!HashPartition(partition, sha1)) {
+    return false;
+  }
+  if (memcmp(sha1, expected_sha1, SHA_DIGEST_LENGTH) != 0) {
+    LOG(ERROR) << "Partition contents don't have the expected checksum";
+    return false;
+  }
+  return true;
+}
+
 // Reads the contents of a Partition to the given FileContents buffer.
 static bool ReadPartitionToBuffer(const Partition& partition, FileContents* out,
                                   bool check_backup) {
@@ -254,10 +324,8 @@ int ParseSha1(const std::string& str, uint8_t* digest) {
 }
 
 bool PatchPartitionCheck(const Partition& target, const Partition& source) {
-  FileContents target_file;
   FileContents source_file;
-  return (ReadPartitionToBuffer(target, &target_file, false) ||
-          ReadPartitionToBuffer(source, &source_file, true));
+  return (PartitionHasHash(target) || ReadPartitionToBuffer(source, &source_file, true));
 }
 
 int ShowLicenses() {
@@ -269,9 +337,8 @@ bool PatchPartition(const Partition& target, const Partition& source, const Valu
                     const Value* bonus, bool backup_source) {
   LOG(INFO) << "Patching " << target.name;
 
-  // We try to load and check against the target hash first.
-  FileContents target_file;
-  if (ReadPartitionToBuffer(target, &target_file, false)) {
+  // We try to check against the target hash first.
+  if (PartitionHasHash(target)) {
     // The early-exit case: the patch was already applied, this file has the desired hash, nothing
     // for us to do.
     LOG(INFO) << "  already " << target.hash.substr(0, 8);
@@ -290,9 +357,8 @@ bool PatchPartition(const Partition& target, const Partition& source, const Valu
 bool FlashPartition(const Partition& partition, const std::string& source_filename) {
   LOG(INFO) << "Flashing " << partition;
 
-  // We try to load and check against the target hash first.
-  FileContents target_file;
-  if (ReadPartitionToBuffer(partition, &target_file, false)) {
+  // We try to check against the target hash first.
+  if (PartitionHasHash(partition)) {
     // The early-exit case: the patch was already applied, this file has the desired hash, nothing
     // for us to do.
     LOG(INFO) << "  already " << partition.hash.substr(0, 8);
@@ -424,8 +490,7 @@ static bool GenerateTarget(const Partition& target, const FileContents& source_f
 }
 
 bool CheckPartition(const Partition& partition) {
-  FileContents target_file;
-  return ReadPartitionToBuffer(partition, &target_file, false);
+  return PartitionHasHash(partition);
 }
 
 Partition Partition::Parse(const std::string& input_str, std::string* err) {
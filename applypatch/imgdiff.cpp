@@ -145,6 +145,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -153,7 +154,11 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <chrono>
+#include <optional>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include <android-base/file.h>
@@ -251,6 +256,8 @@ static const struct option OPTIONS[] = {
   { "block-limit", required_argument, nullptr, 0 },
   { "debug-dir", required_argument, nullptr, 0 },
   { "split-info", required_argument, nullptr, 0 },
+  { "memory-limit", required_argument, nullptr, 0 },
+  { "split-report", required_argument, nullptr, 0 },
   { "verbose", no_argument, nullptr, 'v' },
   { nullptr, 0, nullptr, 0 },
 };
@@ -1188,7 +1195,7 @@ bool ZipModeImage::GeneratePatches(const std::vector<ZipModeImage>& split_tgt_im
                                    const std::vector<SortedRangeSet>& split_src_ranges,
                                    const std::string& patch_name,
                                    const std::string& split_info_file,
-                                   const std::string& debug_dir) {
+                                   const std::string& debug_dir, SplitPatchStats* stats) {
   LOG(INFO) << "Constructing patches for " << split_tgt_images.size() << " split images...";
 
   android::base::unique_fd patch_fd(
@@ -1208,9 +1215,21 @@ bool ZipModeImage::GeneratePatches(const std::vector<ZipModeImage>& split_tgt_im
     }
 
     size_t total_patch_size = 12;
+    size_t max_expanded_size = 0;
     for (auto& p : patch_chunks) {
       p.UpdateSourceOffset(split_src_ranges[i]);
       total_patch_size += p.PatchSize();
+      max_expanded_size = std::max(max_expanded_size, p.ExpandedSize());
+    }
+
+    if (stats != nullptr) {
+      stats->pieces++;
+      stats->patch_size += total_patch_size;
+      // The device loads the whole split source and patch, plus the expanded data of one deflate
+      // chunk at a time.
+      size_t apply_memory =
+          split_src_ranges[i].blocks() * BLOCK_SIZE + total_patch_size + max_expanded_size;
+      stats->apply_memory = std::max(stats->apply_memory, apply_memory);
     }
 
     if (!PatchChunk::WritePatchDataToFd(patch_chunks, patch_fd)) {
@@ -1269,6 +1288,38 @@ bool ZipModeImage::GeneratePatches(const std::vector<ZipModeImage>& split_tgt_im
   return true;
 }
 
+size_t ZipModeImage::SelectSplitCandidate(const std::vector<SplitPatchStats>& candidates,
+                                          size_t memory_limit) {
+  CHECK(!candidates.empty());
+
+  auto fits = [memory_limit](const SplitPatchStats& stats) {
+    return memory_limit == 0 || stats.apply_memory <= memory_limit;
+  };
+  // Prefer the smaller patch; break the ties with the lower memory, then the fewer pieces.
+  auto smaller_patch = [](const SplitPatchStats& a, const SplitPatchStats& b) {
+    return std::tie(a.patch_size, a.apply_memory, a.pieces) <
+           std::tie(b.patch_size, b.apply_memory, b.pieces);
+  };
+
+  std::optional<size_t> best;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    if (fits(candidates[i]) && (!best || smaller_patch(candidates[i], candidates[*best]))) {
+      best = i;
+    }
+  }
+  if (best) {
+    return *best;
+  }
+
+  LOG(WARNING) << "No block limit fits in the memory limit of " << memory_limit
+               << " bytes; using the one that needs the least memory";
+  auto it = std::min_element(candidates.begin(), candidates.end(),
+                             [](const SplitPatchStats& a, const SplitPatchStats& b) {
+                               return a.apply_memory < b.apply_memory;
+                             });
+  return it - candidates.begin();
+}
+
 bool ImageModeImage::Initialize(const std::string& filename) {
   if (!ReadFile(filename, &file_content_)) {
     return false;
@@ -1497,12 +1548,138 @@ bool ImageModeImage::GeneratePatches(const ImageModeImage& tgt_image,
   return PatchChunk::WritePatchDataToFd(patch_chunks, patch_fd);
 }
 
+// Split the zip files with |blocks_limit| and generate the patch for each pair of pieces.
+static bool GenerateSplitZipPatch(const std::string& src_name, const std::string& tgt_name,
+                                  size_t blocks_limit, const std::string& patch_name,
+                                  const std::string& split_info_file, const std::string& debug_dir,
+                                  SplitPatchStats* stats) {
+  auto start = std::chrono::steady_clock::now();
+
+  ZipModeImage src_image(true, blocks_limit * BLOCK_SIZE);
+  ZipModeImage tgt_image(false, blocks_limit * BLOCK_SIZE);
+  if (!src_image.Initialize(src_name) || !tgt_image.Initialize(tgt_name)) {
+    return false;
+  }
+  if (!ZipModeImage::CheckAndProcessChunks(&tgt_image, &src_image)) {
+    return false;
+  }
+
+  std::vector<ZipModeImage> split_tgt_images;
+  std::vector<ZipModeImage> split_src_images;
+  std::vector<SortedRangeSet> split_src_ranges;
+  ZipModeImage::SplitZipModeImageWithLimit(tgt_image, src_image, &split_tgt_images,
+                                           &split_src_images, &split_src_ranges);
+
+  *stats = {};
+  stats->block_limit = blocks_limit;
+  if (!ZipModeImage::GeneratePatches(split_tgt_images, split_src_images, split_src_ranges,
+                                     patch_name, split_info_file, debug_dir, stats)) {
+    return false;
+  }
+  stats->generate_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  return true;
+}
+
+// Generate the split patch with each of the |blocks_limits|, and keep the one with the smallest
+// patch that can be applied within |memory_limit| bytes. The candidates are generated in parallel
+// into temporary files next to the outputs; the debug files of each go into a "block-limit-<N>"
+// subdirectory of |debug_dir|.
+static bool GenerateBestSplitZipPatch(const std::string& src_name, const std::string& tgt_name,
+                                      const std::vector<size_t>& blocks_limits,
+                                      size_t memory_limit, const std::string& patch_name,
+                                      const std::string& split_info_file,
+                                      const std::string& debug_dir,
+                                      const std::string& split_report_file) {
+  size_t count = blocks_limits.size();
+  std::vector<SplitPatchStats> stats(count);
+  std::vector<std::string> patch_names(count, patch_name);
+  std::vector<std::string> split_info_files(count, split_info_file);
+  std::vector<std::string> debug_dirs(count, debug_dir);
+  if (count > 1) {
+    for (size_t i = 0; i < count; i++) {
+      std::string suffix = "." + std::to_string(blocks_limits[i]);
+      patch_names[i] += suffix;
+      split_info_files[i] += suffix;
+      if (!debug_dir.empty()) {
+        debug_dirs[i] = debug_dir + "/block-limit-" + std::to_string(blocks_limits[i]);
+        if (mkdir(debug_dirs[i].c_str(), 0755) != 0 && errno != EEXIST) {
+          PLOG(ERROR) << "Failed to create " << debug_dirs[i];
+          return false;
+        }
+      }
+    }
+  }
+
+  // Each candidate holds its own copy of the images, so don't run more of them than there are
+  // cores.
+  std::vector<uint8_t> succeeded(count, 0);
+  size_t jobs = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, count);
+  for (size_t first = 0; first < count; first += jobs) {
+    std::vector<std::thread> threads;
+    for (size_t i = first; i < std::min(first + jobs, count); i++) {
+      threads.emplace_back([&, i]() {
+        succeeded[i] = GenerateSplitZipPatch(src_name, tgt_name, blocks_limits[i], patch_names[i],
+                                             split_info_files[i], debug_dirs[i], &stats[i]);
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  bool success = std::all_of(succeeded.begin(), succeeded.end(), [](uint8_t s) { return s; });
+  size_t selected = success ? ZipModeImage::SelectSplitCandidate(stats, memory_limit) : 0;
+  if (count > 1) {
+    for (size_t i = 0; i < count; i++) {
+      if (success && i == selected) {
+        if (rename(patch_names[i].c_str(), patch_name.c_str()) != 0 ||
+            rename(split_info_files[i].c_str(), split_info_file.c_str()) != 0) {
+          PLOG(ERROR) << "Failed to rename the patch with block limit " << blocks_limits[i];
+          success = false;
+        }
+      } else {
+        unlink(patch_names[i].c_str());
+        unlink(split_info_files[i].c_str());
+      }
+    }
+  }
+  if (!success) {
+    return false;
+  }
+
+  // Store the trade-off between the candidates in the following format:
+  // Line 0:   the selected block limit
+  // Line 1:   block_limit_1 pieces_1 patch_size_1 apply_memory_1 generate_ms_1
+  // ...
+  // Line n:   block_limit_n pieces_n patch_size_n apply_memory_n generate_ms_n
+  std::string report = std::to_string(blocks_limits[selected]) + "\n";
+  for (const auto& s : stats) {
+    LOG(INFO) << "block limit " << s.block_limit << ": " << s.pieces << " pieces, patch "
+              << s.patch_size << " bytes, apply memory " << s.apply_memory << " bytes, "
+              << s.generate_ms << " ms";
+    report += android::base::StringPrintf("%zu %zu %zu %zu %" PRId64 "\n", s.block_limit,
+                                          s.pieces, s.patch_size, s.apply_memory, s.generate_ms);
+  }
+  LOG(INFO) << "Selected block limit " << blocks_limits[selected];
+
+  if (!split_report_file.empty() &&
+      !android::base::WriteStringToFile(report, split_report_file)) {
+    PLOG(ERROR) << "Failed to write split report to " << split_report_file;
+    return false;
+  }
+  return true;
+}
+
 int imgdiff(int argc, const char** argv) {
   bool verbose = false;
   bool zip_mode = false;
   std::vector<uint8_t> bonus_data;
-  size_t blocks_limit = 0;
+  std::vector<size_t> blocks_limits;
+  size_t memory_limit = 0;
   std::string split_info_file;
+  std::string split_report_file;
   std::string debug_dir;
 
   int opt;
@@ -1540,11 +1717,24 @@ int imgdiff(int argc, const char** argv) {
         break;
       case 0: {
         std::string name = OPTIONS[option_index].name;
-        if (name == "block-limit" && !android::base::ParseUint(optarg, &blocks_limit)) {
-          LOG(ERROR) << "Failed to parse size blocks_limit: " << optarg;
+        if (name == "block-limit") {
+          // Either a single limit, or a comma-separated list of candidates to pick from.
+          blocks_limits.clear();
+          for (const auto& limit : android::base::Split(optarg, ",")) {
+            size_t blocks_limit;
+            if (!android::base::ParseUint(limit, &blocks_limit)) {
+              LOG(ERROR) << "Failed to parse size blocks_limit: " << optarg;
+              return 1;
+            }
+            blocks_limits.push_back(blocks_limit);
+          }
+        } else if (name == "memory-limit" && !android::base::ParseUint(optarg, &memory_limit)) {
+          LOG(ERROR) << "Failed to parse size memory_limit: " << optarg;
           return 1;
         } else if (name == "split-info") {
           split_info_file = optarg;
+        } else if (name == "split-report") {
+          split_report_file = optarg;
         } else if (name == "debug-dir") {
           debug_dir = optarg;
         }
@@ -1568,17 +1758,40 @@ int imgdiff(int argc, const char** argv) {
            "  --block-limit,    For large zips, split the src and tgt based on the block limit;\n"
            "                    and generate patches between each pair of pieces. Concatenate "
            "these\n"
-           "                    patches together and output them into <patch-file>.\n"
+           "                    patches together and output them into <patch-file>. Given a\n"
+           "                    comma-separated list, try each limit and keep the smallest patch.\n"
+           "  --memory-limit,   Device memory in bytes that applying a split piece may use, when\n"
+           "                    picking from several block limits.\n"
            "  --split-info,     Output the split information (patch_size, tgt_size, src_ranges);\n"
            "                    zip mode with block-limit only.\n"
+           "  --split-report,   Output the patch size and memory of each block limit tried;\n"
+           "                    zip mode with block-limit only.\n"
            "  --debug-dir,      Debug directory to put the split srcs and patches, zip mode only.\n"
            "  -v, --verbose,    Enable verbose logging.";
     return 2;
   }
 
-  if (zip_mode) {
-    ZipModeImage src_image(true, blocks_limit * BLOCK_SIZE);
-    ZipModeImage tgt_image(false, blocks_limit * BLOCK_SIZE);
+  bool split = !blocks_limits.empty() && blocks_limits != std::vector<size_t>{ 0 };
+  if (split && std::find(blocks_limits.begin(), blocks_limits.end(), 0) != blocks_limits.end()) {
+    LOG(ERROR) << "block-limit candidates must be positive";
+    return 1;
+  }
+
+  if (zip_mode && split) {
+    if (split_info_file.empty()) {
+      LOG(ERROR) << "split-info path cannot be empty when generating patches with a block-limit";
+      return 1;
+    }
+
+    // Compute bsdiff patches for each pair of split pieces.
+    if (!GenerateBestSplitZipPatch(argv[optind], argv[optind + 1], blocks_limits, memory_limit,
+                                   argv[optind + 2], split_info_file, debug_dir,
+                                   split_report_file)) {
+      return 1;
+    }
+  } else if (zip_mode) {
+    ZipModeImage src_image(true);
+    ZipModeImage tgt_image(false);
 
     if (!src_image.Initialize(argv[optind])) {
       return 1;
@@ -1593,24 +1806,7 @@ int imgdiff(int argc, const char** argv) {
 
     // Compute bsdiff patches for each chunk's data (the uncompressed data, in the case of
     // deflate chunks).
-    if (blocks_limit > 0) {
-      if (split_info_file.empty()) {
-        LOG(ERROR) << "split-info path cannot be empty when generating patches with a block-limit";
-        return 1;
-      }
-
-      std::vector<ZipModeImage> split_tgt_images;
-      std::vector<ZipModeImage> split_src_images;
-      std::vector<SortedRangeSet> split_src_ranges;
-      ZipModeImage::SplitZipModeImageWithLimit(tgt_image, src_image, &split_tgt_images,
-                                               &split_src_images, &split_src_ranges);
-
-      if (!ZipModeImage::GeneratePatches(split_tgt_images, split_src_images, split_src_ranges,
-                                         argv[optind + 2], split_info_file, debug_dir)) {
-        return 1;
-      }
-
-    } else if (!ZipModeImage::GeneratePatches(tgt_image, src_image, argv[optind + 2])) {
+    if (!ZipModeImage::GeneratePatches(tgt_image, src_image, argv[optind + 2])) {
       return 1;
     }
   } else {
@@ -84,7 +84,8 @@ bool PatchPartition(const Partition& target, const Partition& source, const Valu
 bool PatchPartitionCheck(const Partition& target, const Partition& source);
 
 // Checks whether the contents of the given partition has the desired hash. It will NOT look for
-// the backup on /cache if the given partition doesn't have the expected checksum.
+// the backup on /cache if the given partition doesn't have the expected checksum. The partition is
+// hashed in fixed-size windows, so memory use doesn't grow with the partition size.
 bool CheckPartition(const Partition& target);
 
 // Flashes a given image in 'source_filename' to the eMMC target partition. It verifies the target
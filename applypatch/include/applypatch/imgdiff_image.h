@@ -134,6 +134,12 @@ class PatchChunk {
   // Return the total size (header + data) of the patch.
   size_t PatchSize() const;
 
+  // Return the size of the uncompressed source and target data that applying the patch holds in
+  // memory, or 0 if the chunk isn't deflated.
+  size_t ExpandedSize() const {
+    return type_ == CHUNK_DEFLATE ? source_uncompressed_len_ + target_uncompressed_len_ : 0;
+  }
+
   static bool WritePatchDataToFd(const std::vector<PatchChunk>& patch_chunks, int patch_fd);
 
  private:
@@ -205,6 +211,19 @@ class Image {
   std::vector<uint8_t> file_content_;  // Store the whole input file in memory.
 };
 
+// The costs of a zip mode patch split with a given block limit.
+struct SplitPatchStats {
+  size_t block_limit = 0;
+  size_t pieces = 0;
+  // Total size of the patches of all the pieces.
+  size_t patch_size = 0;
+  // Estimated peak memory to apply the costliest piece on the device: the source blocks of the
+  // piece, its patch, and the largest deflate chunk that it expands.
+  size_t apply_memory = 0;
+  // Time spent generating the patch.
+  int64_t generate_ms = 0;
+};
+
 class ZipModeImage : public Image {
  public:
   explicit ZipModeImage(bool is_source, size_t limit = 0) : Image(is_source), limit_(limit) {}
@@ -239,12 +258,19 @@ class ZipModeImage : public Image {
 
   // Compute the patch based on the lists of split src and tgt images. Generate patches for each
   // pair of split pieces and write the data to |patch_name|. If |debug_dir| is specified, write
-  // each split src data and patch data into that directory.
+  // each split src data and patch data into that directory. Fill in the sizes in |stats| if it's
+  // not null.
   static bool GeneratePatches(const std::vector<ZipModeImage>& split_tgt_images,
                               const std::vector<ZipModeImage>& split_src_images,
                               const std::vector<SortedRangeSet>& split_src_ranges,
                               const std::string& patch_name, const std::string& split_info_file,
-                              const std::string& debug_dir);
+                              const std::string& debug_dir, SplitPatchStats* stats = nullptr);
+
+  // Return the index of the candidate with the smallest patch among the ones that can be applied
+  // within |memory_limit| bytes (0 for no limit). If none of them fits, return the one that needs
+  // the least memory.
+  static size_t SelectSplitCandidate(const std::vector<SplitPatchStats>& candidates,
+                                     size_t memory_limit);
 
   // Split the tgt chunks and src chunks based on the size limit.
   static bool SplitZipModeImageWithLimit(const ZipModeImage& tgt_image,
@@ -15,14 +15,20 @@
  */
 
 #include <bootloader_message/bootloader_message.h>
+#include <bootloader_message/wait_for_path.h>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
+#include <iterator>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include <android-base/file.h>
@@ -67,76 +73,171 @@ std::string get_misc_blk_device(std::string* err) {
 // In recovery mode, recovery can get started and try to access the misc
 // device before the kernel has actually created it.
 static bool wait_for_device(const std::string& blk_device, std::string* err) {
-  int tries = 0;
-  int ret;
+  static constexpr std::chrono::seconds kWaitForDeviceTimeout{ 10 };
   err->clear();
-  do {
-    ++tries;
-    struct stat buf;
-    ret = stat(blk_device.c_str(), &buf);
-    if (ret == -1) {
-      *err += android::base::StringPrintf("failed to stat %s try %d: %s\n",
-                                          blk_device.c_str(), tries, strerror(errno));
-      sleep(1);
-    }
-  } while (ret && tries < 10);
+  std::chrono::microseconds elapsed;
+  if (!WaitForPath(blk_device, kWaitForDeviceTimeout, &elapsed)) {
+    *err = android::base::StringPrintf("failed to stat %s after %lld ms: %s\n", blk_device.c_str(),
+                                       static_cast<long long>(elapsed.count() / 1000),
+                                       strerror(ENOENT));
+    return false;
+  }
+  return true;
+}
 
-  if (ret) {
-    *err += android::base::StringPrintf("failed to stat %s\n", blk_device.c_str());
+// Adds [start, end) to |ranges|, merging it with the ranges it overlaps or touches.
+static void AddRange(std::map<size_t, size_t>* ranges, size_t start, size_t end) {
+  if (start == end) {
+    return;
+  }
+  auto it = ranges->upper_bound(start);
+  if (it != ranges->begin() && std::prev(it)->second >= start) {
+    --it;
+    start = it->first;
   }
-  return ret == 0;
+  while (it != ranges->end() && it->first <= end) {
+    end = std::max(end, it->second);
+    it = ranges->erase(it);
+  }
+  ranges->emplace(start, end);
 }
 
-static bool read_misc_partition(void* p, size_t size, const std::string& misc_blk_device,
-                                size_t offset, std::string* err) {
+MiscPartition::MiscPartition(const std::string& misc_blk_device, android::base::unique_fd fd,
+                             bool writable)
+    : misc_blk_device_(misc_blk_device), fd_(std::move(fd)), writable_(writable) {}
+
+std::unique_ptr<MiscPartition> MiscPartition::Open(const std::string& misc_blk_device,
+                                                   bool writable, std::string* err) {
   if (!wait_for_device(misc_blk_device, err)) {
-    return false;
+    return nullptr;
   }
-  android::base::unique_fd fd(open(misc_blk_device.c_str(), O_RDONLY));
+  android::base::unique_fd fd(
+      open(misc_blk_device.c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC));
   if (fd == -1) {
     *err = android::base::StringPrintf("failed to open %s: %s", misc_blk_device.c_str(),
                                        strerror(errno));
-    return false;
+    return nullptr;
   }
-  if (lseek(fd, static_cast<off_t>(offset), SEEK_SET) != static_cast<off_t>(offset)) {
-    *err = android::base::StringPrintf("failed to lseek %s: %s", misc_blk_device.c_str(),
-                                       strerror(errno));
-    return false;
+  std::unique_ptr<MiscPartition> misc(new MiscPartition(misc_blk_device, std::move(fd), writable));
+  misc->stats_.opens++;
+  return misc;
+}
+
+std::unique_ptr<MiscPartition> MiscPartition::Open(bool writable, std::string* err) {
+  std::string misc_blk_device = get_misc_blk_device(err);
+  if (misc_blk_device.empty()) {
+    return nullptr;
   }
-  if (!android::base::ReadFully(fd, p, size)) {
-    *err = android::base::StringPrintf("failed to read %s: %s", misc_blk_device.c_str(),
-                                       strerror(errno));
-    return false;
+  return Open(misc_blk_device, writable, err);
+}
+
+bool MiscPartition::Read(void* p, size_t size, size_t offset, std::string* err) {
+  size_t end = offset + size;
+  if (cache_.size() < end) {
+    cache_.resize(end);
   }
+
+  // Read the gaps between the cached ranges.
+  size_t pos = offset;
+  auto it = cached_.upper_bound(offset);
+  if (it != cached_.begin() && std::prev(it)->second > offset) {
+    pos = std::prev(it)->second;
+  }
+  while (pos < end) {
+    size_t gap_end = (it == cached_.end()) ? end : std::min(end, it->first);
+    if (pos < gap_end) {
+      stats_.reads++;
+      if (!android::base::ReadFullyAtOffset(fd_, &cache_[pos], gap_end - pos, pos)) {
+        *err = android::base::StringPrintf("failed to read %s: %s", misc_blk_device_.c_str(),
+                                           strerror(errno));
+        return false;
+      }
+    }
+    if (it == cached_.end()) {
+      break;
+    }
+    pos = it->second;
+    ++it;
+  }
+  AddRange(&cached_, offset, end);
+
+  memcpy(p, cache_.data() + offset, size);
   return true;
 }
 
-bool write_misc_partition(const void* p, size_t size, const std::string& misc_blk_device,
-                          size_t offset, std::string* err) {
-  android::base::unique_fd fd(open(misc_blk_device.c_str(), O_WRONLY));
-  if (fd == -1) {
-    *err = android::base::StringPrintf("failed to open %s: %s", misc_blk_device.c_str(),
-                                       strerror(errno));
+bool MiscPartition::Write(const void* p, size_t size, size_t offset, std::string* err) {
+  if (!writable_) {
+    *err = misc_blk_device_ + " is opened read-only";
     return false;
   }
-  if (lseek(fd, static_cast<off_t>(offset), SEEK_SET) != static_cast<off_t>(offset)) {
-    *err = android::base::StringPrintf("failed to lseek %s: %s", misc_blk_device.c_str(),
-                                       strerror(errno));
-    return false;
+  size_t end = offset + size;
+  if (cache_.size() < end) {
+    cache_.resize(end);
   }
-  if (!android::base::WriteFully(fd, p, size)) {
-    *err = android::base::StringPrintf("failed to write %s: %s", misc_blk_device.c_str(),
-                                       strerror(errno));
-    return false;
+  memcpy(&cache_[offset], p, size);
+  AddRange(&cached_, offset, end);
+  AddRange(&dirty_, offset, end);
+  return true;
+}
+
+bool MiscPartition::Commit(std::string* err) {
+  if (dirty_.empty()) {
+    return true;
+  }
+  for (auto it = dirty_.begin(); it != dirty_.end(); it = dirty_.erase(it)) {
+    const auto& [start, end] = *it;
+    stats_.writes++;
+    if (!android::base::WriteFullyAtOffset(fd_, cache_.data() + start, end - start, start)) {
+      *err = android::base::StringPrintf("failed to write %s: %s", misc_blk_device_.c_str(),
+                                         strerror(errno));
+      return false;
+    }
   }
-  if (fsync(fd) == -1) {
-    *err = android::base::StringPrintf("failed to fsync %s: %s", misc_blk_device.c_str(),
+  stats_.fsyncs++;
+  if (fsync(fd_) == -1) {
+    *err = android::base::StringPrintf("failed to fsync %s: %s", misc_blk_device_.c_str(),
                                        strerror(errno));
     return false;
   }
   return true;
 }
 
+bool MiscPartition::ReadBootloaderMessage(bootloader_message* boot, std::string* err) {
+  return Read(boot, sizeof(*boot), BOOTLOADER_MESSAGE_OFFSET_IN_MISC, err);
+}
+
+bool MiscPartition::WriteBootloaderMessage(const bootloader_message& boot, std::string* err) {
+  return Write(&boot, sizeof(boot), BOOTLOADER_MESSAGE_OFFSET_IN_MISC, err);
+}
+
+bool MiscPartition::ReadWipePackage(std::string* package_data, size_t size, std::string* err) {
+  package_data->resize(size);
+  return Read(package_data->data(), size, WIPE_PACKAGE_OFFSET_IN_MISC, err);
+}
+
+bool MiscPartition::WriteWipePackage(const std::string& package_data, std::string* err) {
+  static constexpr size_t kMaximumWipePackageSize =
+      SYSTEM_SPACE_OFFSET_IN_MISC - WIPE_PACKAGE_OFFSET_IN_MISC;
+  if (package_data.size() > kMaximumWipePackageSize) {
+    *err = "Wipe package size " + std::to_string(package_data.size()) + " exceeds " +
+           std::to_string(kMaximumWipePackageSize) + " bytes";
+    return false;
+  }
+  return Write(package_data.data(), package_data.size(), WIPE_PACKAGE_OFFSET_IN_MISC, err);
+}
+
+static bool read_misc_partition(void* p, size_t size, const std::string& misc_blk_device,
+                                size_t offset, std::string* err) {
+  auto misc = MiscPartition::Open(misc_blk_device, false, err);
+  return misc && misc->Read(p, size, offset, err);
+}
+
+bool write_misc_partition(const void* p, size_t size, const std::string& misc_blk_device,
+                          size_t offset, std::string* err) {
+  auto misc = MiscPartition::Open(misc_blk_device, true, err);
+  return misc && misc->Write(p, size, offset, err) && misc->Commit(err);
+}
+
 std::string get_bootloader_message_blk_device(std::string* err) {
   std::string misc_blk_device = get_misc_blk_device(err);
   if (misc_blk_device.empty()) return "";
@@ -193,13 +294,14 @@ bool write_bootloader_message_to(const std::vector<std::string>& options,
 }
 
 bool update_bootloader_message(const std::vector<std::string>& options, std::string* err) {
+  auto misc = MiscPartition::Open(true, err);
   bootloader_message boot;
-  if (!read_bootloader_message(&boot, err)) {
+  if (!misc || !misc->ReadBootloaderMessage(&boot, err)) {
     return false;
   }
   update_bootloader_message_in_struct(&boot, options);
 
-  return write_bootloader_message(boot, err);
+  return misc->WriteBootloaderMessage(boot, err) && misc->Commit(err);
 }
 
 bool update_bootloader_message_in_struct(bootloader_message* boot,
@@ -223,8 +325,9 @@ bool update_bootloader_message_in_struct(bootloader_message* boot,
 }
 
 bool write_reboot_bootloader(std::string* err) {
+  auto misc = MiscPartition::Open(true, err);
   bootloader_message boot;
-  if (!read_bootloader_message(&boot, err)) {
+  if (!misc || !misc->ReadBootloaderMessage(&boot, err)) {
     return false;
   }
   if (boot.command[0] != '\0') {
@@ -232,33 +335,17 @@ bool write_reboot_bootloader(std::string* err) {
     return false;
   }
   strlcpy(boot.command, "bootonce-bootloader", sizeof(boot.command));
-  return write_bootloader_message(boot, err);
+  return misc->WriteBootloaderMessage(boot, err) && misc->Commit(err);
 }
 
 bool read_wipe_package(std::string* package_data, size_t size, std::string* err) {
-  std::string misc_blk_device = get_misc_blk_device(err);
-  if (misc_blk_device.empty()) {
-    return false;
-  }
-  package_data->resize(size);
-  return read_misc_partition(&(*package_data)[0], size, misc_blk_device,
-                             WIPE_PACKAGE_OFFSET_IN_MISC, err);
+  auto misc = MiscPartition::Open(false, err);
+  return misc && misc->ReadWipePackage(package_data, size, err);
 }
 
 bool write_wipe_package(const std::string& package_data, std::string* err) {
-  std::string misc_blk_device = get_misc_blk_device(err);
-  if (misc_blk_device.empty()) {
-    return false;
-  }
-  static constexpr size_t kMaximumWipePackageSize =
-      SYSTEM_SPACE_OFFSET_IN_MISC - WIPE_PACKAGE_OFFSET_IN_MISC;
-  if (package_data.size() > kMaximumWipePackageSize) {
-    *err = "Wipe package size " + std::to_string(package_data.size()) + " exceeds " +
-           std::to_string(kMaximumWipePackageSize) + " bytes";
-    return false;
-  }
-  return write_misc_partition(package_data.data(), package_data.size(), misc_blk_device,
-                              WIPE_PACKAGE_OFFSET_IN_MISC, err);
+  auto misc = MiscPartition::Open(true, err);
+  return misc && misc->WriteWipePackage(package_data, err) && misc->Commit(err);
 }
 
 static bool ValidateSystemSpaceRegion(size_t offset, size_t size, std::string* err) {
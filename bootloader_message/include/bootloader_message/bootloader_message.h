@@ -132,9 +132,13 @@ struct misc_system_space_layout {
 
 #ifdef __cplusplus
 
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include <android-base/unique_fd.h>
+
 // Gets the block device name of /misc partition.
 std::string get_misc_blk_device(std::string* err);
 // Return the block device name for the bootloader message partition and waits
@@ -147,6 +151,68 @@ std::string get_bootloader_message_blk_device(std::string* err);
 bool write_misc_partition(const void* p, size_t size, const std::string& misc_blk_device,
                           size_t offset, std::string* err);
 
+// A session on the misc partition. It keeps the device open and caches the ranges it has read or
+// written, so that a sequence of reads and updates (e.g. reading the BCB, then updating it and the
+// wipe package) takes a single open and reads each range once. Writes only go to the cache until
+// Commit(), which writes back the dirty ranges and then syncs the device once.
+class MiscPartition {
+ public:
+  // Syscalls made on the device, for tests.
+  struct Stats {
+    size_t opens = 0;
+    size_t reads = 0;
+    size_t writes = 0;
+    size_t fsyncs = 0;
+  };
+
+  // Opens |misc_blk_device|, waiting for it to show up, for reading and also for writing if
+  // |writable| is true. Returns nullptr and sets |err| on failure.
+  static std::unique_ptr<MiscPartition> Open(const std::string& misc_blk_device, bool writable,
+                                             std::string* err);
+  // Same as above, but opens the /misc partition from the default fstab.
+  static std::unique_ptr<MiscPartition> Open(bool writable, std::string* err);
+
+  // Changes that haven't been committed are dropped.
+  ~MiscPartition() = default;
+
+  MiscPartition(const MiscPartition&) = delete;
+  MiscPartition& operator=(const MiscPartition&) = delete;
+
+  // Reads |size| bytes at |offset| into |p|, from the cache where possible.
+  bool Read(void* p, size_t size, size_t offset, std::string* err);
+
+  // Writes |size| bytes from |p| at |offset| into the cache, to be written back on Commit().
+  bool Write(const void* p, size_t size, size_t offset, std::string* err);
+
+  // Writes back the dirty ranges, coalescing adjacent ones, and syncs the device. Does nothing if
+  // there's nothing to write.
+  bool Commit(std::string* err);
+
+  bool ReadBootloaderMessage(bootloader_message* boot, std::string* err);
+  bool WriteBootloaderMessage(const bootloader_message& boot, std::string* err);
+  bool ReadWipePackage(std::string* package_data, size_t size, std::string* err);
+  bool WriteWipePackage(const std::string& package_data, std::string* err);
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  MiscPartition(const std::string& misc_blk_device, android::base::unique_fd fd, bool writable);
+
+  const std::string misc_blk_device_;
+  const android::base::unique_fd fd_;
+  const bool writable_;
+
+  // The cached contents of the device from offset 0, which are valid in the [start, end) ranges of
+  // |cached_|. |dirty_| holds the ranges yet to be written back.
+  std::string cache_;
+  std::map<size_t, size_t> cached_;
+  std::map<size_t, size_t> dirty_;
+
+  Stats stats_;
+};
+
 // Read bootloader message into boot. Error message will be set in err.
 bool read_bootloader_message(bootloader_message* boot, std::string* err);
 
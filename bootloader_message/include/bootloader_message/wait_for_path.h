@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BOOTLOADER_MESSAGE_WAIT_FOR_PATH_H
+#define _BOOTLOADER_MESSAGE_WAIT_FOR_PATH_H
+
+#include <chrono>
+#include <string>
+
+// Waits until |path| exists, or until |timeout| elapses. Instead of polling with fixed sleeps, it
+// watches the deepest existing ancestor directory of |path| with inotify, and returns as soon as
+// the node (e.g. a block device created by ueventd) shows up. Returns true if the path exists. If
+// |elapsed| is not null, it will be set to the time spent waiting, regardless of the result.
+bool WaitForPath(const std::string& path, std::chrono::milliseconds timeout,
+                 std::chrono::microseconds* elapsed = nullptr);
+
+#endif  // _BOOTLOADER_MESSAGE_WAIT_FOR_PATH_H
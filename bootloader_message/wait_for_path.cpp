@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bootloader_message/wait_for_path.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+// Only used if inotify is unavailable.
+static constexpr std::chrono::milliseconds kPollInterval{ 10 };
+
+// Returns the deepest directory in |path| that currently exists. inotify can only watch existing
+// directories, so we watch the closest one and move down as the intermediate directories appear
+// (e.g. /dev/block/by-name/ that gets created along with the first partition symlink).
+static std::string DeepestExistingAncestor(const std::string& path) {
+  std::string dir = android::base::Dirname(path);
+  while (access(dir.c_str(), F_OK) != 0) {
+    std::string parent = android::base::Dirname(dir);
+    if (parent == dir) break;
+    dir = std::move(parent);
+  }
+  return dir;
+}
+
+// Returns true if |path| exists before |deadline|. Sets |waited| if it didn't exist at the time of
+// the call.
+static bool WaitForPathUntil(const std::string& path,
+                             std::chrono::steady_clock::time_point deadline, bool* waited) {
+  *waited = false;
+  if (access(path.c_str(), F_OK) == 0) {
+    return true;
+  }
+  *waited = true;
+
+  android::base::unique_fd inotify_fd(inotify_init1(IN_CLOEXEC | IN_NONBLOCK));
+  if (inotify_fd == -1) {
+    PLOG(WARNING) << "Failed to initialize inotify, polling for " << path;
+  }
+
+  for (;;) {
+    if (inotify_fd != -1) {
+      std::string dir = DeepestExistingAncestor(path);
+      if (inotify_add_watch(inotify_fd, dir.c_str(), IN_CREATE | IN_MOVED_TO) == -1) {
+        PLOG(WARNING) << "Failed to watch " << dir << ", polling for " << path;
+        inotify_fd.reset();
+      }
+    }
+
+    // Check again after the watch is in place, so that we don't miss a node created in between.
+    if (access(path.c_str(), F_OK) == 0) {
+      return true;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      return false;
+    }
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+
+    if (inotify_fd == -1) {
+      std::this_thread::sleep_for(std::min(remaining, kPollInterval));
+      continue;
+    }
+
+    pollfd pfd = { .fd = inotify_fd, .events = POLLIN };
+    int ret = poll(&pfd, 1, static_cast<int>(remaining.count()));
+    if (ret == -1 && errno != EINTR) {
+      PLOG(ERROR) << "Failed to poll inotify events for " << path;
+      return access(path.c_str(), F_OK) == 0;
+    }
+    if (ret > 0) {
+      // The events themselves don't matter; the loop re-checks the path and moves the watch down.
+      alignas(inotify_event) char buffer[4096];
+      while (read(inotify_fd, buffer, sizeof(buffer)) > 0) {
+      }
+    }
+  }
+}
+
+bool WaitForPath(const std::string& path, std::chrono::milliseconds timeout,
+                 std::chrono::microseconds* elapsed) {
+  auto start = std::chrono::steady_clock::now();
+  bool waited;
+  bool found = WaitForPathUntil(path, start + timeout, &waited);
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  if (elapsed != nullptr) {
+    *elapsed = duration;
+  }
+
+  if (!found) {
+    LOG(WARNING) << "Timed out after " << duration.count() << " us waiting for " << path;
+  } else if (waited) {
+    LOG(INFO) << "Waited " << duration.count() << " us for " << path;
+  }
+  return found;
+}
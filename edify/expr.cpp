@@ -17,17 +17,20 @@
 #include "edify/expr.h"
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include <android-base/parseint.h>
+#include <android-base/scopeguard.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 
@@ -42,12 +45,12 @@ static bool BooleanString(const std::string& s) {
     return !s.empty();
 }
 
-bool Evaluate(State* state, const std::unique_ptr<Expr>& expr, std::string* result) {
+bool Evaluate(State* state, const Expr* expr, std::string* result) {
     if (result == nullptr) {
         return false;
     }
 
-    std::unique_ptr<Value> v(expr->fn(expr->name.c_str(), state, expr->argv));
+    std::unique_ptr<Value> v(EvaluateValue(state, expr));
     if (!v) {
         return false;
     }
@@ -60,8 +63,20 @@ bool Evaluate(State* state, const std::unique_ptr<Expr>& expr, std::string* resu
     return true;
 }
 
+Value* EvaluateValue(State* state, const Expr* expr) {
+    // Literals may point into the script, without a NUL terminator.
+    if (expr->fn == Literal) {
+        return new Value(Value::Type::STRING, std::string(expr->name));
+    }
+    return expr->fn(expr->name.data(), state, expr->argv);
+}
+
 Value* EvaluateValue(State* state, const std::unique_ptr<Expr>& expr) {
-    return expr->fn(expr->name.c_str(), state, expr->argv);
+    return EvaluateValue(state, expr.get());
+}
+
+bool Evaluate(State* state, const std::unique_ptr<Expr>& expr, std::string* result) {
+    return Evaluate(state, expr.get(), result);
 }
 
 Value* StringValue(const char* str) {
@@ -75,7 +90,7 @@ Value* StringValue(const std::string& str) {
     return StringValue(str.c_str());
 }
 
-Value* ConcatFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* ConcatFn(const char* name, State* state, const ExprArgs& argv) {
     if (argv.empty()) {
         return StringValue("");
     }
@@ -91,7 +106,7 @@ Value* ConcatFn(const char* name, State* state, const std::vector<std::unique_pt
     return StringValue(result);
 }
 
-Value* IfElseFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* IfElseFn(const char* name, State* state, const ExprArgs& argv) {
     if (argv.size() != 2 && argv.size() != 3) {
         state->errmsg = "ifelse expects 2 or 3 arguments";
         return nullptr;
@@ -111,7 +126,7 @@ Value* IfElseFn(const char* name, State* state, const std::vector<std::unique_pt
     return StringValue("");
 }
 
-Value* AbortFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* AbortFn(const char* name, State* state, const ExprArgs& argv) {
     std::string msg;
     if (!argv.empty() && Evaluate(state, argv[0], &msg)) {
       state->errmsg += msg;
@@ -121,7 +136,7 @@ Value* AbortFn(const char* name, State* state, const std::vector<std::unique_ptr
     return nullptr;
 }
 
-Value* AssertFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* AssertFn(const char* name, State* state, const ExprArgs& argv) {
     for (size_t i = 0; i < argv.size(); ++i) {
         std::string result;
         if (!Evaluate(state, argv[i], &result)) {
@@ -136,7 +151,7 @@ Value* AssertFn(const char* name, State* state, const std::vector<std::unique_pt
     return StringValue("");
 }
 
-Value* SleepFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* SleepFn(const char* name, State* state, const ExprArgs& argv) {
     std::string val;
     if (!Evaluate(state, argv[0], &val)) {
         return nullptr;
@@ -151,7 +166,7 @@ Value* SleepFn(const char* name, State* state, const std::vector<std::unique_ptr
     return StringValue(val);
 }
 
-Value* StdoutFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* StdoutFn(const char* name, State* state, const ExprArgs& argv) {
     for (size_t i = 0; i < argv.size(); ++i) {
         std::string v;
         if (!Evaluate(state, argv[i], &v)) {
@@ -162,8 +177,7 @@ Value* StdoutFn(const char* name, State* state, const std::vector<std::unique_pt
     return StringValue("");
 }
 
-Value* LogicalAndFn(const char* name, State* state,
-                    const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* LogicalAndFn(const char* name, State* state, const ExprArgs& argv) {
     std::string left;
     if (!Evaluate(state, argv[0], &left)) {
         return nullptr;
@@ -175,8 +189,7 @@ Value* LogicalAndFn(const char* name, State* state,
     }
 }
 
-Value* LogicalOrFn(const char* name, State* state,
-                   const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* LogicalOrFn(const char* name, State* state, const ExprArgs& argv) {
     std::string left;
     if (!Evaluate(state, argv[0], &left)) {
         return nullptr;
@@ -188,8 +201,7 @@ Value* LogicalOrFn(const char* name, State* state,
     }
 }
 
-Value* LogicalNotFn(const char* name, State* state,
-                    const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* LogicalNotFn(const char* name, State* state, const ExprArgs& argv) {
     std::string val;
     if (!Evaluate(state, argv[0], &val)) {
         return nullptr;
@@ -198,8 +210,7 @@ Value* LogicalNotFn(const char* name, State* state,
     return StringValue(BooleanString(val) ? "" : "t");
 }
 
-Value* SubstringFn(const char* name, State* state,
-                   const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* SubstringFn(const char* name, State* state, const ExprArgs& argv) {
     std::string needle;
     if (!Evaluate(state, argv[0], &needle)) {
         return nullptr;
@@ -214,7 +225,7 @@ Value* SubstringFn(const char* name, State* state,
     return StringValue(result);
 }
 
-Value* EqualityFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* EqualityFn(const char* name, State* state, const ExprArgs& argv) {
     std::string left;
     if (!Evaluate(state, argv[0], &left)) {
         return nullptr;
@@ -228,8 +239,7 @@ Value* EqualityFn(const char* name, State* state, const std::vector<std::unique_
     return StringValue(result);
 }
 
-Value* InequalityFn(const char* name, State* state,
-                    const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* InequalityFn(const char* name, State* state, const ExprArgs& argv) {
     std::string left;
     if (!Evaluate(state, argv[0], &left)) {
         return nullptr;
@@ -243,7 +253,7 @@ Value* InequalityFn(const char* name, State* state,
     return StringValue(result);
 }
 
-Value* SequenceFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* SequenceFn(const char* name, State* state, const ExprArgs& argv) {
     std::unique_ptr<Value> left(EvaluateValue(state, argv[0]));
     if (!left) {
         return nullptr;
@@ -251,8 +261,7 @@ Value* SequenceFn(const char* name, State* state, const std::vector<std::unique_
     return EvaluateValue(state, argv[1]);
 }
 
-Value* LessThanIntFn(const char* name, State* state,
-                     const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* LessThanIntFn(const char* name, State* state, const ExprArgs& argv) {
     if (argv.size() != 2) {
         state->errmsg = "less_than_int expects 2 arguments";
         return nullptr;
@@ -279,8 +288,7 @@ Value* LessThanIntFn(const char* name, State* state,
     return StringValue(l_int < r_int ? "t" : "");
 }
 
-Value* GreaterThanIntFn(const char* name, State* state,
-                        const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* GreaterThanIntFn(const char* name, State* state, const ExprArgs& argv) {
     if (argv.size() != 2) {
         state->errmsg = "greater_than_int expects 2 arguments";
         return nullptr;
@@ -307,7 +315,7 @@ Value* GreaterThanIntFn(const char* name, State* state,
     return StringValue(l_int > r_int ? "t" : "");
 }
 
-Value* Literal(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* Literal(const char* name, State* state, const ExprArgs& argv) {
     return StringValue(name);
 }
 
@@ -316,9 +324,33 @@ Value* Literal(const char* name, State* state, const std::vector<std::unique_ptr
 // -----------------------------------------------------------------
 
 static std::unordered_map<std::string, Function> fn_table;
+static std::unordered_map<std::string, LegacyFunction> legacy_fn_table;
 
 void RegisterFunction(const std::string& name, Function fn) {
     fn_table[name] = fn;
+    legacy_fn_table.erase(name);
+}
+
+// Calls the LegacyFunction registered as |name|, with the arguments wrapped into unique_ptrs. They
+// get released afterwards, as the nodes belong to the arena.
+static Value* CallLegacyFunction(const char* name, State* state, const ExprArgs& argv) {
+    LegacyFunction fn = legacy_fn_table.at(name);
+    std::vector<std::unique_ptr<Expr>> legacy_argv;
+    auto release = android::base::make_scope_guard([&legacy_argv] {
+        for (auto& arg : legacy_argv) {
+            static_cast<void>(arg.release());
+        }
+    });
+    legacy_argv.reserve(argv.size());
+    for (Expr* arg : argv) {
+        legacy_argv.emplace_back(arg);
+    }
+    return fn(name, state, legacy_argv);
+}
+
+void RegisterFunction(const std::string& name, LegacyFunction fn) {
+    fn_table[name] = CallLegacyFunction;
+    legacy_fn_table[name] = fn;
 }
 
 Function FindFunction(const std::string& name) {
@@ -349,12 +381,12 @@ void RegisterBuiltins() {
 
 // Evaluate the expressions in argv, and put the results of strings in args. If any expression
 // evaluates to nullptr, return false. Return true on success.
-bool ReadArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
+bool ReadArgs(State* state, const ExprArgs& argv,
               std::vector<std::string>* args) {
     return ReadArgs(state, argv, args, 0, argv.size());
 }
 
-bool ReadArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
+bool ReadArgs(State* state, const ExprArgs& argv,
               std::vector<std::string>* args, size_t start, size_t len) {
     if (args == nullptr) {
         return false;
@@ -373,14 +405,35 @@ bool ReadArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
     return true;
 }
 
+// Returns a view of |argv| for the ExprArgs versions of the helpers.
+static std::vector<Expr*> GetArgs(const std::vector<std::unique_ptr<Expr>>& argv) {
+    std::vector<Expr*> exprs;
+    exprs.reserve(argv.size());
+    for (const auto& arg : argv) {
+        exprs.push_back(arg.get());
+    }
+    return exprs;
+}
+
+bool ReadArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
+              std::vector<std::string>* args) {
+    return ReadArgs(state, argv, args, 0, argv.size());
+}
+
+bool ReadArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
+              std::vector<std::string>* args, size_t start, size_t len) {
+    auto exprs = GetArgs(argv);
+    return ReadArgs(state, ExprArgs(exprs.data(), exprs.size()), args, start, len);
+}
+
 // Evaluate the expressions in argv, and put the results of Value* in args. If any expression
 // evaluate to nullptr, return false. Return true on success.
-bool ReadValueArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
+bool ReadValueArgs(State* state, const ExprArgs& argv,
                    std::vector<std::unique_ptr<Value>>* args) {
     return ReadValueArgs(state, argv, args, 0, argv.size());
 }
 
-bool ReadValueArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
+bool ReadValueArgs(State* state, const ExprArgs& argv,
                    std::vector<std::unique_ptr<Value>>* args, size_t start, size_t len) {
     if (args == nullptr) {
         return false;
@@ -399,6 +452,17 @@ bool ReadValueArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
     return true;
 }
 
+bool ReadValueArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
+                   std::vector<std::unique_ptr<Value>>* args) {
+    return ReadValueArgs(state, argv, args, 0, argv.size());
+}
+
+bool ReadValueArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
+                   std::vector<std::unique_ptr<Value>>* args, size_t start, size_t len) {
+    auto exprs = GetArgs(argv);
+    return ReadValueArgs(state, ExprArgs(exprs.data(), exprs.size()), args, start, len);
+}
+
 // Use printf-style arguments to compose an error message to put into
 // *state.  Returns nullptr.
 Value* ErrorAbort(State* state, const char* format, ...) {
@@ -421,5 +485,35 @@ Value* ErrorAbort(State* state, CauseCode cause_code, const char* format, ...) {
   return nullptr;
 }
 
+std::string_view ExprArena::CopyString(std::string_view str) {
+  char* copy = static_cast<char*>(Allocate(str.size() + 1, 1));
+  std::copy(str.begin(), str.end(), copy);
+  copy[str.size()] = '\0';
+  return std::string_view(copy, str.size());
+}
+
+void* ExprArena::Allocate(size_t size, size_t alignment) {
+  size_t padding = (alignment - reinterpret_cast<uintptr_t>(next_) % alignment) % alignment;
+  if (padding + size > remaining_) {
+    // Oversized requests get a block of their own, so that the current one keeps serving the
+    // small ones.
+    size_t block_size = std::max(kBlockSize, size + alignment);
+    blocks_.emplace_back(new char[block_size]);
+    char* block = blocks_.back().get();
+    if (block_size > kBlockSize) {
+      bytes_used_ += size;
+      return block + (alignment - reinterpret_cast<uintptr_t>(block) % alignment) % alignment;
+    }
+    next_ = block;
+    remaining_ = block_size;
+    padding = (alignment - reinterpret_cast<uintptr_t>(next_) % alignment) % alignment;
+  }
+  char* result = next_ + padding;
+  next_ += padding + size;
+  remaining_ -= padding + size;
+  bytes_used_ += size;
+  return result;
+}
+
 State::State(const std::string& script, UpdaterInterface* interface)
     : script(script), updater(interface), error_code(kNoError), cause_code(kNoCause) {}
@@ -20,7 +20,11 @@
 #include <unistd.h>
 
 #include <memory>
+#include <new>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "edify/updater_interface.h"
@@ -68,53 +72,133 @@ struct Value {
 
 struct Expr;
 
-using Function = Value* (*)(const char* name, State* state,
-                            const std::vector<std::unique_ptr<Expr>>& argv);
+// The arguments of a function call. The Expr nodes and the array pointing to them live in the
+// ExprArena that the script was parsed into.
+class ExprArgs {
+ public:
+  ExprArgs() = default;
+  ExprArgs(Expr* const* args, size_t size) : args_(args), size_(size) {}
+
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+  const Expr* operator[](size_t i) const {
+    return args_[i];
+  }
+  Expr* const* begin() const {
+    return args_;
+  }
+  Expr* const* end() const {
+    return args_ + size_;
+  }
+
+ private:
+  Expr* const* args_ = nullptr;
+  size_t size_ = 0;
+};
+
+using Function = Value* (*)(const char* name, State* state, const ExprArgs& argv);
+
+// The signature that functions had before the parsed tree moved into an arena. Device extensions
+// (TARGET_RECOVERY_UPDATER_LIBS) may still register functions of this type, along with the
+// matching overloads of Evaluate(), EvaluateValue(), ReadArgs() and ReadValueArgs(). The arguments
+// are owned by the arena: the unique_ptrs in |argv| are released rather than deleted after the
+// call.
+using LegacyFunction = Value* (*)(const char* name, State* state,
+                                  const std::vector<std::unique_ptr<Expr>>& argv);
 
 struct Expr {
   Function fn;
-  std::string name;
-  std::vector<std::unique_ptr<Expr>> argv;
+  // The function name (NUL-terminated), or the value of a literal. Literals point into the script
+  // where possible, so the script must outlive the parsed tree. Unlike the std::string it used to
+  // be, a literal isn't NUL-terminated; use Evaluate() to get its value.
+  std::string_view name;
+  ExprArgs argv;
   int start, end;
 
-  Expr(Function fn, const std::string& name, int start, int end) :
-    fn(fn),
-    name(name),
-    start(start),
-    end(end) {}
+  Expr(Function fn, std::string_view name, int start, int end)
+      : fn(fn), name(name), start(start), end(end) {}
+};
+
+// Owns the nodes of a parsed script. Allocations are carved out of large blocks and released all
+// at once with the arena, so only trivially destructible objects may be placed in it.
+class ExprArena {
+ public:
+  ExprArena() = default;
+  ExprArena(const ExprArena&) = delete;
+  ExprArena& operator=(const ExprArena&) = delete;
+
+  template <typename T, typename... Args>
+  T* New(Args&&... args) {
+    static_assert(std::is_trivially_destructible_v<T>);
+    return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  template <typename T>
+  T* NewArray(size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>);
+    T* array = static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+    std::uninitialized_value_construct_n(array, count);
+    return array;
+  }
+
+  // Copy |str| into the arena, followed by a NUL terminator.
+  std::string_view CopyString(std::string_view str);
+
+  // Total bytes handed out so far.
+  size_t bytes_used() const {
+    return bytes_used_;
+  }
+
+ private:
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  void* Allocate(size_t size, size_t alignment);
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* next_ = nullptr;
+  size_t remaining_ = 0;
+  size_t bytes_used_ = 0;
 };
 
 // Evaluate the input expr, return the resulting Value.
+Value* EvaluateValue(State* state, const Expr* expr);
 Value* EvaluateValue(State* state, const std::unique_ptr<Expr>& expr);
 
 // Evaluate the input expr, assert that it is a string, and update the result parameter. This
 // function returns true if the evaluation succeeds. This is a convenience function for older
 // functions that want to deal only with strings.
+bool Evaluate(State* state, const Expr* expr, std::string* result);
 bool Evaluate(State* state, const std::unique_ptr<Expr>& expr, std::string* result);
 
-// Glue to make an Expr out of a literal.
-Value* Literal(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
+// Glue to make an Expr out of a literal. Literal nodes are evaluated straight from Expr::name,
+// which isn't NUL-terminated; this function only tags them.
+Value* Literal(const char* name, State* state, const ExprArgs& argv);
 
 // Functions corresponding to various syntactic sugar operators.
 // ("concat" is also available as a builtin function, to concatenate
 // more than two strings.)
-Value* ConcatFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
-Value* LogicalAndFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
-Value* LogicalOrFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
-Value* LogicalNotFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
-Value* SubstringFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
-Value* EqualityFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
-Value* InequalityFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
-Value* SequenceFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
+Value* ConcatFn(const char* name, State* state, const ExprArgs& argv);
+Value* LogicalAndFn(const char* name, State* state, const ExprArgs& argv);
+Value* LogicalOrFn(const char* name, State* state, const ExprArgs& argv);
+Value* LogicalNotFn(const char* name, State* state, const ExprArgs& argv);
+Value* SubstringFn(const char* name, State* state, const ExprArgs& argv);
+Value* EqualityFn(const char* name, State* state, const ExprArgs& argv);
+Value* InequalityFn(const char* name, State* state, const ExprArgs& argv);
+Value* SequenceFn(const char* name, State* state, const ExprArgs& argv);
 
 // Global builtins, registered by RegisterBuiltins().
-Value* IfElseFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
-Value* AssertFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
-Value* AbortFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv);
+Value* IfElseFn(const char* name, State* state, const ExprArgs& argv);
+Value* AssertFn(const char* name, State* state, const ExprArgs& argv);
+Value* AbortFn(const char* name, State* state, const ExprArgs& argv);
 
 // Register a new function.  The same Function may be registered under
 // multiple names, but a given name should only be used once.
 void RegisterFunction(const std::string& name, Function fn);
+void RegisterFunction(const std::string& name, LegacyFunction fn);
 
 // Register all the builtins.
 void RegisterBuiltins();
@@ -127,6 +211,9 @@ Function FindFunction(const std::string& name);
 
 // Evaluate the expressions in argv, and put the results of strings in args. If any expression
 // evaluates to nullptr, return false. Return true on success.
+bool ReadArgs(State* state, const ExprArgs& argv, std::vector<std::string>* args);
+bool ReadArgs(State* state, const ExprArgs& argv, std::vector<std::string>* args, size_t start,
+              size_t len);
 bool ReadArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
               std::vector<std::string>* args);
 bool ReadArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
@@ -134,6 +221,9 @@ bool ReadArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
 
 // Evaluate the expressions in argv, and put the results of Value* in args. If any
 // expression evaluate to nullptr, return false. Return true on success.
+bool ReadValueArgs(State* state, const ExprArgs& argv, std::vector<std::unique_ptr<Value>>* args);
+bool ReadValueArgs(State* state, const ExprArgs& argv,
+                   std::vector<std::unique_ptr<Value>>* args, size_t start, size_t len);
 bool ReadValueArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
                    std::vector<std::unique_ptr<Value>>* args);
 bool ReadValueArgs(State* state, const std::vector<std::unique_ptr<Expr>>& argv,
@@ -154,6 +244,8 @@ Value* StringValue(const char* str);
 
 Value* StringValue(const std::string& str);
 
-int ParseString(const std::string& str, std::unique_ptr<Expr>* root, int* error_count);
+// Parse |str| into a tree of Exprs allocated from |arena|, and set |root| to the top of it. The
+// tree refers to |str|, which must outlive it.
+int ParseString(const std::string& str, ExprArena* arena, Expr** root, int* error_count);
 
 #endif  // _EXPRESSION_H
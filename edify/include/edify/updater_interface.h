@@ -43,6 +43,12 @@ class UpdaterInterface {
   virtual UpdaterRuntimeInterface* GetRuntime() const = 0;
   virtual ZipArchiveHandle GetPackageHandle() const = 0;
   virtual std::string GetResult() const = 0;
-  virtual uint8_t* GetMappedPackageAddress() const = 0;
-  virtual size_t GetMappedPackageLength() const = 0;
+
+  // Returns a pointer to |size| bytes of the package at |offset|, or nullptr if they're out of
+  // bounds or can't be read. A large package is mapped a window at a time, so the pointer is only
+  // valid until the next call.
+  virtual const uint8_t* GetPackageData(uint64_t offset, size_t size) const = 0;
+  virtual uint64_t GetPackageLength() const = 0;
+  // Hints that the package data at [offset, offset + size) won't be needed again soon.
+  virtual void ReleasePackageData(uint64_t offset, size_t size) const = 0;
 };
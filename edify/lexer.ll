@@ -16,7 +16,9 @@
  */
 
 #include <string.h>
+
 #include <string>
+#include <string_view>
 
 #include "edify/expr.h"
 #include "yydefs.h"
@@ -26,11 +28,42 @@ int gLine = 1;
 int gColumn = 1;
 int gPos = 0;
 
-std::string string_buffer;
+// The script being parsed, and the arena that its tree is allocated from.
+const char* gScript = nullptr;
+ExprArena* gArena = nullptr;
+
+// Tokens refer to the script directly. Only a quoted string with escape sequences needs its
+// decoded value built up in |string_buffer|, starting from the first escape.
+static std::string string_buffer;
+static int string_start;
+static bool string_escaped;
 
 #define ADVANCE do {yylloc.start=gPos; yylloc.end=gPos+yyleng; \
                     gColumn+=yyleng; gPos+=yyleng;} while(0)
 
+static void AppendEscaped(char c) {
+    if (!string_escaped) {
+        string_escaped = true;
+        string_buffer.assign(gScript + string_start, gPos - string_start);
+    }
+    gColumn += yyleng;
+    gPos += yyleng;
+    string_buffer.push_back(c);
+}
+
+static void AppendPlain(int newlines) {
+    if (string_escaped) {
+        string_buffer.append(yytext, yyleng);
+    }
+    gPos += yyleng;
+    if (newlines > 0) {
+        gLine += newlines;
+        gColumn = 1;
+    } else {
+        gColumn += yyleng;
+    }
+}
+
 %}
 
 %x STR
@@ -44,47 +77,42 @@ std::string string_buffer;
 
 \" {
     BEGIN(STR);
-    string_buffer.clear();
+    string_escaped = false;
     yylloc.start = gPos;
     ++gColumn;
     ++gPos;
+    string_start = gPos;
 }
 
 <STR>{
   \" {
+      if (string_escaped) {
+          std::string_view value = gArena->CopyString(string_buffer);
+          yylval.str = { value.data(), value.size() };
+      } else {
+          yylval.str = { gScript + string_start, static_cast<size_t>(gPos - string_start) };
+      }
       ++gColumn;
       ++gPos;
       BEGIN(INITIAL);
-      yylval.str = strdup(string_buffer.c_str());
       yylloc.end = gPos;
       return STRING;
   }
 
-  \\n   { gColumn += yyleng; gPos += yyleng; string_buffer.push_back('\n'); }
-  \\t   { gColumn += yyleng; gPos += yyleng; string_buffer.push_back('\t'); }
-  \\\"  { gColumn += yyleng; gPos += yyleng; string_buffer.push_back('\"'); }
-  \\\\  { gColumn += yyleng; gPos += yyleng; string_buffer.push_back('\\'); }
+  \\n   AppendEscaped('\n');
+  \\t   AppendEscaped('\t');
+  \\\"  AppendEscaped('\"');
+  \\\\  AppendEscaped('\\');
 
   \\x[0-9a-fA-F]{2} {
-      gColumn += yyleng;
-      gPos += yyleng;
       int val;
       sscanf(yytext+2, "%x", &val);
-      string_buffer.push_back(static_cast<char>(val));
+      AppendEscaped(static_cast<char>(val));
   }
 
-  \n {
-      ++gLine;
-      ++gPos;
-      gColumn = 1;
-      string_buffer.push_back(yytext[0]);
-  }
-
-  . {
-      ++gColumn;
-      ++gPos;
-      string_buffer.push_back(yytext[0]);
-  }
+  [^\\\"\n]+ AppendPlain(0);
+  \n         AppendPlain(1);
+  .          AppendPlain(0);
 }
 
 if                ADVANCE; return IF;
@@ -94,7 +122,7 @@ endif             ADVANCE; return ENDIF;
 
 [a-zA-Z0-9_:/.]+ {
   ADVANCE;
-  yylval.str = strdup(yytext);
+  yylval.str = { gScript + yylloc.start, static_cast<size_t>(yyleng) };
   return STRING;
 }
 
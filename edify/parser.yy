@@ -22,34 +22,50 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
-#include <android-base/macros.h>
-
 #include "edify/expr.h"
 #include "yydefs.h"
 #include "parser.h"
 
 extern int gLine;
 extern int gColumn;
+extern int gPos;
+extern const char* gScript;
+extern ExprArena* gArena;
 
-void yyerror(std::unique_ptr<Expr>* root, int* error_count, const char* s);
-int yyparse(std::unique_ptr<Expr>* root, int* error_count);
+void yyerror(Expr** root, int* error_count, const char* s);
+int yyparse(Expr** root, int* error_count);
 
 struct yy_buffer_state;
 void yy_switch_to_buffer(struct yy_buffer_state* new_buffer);
 struct yy_buffer_state* yy_scan_string(const char* yystr);
+void yy_delete_buffer(struct yy_buffer_state* buffer);
+
+// The arguments of a call while it's being parsed, linked from the last one back to the first.
+struct ArgList {
+    Expr* expr;
+    ArgList* prev;
+    size_t size;
+};
+
+static ArgList* AppendArg(ArgList* list, Expr* expr) {
+    return gArena->New<ArgList>(ArgList{ expr, list, list == nullptr ? 1 : list->size + 1 });
+}
 
 // Convenience function for building expressions with a fixed number
 // of arguments.
 static Expr* Build(Function fn, YYLTYPE loc, size_t count, ...) {
     va_list v;
     va_start(v, count);
-    Expr* e = new Expr(fn, "(operator)", loc.start, loc.end);
+    Expr** args = gArena->NewArray<Expr*>(count);
     for (size_t i = 0; i < count; ++i) {
-        e->argv.emplace_back(va_arg(v, Expr*));
+        args[i] = va_arg(v, Expr*);
     }
     va_end(v);
+    Expr* e = gArena->New<Expr>(fn, "(operator)", loc.start, loc.end);
+    e->argv = ExprArgs(args, count);
     return e;
 }
 
@@ -58,9 +74,9 @@ static Expr* Build(Function fn, YYLTYPE loc, size_t count, ...) {
 %locations
 
 %union {
-    char* str;
+    Token str;
     Expr* expr;
-    std::vector<std::unique_ptr<Expr>>* args;
+    ArgList* args;
 }
 
 %token AND OR SUBSTR SUPERSTR EQ NE IF THEN ELSE ENDIF
@@ -68,10 +84,7 @@ static Expr* Build(Function fn, YYLTYPE loc, size_t count, ...) {
 %type <expr> expr
 %type <args> arglist
 
-%destructor { delete $$; } expr
-%destructor { delete $$; } arglist
-
-%parse-param {std::unique_ptr<Expr>* root}
+%parse-param {Expr** root}
 %parse-param {int* error_count}
 %define parse.error verbose
 
@@ -86,11 +99,11 @@ static Expr* Build(Function fn, YYLTYPE loc, size_t count, ...) {
 
 %%
 
-input:  expr           { root->reset($1); }
+input:  expr           { *root = $1; }
 ;
 
 expr:  STRING {
-    $$ = new Expr(Literal, $1, @$.start, @$.end);
+    $$ = gArena->New<Expr>(Literal, std::string_view($1.data, $1.size), @$.start, @$.end);
 }
 |  '(' expr ')'                      { $$ = $2; $$->start=@$.start; $$->end=@$.end; }
 |  expr ';'                          { $$ = $1; $$->start=@1.start; $$->end=@1.end; }
@@ -105,33 +118,40 @@ expr:  STRING {
 |  IF expr THEN expr ENDIF           { $$ = Build(IfElseFn, @$, 2, $2, $4); }
 |  IF expr THEN expr ELSE expr ENDIF { $$ = Build(IfElseFn, @$, 3, $2, $4, $6); }
 | STRING '(' arglist ')' {
-    Function fn = FindFunction($1);
+    static std::string fn_name;
+    fn_name.assign($1.data, $1.size);
+    Function fn = FindFunction(fn_name);
     if (fn == nullptr) {
-        std::string msg = "unknown function \"" + std::string($1) + "\"";
+        std::string msg = "unknown function \"" + fn_name + "\"";
         yyerror(root, error_count, msg.c_str());
         YYERROR;
     }
-    $$ = new Expr(fn, $1, @$.start, @$.end);
-    $$->argv = std::move(*$3);
+    // Function names get a NUL-terminated copy, as they're passed to the Function as a C string.
+    $$ = gArena->New<Expr>(fn, gArena->CopyString(fn_name), @$.start, @$.end);
+    if ($3 != nullptr) {
+        Expr** args = gArena->NewArray<Expr*>($3->size);
+        for (ArgList* arg = $3; arg != nullptr; arg = arg->prev) {
+            args[arg->size - 1] = arg->expr;
+        }
+        $$->argv = ExprArgs(args, $3->size);
+    }
 }
 ;
 
 arglist:    /* empty */ {
-    $$ = new std::vector<std::unique_ptr<Expr>>;
+    $$ = nullptr;
 }
 | expr {
-    $$ = new std::vector<std::unique_ptr<Expr>>;
-    $$->emplace_back($1);
+    $$ = AppendArg(nullptr, $1);
 }
 | arglist ',' expr {
-    UNUSED($1);
-    $$->push_back(std::unique_ptr<Expr>($3));
+    $$ = AppendArg($1, $3);
 }
 ;
 
 %%
 
-void yyerror(std::unique_ptr<Expr>* root, int* error_count, const char* s) {
+void yyerror(Expr** root, int* error_count, const char* s) {
   if (strlen(s) == 0) {
     s = "syntax error";
   }
@@ -139,7 +159,17 @@ void yyerror(std::unique_ptr<Expr>* root, int* error_count, const char* s) {
   ++*error_count;
 }
 
-int ParseString(const std::string& str, std::unique_ptr<Expr>* root, int* error_count) {
-  yy_switch_to_buffer(yy_scan_string(str.c_str()));
-  return yyparse(root, error_count);
+int ParseString(const std::string& str, ExprArena* arena, Expr** root, int* error_count) {
+  gScript = str.data();
+  gArena = arena;
+  gLine = 1;
+  gColumn = 1;
+  gPos = 0;
+  *root = nullptr;
+
+  yy_buffer_state* buffer = yy_scan_string(str.c_str());
+  yy_switch_to_buffer(buffer);
+  int result = yyparse(root, error_count);
+  yy_delete_buffer(buffer);
+  return result;
 }
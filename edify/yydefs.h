@@ -17,6 +17,17 @@
 #ifndef _YYDEFS_H_
 #define _YYDEFS_H_
 
+#include <stddef.h>
+
+// The text of a STRING token. It points into the script, or into the ExprArena for quoted strings
+// with escape sequences.
+struct Token {
+    const char* data;
+    size_t size;
+};
+
+struct ArgList;
+
 #define YYLTYPE YYLTYPE
 typedef struct {
     int start, end;
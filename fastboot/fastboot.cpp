@@ -24,9 +24,9 @@
 #include <vector>
 
 #include <android-base/logging.h>
-#include <android-base/properties.h>
 #include <bootloader_message/bootloader_message.h>
 
+#include "recovery_ui/property_snapshot.h"
 #include "recovery_ui/ui.h"
 
 static const std::vector<std::pair<std::string, Device::BuiltinAction>> kFastbootMenuActions{
@@ -39,16 +39,22 @@ static const std::vector<std::pair<std::string, Device::BuiltinAction>> kFastboo
 Device::BuiltinAction StartFastboot(Device* device, const std::vector<std::string>& /* args */) {
   RecoveryUI* ui = device->GetUI();
 
+  // These don't change while in recovery, so read them once rather than on every entry.
+  static const PropertySnapshot properties({ "ro.product.device", "ro.bootloader",
+                                             "ro.build.expect.baseband", "ro.serialno",
+                                             "ro.secure", "ro.revision" });
+
   std::vector<std::string> title_lines = { "AOSPA Fastboot" };
-  title_lines.push_back("Product name - " + android::base::GetProperty("ro.product.device", ""));
-  title_lines.push_back("Bootloader version - " + android::base::GetProperty("ro.bootloader", ""));
-  title_lines.push_back("Baseband version - " +
-                        android::base::GetProperty("ro.build.expect.baseband", ""));
-  title_lines.push_back("Serial number - " + android::base::GetProperty("ro.serialno", ""));
+  title_lines.push_back("Product name - " + properties.Get("ro.product.device"));
+  title_lines.push_back("Bootloader version - " + properties.Get("ro.bootloader"));
+  title_lines.push_back("Baseband version - " + properties.Get("ro.build.expect.baseband"));
+  title_lines.push_back("Serial number - " + properties.Get("ro.serialno"));
   title_lines.push_back(std::string("Secure boot - ") +
-                        ((android::base::GetProperty("ro.secure", "") == "1") ? "yes" : "no"));
-  title_lines.push_back("HW version - " + android::base::GetProperty("ro.revision", ""));
+                        ((properties.Get("ro.secure") == "1") ? "yes" : "no"));
+  title_lines.push_back("HW version - " + properties.Get("ro.revision"));
 
+  // Draw the title, the text screen and the menu below in one go.
+  ScopedUiUpdate update(ui);
   ui->ResetKeyInterruptStatus();
   ui->SetTitle(title_lines);
   ui->ShowText(true);
@@ -47,6 +47,7 @@
 #include <fcntl.h>
 #include <limits.h>  // PATH_MAX
 #include <linux/fuse.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -57,7 +58,9 @@
 #include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -418,7 +421,8 @@ static int handle_read(void* data, fuse_data* fd, const fuse_in_header* hdr) {
   return NO_STATUS;
 }
 
-int run_fuse_sideload(std::unique_ptr<FuseDataProvider>&& provider, const char* mount_point) {
+int run_fuse_sideload(std::unique_ptr<FuseDataProvider>&& provider, const char* mount_point,
+                      const FuseReadyCallback& on_ready) {
   // If something's already mounted on our mountpoint, try to remove it. (Mostly in case of a
   // previous abnormal exit.)
   umount2(mount_point, MNT_FORCE);
@@ -446,6 +450,7 @@ int run_fuse_sideload(std::unique_ptr<FuseDataProvider>&& provider, const char*
   uint64_t avail = mem - (INSTALL_REQUIRED_MEMORY + fd.file_blocks * sizeof(uint8_t*));
 
   int result;
+  bool ready_notified = false;
   if (fd.file_blocks > (1 << 18)) {
     fprintf(stderr, "file has too many blocks (%u)\n", fd.file_blocks);
     result = -1;
@@ -563,6 +568,17 @@ int run_fuse_sideload(std::unique_ptr<FuseDataProvider>&& provider, const char*
         break;
     }
 
+    // The package file becomes accessible once the INIT handshake is done. Let the caller know
+    // right away, so that it doesn't need to poll for FUSE_SIDELOAD_HOST_PATHNAME.
+    if (hdr->opcode == FUSE_INIT && result == NO_STATUS && !ready_notified) {
+      ready_notified = true;
+      if (on_ready && !on_ready()) {
+        fprintf(stderr, "fuse_sideload aborted by the ready callback\n");
+        result = -1;
+        break;
+      }
+    }
+
     if (result == NO_STATUS_EXIT) {
       result = 0;
       break;
@@ -597,3 +613,44 @@ done:
 
   return result;
 }
+
+bool NotifyFuseSideloadReady(int ready_fd) {
+  uint8_t ready = 1;
+  if (TEMP_FAILURE_RETRY(write(ready_fd, &ready, sizeof(ready))) != sizeof(ready)) {
+    perror("write ready signal");
+    return false;
+  }
+  return true;
+}
+
+FuseReadyStatus WaitForFuseSideloadReady(int ready_fd, int timeout_ms) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  pollfd pfd = { .fd = ready_fd, .events = POLLIN };
+  for (;;) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    int ret = poll(&pfd, 1, static_cast<int>(std::max<int64_t>(remaining.count(), 0)));
+    if (ret == -1) {
+      if (errno == EINTR) continue;
+      perror("poll ready signal");
+      return FuseReadyStatus::kError;
+    }
+    if (ret == 0) {
+      return FuseReadyStatus::kTimedOut;
+    }
+    break;
+  }
+
+  // Either the ready byte has arrived, or the write end has been closed (POLLHUP) because the
+  // process running the filesystem has exited.
+  uint8_t ready;
+  ssize_t len = TEMP_FAILURE_RETRY(read(ready_fd, &ready, sizeof(ready)));
+  if (len == sizeof(ready)) {
+    return FuseReadyStatus::kReady;
+  }
+  if (len == 0) {
+    return FuseReadyStatus::kExited;
+  }
+  perror("read ready signal");
+  return FuseReadyStatus::kError;
+}
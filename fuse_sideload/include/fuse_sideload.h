@@ -17,6 +17,7 @@
 #ifndef __FUSE_SIDELOAD_H
 #define __FUSE_SIDELOAD_H
 
+#include <functional>
 #include <memory>
 
 #include "fuse_provider.h"
@@ -28,7 +29,27 @@ static constexpr const char* FUSE_SIDELOAD_HOST_PATHNAME = "/sideload/package.zi
 static constexpr const char* FUSE_SIDELOAD_HOST_EXIT_FLAG = "exit";
 static constexpr const char* FUSE_SIDELOAD_HOST_EXIT_PATHNAME = "/sideload/exit";
 
+// Invoked once the filesystem is mounted and the kernel has completed the FUSE_INIT handshake, i.e.
+// the package file can be accessed from now on. Returning false aborts the sideload.
+using FuseReadyCallback = std::function<bool()>;
+
 int run_fuse_sideload(std::unique_ptr<FuseDataProvider>&& provider,
-                      const char* mount_point = FUSE_SIDELOAD_HOST_MOUNTPOINT);
+                      const char* mount_point = FUSE_SIDELOAD_HOST_MOUNTPOINT,
+                      const FuseReadyCallback& on_ready = nullptr);
+
+// Helpers to pass the ready signal across fork(). The child (which calls run_fuse_sideload())
+// writes to the write end of a pipe from its |on_ready| callback via NotifyFuseSideloadReady(). The
+// parent waits on the read end with WaitForFuseSideloadReady(). Since the child holds the only
+// write end, its exit (e.g. a mount failure) closes the pipe and wakes up the parent immediately.
+enum class FuseReadyStatus {
+  kReady,
+  kExited,
+  kTimedOut,
+  kError,
+};
+
+bool NotifyFuseSideloadReady(int ready_fd);
+
+FuseReadyStatus WaitForFuseSideloadReady(int ready_fd, int timeout_ms);
 
 #endif
@@ -91,32 +91,21 @@ static bool WriteStatusToFd(MinadbdCommandStatus status, int fd) {
 // Installs the package from FUSE. Returns the installation result and whether it should continue
 // waiting for new commands.
 static auto AdbInstallPackageHandler(Device* device, InstallResult* result) {
-  // How long (in seconds) we wait for the package path to be ready. It doesn't need to be too long
-  // because the minadbd service has already issued an install command. FUSE_SIDELOAD_HOST_PATHNAME
-  // will start to exist once the host connects and starts serving a package. Poll for its
-  // appearance. (Note that inotify doesn't work with FUSE.)
+  // minadbd only issues the install command after the FUSE filesystem has completed its handshake
+  // with the kernel (see run_fuse_sideload()), so FUSE_SIDELOAD_HOST_PATHNAME is expected to be
+  // accessible right away; no need to poll for its appearance.
   auto ui = device->GetUI();
-  constexpr int ADB_INSTALL_TIMEOUT = 15;
   bool should_continue = true;
   *result = INSTALL_ERROR;
-  for (int i = 0; i < ADB_INSTALL_TIMEOUT; ++i) {
-    struct stat st;
-    if (stat(FUSE_SIDELOAD_HOST_PATHNAME, &st) != 0) {
-      if (errno == ENOENT && i < ADB_INSTALL_TIMEOUT - 1) {
-        sleep(1);
-        continue;
-      } else {
-        should_continue = false;
-        ui->Print("\nTimed out waiting for fuse to be ready.\n\n");
-        break;
-      }
-    }
-
+  if (struct stat st; stat(FUSE_SIDELOAD_HOST_PATHNAME, &st) != 0) {
+    PLOG(ERROR) << "Failed to stat " << FUSE_SIDELOAD_HOST_PATHNAME;
+    should_continue = false;
+    ui->Print("\nFuse is not ready.\n\n");
+  } else {
     auto package =
         Package::CreateFilePackage(FUSE_SIDELOAD_HOST_PATHNAME,
                                    std::bind(&RecoveryUI::SetProgress, ui, std::placeholders::_1));
     *result = InstallPackage(package.get(), FUSE_SIDELOAD_HOST_PATHNAME, false, 0, device);
-    break;
   }
 
   // Calling stat() on this magic filename signals the FUSE to exit.
@@ -33,6 +33,7 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <cutils/properties.h>
 
 #include "bootloader_message/bootloader_message.h"
@@ -50,7 +51,7 @@
 
 static constexpr const char* SDCARD_ROOT = "/sdcard";
 // How long (in seconds) we wait for the fuse-provided package file to
-// appear, before timing out.
+// become ready, before timing out.
 static constexpr int SDCARD_INSTALL_TIMEOUT = 10;
 
 // Set the BCB to reboot back into recovery (it won't resume the install from
@@ -130,7 +131,7 @@ static std::string BrowseDirectory(const std::string& path, Device* device, Reco
   // Unreachable.
 }
 
-static bool StartInstallPackageFuse(std::string_view path) {
+static bool StartInstallPackageFuse(std::string_view path, int ready_fd) {
   if (path.empty()) {
     return false;
   }
@@ -152,7 +153,8 @@ static bool StartInstallPackageFuse(std::string_view path) {
     umount2(SDCARD_ROOT, MNT_DETACH);
   }
 
-  return run_fuse_sideload(std::move(fuse_data_provider)) == 0;
+  return run_fuse_sideload(std::move(fuse_data_provider), FUSE_SIDELOAD_HOST_MOUNTPOINT,
+                           std::bind(&NotifyFuseSideloadReady, ready_fd)) == 0;
 }
 
 InstallResult InstallWithFuseFromPath(std::string_view path, Device* device) {
@@ -160,42 +162,48 @@ InstallResult InstallWithFuseFromPath(std::string_view path, Device* device) {
   // through fuse involves going from kernel to userspace to kernel, it leads
   // to deadlock when a page fault occurs. (Bug: 26313124)
   auto ui = device->GetUI();
+  android::base::unique_fd ready_read_fd, ready_write_fd;
+  if (!android::base::Pipe(&ready_read_fd, &ready_write_fd)) {
+    PLOG(ERROR) << "Failed to create the fuse ready pipe";
+    return INSTALL_ERROR;
+  }
+
   pid_t child;
   if ((child = fork()) == 0) {
-    bool status = StartInstallPackageFuse(path);
+    ready_read_fd.reset();
+    bool status = StartInstallPackageFuse(path, ready_write_fd);
 
     _exit(status ? EXIT_SUCCESS : EXIT_FAILURE);
   }
+  // Keep the child as the only writer, so that its exit wakes us up.
+  ready_write_fd.reset();
 
-  // FUSE_SIDELOAD_HOST_PATHNAME will start to exist once the fuse in child process is ready.
+  // The child signals through the pipe as soon as FUSE_SIDELOAD_HOST_PATHNAME is ready.
   InstallResult result = INSTALL_ERROR;
   int status;
   bool waited = false;
-  for (int i = 0; i < SDCARD_INSTALL_TIMEOUT; ++i) {
-    if (waitpid(child, &status, WNOHANG) == -1) {
-      result = INSTALL_ERROR;
-      waited = true;
+  switch (WaitForFuseSideloadReady(ready_read_fd, SDCARD_INSTALL_TIMEOUT * 1000)) {
+    case FuseReadyStatus::kReady: {
+      auto package = Package::CreateFilePackage(
+          FUSE_SIDELOAD_HOST_PATHNAME,
+          std::bind(&RecoveryUI::SetProgress, ui, std::placeholders::_1));
+      result = InstallPackage(package.get(), FUSE_SIDELOAD_HOST_PATHNAME, false,
+                              0 /* retry_count */, device);
       break;
     }
-
-    struct stat sb;
-    if (stat(FUSE_SIDELOAD_HOST_PATHNAME, &sb) == -1) {
-      if (errno == ENOENT && i < SDCARD_INSTALL_TIMEOUT - 1) {
-        sleep(1);
-        continue;
-      } else {
-        LOG(ERROR) << "Timed out waiting for the fuse-provided package.";
-        result = INSTALL_ERROR;
-        kill(child, SIGKILL);
-        break;
-      }
-    }
-    auto package =
-        Package::CreateFilePackage(FUSE_SIDELOAD_HOST_PATHNAME,
-                                   std::bind(&RecoveryUI::SetProgress, ui, std::placeholders::_1));
-    result = InstallPackage(package.get(), FUSE_SIDELOAD_HOST_PATHNAME, false, 0 /* retry_count */,
-                            device);
-    break;
+    case FuseReadyStatus::kExited:
+      LOG(ERROR) << "The fuse process exited before the package became ready.";
+      waitpid(child, &status, 0);
+      waited = true;
+      break;
+    case FuseReadyStatus::kTimedOut:
+      LOG(ERROR) << "Timed out waiting for the fuse-provided package.";
+      kill(child, SIGKILL);
+      break;
+    case FuseReadyStatus::kError:
+      PLOG(ERROR) << "Failed to wait for the fuse-provided package";
+      kill(child, SIGKILL);
+      break;
   }
 
   if (!waited) {
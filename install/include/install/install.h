@@ -61,6 +61,10 @@ bool verify_package(Package* package, RecoveryUI* ui);
 // result to |metadata|. Return true if succeed, otherwise return false.
 bool ReadMetadataFromPackage(ZipArchiveHandle zip, std::map<std::string, std::string>* metadata);
 
+// Same as above, but reads the metadata through the entry cache of |package|, so that repeated
+// reads of the same package don't extract it again.
+bool ReadMetadataFromPackage(Package* package, std::map<std::string, std::string>* metadata);
+
 // Checks if the metadata in the OTA package has expected values. Mandatory checks: ota-type,
 // pre-device and serial number (if presents). A/B OTA specific checks: pre-build version,
 // fingerprint, timestamp.
@@ -27,14 +27,10 @@
 #include <unistd.h>
 
 #include <algorithm>
-#include <atomic>
 #include <chrono>
-#include <condition_variable>
 #include <filesystem>
 #include <functional>
 #include <limits>
-#include <mutex>
-#include <thread>
 #include <vector>
 
 #include <android-base/file.h>
@@ -58,10 +54,9 @@
 #include "recovery_ui/device.h"
 #include "recovery_ui/ui.h"
 #include "recovery_utils/roots.h"
+#include "recovery_utils/telemetry_sampler.h"
 #include "recovery_utils/thermalutil.h"
 
-using namespace std::chrono_literals;
-
 bool ask_to_continue_unverified(Device* device);
 
 static constexpr int kRecoveryApiVersion = 3;
@@ -78,14 +73,15 @@ static constexpr auto&& RELEASE_KEYS_TAG = "release-keys";
 // If brick packages are smaller than |MEMORY_PACKAGE_LIMIT|, read the entire package into memory
 static constexpr size_t MEMORY_PACKAGE_LIMIT = 1024 * 1024;
 
-static std::condition_variable finish_log_temperature;
 static bool isInStringList(const std::string& target_token, const std::string& str_list,
                            const std::string& deliminator);
 
+static constexpr const char* METADATA_PATH = "META-INF/com/android/metadata";
+static constexpr const char* AB_OTA_PAYLOAD_PROPERTIES = "payload_properties.txt";
+
 bool ReadMetadataFromPackage(ZipArchiveHandle zip, std::map<std::string, std::string>* metadata) {
   CHECK(metadata != nullptr);
 
-  static constexpr const char* METADATA_PATH = "META-INF/com/android/metadata";
   ZipEntry64 entry;
   if (FindEntry(zip, METADATA_PATH, &entry) != 0) {
     LOG(ERROR) << "Failed to find " << METADATA_PATH;
@@ -101,14 +97,19 @@ bool ReadMetadataFromPackage(ZipArchiveHandle zip, std::map<std::string, std::st
     return false;
   }
 
-  for (const std::string& line : android::base::Split(metadata_string, "\n")) {
-    size_t eq = line.find('=');
-    if (eq != std::string::npos) {
-      metadata->emplace(android::base::Trim(line.substr(0, eq)),
-                        android::base::Trim(line.substr(eq + 1)));
-    }
-  }
+  auto properties = Package::ParseProperties(metadata_string);
+  metadata->insert(properties.begin(), properties.end());
+  return true;
+}
 
+bool ReadMetadataFromPackage(Package* package, std::map<std::string, std::string>* metadata) {
+  CHECK(metadata != nullptr);
+
+  const auto* properties = package->ReadCachedProperties(METADATA_PATH);
+  if (properties == nullptr) {
+    return false;
+  }
+  metadata->insert(properties->begin(), properties->end());
   return true;
 }
 
@@ -259,56 +260,28 @@ bool CheckPackageMetadata(const std::map<std::string, std::string>& metadata, Ot
   return true;
 }
 
-static std::string ExtractPayloadProperties(ZipArchiveHandle zip) {
-  // For A/B updates we extract the payload properties to a buffer and obtain the RAW payload offset
-  // in the zip file.
-  static constexpr const char* AB_OTA_PAYLOAD_PROPERTIES = "payload_properties.txt";
-  ZipEntry64 properties_entry;
-  if (FindEntry(zip, AB_OTA_PAYLOAD_PROPERTIES, &properties_entry) != 0) {
-    LOG(ERROR) << "Failed to find " << AB_OTA_PAYLOAD_PROPERTIES;
-    return {};
-  }
-  auto properties_entry_length = properties_entry.uncompressed_length;
-  if (properties_entry_length > std::numeric_limits<size_t>::max()) {
-    LOG(ERROR) << "Failed to extract " << AB_OTA_PAYLOAD_PROPERTIES
-               << " because's uncompressed size exceeds size of address space. "
-               << properties_entry_length;
-    return {};
-  }
-  std::string payload_properties(properties_entry_length, '\0');
-  int32_t err =
-      ExtractToMemory(zip, &properties_entry, reinterpret_cast<uint8_t*>(payload_properties.data()),
-                      properties_entry_length);
-  if (err != 0) {
-    LOG(ERROR) << "Failed to extract " << AB_OTA_PAYLOAD_PROPERTIES << ": " << ErrorCodeString(err);
-    return {};
-  }
-  return payload_properties;
-}
-
-bool SetUpAbUpdateCommands(const std::string& package, ZipArchiveHandle zip, int status_fd,
-                           std::vector<std::string>* cmd) {
+bool SetUpAbUpdateCommands(Package* package, int status_fd, std::vector<std::string>* cmd) {
   CHECK(cmd != nullptr);
 
   // For A/B updates we extract the payload properties to a buffer and obtain the RAW payload offset
   // in the zip file.
-  const auto payload_properties = ExtractPayloadProperties(zip);
-  if (payload_properties.empty()) {
+  const auto* payload_properties = package->ReadCachedEntry(AB_OTA_PAYLOAD_PROPERTIES);
+  if (payload_properties == nullptr || payload_properties->empty()) {
     return false;
   }
 
   static constexpr const char* AB_OTA_PAYLOAD = "payload.bin";
   ZipEntry64 payload_entry;
-  if (FindEntry(zip, AB_OTA_PAYLOAD, &payload_entry) != 0) {
+  if (!package->LookupEntry(AB_OTA_PAYLOAD, &payload_entry)) {
     LOG(ERROR) << "Failed to find " << AB_OTA_PAYLOAD;
     return false;
   }
   long payload_offset = payload_entry.offset;
   *cmd = {
     "/system/bin/update_engine_sideload",
-    "--payload=file://" + package,
+    "--payload=file://" + package->GetPath(),
     android::base::StringPrintf("--offset=%ld", payload_offset),
-    "--headers=" + std::string(payload_properties.begin(), payload_properties.end()),
+    "--headers=" + *payload_properties,
     android::base::StringPrintf("--status_fd=%d", status_fd),
   };
   return true;
@@ -357,19 +330,10 @@ bool SetUpNonAbUpdateCommands(const std::string& package, ZipArchiveHandle zip,
   return true;
 }
 
-static void log_max_temperature(int* max_temperature, const std::atomic<bool>& logger_finished) {
-  CHECK(max_temperature != nullptr);
-  std::mutex mtx;
-  std::unique_lock<std::mutex> lck(mtx);
-  while (!logger_finished.load() &&
-         finish_log_temperature.wait_for(lck, 20s) == std::cv_status::timeout) {
-    *max_temperature = std::max(*max_temperature, GetMaxValueFromThermalZone());
-  }
-}
-
-static bool PerformPowerwashIfRequired(ZipArchiveHandle zip, Device *device) {
-  const auto payload_properties = ExtractPayloadProperties(zip);
-  if (payload_properties.find("POWERWASH=1") != std::string::npos) {
+static bool PerformPowerwashIfRequired(Package* package, Device* device) {
+  // Already read when setting up the update, so this doesn't touch the package again.
+  const auto* payload_properties = package->ReadCachedProperties(AB_OTA_PAYLOAD_PROPERTIES);
+  if (payload_properties != nullptr && get_value(*payload_properties, "POWERWASH") == "1") {
     LOG(INFO) << "Payload properties has POWERWASH=1, wiping userdata...";
     return WipeData(device);
   }
@@ -379,11 +343,11 @@ static bool PerformPowerwashIfRequired(ZipArchiveHandle zip, Device *device) {
 // If the package contains an update binary, extract it and run it.
 static InstallResult TryUpdateBinary(Package* package, bool* wipe_cache,
                                      std::vector<std::string>* log_buffer, int retry_count,
-                                     int* max_temperature, Device* device) {
+                                     Device* device) {
   auto ui = device->GetUI();
   std::map<std::string, std::string> metadata;
   auto zip = package->GetZipArchiveHandle();
-  if (!ReadMetadataFromPackage(zip, &metadata)) {
+  if (!ReadMetadataFromPackage(package, &metadata)) {
     LOG(ERROR) << "Failed to parse metadata in the zip file";
     return INSTALL_CORRUPT;
   }
@@ -476,7 +440,7 @@ static InstallResult TryUpdateBinary(Package* package, bool* wipe_cache,
   std::vector<std::string> args;
   if (auto setup_result =
           package_is_ab
-              ? SetUpAbUpdateCommands(package_path, zip, pipe_write.get(), &args)
+              ? SetUpAbUpdateCommands(package, pipe_write.get(), &args)
               : SetUpNonAbUpdateCommands(package_path, zip, retry_count, pipe_write.get(), &args);
       !setup_result) {
     log_buffer->push_back(android::base::StringPrintf("error: %d", kUpdateBinaryCommandFailure));
@@ -505,9 +469,6 @@ static InstallResult TryUpdateBinary(Package* package, bool* wipe_cache,
   }
   pipe_write.reset();
 
-  std::atomic<bool> logger_finished(false);
-  std::thread temperature_logger(log_max_temperature, max_temperature, std::ref(logger_finished));
-
   *wipe_cache = false;
   bool retry_update = false;
 
@@ -570,10 +531,6 @@ static InstallResult TryUpdateBinary(Package* package, bool* wipe_cache,
   int status;
   waitpid(pid, &status, 0);
 
-  logger_finished.store(true);
-  finish_log_temperature.notify_one();
-  temperature_logger.join();
-
   if (retry_update) {
     return INSTALL_RETRY;
   }
@@ -589,7 +546,7 @@ static InstallResult TryUpdateBinary(Package* package, bool* wipe_cache,
     LOG(FATAL) << "Invalid status code " << status;
   }
   if (package_is_ab) {
-    PerformPowerwashIfRequired(zip, device);
+    PerformPowerwashIfRequired(package, device);
   }
 
   return INSTALL_SUCCESS;
@@ -597,7 +554,7 @@ static InstallResult TryUpdateBinary(Package* package, bool* wipe_cache,
 
 static InstallResult VerifyAndInstallPackage(Package* package, bool* wipe_cache,
                                              std::vector<std::string>* log_buffer, int retry_count,
-                                             int* max_temperature, Device* device) {
+                                             Device* device) {
   auto ui = device->GetUI();
   ui->SetBackground(RecoveryUI::INSTALLING_UPDATE);
   // Give verification half the progress bar...
@@ -621,8 +578,7 @@ static InstallResult VerifyAndInstallPackage(Package* package, bool* wipe_cache,
     ui->Print("Retry attempt: %d\n", retry_count);
   }
   ui->SetEnableReboot(false);
-  auto result =
-      TryUpdateBinary(package, wipe_cache, log_buffer, retry_count, max_temperature, device);
+  auto result = TryUpdateBinary(package, wipe_cache, log_buffer, retry_count, device);
   ui->SetEnableReboot(true);
   ui->Print("\n");
 
@@ -635,7 +591,11 @@ InstallResult InstallPackage(Package* package, const std::string_view package_id
   auto start = std::chrono::system_clock::now();
 
   int start_temperature = GetMaxValueFromThermalZone();
-  int max_temperature = start_temperature;
+  // Sample the thermal zones and the block device stats throughout the install, which allows
+  // correlating throttling with throughput dips.
+  TelemetrySampler telemetry(std::chrono::milliseconds(android::base::GetIntProperty(
+      "ro.recovery.telemetry_interval_ms", TelemetrySampler::kDefaultInterval.count())));
+  telemetry.Start();
 
   InstallResult result;
   std::vector<std::string> log_buffer;
@@ -652,8 +612,8 @@ InstallResult InstallPackage(Package* package, const std::string_view package_id
     result = INSTALL_ERROR;
   } else {
     bool updater_wipe_cache = false;
-    result = VerifyAndInstallPackage(package, &updater_wipe_cache, &log_buffer, retry_count,
-                                     &max_temperature, device);
+    result =
+        VerifyAndInstallPackage(package, &updater_wipe_cache, &log_buffer, retry_count, device);
     should_wipe_cache = should_wipe_cache || updater_wipe_cache;
   }
 
@@ -687,8 +647,10 @@ InstallResult InstallPackage(Package* package, const std::string_view package_id
     "retry: " + std::to_string(retry_count),
   };
 
+  telemetry.Stop();
   int end_temperature = GetMaxValueFromThermalZone();
-  max_temperature = std::max(end_temperature, max_temperature);
+  int max_temperature =
+      std::max({ start_temperature, end_temperature, telemetry.MaxTemperature() });
   if (start_temperature > 0) {
     log_buffer.push_back("temperature_start: " + std::to_string(start_temperature));
   }
@@ -698,6 +660,9 @@ InstallResult InstallPackage(Package* package, const std::string_view package_id
   if (max_temperature > 0) {
     log_buffer.push_back("temperature_max: " + std::to_string(max_temperature));
   }
+  for (auto& line : telemetry.GetSummary()) {
+    log_buffer.push_back(std::move(line));
+  }
 
   std::string log_content =
       android::base::Join(log_header, "\n") + "\n" + android::base::Join(log_buffer, "\n") + "\n";
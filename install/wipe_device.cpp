@@ -40,31 +40,16 @@
 #include "recovery_ui/ui.h"
 
 std::vector<std::string> GetWipePartitionList(Package* wipe_package) {
-  ZipArchiveHandle zip = wipe_package->GetZipArchiveHandle();
-  if (!zip) {
-    LOG(ERROR) << "Failed to get ZipArchiveHandle";
-    return {};
-  }
-
   constexpr char RECOVERY_WIPE_ENTRY_NAME[] = "recovery.wipe";
 
   std::string partition_list_content;
   ZipEntry64 entry;
-  if (FindEntry(zip, RECOVERY_WIPE_ENTRY_NAME, &entry) == 0) {
-    auto length = entry.uncompressed_length;
-    if (length > std::numeric_limits<size_t>::max()) {
-      LOG(ERROR) << "Failed to extract " << RECOVERY_WIPE_ENTRY_NAME
-                 << " because's uncompressed size exceeds size of address space. " << length;
-      return {};
-    }
-    partition_list_content = std::string(length, '\0');
-    if (auto err = ExtractToMemory(
-            zip, &entry, reinterpret_cast<uint8_t*>(partition_list_content.data()), length);
-        err != 0) {
-      LOG(ERROR) << "Failed to extract " << RECOVERY_WIPE_ENTRY_NAME << ": "
-                 << ErrorCodeString(err);
+  if (wipe_package->LookupEntry(RECOVERY_WIPE_ENTRY_NAME, &entry)) {
+    const auto* content = wipe_package->ReadCachedEntry(RECOVERY_WIPE_ENTRY_NAME);
+    if (content == nullptr) {
       return {};
     }
+    partition_list_content = *content;
   } else {
     LOG(INFO) << "Failed to find " << RECOVERY_WIPE_ENTRY_NAME
               << ", falling back to use the partition list on device.";
@@ -157,14 +142,8 @@ static bool CheckWipePackage(Package* wipe_package, RecoveryUI* ui) {
     return false;
   }
 
-  ZipArchiveHandle zip = wipe_package->GetZipArchiveHandle();
-  if (!zip) {
-    LOG(ERROR) << "Failed to get ZipArchiveHandle";
-    return false;
-  }
-
   std::map<std::string, std::string> metadata;
-  if (!ReadMetadataFromPackage(zip, &metadata)) {
+  if (!ReadMetadataFromPackage(wipe_package, &metadata)) {
     LOG(ERROR) << "Failed to parse metadata in the zip file";
     return false;
   }
@@ -30,6 +30,7 @@
 
 #include "minadbd/types.h"
 #include "minadbd_services.h"
+#include "recovery_utils/battery_utils.h"
 
 using namespace std::string_literals;
 
@@ -56,6 +57,8 @@ int main(int argc, char** argv) {
   if (argc == 4) {
     SetMinadbdRescueMode(true);
     adb_device_banner = "rescue";
+    // Have the battery level ready for the rescue-getprop queries.
+    BatteryMonitor::Get().Start();
   } else {
     adb_device_banner = "sideload";
   }
@@ -110,13 +110,21 @@ static MinadbdErrorCode RunAdbFuseSideload(int sfd, const std::string& args,
 
   LOG(INFO) << "sideload-host file size " << file_size << ", block size " << block_size;
 
-  if (!WriteCommandToFd(MinadbdCommand::kInstall, minadbd_socket)) {
-    return kMinadbdSocketIOError;
-  }
+  // Send the install command to recovery only once the FUSE filesystem is ready, so that recovery
+  // can open FUSE_SIDELOAD_HOST_PATHNAME right away instead of polling for it.
+  bool install_command_failed = false;
+  auto send_install_command = [&install_command_failed]() {
+    install_command_failed = !WriteCommandToFd(MinadbdCommand::kInstall, minadbd_socket);
+    return !install_command_failed;
+  };
 
   auto adb_data_reader = std::make_unique<FuseAdbDataProvider>(sfd, file_size, block_size);
-  if (int result = run_fuse_sideload(std::move(adb_data_reader), sideload_mount_point.c_str());
+  if (int result = run_fuse_sideload(std::move(adb_data_reader), sideload_mount_point.c_str(),
+                                     send_install_command);
       result != 0) {
+    if (install_command_failed) {
+      return kMinadbdSocketIOError;
+    }
     LOG(ERROR) << "Failed to start fuse";
     return kMinadbdFuseStartError;
   }
@@ -218,7 +226,8 @@ static void RescueGetpropHostService(unique_fd sfd, const std::string& prop) {
 
   auto query_prop = [](const std::string& key) {
     if (key == kRescueBatteryLevelProp) {
-      auto battery_info = GetBatteryInfo();
+      // Hosts may poll the level; reuse a value that's a few seconds old.
+      auto battery_info = BatteryMonitor::Get().GetInfo(std::chrono::seconds(5));
       return std::to_string(battery_info.capacity);
     }
     return android::base::GetProperty(key, "");
@@ -21,12 +21,18 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <cmath>
+#include <map>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include <android-base/properties.h>
 
 #include "graphics_drm.h"
 #include "graphics_fbdev.h"
+#include "graphics_memory.h"
 #include "minui/minui.h"
 
 static GRFont* gr_font = nullptr;
@@ -37,18 +43,73 @@ static int overscan_offset_y = 0;
 
 static uint32_t gr_current = ~0;
 
-// gr_draw is owned by backends.
+// The surface being drawn into: the backend's draw surface, |rotated_canvas| while the screen is
+// rotated, or the target of gr_set_draw_target().
 static GRSurface* gr_draw = nullptr;
+// The backend's surface to be flipped next. Owned by backends.
+static GRSurface* backend_draw = nullptr;
 static GRRotation rotation = GRRotation::NONE;
+// While the screen is rotated, drawing goes unrotated into this canvas (so that it takes the same
+// row-wise paths as an unrotated screen), and gr_flip() rotates it into the backend's surface in
+// one pass, a tile at a time.
+static std::unique_ptr<GRSurface> rotated_canvas;
+// The side of the square tiles, in pixels. Reading and writing one tile (2 x 4 KiB) stays within
+// the L1 cache even though one side is written a column at a time.
+static constexpr int kRotateTileSize = 32;
+// The tiles of the canvas that changed since each backend surface was last rotated into. A surface
+// missing from the map gets all of them.
+static std::map<const GRSurface*, std::vector<bool>> stale_tiles;
+static uint64_t pixels_rotated = 0;
 static PixelFormat pixel_format = PixelFormat::UNKNOWN;
+// Number of gr_flip() calls so far, and the frame each backend surface was last flipped as. Used to
+// tell how stale the contents of the draw surface are (see gr_draw_buffer_age()).
+static uint64_t flip_count = 0;
+static std::map<const GRSurface*, uint64_t> flipped_frames;
+// The screen's draw surface and its settings while gr_set_draw_target() redirects drawing to an
+// offscreen surface.
+static struct {
+  GRSurface* draw = nullptr;
+  int overscan_offset_x = 0;
+  int overscan_offset_y = 0;
+} screen_target;
+// The spans that drawing on the screen is restricted to, if any (see gr_set_clip_spans()).
+static std::vector<GRSpan> clip_spans;
+static uint64_t pixels_drawn = 0;
 // The graphics backend list that provides fallback options for the default backend selection.
 // For example, it will fist try DRM, then try FBDEV if DRM is unavailable.
 constexpr auto default_backends = { GraphicsBackend::DRM, GraphicsBackend::FBDEV };
 
 static bool outside(int x, int y) {
-  auto swapped = (rotation == GRRotation::LEFT || rotation == GRRotation::RIGHT);
-  return x < 0 || x >= (swapped ? gr_draw->height : gr_draw->width) || y < 0 ||
-         y >= (swapped ? gr_draw->width : gr_draw->height);
+  return x < 0 || x >= static_cast<int>(gr_draw->width) || y < 0 ||
+         y >= static_cast<int>(gr_draw->height);
+}
+
+// Records that [x1, x2) x [y1, y2) of the draw surface changed, if it's the rotated canvas.
+static void MarkDirty(int x1, int y1, int x2, int y2) {
+  if (!rotated_canvas || gr_draw != rotated_canvas.get() || stale_tiles.empty()) return;
+  int tiles_x = (rotated_canvas->width + kRotateTileSize - 1) / kRotateTileSize;
+  int tx1 = std::max(x1, 0) / kRotateTileSize;
+  int ty1 = std::max(y1, 0) / kRotateTileSize;
+  int tx2 = (std::min(x2, static_cast<int>(rotated_canvas->width)) + kRotateTileSize - 1) /
+            kRotateTileSize;
+  int ty2 = (std::min(y2, static_cast<int>(rotated_canvas->height)) + kRotateTileSize - 1) /
+            kRotateTileSize;
+  for (auto& [surface, stale] : stale_tiles) {
+    for (int ty = ty1; ty < ty2; ++ty) {
+      std::fill(stale.begin() + ty * tiles_x + tx1, stale.begin() + ty * tiles_x + tx2, true);
+    }
+  }
+}
+
+// Narrows [*x1, *x2) on row |y| of the draw surface to the clip span of that row. Returns false if
+// nothing is left to draw.
+static bool clip_row(int y, int* x1, int* x2) {
+  if (clip_spans.empty() || screen_target.draw != nullptr) return *x1 < *x2;
+  int row = y - overscan_offset_y;
+  if (row < 0 || row >= static_cast<int>(clip_spans.size())) return false;
+  *x1 = std::max(*x1, clip_spans[row].x1 + overscan_offset_x);
+  *x2 = std::min(*x2, clip_spans[row].x2 + overscan_offset_x);
+  return *x1 < *x2;
 }
 
 const GRFont* gr_sys_font() {
@@ -137,65 +198,29 @@ static inline uint8_t get_alpha(uint32_t pix) {
   return static_cast<uint8_t>((pix & (gr_current & get_alphamask())) >> get_alpha_shift());
 }
 
-// Increments pixel pointer right, with current rotation.
-static void incr_x(uint32_t** p, int row_pixels) {
-  if (rotation == GRRotation::LEFT) {
-    *p = *p - row_pixels;
-  } else if (rotation == GRRotation::RIGHT) {
-    *p = *p + row_pixels;
-  } else if (rotation == GRRotation::DOWN) {
-    *p = *p - 1;
-  } else {  // GRRotation::NONE
-    *p = *p + 1;
-  }
-}
-
-// Increments pixel pointer down, with current rotation.
-static void incr_y(uint32_t** p, int row_pixels) {
-  if (rotation == GRRotation::LEFT) {
-    *p = *p + 1;
-  } else if (rotation == GRRotation::RIGHT) {
-    *p = *p - 1;
-  } else if (rotation == GRRotation::DOWN) {
-    *p = *p - row_pixels;
-  } else {  // GRRotation::NONE
-    *p = *p + row_pixels;
-  }
-}
-
-// Returns pixel pointer at given coordinates with rotation adjustment.
 static uint32_t* PixelAt(GRSurface* surface, int x, int y, int row_pixels) {
-  switch (rotation) {
-    case GRRotation::NONE:
-      return reinterpret_cast<uint32_t*>(surface->data()) + y * row_pixels + x;
-    case GRRotation::RIGHT:
-      return reinterpret_cast<uint32_t*>(surface->data()) + x * row_pixels + (surface->width - y);
-    case GRRotation::DOWN:
-      return reinterpret_cast<uint32_t*>(surface->data()) + (surface->height - 1 - y) * row_pixels +
-             (surface->width - 1 - x);
-    case GRRotation::LEFT:
-      return reinterpret_cast<uint32_t*>(surface->data()) + (surface->height - 1 - x) * row_pixels +
-             y;
-    default:
-      printf("invalid rotation %d", static_cast<int>(rotation));
-  }
-  return nullptr;
+  return reinterpret_cast<uint32_t*>(surface->data()) + y * row_pixels + x;
 }
 
-static void TextBlend(const uint8_t* src_p, int src_row_bytes, uint32_t* dst_p, int dst_row_pixels,
-                      int width, int height) {
+// Blends the alpha mask at |src_p| in gr_current onto the draw surface at (x, y).
+static void TextBlend(const uint8_t* src_p, int src_row_bytes, int x, int y, int width,
+                      int height) {
+  int row_pixels = gr_draw->row_bytes / gr_draw->pixel_bytes;
   uint8_t alpha_current = get_alpha(gr_current);
-  for (int j = 0; j < height; ++j) {
-    const uint8_t* sx = src_p;
-    uint32_t* px = dst_p;
-    for (int i = 0; i < width; ++i, incr_x(&px, dst_row_pixels)) {
+  for (int j = 0; j < height; ++j, src_p += src_row_bytes) {
+    int x1 = x;
+    int x2 = x + width;
+    if (!clip_row(y + j, &x1, &x2)) continue;
+    const uint8_t* sx = src_p + (x1 - x);
+    uint32_t* px = PixelAt(gr_draw, x1, y + j, row_pixels);
+    for (int i = x1; i < x2; ++i, ++px) {
       uint8_t a = *sx++;
       if (alpha_current < 255) a = (static_cast<uint32_t>(a) * alpha_current) / 255;
       *px = pixel_blend(a, *px);
     }
-    src_p += src_row_bytes;
-    incr_y(&dst_p, dst_row_pixels);
+    pixels_drawn += x2 - x1;
   }
+  MarkDirty(x, y, x + width, y + height);
 }
 
 void gr_text(const GRFont* font, int x, int y, const char* s, bool bold) {
@@ -219,13 +244,9 @@ void gr_text(const GRFont* font, int x, int y, const char* s, bool bold) {
       ch = '?';
     }
 
-    int row_pixels = gr_draw->row_bytes / gr_draw->pixel_bytes;
     const uint8_t* src_p = font->texture->data() + ((ch - ' ') * font->char_width) +
                            (bold ? font->char_height * font->texture->row_bytes : 0);
-    uint32_t* dst_p = PixelAt(gr_draw, x, y, row_pixels);
-
-    TextBlend(src_p, font->texture->row_bytes, dst_p, row_pixels, font->char_width,
-              font->char_height);
+    TextBlend(src_p, font->texture->row_bytes, x, y, font->char_width, font->char_height);
 
     x += font->char_width;
   }
@@ -244,10 +265,7 @@ void gr_texticon(int x, int y, const GRSurface* icon) {
 
   if (outside(x, y) || outside(x + icon->width - 1, y + icon->height - 1)) return;
 
-  int row_pixels = gr_draw->row_bytes / gr_draw->pixel_bytes;
-  const uint8_t* src_p = icon->data();
-  uint32_t* dst_p = PixelAt(gr_draw, x, y, row_pixels);
-  TextBlend(src_p, icon->row_bytes, dst_p, row_pixels, icon->width, icon->height);
+  TextBlend(icon->data(), icon->row_bytes, x, y, icon->width, icon->height);
 }
 
 void gr_color(unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
@@ -262,6 +280,20 @@ void gr_color(unsigned char r, unsigned char g, unsigned char b, unsigned char a
 }
 
 void gr_clear() {
+  MarkDirty(0, 0, gr_draw->width, gr_draw->height);
+  if (!clip_spans.empty() && screen_target.draw == nullptr) {
+    int row_pixels = gr_draw->row_bytes / gr_draw->pixel_bytes;
+    for (int y = 0; y < static_cast<int>(gr_draw->height); ++y) {
+      int x1 = 0;
+      int x2 = gr_draw->width;
+      if (!clip_row(y, &x1, &x2)) continue;
+      std::fill_n(PixelAt(gr_draw, x1, y, row_pixels), x2 - x1, gr_current);
+      pixels_drawn += x2 - x1;
+    }
+    return;
+  }
+
+  pixels_drawn += gr_draw->width * gr_draw->height;
   if ((gr_current & 0xff) == ((gr_current >> 8) & 0xff) &&
       (gr_current & 0xff) == ((gr_current >> 16) & 0xff) &&
       (gr_current & 0xff) == ((gr_current >> 24) & 0xff) &&
@@ -288,18 +320,25 @@ void gr_fill(int x1, int y1, int x2, int y2) {
 
   if (outside(x1, y1) || outside(x2 - 1, y2 - 1)) return;
 
-  int row_pixels = gr_draw->row_bytes / gr_draw->pixel_bytes;
-  uint32_t* p = PixelAt(gr_draw, x1, y1, row_pixels);
   uint8_t alpha = get_alpha(gr_current);
-  if (alpha > 0) {
-    for (int y = y1; y < y2; ++y) {
-      uint32_t* px = p;
-      for (int x = x1; x < x2; ++x) {
+  if (alpha == 0) return;
+
+  MarkDirty(x1, y1, x2, y2);
+  int row_pixels = gr_draw->row_bytes / gr_draw->pixel_bytes;
+  for (int y = y1; y < y2; ++y) {
+    int row_x1 = x1;
+    int row_x2 = x2;
+    if (!clip_row(y, &row_x1, &row_x2)) continue;
+    uint32_t* px = PixelAt(gr_draw, row_x1, y, row_pixels);
+    if (alpha == 255) {
+      // Opaque fills don't need blending, which makes clearing parts of the screen cheap.
+      std::fill_n(px, row_x2 - row_x1, gr_current);
+    } else {
+      for (int x = row_x1; x < row_x2; ++x, ++px) {
         *px = pixel_blend(alpha, *px);
-        incr_x(&px, row_pixels);
       }
-      incr_y(&p, row_pixels);
     }
+    pixels_drawn += row_x2 - row_x1;
   }
 }
 
@@ -316,33 +355,42 @@ void gr_blit(const GRSurface* source, int sx, int sy, int w, int h, int dx, int
 
   if (outside(dx, dy) || outside(dx + w - 1, dy + h - 1)) return;
 
-  if (rotation != GRRotation::NONE) {
-    int src_row_pixels = source->row_bytes / source->pixel_bytes;
-    int row_pixels = gr_draw->row_bytes / gr_draw->pixel_bytes;
-    const uint32_t* src_py =
-        reinterpret_cast<const uint32_t*>(source->data()) + sy * source->row_bytes / 4 + sx;
-    uint32_t* dst_py = PixelAt(gr_draw, dx, dy, row_pixels);
-
-    for (int y = 0; y < h; y += 1) {
-      const uint32_t* src_px = src_py;
-      uint32_t* dst_px = dst_py;
-      for (int x = 0; x < w; x += 1) {
-        *dst_px = *src_px++;
-        incr_x(&dst_px, row_pixels);
-      }
-      src_py += src_row_pixels;
-      incr_y(&dst_py, row_pixels);
-    }
-  } else {
-    const uint8_t* src_p = source->data() + sy * source->row_bytes + sx * source->pixel_bytes;
-    uint8_t* dst_p = gr_draw->data() + dy * gr_draw->row_bytes + dx * gr_draw->pixel_bytes;
+  MarkDirty(dx, dy, dx + w, dy + h);
+  const uint8_t* src_p = source->data() + sy * source->row_bytes + sx * source->pixel_bytes;
+  for (int y = dy; y < dy + h; ++y, src_p += source->row_bytes) {
+    int x1 = dx;
+    int x2 = dx + w;
+    if (!clip_row(y, &x1, &x2)) continue;
+    memcpy(gr_draw->data() + y * gr_draw->row_bytes + x1 * gr_draw->pixel_bytes,
+           src_p + (x1 - dx) * source->pixel_bytes, (x2 - x1) * source->pixel_bytes);
+    pixels_drawn += x2 - x1;
+  }
+}
 
-    for (int i = 0; i < h; ++i) {
-      memcpy(dst_p, src_p, w * source->pixel_bytes);
-      src_p += source->row_bytes;
-      dst_p += gr_draw->row_bytes;
-    }
+void gr_set_clip_spans(std::vector<GRSpan> spans) {
+  clip_spans = std::move(spans);
+}
+
+std::vector<GRSpan> gr_round_clip_spans(int width, int height) {
+  std::vector<GRSpan> spans;
+  double rx = width / 2.0;
+  double ry = height / 2.0;
+  for (int y = 0; y < height; ++y) {
+    // The widest part of a row is the edge nearer to the center, or the center itself.
+    double dy = std::max({ 0.0, y - ry, ry - (y + 1) }) / ry;
+    double half_width = rx * std::sqrt(1 - dy * dy);
+    spans.push_back({ std::max(0, static_cast<int>(std::floor(rx - half_width))),
+                      std::min(width, static_cast<int>(std::ceil(rx + half_width))) });
   }
+  return spans;
+}
+
+uint64_t gr_pixels_drawn() {
+  return pixels_drawn;
+}
+
+uint64_t gr_pixels_rotated() {
+  return pixels_rotated;
 }
 
 unsigned int gr_get_width(const GRSurface* surface) {
@@ -382,8 +430,114 @@ int gr_init_font(const char* name, GRFont** dest) {
   return 0;
 }
 
+bool gr_scroll(int y1, int y2, int dy) {
+  y1 += overscan_offset_y;
+  y2 += overscan_offset_y;
+  if (y1 < 0 || y1 >= y2 || y2 > static_cast<int>(gr_draw->height)) return false;
+
+  int rows = y2 - y1 - abs(dy);
+  if (dy == 0 || rows <= 0) return true;
+
+  MarkDirty(0, y1, gr_draw->width, y2);
+  int src = dy > 0 ? y1 : y1 - dy;
+  uint8_t* data = gr_draw->data();
+  memmove(data + (src + dy) * gr_draw->row_bytes, data + src * gr_draw->row_bytes,
+          rows * gr_draw->row_bytes);
+  return true;
+}
+
+void gr_set_draw_target(GRSurface* surface) {
+  if (surface != nullptr && screen_target.draw == nullptr) {
+    screen_target = { gr_draw, overscan_offset_x, overscan_offset_y };
+    overscan_offset_x = 0;
+    overscan_offset_y = 0;
+  } else if (surface == nullptr && screen_target.draw != nullptr) {
+    surface = screen_target.draw;
+    overscan_offset_x = screen_target.overscan_offset_x;
+    overscan_offset_y = screen_target.overscan_offset_y;
+    screen_target.draw = nullptr;
+  }
+  if (surface != nullptr) {
+    gr_draw = surface;
+  }
+}
+
+// Copies the |width| x |height| block at (x, y) of the canvas into the backend's surface, rotated.
+static void RotateBlock(int x, int y, int width, int height) {
+  const GRSurface* canvas = rotated_canvas.get();
+  int canvas_row_pixels = canvas->row_bytes / canvas->pixel_bytes;
+  int row_pixels = backend_draw->row_bytes / backend_draw->pixel_bytes;
+  int last_x = backend_draw->width - 1;
+  int last_y = backend_draw->height - 1;
+  for (int j = y; j < y + height; ++j) {
+    const uint32_t* src = reinterpret_cast<const uint32_t*>(canvas->data()) +
+                          j * canvas_row_pixels + x;
+    // Where the canvas pixel (x, j) lands, and how far apart the next ones along the row land.
+    uint32_t* dst;
+    int step;
+    switch (rotation) {
+      case GRRotation::RIGHT:
+        dst = PixelAt(backend_draw, last_x - j, x, row_pixels);
+        step = row_pixels;
+        break;
+      case GRRotation::DOWN:
+        dst = PixelAt(backend_draw, last_x - x, last_y - j, row_pixels);
+        step = -1;
+        break;
+      case GRRotation::LEFT:
+        dst = PixelAt(backend_draw, j, last_y - x, row_pixels);
+        step = -row_pixels;
+        break;
+      default:
+        return;
+    }
+    for (int i = 0; i < width; ++i, dst += step) {
+      *dst = src[i];
+    }
+  }
+  pixels_rotated += width * height;
+}
+
+// Rotates the tiles of the canvas that changed since the backend's surface last got them.
+static void RotateCanvas() {
+  int width = rotated_canvas->width;
+  int height = rotated_canvas->height;
+  int tiles_x = (width + kRotateTileSize - 1) / kRotateTileSize;
+  int tiles_y = (height + kRotateTileSize - 1) / kRotateTileSize;
+  auto& stale = stale_tiles.try_emplace(backend_draw, tiles_x * tiles_y, true).first->second;
+  for (int ty = 0; ty < tiles_y; ++ty) {
+    for (int tx = 0; tx < tiles_x; ++tx) {
+      if (!stale[ty * tiles_x + tx]) continue;
+      int x = tx * kRotateTileSize;
+      int y = ty * kRotateTileSize;
+      RotateBlock(x, y, std::min(kRotateTileSize, width - x),
+                  std::min(kRotateTileSize, height - y));
+      stale[ty * tiles_x + tx] = false;
+    }
+  }
+}
+
 void gr_flip() {
-  gr_draw = gr_backend->Flip();
+  gr_set_draw_target(nullptr);
+  flipped_frames[gr_draw] = ++flip_count;
+  if (rotated_canvas) {
+    RotateCanvas();
+  }
+  backend_draw = gr_backend->Flip();
+  // The canvas keeps the frame just drawn, so the next one can start from it.
+  if (!rotated_canvas) {
+    gr_draw = backend_draw;
+  }
+}
+
+uint64_t gr_flip_count() {
+  return flip_count;
+}
+
+int gr_draw_buffer_age() {
+  auto it = flipped_frames.find(gr_draw);
+  if (it == flipped_frames.end()) return 0;
+  return flip_count - it->second + 1;
 }
 
 std::unique_ptr<MinuiBackend> create_backend(GraphicsBackend backend) {
@@ -392,6 +546,8 @@ std::unique_ptr<MinuiBackend> create_backend(GraphicsBackend backend) {
       return std::make_unique<MinuiBackendDrm>();
     case GraphicsBackend::FBDEV:
       return std::make_unique<MinuiBackendFbdev>();
+    case GraphicsBackend::MEMORY:
+      return std::make_unique<MinuiBackendMemory>();
     default:
       return nullptr;
   }
@@ -431,7 +587,7 @@ int gr_init(std::initializer_list<GraphicsBackend> backends) {
       printf("gr_init: minui_backend %d is a nullptr\n", backend);
       continue;
     }
-    gr_draw = minui_backend->Init();
+    gr_draw = backend_draw = minui_backend->Init();
     if (gr_draw) break;
   }
 
@@ -472,23 +628,42 @@ int gr_init(std::initializer_list<GraphicsBackend> backends) {
 }
 
 void gr_exit() {
+  gr_set_draw_target(nullptr);
   delete gr_backend;
   gr_backend = nullptr;
+  flipped_frames.clear();
+  clip_spans.clear();
+  rotated_canvas.reset();
+  stale_tiles.clear();
+  rotation = GRRotation::NONE;
+  gr_draw = backend_draw = nullptr;
 
   delete gr_font;
   gr_font = nullptr;
 }
 
+// Returns the size of the screen, even while drawing offscreen.
+static void GetScreenSize(int* width, int* height) {
+  bool offscreen = screen_target.draw != nullptr;
+  *width = backend_draw->width -
+           2 * (offscreen ? screen_target.overscan_offset_x : overscan_offset_x);
+  *height = backend_draw->height -
+            2 * (offscreen ? screen_target.overscan_offset_y : overscan_offset_y);
+  if (rotation == GRRotation::LEFT || rotation == GRRotation::RIGHT) {
+    std::swap(*width, *height);
+  }
+}
+
 int gr_fb_width() {
-  return (rotation == GRRotation::LEFT || rotation == GRRotation::RIGHT)
-             ? gr_draw->height - 2 * overscan_offset_y
-             : gr_draw->width - 2 * overscan_offset_x;
+  int width, height;
+  GetScreenSize(&width, &height);
+  return width;
 }
 
 int gr_fb_height() {
-  return (rotation == GRRotation::LEFT || rotation == GRRotation::RIGHT)
-             ? gr_draw->width - 2 * overscan_offset_x
-             : gr_draw->height - 2 * overscan_offset_y;
+  int width, height;
+  GetScreenSize(&width, &height);
+  return height;
 }
 
 void gr_fb_blank(bool blank) {
@@ -501,6 +676,24 @@ void gr_fb_blank(bool blank, int index) {
 
 void gr_rotate(GRRotation rot) {
   rotation = rot;
+  rotated_canvas.reset();
+  stale_tiles.clear();
+  if (rotation != GRRotation::NONE && backend_draw != nullptr) {
+    bool swapped = (rotation == GRRotation::LEFT || rotation == GRRotation::RIGHT);
+    size_t width = swapped ? backend_draw->height : backend_draw->width;
+    size_t height = swapped ? backend_draw->width : backend_draw->height;
+    rotated_canvas = GRSurface::Create(width, height, width * 4, 4);
+    if (!rotated_canvas) {
+      printf("gr_rotate: failed to allocate %zu x %zu canvas, not rotating\n", width, height);
+      rotation = GRRotation::NONE;
+    } else {
+      memset(rotated_canvas->data(), 0, rotated_canvas->data_size());
+    }
+  }
+  GRSurface* screen = rotated_canvas ? rotated_canvas.get() : backend_draw;
+  (screen_target.draw != nullptr ? screen_target.draw : gr_draw) = screen;
+  // Whatever the surfaces hold was laid out for the old rotation.
+  flipped_frames.clear();
 }
 
 bool gr_has_multiple_connectors() {
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "graphics_memory.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "minui/minui.h"
+
+// The frame last flipped by the active memory backend (there is at most one, owned by minui).
+static const GRSurface* displayed_frame = nullptr;
+
+MinuiBackendMemory::MinuiBackendMemory(size_t width, size_t height)
+    : width_(width), height_(height) {}
+
+MinuiBackendMemory::~MinuiBackendMemory() {
+  if (displayed_frame == framebuffer_[0].get() || displayed_frame == framebuffer_[1].get()) {
+    displayed_frame = nullptr;
+  }
+}
+
+GRSurface* MinuiBackendMemory::Init() {
+  for (auto& framebuffer : framebuffer_) {
+    framebuffer = GRSurface::Create(width_, height_, width_ * 4, 4);
+    if (!framebuffer) {
+      fprintf(stderr, "Failed to allocate %zu x %zu memory framebuffer\n", width_, height_);
+      return nullptr;
+    }
+    memset(framebuffer->data(), 0, framebuffer->data_size());
+  }
+
+  draw_index_ = 0;
+  printf("memory framebuffer: %zu x %zu\n", width_, height_);
+  return framebuffer_[draw_index_].get();
+}
+
+GRSurface* MinuiBackendMemory::Flip() {
+  displayed_frame = framebuffer_[draw_index_].get();
+  draw_index_ = 1 - draw_index_;
+  return framebuffer_[draw_index_].get();
+}
+
+const GRSurface* MinuiBackendMemory::DisplayedFrame() {
+  return displayed_frame;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "graphics.h"
+#include "minui/minui.h"
+
+// A backend that draws into plain memory and never touches a display. It behaves like a
+// double-buffered framebuffer, which allows exercising (and timing) the drawing code in tests
+// without a graphics device. Select it with gr_init({ GraphicsBackend::MEMORY }).
+class MinuiBackendMemory : public MinuiBackend {
+ public:
+  static constexpr size_t kDefaultWidth = 720;
+  static constexpr size_t kDefaultHeight = 1280;
+
+  MinuiBackendMemory(size_t width = kDefaultWidth, size_t height = kDefaultHeight);
+  ~MinuiBackendMemory() override;
+
+  GRSurface* Init() override;
+  GRSurface* Flip() override;
+  void Blank(bool) override {}
+  void Blank(bool, DrmConnector) override {}
+  bool HasMultipleConnectors() override {
+    return false;
+  }
+
+  // Returns the frame that was made visible by the most recent Flip() of the active memory
+  // backend, or nullptr if there's none. Meant for tests to inspect what ends up on "screen".
+  static const GRSurface* DisplayedFrame();
+
+ private:
+  const size_t width_;
+  const size_t height_;
+
+  std::unique_ptr<GRSurface> framebuffer_[2];
+  // Index of the buffer being drawn into; the other one is on display.
+  size_t draw_index_{ 0 };
+};
@@ -109,6 +109,8 @@ enum class GraphicsBackend : int {
   UNKNOWN = 0,
   DRM = 1,
   FBDEV = 2,
+  // Draws into memory only, for tests that don't have (or want) a display.
+  MEMORY = 3,
 };
 
 // Initializes the default graphics backend and loads font file. Returns 0 on success, or -1 on
@@ -127,14 +129,53 @@ int gr_fb_width();
 int gr_fb_height();
 
 void gr_flip();
+// Returns the number of gr_flip() calls so far.
+uint64_t gr_flip_count();
+// Returns how many frames old the contents of the current draw surface are: 1 if it still holds
+// the frame on screen (e.g. single buffering), 2 if it holds the one flipped before that (double
+// buffering), and so on. Returns 0 if the contents are unknown (e.g. after gr_rotate()). Callers
+// that only redraw what changed must repair the changes of that many frames.
+int gr_draw_buffer_age();
 void gr_fb_blank(bool blank);
 void gr_fb_blank(bool blank, int index);
 bool gr_has_multiple_connectors();
 
-// Clears entire surface to current color.
+// Redirects the drawing functions to |surface| (e.g. to render something once and then gr_blit()
+// it to several places), or back to the screen if nullptr. Neither rotation nor overscan applies to
+// the surface, which must have 4-byte pixels, and gr_fb_width/height() keep returning the screen
+// size. gr_flip() goes back to the screen.
+void gr_set_draw_target(GRSurface* surface);
+
+// A horizontal run of pixels [x1, x2) on one row of the screen.
+struct GRSpan {
+  int x1;
+  int x2;
+};
+
+// Restricts drawing on the screen to one span per row, e.g. to skip the corners that a round
+// display never shows. |spans| is indexed by row, in the coordinates of gr_fb_width/height();
+// rows past its end, and empty spans, are not drawn at all. gr_clear(), gr_fill(), gr_blit(),
+// gr_text() and gr_texticon() leave the pixels outside the spans untouched, so whatever was there
+// before stays. Drawing offscreen (see gr_set_draw_target()) is not clipped. An empty vector
+// removes the mask.
+void gr_set_clip_spans(std::vector<GRSpan> spans);
+// Returns the spans of the ellipse inscribed in a |width| x |height| screen (i.e. the circle of a
+// round display). Pixels the outline passes through are kept.
+std::vector<GRSpan> gr_round_clip_spans(int width, int height);
+// Returns the number of pixels written by the drawing functions so far.
+uint64_t gr_pixels_drawn();
+// Returns the number of pixels gr_flip() has copied into the backend while the screen is rotated.
+uint64_t gr_pixels_rotated();
+
+// Clears entire surface (within the clip spans, if any) to current color.
 void gr_clear();
 void gr_color(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
 void gr_fill(int x1, int y1, int x2, int y2);
+// Moves the full-width pixel rows [y1, y2) of the draw surface by |dy| rows (negative for up),
+// e.g. to scroll a list without redrawing it. Rows that move out of [y1, y2) are dropped, and the
+// ones uncovered keep their old contents. Returns false if the range is invalid, in which case
+// nothing is moved.
+bool gr_scroll(int y1, int y2, int dy);
 
 void gr_texticon(int x, int y, const GRSurface* icon);
 
@@ -150,7 +191,9 @@ void gr_blit(const GRSurface* source, int sx, int sy, int w, int h, int dx, int
 unsigned int gr_get_width(const GRSurface* surface);
 unsigned int gr_get_height(const GRSurface* surface);
 
-// Sets rotation, flips gr_fb_width/height if 90 degree rotation difference
+// Sets rotation, flips gr_fb_width/height if 90 degree rotation difference. While rotated, drawing
+// goes into an unrotated canvas of the gr_fb_width/height() size, and gr_flip() copies the parts
+// that changed to the screen, rotated.
 void gr_rotate(GRRotation rotation);
 
 // Returns the current PixelFormat being used.
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "otautil/async_logger.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <android-base/stringprintf.h>
+
+// Whether the current thread is inside the sink. A sink that logs itself gets its messages handed
+// over right away, as waiting for the queue would deadlock.
+static thread_local bool in_sink = false;
+
+static size_t RoundUpToPowerOf2(size_t n) {
+  size_t result = 1;
+  while (result < n) {
+    result <<= 1;
+  }
+  return result;
+}
+
+AsyncLogger::AsyncLogger(android::base::LogFunction sink, const Options& options)
+    : sink_(std::move(sink)),
+      options_(options),
+      mask_(RoundUpToPowerOf2(std::max<size_t>(options.capacity, 2)) - 1),
+      slots_(new Slot[mask_ + 1]),
+      messages_(new char[(mask_ + 1) * options.max_message_size]) {
+  for (size_t i = 0; i <= mask_; i++) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  thread_ = std::thread(&AsyncLogger::DrainLoop, this);
+}
+
+AsyncLogger::~AsyncLogger() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+    cv_.notify_one();
+  }
+  thread_.join();
+}
+
+void AsyncLogger::Log(android::base::LogId id, android::base::LogSeverity severity,
+                      const char* tag, const char* file, unsigned int line, const char* message) {
+  size_t length = strlen(message);
+  if (in_sink || detached_.load(std::memory_order_relaxed) ||
+      severity >= std::min(options_.sync_severity, android::base::FATAL) ||
+      length >= options_.max_message_size) {
+    LogSynchronously(id, severity, tag, file, line, message);
+    return;
+  }
+
+  // Claims a slot, as in Dmitry Vyukov's bounded MPMC queue. The slot's sequence equals the
+  // position while it's free for that position, and position + 1 once the message is published.
+  size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+  Slot* slot;
+  while (true) {
+    slot = &slots_[pos & mask_];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The buffer is full. Wait for the drain thread to make room.
+      full_waits_.fetch_add(1, std::memory_order_relaxed);
+      std::this_thread::yield();
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    } else {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->id = id;
+  slot->severity = severity;
+  slot->file = file;
+  slot->line = line;
+  slot->time = std::chrono::steady_clock::now();
+  strncpy(slot->tag, tag != nullptr ? tag : "", sizeof(slot->tag) - 1);
+  slot->tag[sizeof(slot->tag) - 1] = '\0';
+  memcpy(&messages_[(pos & mask_) * options_.max_message_size], message, length + 1);
+  slot->sequence.store(pos + 1, std::memory_order_release);
+
+  // Pairs with the fence in DrainLoop(): either the drain thread sees the message before going to
+  // sleep, or we see it asleep.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping_.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wakeup_ = true;
+    cv_.notify_one();
+  }
+}
+
+void AsyncLogger::Flush() {
+  if (in_sink || detached_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  size_t target = enqueue_pos_.load(std::memory_order_acquire);
+  std::unique_lock<std::mutex> lock(mutex_);
+  flush_pending_ = true;
+  wakeup_ = true;
+  cv_.notify_one();
+  // Stopping drains everything too.
+  flushed_cv_.wait(lock, [this, target] { return flushed_ >= target && !flush_pending_; });
+}
+
+void AsyncLogger::DetachAfterFork() {
+  detached_.store(true, std::memory_order_relaxed);
+}
+
+AsyncLogger::Stats AsyncLogger::stats() const {
+  return Stats{
+    delivered_.load(std::memory_order_relaxed),
+    synchronous_.load(std::memory_order_relaxed),
+    suppressed_.load(std::memory_order_relaxed),
+    full_waits_.load(std::memory_order_relaxed),
+  };
+}
+
+void AsyncLogger::Deliver(android::base::LogId id, android::base::LogSeverity severity,
+                          const char* tag, const char* file, unsigned int line,
+                          const char* message) {
+  in_sink = true;
+  sink_(id, severity, tag, file, line, message);
+  in_sink = false;
+  delivered_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AsyncLogger::LogSynchronously(android::base::LogId id, android::base::LogSeverity severity,
+                                   const char* tag, const char* file, unsigned int line,
+                                   const char* message) {
+  synchronous_.fetch_add(1, std::memory_order_relaxed);
+  if (in_sink) {
+    sink_(id, severity, tag, file, line, message);
+    delivered_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  // The messages logged earlier go first. A child after fork(2) may have inherited the lock held,
+  // so it goes straight to the sink.
+  Flush();
+  if (detached_.load(std::memory_order_relaxed)) {
+    Deliver(id, severity, tag, file, line, message);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(sink_mutex_);
+  Deliver(id, severity, tag, file, line, message);
+}
+
+bool AsyncLogger::Available() const {
+  return slots_[dequeue_pos_ & mask_].sequence.load(std::memory_order_acquire) ==
+         dequeue_pos_ + 1;
+}
+
+void AsyncLogger::Process(const Slot& slot, const char* message) {
+  if (has_last_ && slot.severity == last_severity_ && last_tag_ == slot.tag &&
+      last_message_ == message && slot.time - last_time_ < options_.repeat_window) {
+    if (++repeats_ > options_.max_repeats) {
+      pending_suppressed_++;
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  } else {
+    EmitRepeats();
+    has_last_ = true;
+    last_id_ = slot.id;
+    last_severity_ = slot.severity;
+    last_tag_ = slot.tag;
+    last_file_ = slot.file;
+    last_line_ = slot.line;
+    last_message_ = message;
+    last_time_ = slot.time;
+    repeats_ = 0;
+  }
+  std::lock_guard<std::mutex> lock(sink_mutex_);
+  Deliver(slot.id, slot.severity, slot.tag, slot.file, slot.line, message);
+}
+
+void AsyncLogger::EmitRepeats() {
+  if (pending_suppressed_ == 0) {
+    return;
+  }
+  std::string summary = android::base::StringPrintf("(last message repeated %zu more times)",
+                                                    pending_suppressed_);
+  pending_suppressed_ = 0;
+  std::lock_guard<std::mutex> lock(sink_mutex_);
+  Deliver(last_id_, last_severity_, last_tag_.c_str(), last_file_, last_line_, summary.c_str());
+}
+
+void AsyncLogger::DrainLoop() {
+  while (true) {
+    while (Available()) {
+      const Slot& slot = slots_[dequeue_pos_ & mask_];
+      Process(slot, &messages_[(dequeue_pos_ & mask_) * options_.max_message_size]);
+      slots_[dequeue_pos_ & mask_].sequence.store(dequeue_pos_ + mask_ + 1,
+                                                  std::memory_order_release);
+      dequeue_pos_++;
+    }
+
+    bool flush;
+    bool stop;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      flush = flush_pending_;
+      stop = stop_;
+    }
+    if (flush || stop ||
+        std::chrono::steady_clock::now() - last_time_ >= options_.repeat_window) {
+      EmitRepeats();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    flushed_ = dequeue_pos_;
+    if (flush) {
+      flush_pending_ = false;
+    }
+    flushed_cv_.notify_all();
+    if (stop_ && !Available()) {
+      return;
+    }
+    if (wakeup_ || flush_pending_) {
+      wakeup_ = false;
+      continue;
+    }
+
+    sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!Available()) {
+      // Wakes up once the repeats being suppressed are due for a summary, if any.
+      auto awake = [this] { return wakeup_ || stop_; };
+      if (pending_suppressed_ > 0) {
+        cv_.wait_until(lock, last_time_ + options_.repeat_window, awake);
+      } else {
+        cv_.wait(lock, awake);
+      }
+    }
+    wakeup_ = false;
+    sleeping_.store(false, std::memory_order_relaxed);
+  }
+}
+
+static AsyncLogger* async_logger = nullptr;
+
+android::base::LogFunction StartAsyncLogging(android::base::LogFunction sink,
+                                             const AsyncLogger::Options& options) {
+  CHECK(async_logger == nullptr);
+  // Never destroyed, as messages may be logged until the very end.
+  async_logger = new AsyncLogger(std::move(sink), options);
+  atexit(FlushAsyncLogging);
+  pthread_atfork(nullptr, nullptr, [] { async_logger->DetachAfterFork(); });
+  return [](android::base::LogId id, android::base::LogSeverity severity, const char* tag,
+            const char* file, unsigned int line, const char* message) {
+    async_logger->Log(id, severity, tag, file, line, message);
+  };
+}
+
+void FlushAsyncLogging() {
+  if (async_logger != nullptr) {
+    async_logger->Flush();
+  }
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <android-base/logging.h>
+
+// A logging backend that queues the messages in a lock-free ring buffer, and hands them to the
+// actual LogFunction (e.g. a write to /dev/kmsg and to the console) on a background thread. Callers
+// on hot paths then don't wait for slow consoles or a busy kmsg.
+//
+// Messages are delivered in the order they were logged. Messages at or above
+// |Options::sync_severity|, and ones longer than |Options::max_message_size|, are handed over
+// synchronously after the queue has been drained, so that nothing logged before an error or a
+// crash gets lost. When the buffer is full, loggers wait for room rather than dropping messages.
+class AsyncLogger {
+ public:
+  struct Options {
+    // The number of messages the buffer holds. Rounded up to a power of 2.
+    size_t capacity{ 1024 };
+    size_t max_message_size{ 512 };
+    android::base::LogSeverity sync_severity{ android::base::ERROR };
+    // A message repeated (with the same severity and tag) more than |max_repeats| times in a row
+    // within |repeat_window| gets suppressed, and then summarized in one line.
+    size_t max_repeats{ 3 };
+    std::chrono::milliseconds repeat_window{ 1000 };
+  };
+
+  struct Stats {
+    size_t delivered;    // Messages handed to the sink, including the synchronous ones.
+    size_t synchronous;  // Messages handed to the sink on the logging thread.
+    size_t suppressed;   // Repeated messages left out.
+    size_t full_waits;   // Times a logger waited for room in the buffer.
+  };
+
+  explicit AsyncLogger(android::base::LogFunction sink)
+      : AsyncLogger(std::move(sink), Options()) {}
+  AsyncLogger(android::base::LogFunction sink, const Options& options);
+  // Delivers all the queued messages, and stops the drain thread.
+  ~AsyncLogger();
+
+  AsyncLogger(const AsyncLogger&) = delete;
+  AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+  // Has the same signature as android::base::LogFunction. The strings are copied, except |file|,
+  // which is expected to be a string literal (i.e. __FILE__).
+  void Log(android::base::LogId id, android::base::LogSeverity severity, const char* tag,
+           const char* file, unsigned int line, const char* message);
+
+  // Waits until everything logged so far has been handed to the sink, including the summary of
+  // any suppressed repeats.
+  void Flush();
+
+  // Makes all later messages go to the sink synchronously. To be called in the child after fork(2),
+  // which doesn't inherit the drain thread.
+  void DetachAfterFork();
+
+  Stats stats() const;
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    android::base::LogId id;
+    android::base::LogSeverity severity;
+    const char* file;
+    unsigned int line;
+    std::chrono::steady_clock::time_point time;
+    char tag[32];
+  };
+
+  void Deliver(android::base::LogId id, android::base::LogSeverity severity, const char* tag,
+               const char* file, unsigned int line, const char* message);
+  void LogSynchronously(android::base::LogId id, android::base::LogSeverity severity,
+                        const char* tag, const char* file, unsigned int line, const char* message);
+  void DrainLoop();
+  // Returns whether the next slot has been published. Drain thread only.
+  bool Available() const;
+  // Hands over one queued message, or leaves it out if it's a repeat. Drain thread only.
+  void Process(const Slot& slot, const char* message);
+  // Logs the summary of the suppressed repeats, if any. Drain thread only.
+  void EmitRepeats();
+
+  const android::base::LogFunction sink_;
+  const Options options_;
+  const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+  std::unique_ptr<char[]> messages_;
+
+  // The next position to claim for producers, and to drain for the consumer.
+  std::atomic<size_t> enqueue_pos_{ 0 };
+  size_t dequeue_pos_{ 0 };
+
+  // Serializes the synchronous deliveries with the drain thread.
+  std::mutex sink_mutex_;
+
+  // Wakes the drain thread up when it's asleep, and reports the progress to Flush().
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable flushed_cv_;
+  std::atomic<bool> sleeping_{ false };
+  bool wakeup_{ false };
+  bool flush_pending_{ false };
+  bool stop_{ false };
+  size_t flushed_{ 0 };
+
+  std::atomic<bool> detached_{ false };
+
+  // The run of identical messages being rate-limited. Drain thread only.
+  bool has_last_{ false };
+  android::base::LogId last_id_;
+  android::base::LogSeverity last_severity_;
+  std::string last_tag_;
+  const char* last_file_;
+  unsigned int last_line_;
+  std::string last_message_;
+  std::chrono::steady_clock::time_point last_time_;
+  size_t repeats_{ 0 };
+  size_t pending_suppressed_{ 0 };
+
+  std::atomic<size_t> delivered_{ 0 };
+  std::atomic<size_t> synchronous_{ 0 };
+  std::atomic<size_t> suppressed_{ 0 };
+  std::atomic<size_t> full_waits_{ 0 };
+
+  std::thread thread_;
+};
+
+// Starts the process-wide AsyncLogger over |sink|, and returns the LogFunction to pass to
+// android::base::InitLogging(). The logger is flushed at exit, and logs synchronously in forked
+// children.
+android::base::LogFunction StartAsyncLogging(android::base::LogFunction sink,
+                                             const AsyncLogger::Options& options = {});
+
+// Flushes the process-wide AsyncLogger, if any, e.g. before rebooting.
+void FlushAsyncLogging();
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+// The large allocations of the updater process that are sized against the memory budget.
+enum class MemoryConsumer {
+  // The command buffer in blockimg.cpp, kept across the transfer list commands.
+  kTransferBuffer,
+  // The window used to hash blocks that only need to be verified.
+  kVerifyWindow,
+  // The pages of the mapped package that hold the patch data.
+  kPatchData,
+  kCount,
+};
+
+// A singleton that hands out a share of the available memory to each of the large consumers in the
+// updater. The available memory is read once at start. When the system comes under memory pressure
+// (PSI "some" stall above a threshold, or MemAvailable dropping below half of the initial figure),
+// the governor switches to a degraded mode with smaller budgets, so the consumers keep less in
+// memory and release what they can back to the kernel.
+class MemoryBudget {
+ public:
+  static MemoryBudget& Get();
+
+  MemoryBudget(std::string meminfo_path, std::string psi_path);
+
+  // Sets the limit from MemAvailable in /proc/meminfo. No-op if a limit has been set already.
+  void Init();
+
+  // Total memory in bytes to share among the consumers. 0 means unlimited.
+  size_t limit() const;
+  // Overrides the limit, e.g. to run the updater under an artificial limit in tests.
+  void set_limit(size_t limit);
+
+  // Returns the number of bytes the given consumer may keep in memory. The result is never smaller
+  // than kMinBudget, and is SIZE_MAX if there's no limit.
+  size_t Budget(MemoryConsumer consumer);
+
+  // Returns whether the system is under memory pressure. The pressure is sampled at most once per
+  // kPressureCheckInterval.
+  bool degraded();
+
+  // Records the number of bytes currently held by the given consumer.
+  void SetUsage(MemoryConsumer consumer, size_t bytes);
+  // The total bytes held by all consumers, now and at the peak.
+  size_t usage() const;
+  size_t peak_usage() const;
+
+  static constexpr size_t kMinBudget = 64 * 1024;
+  static constexpr std::chrono::milliseconds kPressureCheckInterval{ 1000 };
+  // The avg10 value of the PSI "some" line, in percent, above which the system is under pressure.
+  static constexpr double kPressureStallThreshold = 10.0;
+
+ private:
+  // Reads MemAvailable in bytes; returns 0 on failure.
+  size_t ReadMemAvailable() const;
+  bool CheckPressure() const;
+
+  const std::string meminfo_path_;
+  const std::string psi_path_;
+
+  mutable std::mutex mutex_;
+  size_t limit_{ 0 };
+  size_t initial_available_{ 0 };
+  bool degraded_{ false };
+  std::chrono::steady_clock::time_point last_check_;
+  bool checked_{ false };
+  size_t usage_[static_cast<size_t>(MemoryConsumer::kCount)]{};
+  size_t peak_usage_{ 0 };
+};
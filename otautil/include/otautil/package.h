@@ -53,10 +53,56 @@ class Package : public VerifierInterface {
   // Opens the package as a zip file and returns the ZipArchiveHandle.
   virtual ZipArchiveHandle GetZipArchiveHandle() = 0;
 
+  // Looks up the zip entry |name|. The first call indexes all the entries with a single pass over
+  // the central directory; later ones are answered from the index. Returns false if there's no such
+  // entry.
+  bool LookupEntry(const std::string& name, ZipEntry64* entry);
+
+  // Returns the contents of the small zip entry |name| (e.g. the metadata or the payload
+  // properties), extracting it on the first call only. Returns nullptr if the entry doesn't exist,
+  // is larger than kMaxCachedEntrySize, or fails to extract. The pointer stays valid for the
+  // lifetime of the package.
+  const std::string* ReadCachedEntry(const std::string& name);
+
+  // Same as ReadCachedEntry(), but parses each line of the entry in the format "key=value". Both
+  // keys and values are trimmed, and lines without '=' are skipped.
+  const std::map<std::string, std::string>* ReadCachedProperties(const std::string& name);
+
+  // Parses |content| the same way as ReadCachedProperties(), for callers that read the entry on
+  // their own.
+  static std::map<std::string, std::string> ParseProperties(const std::string& content);
+
+  // Counters for the calls above, to tell how much work the cache saves.
+  struct EntryCacheStats {
+    size_t lookups{ 0 };      // LookupEntry() calls, including the ones made for reads.
+    size_t scans{ 0 };        // Passes over the central directory.
+    size_t reads{ 0 };        // ReadCachedEntry() and ReadCachedProperties() calls.
+    size_t extractions{ 0 };  // Entries actually extracted from the zip.
+  };
+
+  const EntryCacheStats& GetEntryCacheStats() const {
+    return entry_cache_stats_;
+  }
+
   // Updates the progress in fraction during package verification.
   void SetProgress(float progress) override;
 
+  // Entries above this size aren't cached by ReadCachedEntry().
+  static constexpr uint64_t kMaxCachedEntrySize = 1024 * 1024;
+
  protected:
   // An optional function to update the progress.
   std::function<void(float)> set_progress_;
+
+ private:
+  // Indexes the zip entries if it hasn't been done yet. Returns false on failure.
+  bool IndexEntries();
+
+  bool entries_indexed_{ false };
+  // All the entries in the package, keyed by name.
+  std::map<std::string, ZipEntry64> entries_;
+  // The contents of the entries read via ReadCachedEntry(), and their parsed forms.
+  std::map<std::string, std::string> entry_contents_;
+  std::map<std::string, std::map<std::string, std::string>> entry_properties_;
+  EntryCacheStats entry_cache_stats_;
 };
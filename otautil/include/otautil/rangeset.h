@@ -64,6 +64,24 @@ class RangeSet {
   // equal to groups. The current RangeSet remains intact after the split.
   std::vector<RangeSet> Split(size_t groups) const;
 
+  // Returns the same blocks as a normalized RangeSet, i.e. sorted by the start block, with
+  // overlapping and adjacent ranges merged. For example, "6,10,15,0,5,5,8" gives "4,0,8,10,15".
+  RangeSet Normalized() const;
+
+  // Set operations, which return normalized RangeSets. They take O(n + m) time on RangeSets whose
+  // ranges are sorted by the start block (e.g. SortedRangeSet, or the results of these), and sort
+  // a copy of the ranges first otherwise.
+  RangeSet Union(const RangeSet& other) const;
+  RangeSet Intersection(const RangeSet& other) const;
+  RangeSet Difference(const RangeSet& other) const;
+
+  // Returns the number of blocks in both the current RangeSet and |other|, without building their
+  // intersection. Blocks are counted once even if the ranges of either set overlap.
+  size_t OverlapBlocks(const RangeSet& other) const;
+
+  // Returns whether every block of |other| is in the current RangeSet.
+  bool Contains(const RangeSet& other) const;
+
   // Returns the number of Range's in this RangeSet.
   size_t size() const {
     return ranges_.size();
@@ -126,6 +144,9 @@ class RangeSet {
   }
 
  protected:
+  // Takes |ranges| that are normalized already.
+  static RangeSet FromNormalized(std::vector<Range>&& ranges);
+
   // Actual limit for each value and the total number are both INT_MAX.
   std::vector<Range> ranges_;
   size_t blocks_;
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+// A request issued by the storage benchmark.
+struct IoRequest {
+  enum class Type {
+    kRead,
+    kWrite,
+    // Flushes the writes issued so far. Waits for all the earlier requests to complete.
+    kSync,
+  };
+
+  Type type;
+  uint64_t offset;
+  size_t size;
+};
+
+// The storage under test.
+class StorageDevice {
+ public:
+  virtual ~StorageDevice() = default;
+
+  // The size of the scratch region in bytes. All requests fall within [0, size()).
+  virtual uint64_t size() const = 0;
+
+  // Issues |requests| in order, with up to |queue_depth| of them in flight, and sets |elapsed| to
+  // the time they took. Returns false if any of them fails.
+  virtual bool Run(const std::vector<IoRequest>& requests, size_t queue_depth,
+                   std::chrono::nanoseconds* elapsed) = 0;
+};
+
+// A scratch file on the filesystem under test (e.g. /cache). Reads and writes bypass the page
+// cache where the filesystem supports O_DIRECT.
+class FileStorageDevice : public StorageDevice {
+ public:
+  // Creates |path| with |size| bytes. Returns nullptr on failure.
+  static std::unique_ptr<FileStorageDevice> Create(const std::string& path, uint64_t size);
+
+  // Removes the scratch file.
+  ~FileStorageDevice() override;
+
+  uint64_t size() const override {
+    return size_;
+  }
+
+  bool Run(const std::vector<IoRequest>& requests, size_t queue_depth,
+           std::chrono::nanoseconds* elapsed) override;
+
+ private:
+  FileStorageDevice(std::string path, android::base::unique_fd fd, uint64_t size, bool direct)
+      : path_(std::move(path)), fd_(std::move(fd)), size_(size), direct_(direct) {}
+
+  bool Issue(const IoRequest& request, uint8_t* buffer);
+
+  std::string path_;
+  android::base::unique_fd fd_;
+  uint64_t size_;
+  bool direct_;
+};
+
+// The throughput of one access pattern.
+struct ThroughputSample {
+  bool write;
+  bool sequential;
+  size_t request_size;
+  size_t queue_depth;
+  double bytes_per_second;
+};
+
+struct StorageProfile {
+  std::vector<ThroughputSample> samples;
+  // Median latency of a 4 KiB write followed by fsync.
+  std::chrono::nanoseconds sync_latency{ 0 };
+
+  // Returns the best throughput measured for the given pattern, or 0 if none was measured.
+  double BestThroughput(bool write, bool sequential) const;
+};
+
+std::ostream& operator<<(std::ostream& os, const StorageProfile& profile);
+
+struct BenchmarkConfig {
+  // Request sizes for the sequential samples, and for the random ones.
+  std::vector<size_t> sequential_request_sizes{ 4096, 16384, 65536, 262144, 1048576 };
+  std::vector<size_t> random_request_sizes{ 4096, 65536 };
+  std::vector<size_t> queue_depths{ 1, 4 };
+  // Bytes transferred by each throughput sample.
+  size_t bytes_per_sample{ 512 * 1024 };
+  size_t sync_iterations{ 5 };
+  // The benchmark stops taking samples once the device time spent so far exceeds this.
+  std::chrono::milliseconds time_limit{ 1000 };
+};
+
+// Measures the given device. Samples that didn't fit in the time limit or failed are left out of
+// |profile|. Returns false if no sample could be taken at all.
+bool BenchmarkStorage(StorageDevice* device, const BenchmarkConfig& config,
+                      StorageProfile* profile);
+
+// The I/O parameters of the updater. The defaults are the values used without a benchmark.
+struct IoParameters {
+  // Read size when streaming a partition (e.g. to hash it).
+  size_t read_chunk_size{ 1024 * 1024 };
+  // Write size when filling blocks with zeroes.
+  size_t write_chunk_size{ 4096 };
+};
+
+std::ostream& operator<<(std::ostream& os, const IoParameters& parameters);
+
+// Picks the I/O parameters for the measured profile, keeping the defaults of anything that wasn't
+// measured. Request sizes are the smallest ones that reach 90% of the best sequential throughput.
+IoParameters ChooseIoParameters(const StorageProfile& profile);
+
+// A singleton holding the I/O parameters in use. They should be set at most once, at the start of
+// the install.
+class IoTuning {
+ public:
+  static IoTuning& Get();
+
+  const IoParameters& parameters() const {
+    return parameters_;
+  }
+  void set_parameters(const IoParameters& parameters) {
+    parameters_ = parameters;
+  }
+
+ private:
+  IoTuning() = default;
+
+  IoParameters parameters_;
+};
@@ -16,12 +16,18 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <sys/types.h>
 
+#include <functional>
+#include <limits>
+#include <list>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include <android-base/unique_fd.h>
+
 #include "rangeset.h"
 
 // This class holds the content of a block map file.
@@ -73,6 +79,19 @@ class BlockMapData {
   RangeSet block_ranges_;
 };
 
+// Limits on the address space that a mapped package may take.
+struct MappingLimits {
+  // The largest package that MemMapping maps as a whole. Defaults to a quarter of the address
+  // space, i.e. 1 GiB on 32-bit builds.
+  size_t max_flat_size{ std::numeric_limits<size_t>::max() / 4 };
+  // The most VMAs (i.e. separate mmap(2) regions) that a mapping may take, well below the default
+  // vm.max_map_count of 65530. Each range of a block map takes one.
+  size_t max_vmas{ 16384 };
+  // The size and the number of the windows of MappedWindows.
+  size_t window_size{ 64 * 1024 * 1024 };
+  size_t max_windows{ 4 };
+};
+
 /*
  * Use this to keep track of mapped segments.
  */
@@ -81,7 +100,9 @@ class MemMapping {
   ~MemMapping();
   // Map a file into a private, read-only memory segment. If 'filename' begins with an '@'
   // character, it is a map of blocks to be mapped, otherwise it is treated as an ordinary file.
-  bool MapFile(const std::string& filename);
+  // Fails without mapping anything if the file is larger than |limits.max_flat_size|, or would
+  // take more than |limits.max_vmas| VMAs; such a file can be read through MappedWindows instead.
+  bool MapFile(const std::string& filename, const MappingLimits& limits = {});
   size_t ranges() const {
     return ranges_.size();
   };
@@ -95,12 +116,92 @@ class MemMapping {
     size_t length;
   };
 
-  bool MapBlockFile(const std::string& filename);
-  bool MapFD(int fd);
+  bool MapBlockFile(const std::string& filename, const MappingLimits& limits);
+  bool MapFD(int fd, const MappingLimits& limits);
 
   std::vector<MappedRange> ranges_;
 };
 
+// Maps a file (a block map, or an ordinary file as with MemMapping) a window at a time, so that
+// packages too large for the address space, or too fragmented for the VMA budget, can still be
+// read. At most |limits.max_windows| windows of |limits.window_size| bytes stay mapped, taking at
+// most |limits.max_vmas| VMAs together; the least recently used ones get unmapped to make room.
+class MappedWindows {
+ public:
+  // Counters to tell how much the windows churn.
+  struct Stats {
+    size_t hits{ 0 };       // Accesses served by a window already mapped.
+    size_t maps{ 0 };       // Windows mapped.
+    size_t evictions{ 0 };  // Windows unmapped to make room for another.
+    size_t reads{ 0 };      // Windows read into memory, as mapping them would take too many VMAs.
+    size_t peak_vmas{ 0 };
+    size_t peak_mapped_bytes{ 0 };
+  };
+
+  MappedWindows() = default;
+  ~MappedWindows();
+
+  MappedWindows(const MappedWindows&) = delete;
+  MappedWindows& operator=(const MappedWindows&) = delete;
+
+  // Opens |filename|, which is a block map if it begins with '@'. Nothing is mapped until the
+  // first access.
+  bool Open(const std::string& filename, const MappingLimits& limits = {});
+
+  uint64_t length() const {
+    return length_;
+  }
+
+  // Returns a pointer to the |size| bytes at |offset|, mapping a window that covers them if
+  // needed. The pointer is only valid until the next call. Returns nullptr if the bytes are out of
+  // bounds or can't be mapped.
+  const uint8_t* Access(uint64_t offset, size_t size);
+
+  // Copies the |size| bytes at |offset| into |buffer|, which may span any number of windows.
+  bool ReadAt(uint8_t* buffer, size_t size, uint64_t offset);
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  struct Window {
+    uint64_t offset;  // Of the first byte in the file.
+    size_t length;
+    uint8_t* addr;
+    size_t mapped_length;  // |length| rounded up to whole pages (or blocks).
+    size_t vmas;
+  };
+
+  // Maps the window that starts at the aligned |offset| and covers at least |size| bytes. Returns
+  // nullptr on failure.
+  const Window* MapWindow(uint64_t offset, size_t size);
+  // Calls |fn| with the window offset, the device offset and the size of each piece of the block
+  // map that the blocks in [offset, offset + length) come in, in order. Stops and returns false
+  // as soon as |fn| does.
+  bool ForEachPiece(uint64_t offset, size_t length,
+                    const std::function<bool(size_t, off64_t, size_t)>& fn) const;
+  void Unmap(const Window& window);
+
+  MappingLimits limits_;
+  android::base::unique_fd fd_;
+  uint64_t length_{ 0 };
+  // The granularity of the windows: the page size, or the block size of a block map if larger.
+  size_t alignment_{ 0 };
+
+  // For block maps only: the block size, the block ranges in the order of the file, and the index
+  // of the first file block in each range.
+  uint32_t block_size_{ 0 };
+  std::vector<Range> block_ranges_;
+  std::vector<uint64_t> range_starts_;
+
+  // The mapped windows, the most recently used first.
+  std::list<Window> windows_;
+  size_t vmas_{ 0 };
+  size_t mapped_bytes_{ 0 };
+  Stats stats_;
+};
+
 // Reboots the device into the specified target, by additionally handling quiescent reboot mode.
 // All unknown targets reboot into Android.
 [[noreturn]] void Reboot(std::string_view target);
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "otautil/memory_budget.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+constexpr const char kDefaultMeminfoPath[] = "/proc/meminfo";
+constexpr const char kDefaultPsiPath[] = "/proc/pressure/memory";
+
+// Each consumer gets 1 / kBudgetShares[consumer] of the limit, and a quarter of that when degraded.
+static constexpr size_t kBudgetShares[] = {
+  4,   // kTransferBuffer
+  16,  // kVerifyWindow
+  8,   // kPatchData
+};
+static_assert(std::size(kBudgetShares) == static_cast<size_t>(MemoryConsumer::kCount));
+static constexpr size_t kDegradedDivisor = 4;
+
+MemoryBudget& MemoryBudget::Get() {
+  static MemoryBudget budget(kDefaultMeminfoPath, kDefaultPsiPath);
+  return budget;
+}
+
+MemoryBudget::MemoryBudget(std::string meminfo_path, std::string psi_path)
+    : meminfo_path_(std::move(meminfo_path)), psi_path_(std::move(psi_path)) {}
+
+void MemoryBudget::Init() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (limit_ != 0) {
+    return;
+  }
+  initial_available_ = ReadMemAvailable();
+  limit_ = initial_available_;
+  if (limit_ == 0) {
+    LOG(WARNING) << "Unknown available memory; memory budgets are unlimited";
+    return;
+  }
+  LOG(INFO) << "Memory budget: " << limit_ / 1024 << " KiB";
+}
+
+size_t MemoryBudget::limit() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return limit_;
+}
+
+void MemoryBudget::set_limit(size_t limit) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  limit_ = limit;
+}
+
+size_t MemoryBudget::Budget(MemoryConsumer consumer) {
+  bool under_pressure = degraded();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (limit_ == 0) {
+    return SIZE_MAX;
+  }
+  size_t budget = limit_ / kBudgetShares[static_cast<size_t>(consumer)];
+  if (under_pressure) {
+    budget /= kDegradedDivisor;
+  }
+  return std::max(budget, kMinBudget);
+}
+
+bool MemoryBudget::degraded() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  if (checked_ && now - last_check_ < kPressureCheckInterval) {
+    return degraded_;
+  }
+  checked_ = true;
+  last_check_ = now;
+
+  bool under_pressure = CheckPressure();
+  if (under_pressure != degraded_) {
+    LOG(WARNING) << (under_pressure ? "Entering" : "Leaving") << " degraded memory mode";
+    degraded_ = under_pressure;
+  }
+  return degraded_;
+}
+
+void MemoryBudget::SetUsage(MemoryConsumer consumer, size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  usage_[static_cast<size_t>(consumer)] = bytes;
+  size_t total = 0;
+  for (size_t usage : usage_) {
+    total += usage;
+  }
+  peak_usage_ = std::max(peak_usage_, total);
+}
+
+size_t MemoryBudget::usage() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t total = 0;
+  for (size_t usage : usage_) {
+    total += usage;
+  }
+  return total;
+}
+
+size_t MemoryBudget::peak_usage() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return peak_usage_;
+}
+
+size_t MemoryBudget::ReadMemAvailable() const {
+  std::string content;
+  if (!android::base::ReadFileToString(meminfo_path_, &content)) {
+    PLOG(WARNING) << "Failed to read " << meminfo_path_;
+    return 0;
+  }
+
+  // MemAvailable:    1234567 kB
+  for (std::string_view line : android::base::Split(content, "\n")) {
+    if (!android::base::ConsumePrefix(&line, "MemAvailable:")) {
+      continue;
+    }
+    std::string value = android::base::Trim(line);
+    uint64_t kib;
+    if (!android::base::ConsumeSuffix(&line, " kB") ||
+        !android::base::ParseUint(android::base::Trim(line), &kib)) {
+      LOG(WARNING) << "Failed to parse MemAvailable: " << value;
+      return 0;
+    }
+    return static_cast<size_t>(std::min<uint64_t>(kib * 1024, SIZE_MAX));
+  }
+  LOG(WARNING) << "No MemAvailable in " << meminfo_path_;
+  return 0;
+}
+
+bool MemoryBudget::CheckPressure() const {
+  // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+  std::string psi;
+  if (android::base::ReadFileToString(psi_path_, &psi)) {
+    double avg10;
+    if (sscanf(psi.c_str(), "some avg10=%lf", &avg10) == 1 && avg10 > kPressureStallThreshold) {
+      return true;
+    }
+  }
+
+  if (initial_available_ != 0) {
+    size_t available = ReadMemAvailable();
+    if (available != 0 && available < initial_available_ / 2) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -22,6 +22,7 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 
 #include "otautil/error_code.h"
@@ -83,6 +84,110 @@ void Package::SetProgress(float progress) {
   }
 }
 
+bool Package::IndexEntries() {
+  if (entries_indexed_) {
+    return true;
+  }
+
+  ZipArchiveHandle zip = GetZipArchiveHandle();
+  if (!zip) {
+    return false;
+  }
+
+  void* cookie;
+  if (auto err = StartIteration(zip, &cookie); err != 0) {
+    LOG(ERROR) << "Failed to iterate over entries in " << GetPath() << ": "
+               << ErrorCodeString(err);
+    return false;
+  }
+  std::unique_ptr<void, decltype(&EndIteration)> cookie_guard(cookie, &EndIteration);
+
+  entry_cache_stats_.scans++;
+  std::string name;
+  ZipEntry64 entry;
+  int32_t iter_status;
+  while ((iter_status = Next(cookie, &entry, &name)) == 0) {
+    entries_.emplace(name, entry);
+  }
+  if (iter_status != -1) {
+    LOG(ERROR) << "Error while iterating over entries in " << GetPath() << ": "
+               << ErrorCodeString(iter_status);
+    entries_.clear();
+    return false;
+  }
+
+  entries_indexed_ = true;
+  return true;
+}
+
+bool Package::LookupEntry(const std::string& name, ZipEntry64* entry) {
+  entry_cache_stats_.lookups++;
+  if (!IndexEntries()) {
+    return false;
+  }
+
+  auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    return false;
+  }
+  *entry = it->second;
+  return true;
+}
+
+const std::string* Package::ReadCachedEntry(const std::string& name) {
+  entry_cache_stats_.reads++;
+  if (auto it = entry_contents_.find(name); it != entry_contents_.end()) {
+    return &it->second;
+  }
+
+  ZipEntry64 entry;
+  if (!LookupEntry(name, &entry)) {
+    LOG(ERROR) << "Failed to find " << name;
+    return nullptr;
+  }
+  if (entry.uncompressed_length > kMaxCachedEntrySize) {
+    LOG(ERROR) << "Failed to extract " << name << " because its uncompressed size "
+               << entry.uncompressed_length << " exceeds " << kMaxCachedEntrySize;
+    return nullptr;
+  }
+
+  std::string content(entry.uncompressed_length, '\0');
+  entry_cache_stats_.extractions++;
+  if (auto err = ExtractToMemory(GetZipArchiveHandle(), &entry,
+                                 reinterpret_cast<uint8_t*>(content.data()), content.size());
+      err != 0) {
+    LOG(ERROR) << "Failed to extract " << name << ": " << ErrorCodeString(err);
+    return nullptr;
+  }
+  return &entry_contents_.emplace(name, std::move(content)).first->second;
+}
+
+const std::map<std::string, std::string>* Package::ReadCachedProperties(const std::string& name) {
+  if (auto it = entry_properties_.find(name); it != entry_properties_.end()) {
+    entry_cache_stats_.reads++;
+    return &it->second;
+  }
+
+  const std::string* content = ReadCachedEntry(name);
+  if (content == nullptr) {
+    return nullptr;
+  }
+
+  return &entry_properties_.emplace(name, ParseProperties(*content)).first->second;
+}
+
+std::map<std::string, std::string> Package::ParseProperties(const std::string& content) {
+  std::map<std::string, std::string> properties;
+  for (const auto& line : android::base::Split(content, "\n")) {
+    size_t eq = line.find('=');
+    if (eq != std::string::npos) {
+      properties.emplace(android::base::Trim(line.substr(0, eq)),
+                         android::base::Trim(line.substr(eq + 1)));
+    }
+  }
+  return properties;
+}
+
 class FilePackage : public Package {
  public:
   FilePackage(android::base::unique_fd&& fd, uint64_t file_size, const std::string& path,
@@ -170,18 +170,170 @@ size_t RangeSet::GetBlockNumber(size_t idx) const {
   return 0;  // Unreachable, but to make compiler happy.
 }
 
-// RangeSet has half-closed half-open bounds. For example, "3,5" contains blocks 3 and 4. So "3,5"
-// and "5,7" are not overlapped.
-bool RangeSet::Overlaps(const RangeSet& other) const {
-  for (const auto& [begin, end] : ranges_) {
-    for (const auto& [other_begin, other_end] : other.ranges_) {
-      // [begin, end) vs [other_begin, other_end)
-      if (!(other_begin >= end || begin >= other_end)) {
-        return true;
+// Returns |ranges| normalized, i.e. sorted by the start block with overlapping and adjacent ranges
+// merged. Returns |ranges| itself if it's normalized already, without copying it.
+static const std::vector<Range>& Normalize(const std::vector<Range>& ranges,
+                                           std::vector<Range>* storage) {
+  auto adjacent = std::adjacent_find(ranges.cbegin(), ranges.cend(),
+                                     [](const Range& a, const Range& b) {
+                                       return b.first <= a.second;
+                                     });
+  if (adjacent == ranges.cend()) {
+    return ranges;
+  }
+
+  *storage = ranges;
+  if (!std::is_sorted(storage->cbegin(), storage->cend())) {
+    std::sort(storage->begin(), storage->end());
+  }
+  auto out = storage->begin();
+  for (auto it = storage->begin() + 1; it != storage->end(); ++it) {
+    if (it->first <= out->second) {
+      out->second = std::max(out->second, it->second);
+    } else {
+      *++out = *it;
+    }
+  }
+  storage->erase(out + 1, storage->end());
+  return *storage;
+}
+
+// Calls |fn| with each maximal range of blocks that's in both |a| and |b|, in order, until it
+// returns false. Both need to be normalized.
+template <typename Fn>
+static void ForEachOverlap(const std::vector<Range>& a, const std::vector<Range>& b, Fn fn) {
+  auto it_a = a.cbegin();
+  auto it_b = b.cbegin();
+  while (it_a != a.cend() && it_b != b.cend()) {
+    size_t begin = std::max(it_a->first, it_b->first);
+    size_t end = std::min(it_a->second, it_b->second);
+    if (begin < end && !fn(Range{ begin, end })) {
+      return;
+    }
+    // Whichever ends first can't overlap anything further along the other.
+    if (it_a->second < it_b->second) {
+      ++it_a;
+    } else {
+      ++it_b;
+    }
+  }
+}
+
+RangeSet RangeSet::FromNormalized(std::vector<Range>&& ranges) {
+  RangeSet result;
+  result.ranges_ = std::move(ranges);
+  for (const auto& [begin, end] : result.ranges_) {
+    result.blocks_ += end - begin;
+  }
+  return result;
+}
+
+RangeSet RangeSet::Normalized() const {
+  std::vector<Range> storage;
+  const std::vector<Range>& ranges = Normalize(ranges_, &storage);
+  if (&ranges == &ranges_) {
+    return *this;
+  }
+  return FromNormalized(std::move(storage));
+}
+
+RangeSet RangeSet::Union(const RangeSet& other) const {
+  std::vector<Range> storage_a;
+  std::vector<Range> storage_b;
+  const std::vector<Range>& a = Normalize(ranges_, &storage_a);
+  const std::vector<Range>& b = Normalize(other.ranges_, &storage_b);
+
+  std::vector<Range> result;
+  result.reserve(a.size() + b.size());
+  auto it_a = a.cbegin();
+  auto it_b = b.cbegin();
+  while (it_a != a.cend() || it_b != b.cend()) {
+    // Take the range that starts first, and merge it into the last one if they touch.
+    const Range& next =
+        (it_b == b.cend() || (it_a != a.cend() && it_a->first < it_b->first)) ? *it_a++ : *it_b++;
+    if (!result.empty() && next.first <= result.back().second) {
+      result.back().second = std::max(result.back().second, next.second);
+    } else {
+      result.push_back(next);
+    }
+  }
+  return FromNormalized(std::move(result));
+}
+
+RangeSet RangeSet::Intersection(const RangeSet& other) const {
+  std::vector<Range> storage_a;
+  std::vector<Range> storage_b;
+  std::vector<Range> result;
+  ForEachOverlap(Normalize(ranges_, &storage_a), Normalize(other.ranges_, &storage_b),
+                 [&result](const Range& range) {
+                   result.push_back(range);
+                   return true;
+                 });
+  return FromNormalized(std::move(result));
+}
+
+RangeSet RangeSet::Difference(const RangeSet& other) const {
+  std::vector<Range> storage_a;
+  std::vector<Range> storage_b;
+  const std::vector<Range>& a = Normalize(ranges_, &storage_a);
+  const std::vector<Range>& b = Normalize(other.ranges_, &storage_b);
+
+  std::vector<Range> result;
+  auto it_b = b.cbegin();
+  for (const auto& [begin, end] : a) {
+    // Skip the ranges that end before this one starts; they can't cut the later ones either.
+    while (it_b != b.cend() && it_b->second <= begin) {
+      ++it_b;
+    }
+    size_t current = begin;
+    for (; it_b != b.cend() && it_b->first < end; ++it_b) {
+      if (it_b->first > current) {
+        result.emplace_back(current, it_b->first);
       }
+      current = it_b->second;
+      // This one may cut the next range too.
+      if (current >= end) break;
+    }
+    if (current < end) {
+      result.emplace_back(current, end);
     }
   }
-  return false;
+  return FromNormalized(std::move(result));
+}
+
+size_t RangeSet::OverlapBlocks(const RangeSet& other) const {
+  std::vector<Range> storage_a;
+  std::vector<Range> storage_b;
+  size_t blocks = 0;
+  ForEachOverlap(Normalize(ranges_, &storage_a), Normalize(other.ranges_, &storage_b),
+                 [&blocks](const Range& range) {
+                   blocks += range.second - range.first;
+                   return true;
+                 });
+  return blocks;
+}
+
+bool RangeSet::Contains(const RangeSet& other) const {
+  std::vector<Range> storage;
+  size_t blocks = 0;
+  for (const auto& [begin, end] : Normalize(other.ranges_, &storage)) {
+    blocks += end - begin;
+  }
+  return OverlapBlocks(other) == blocks;
+}
+
+// RangeSet has half-closed half-open bounds. For example, "3,5" contains blocks 3 and 4. So "3,5"
+// and "5,7" are not overlapped.
+bool RangeSet::Overlaps(const RangeSet& other) const {
+  std::vector<Range> storage_a;
+  std::vector<Range> storage_b;
+  bool overlaps = false;
+  ForEachOverlap(Normalize(ranges_, &storage_a), Normalize(other.ranges_, &storage_b),
+                 [&overlaps](const Range&) {
+                   overlaps = true;
+                   return false;
+                 });
+  return overlaps;
 }
 
 std::optional<RangeSet> RangeSet::GetSubRanges(size_t start_index, size_t num_of_blocks) const {
@@ -251,25 +403,7 @@ void SortedRangeSet::Insert(const SortedRangeSet& rs) {
   if (rs.size() == 0) {
     return;
   }
-  // Merge and sort the two RangeSets.
-  std::vector<Range> temp = std::move(ranges_);
-  std::copy(rs.begin(), rs.end(), std::back_inserter(temp));
-  std::sort(temp.begin(), temp.end());
-
-  Clear();
-  // Trim overlaps and insert the result back to ranges_.
-  Range to_insert = temp.front();
-  for (auto it = temp.cbegin() + 1; it != temp.cend(); it++) {
-    if (it->first <= to_insert.second) {
-      to_insert.second = std::max(to_insert.second, it->second);
-    } else {
-      ranges_.push_back(to_insert);
-      blocks_ += (to_insert.second - to_insert.first);
-      to_insert = *it;
-    }
-  }
-  ranges_.push_back(to_insert);
-  blocks_ += (to_insert.second - to_insert.first);
+  RangeSet::operator=(Union(rs));
 }
 
 // Compute the block range the file occupies, and insert that range.
@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "otautil/storage_benchmark.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+
+static constexpr size_t kAlignment = 4096;
+
+namespace {
+
+struct FreeDeleter {
+  void operator()(uint8_t* p) const {
+    free(p);
+  }
+};
+using AlignedBuffer = std::unique_ptr<uint8_t, FreeDeleter>;
+
+// O_DIRECT needs the buffers aligned to the logical block size.
+AlignedBuffer AllocateAligned(size_t size) {
+  void* p = nullptr;
+  if (posix_memalign(&p, kAlignment, std::max(size, kAlignment)) != 0) {
+    return nullptr;
+  }
+  memset(p, 0xa5, size);
+  return AlignedBuffer(static_cast<uint8_t*>(p));
+}
+
+std::chrono::nanoseconds Median(std::vector<std::chrono::nanoseconds> values) {
+  if (values.empty()) {
+    return std::chrono::nanoseconds(0);
+  }
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+}  // namespace
+
+std::unique_ptr<FileStorageDevice> FileStorageDevice::Create(const std::string& path,
+                                                             uint64_t size) {
+  size = size / kAlignment * kAlignment;
+  if (size == 0) {
+    LOG(ERROR) << "Invalid scratch size for " << path;
+    return nullptr;
+  }
+
+  static constexpr size_t kFillSize = 1024 * 1024;
+  AlignedBuffer buffer = AllocateAligned(kFillSize);
+  if (!buffer) {
+    LOG(ERROR) << "Failed to allocate the fill buffer";
+    return nullptr;
+  }
+
+  // Fills the file with data, so that reads hit the device rather than holes. Filesystems that
+  // don't support O_DIRECT fail either the open or the first write with EINVAL.
+  for (bool direct : { true, false }) {
+    int flags = O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC | (direct ? O_DIRECT : 0);
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), flags, 0600)));
+    if (fd == -1) {
+      if (direct && errno == EINVAL) continue;
+      PLOG(ERROR) << "Failed to create " << path;
+      return nullptr;
+    }
+
+    bool filled = true;
+    for (uint64_t offset = 0; offset < size; offset += kFillSize) {
+      size_t to_write = std::min<uint64_t>(kFillSize, size - offset);
+      if (!android::base::WriteFullyAtOffset(fd, buffer.get(), to_write, offset)) {
+        filled = false;
+        break;
+      }
+    }
+    if (!filled) {
+      if (direct && errno == EINVAL) continue;
+      PLOG(ERROR) << "Failed to fill " << path;
+      unlink(path.c_str());
+      return nullptr;
+    }
+    if (fsync(fd) == -1) {
+      PLOG(ERROR) << "Failed to fsync " << path;
+      unlink(path.c_str());
+      return nullptr;
+    }
+    return std::unique_ptr<FileStorageDevice>(
+        new FileStorageDevice(path, std::move(fd), size, direct));
+  }
+  return nullptr;
+}
+
+FileStorageDevice::~FileStorageDevice() {
+  if (unlink(path_.c_str()) == -1 && errno != ENOENT) {
+    PLOG(WARNING) << "Failed to remove " << path_;
+  }
+}
+
+bool FileStorageDevice::Issue(const IoRequest& request, uint8_t* buffer) {
+  switch (request.type) {
+    case IoRequest::Type::kRead:
+      if (!android::base::ReadFullyAtOffset(fd_, buffer, request.size, request.offset)) {
+        PLOG(ERROR) << "Failed to read " << request.size << " bytes at " << request.offset;
+        return false;
+      }
+      return true;
+    case IoRequest::Type::kWrite:
+      if (!android::base::WriteFullyAtOffset(fd_, buffer, request.size, request.offset)) {
+        PLOG(ERROR) << "Failed to write " << request.size << " bytes at " << request.offset;
+        return false;
+      }
+      return true;
+    case IoRequest::Type::kSync:
+      if (fsync(fd_) == -1) {
+        PLOG(ERROR) << "Failed to fsync " << path_;
+        return false;
+      }
+      return true;
+  }
+  return false;
+}
+
+bool FileStorageDevice::Run(const std::vector<IoRequest>& requests, size_t queue_depth,
+                            std::chrono::nanoseconds* elapsed) {
+  if (!direct_) {
+    // Keeps the reads off the page cache as far as we can without O_DIRECT.
+    fdatasync(fd_);
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+  }
+
+  size_t max_size = 0;
+  for (const auto& request : requests) {
+    max_size = std::max(max_size, request.size);
+  }
+  queue_depth = std::max<size_t>(queue_depth, 1);
+  std::vector<AlignedBuffer> buffers;
+  for (size_t i = 0; i < queue_depth; i++) {
+    buffers.push_back(AllocateAligned(max_size));
+    if (!buffers.back()) {
+      LOG(ERROR) << "Failed to allocate " << max_size << " bytes";
+      return false;
+    }
+  }
+
+  std::atomic<bool> success{ true };
+  auto start = std::chrono::steady_clock::now();
+  size_t begin = 0;
+  while (begin < requests.size()) {
+    // Each sync splits the requests: the ones before it all complete before it's issued.
+    size_t end = begin;
+    while (end < requests.size() && requests[end].type != IoRequest::Type::kSync) {
+      end++;
+    }
+
+    std::atomic<size_t> next{ begin };
+    auto worker = [&](uint8_t* buffer) {
+      for (size_t i = next++; i < end; i = next++) {
+        if (!Issue(requests[i], buffer)) {
+          success = false;
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(queue_depth, end - begin); i++) {
+      threads.emplace_back(worker, buffers[i].get());
+    }
+    worker(buffers[0].get());
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    if (end < requests.size() && !Issue(requests[end], nullptr)) {
+      success = false;
+    }
+    begin = end + 1;
+  }
+  *elapsed = std::chrono::steady_clock::now() - start;
+  return success;
+}
+
+double StorageProfile::BestThroughput(bool write, bool sequential) const {
+  double best = 0;
+  for (const auto& sample : samples) {
+    if (sample.write == write && sample.sequential == sequential) {
+      best = std::max(best, sample.bytes_per_second);
+    }
+  }
+  return best;
+}
+
+std::ostream& operator<<(std::ostream& os, const StorageProfile& profile) {
+  for (const auto& sample : profile.samples) {
+    os << (sample.sequential ? "seq " : "rand ") << (sample.write ? "write " : "read ")
+       << sample.request_size << "x" << sample.queue_depth << ": "
+       << static_cast<uint64_t>(sample.bytes_per_second / 1024) << " KiB/s, ";
+  }
+  using std::chrono::microseconds;
+  os << "sync: " << std::chrono::duration_cast<microseconds>(profile.sync_latency).count() << " us";
+  return os;
+}
+
+bool BenchmarkStorage(StorageDevice* device, const BenchmarkConfig& config,
+                      StorageProfile* profile) {
+  *profile = {};
+
+  std::chrono::nanoseconds spent(0);
+  auto run = [&](const std::vector<IoRequest>& requests, size_t queue_depth,
+                 std::chrono::nanoseconds* elapsed) {
+    if (spent >= config.time_limit) {
+      return false;
+    }
+    std::chrono::nanoseconds taken(0);
+    bool result = device->Run(requests, queue_depth, &taken);
+    spent += taken;
+    if (elapsed != nullptr) {
+      *elapsed = taken;
+    }
+    return result;
+  };
+
+  // A fixed seed keeps the random offsets the same from run to run.
+  std::mt19937_64 random(0);
+  uint64_t region = device->size();
+
+  for (bool write : { false, true }) {
+    for (bool sequential : { true, false }) {
+      const auto& sizes =
+          sequential ? config.sequential_request_sizes : config.random_request_sizes;
+      for (size_t request_size : sizes) {
+        if (request_size == 0 || request_size > region) continue;
+        uint64_t slots = region / request_size;
+        size_t count = std::max<size_t>(config.bytes_per_sample / request_size, 1);
+        for (size_t queue_depth : config.queue_depths) {
+          std::vector<IoRequest> requests;
+          for (size_t i = 0; i < count; i++) {
+            uint64_t slot = sequential ? i % slots : random() % slots;
+            requests.push_back({ write ? IoRequest::Type::kWrite : IoRequest::Type::kRead,
+                                 slot * request_size, request_size });
+          }
+          if (write) {
+            requests.push_back({ IoRequest::Type::kSync, 0, 0 });
+          }
+
+          std::chrono::nanoseconds elapsed;
+          if (!run(requests, queue_depth, &elapsed) || elapsed.count() <= 0) continue;
+          profile->samples.push_back(
+              { write, sequential, request_size, queue_depth,
+                static_cast<double>(count * request_size) * 1e9 / elapsed.count() });
+        }
+      }
+    }
+  }
+
+  std::vector<std::chrono::nanoseconds> sync_latencies;
+  for (size_t i = 0; i < config.sync_iterations; i++) {
+    std::vector<IoRequest> requests{
+      { IoRequest::Type::kWrite, (i * kAlignment) % region, kAlignment },
+      { IoRequest::Type::kSync, 0, 0 },
+    };
+    std::chrono::nanoseconds elapsed;
+    if (!run(requests, 1, &elapsed)) break;
+    sync_latencies.push_back(elapsed);
+  }
+  profile->sync_latency = Median(sync_latencies);
+
+  return !profile->samples.empty();
+}
+
+std::ostream& operator<<(std::ostream& os, const IoParameters& parameters) {
+  return os << "read chunk " << parameters.read_chunk_size << ", write chunk "
+            << parameters.write_chunk_size;
+}
+
+// Returns the smallest sequential request size, at queue depth 1, whose throughput is within 90%
+// of the best one. Returns 0 if there's no such sample.
+static size_t PickRequestSize(const StorageProfile& profile, bool write) {
+  double best = 0;
+  for (const auto& sample : profile.samples) {
+    if (sample.write == write && sample.sequential && sample.queue_depth == 1) {
+      best = std::max(best, sample.bytes_per_second);
+    }
+  }
+
+  size_t chosen = 0;
+  for (const auto& sample : profile.samples) {
+    if (sample.write == write && sample.sequential && sample.queue_depth == 1 &&
+        sample.bytes_per_second >= best * 0.9 && (chosen == 0 || sample.request_size < chosen)) {
+      chosen = sample.request_size;
+    }
+  }
+  return chosen / kAlignment * kAlignment;
+}
+
+IoParameters ChooseIoParameters(const StorageProfile& profile) {
+  IoParameters parameters;
+  if (size_t read_size = PickRequestSize(profile, false); read_size != 0) {
+    parameters.read_chunk_size = read_size;
+  }
+  if (size_t write_size = PickRequestSize(profile, true); write_size != 0) {
+    parameters.write_chunk_size = write_size;
+  }
+  return parameters;
+}
+
+IoTuning& IoTuning::Get() {
+  static IoTuning tuning;
+  return tuning;
+}
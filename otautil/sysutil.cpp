@@ -19,12 +19,15 @@
 #include <errno.h>  // TEMP_FAILURE_RETRY
 #include <fcntl.h>
 #include <inttypes.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <limits>
+#include <numeric>
 #include <string>
 #include <vector>
 
@@ -35,6 +38,8 @@
 #include <android-base/unique_fd.h>
 #include <cutils/android_reboot.h>
 
+#include "otautil/async_logger.h"
+
 BlockMapData BlockMapData::ParseBlockMapFile(const std::string& block_map_path) {
   std::string content;
   if (!android::base::ReadFileToString(block_map_path, &content)) {
@@ -102,12 +107,17 @@ BlockMapData BlockMapData::ParseBlockMapFile(const std::string& block_map_path)
   return BlockMapData(block_dev, file_size, blksize, std::move(ranges));
 }
 
-bool MemMapping::MapFD(int fd) {
+bool MemMapping::MapFD(int fd, const MappingLimits& limits) {
   struct stat sb;
   if (fstat(fd, &sb) == -1) {
     PLOG(ERROR) << "fstat(" << fd << ") failed";
     return false;
   }
+  if (static_cast<uint64_t>(sb.st_size) > limits.max_flat_size) {
+    LOG(INFO) << "File size " << sb.st_size << " is over the limit of " << limits.max_flat_size
+              << " to map at once";
+    return false;
+  }
 
   void* memPtr = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
   if (memPtr == MAP_FAILED) {
@@ -123,7 +133,7 @@ bool MemMapping::MapFD(int fd) {
   return true;
 }
 
-bool MemMapping::MapBlockFile(const std::string& filename) {
+bool MemMapping::MapBlockFile(const std::string& filename, const MappingLimits& limits) {
   auto block_map_data = BlockMapData::ParseBlockMapFile(filename);
   if (!block_map_data) {
     return false;
@@ -133,6 +143,17 @@ bool MemMapping::MapBlockFile(const std::string& filename) {
     LOG(ERROR) << "File size is too large for mmap " << block_map_data.file_size();
     return false;
   }
+  if (block_map_data.file_size() > limits.max_flat_size) {
+    LOG(INFO) << "File size " << block_map_data.file_size() << " is over the limit of "
+              << limits.max_flat_size << " to map at once";
+    return false;
+  }
+  // Each range takes a VMA of its own.
+  if (block_map_data.block_ranges().size() > limits.max_vmas) {
+    LOG(INFO) << "Block map has " << block_map_data.block_ranges().size()
+              << " ranges, over the limit of " << limits.max_vmas << " to map at once";
+    return false;
+  }
 
   // Reserve enough contiguous address space for the whole file.
   uint32_t blksize = block_map_data.block_size();
@@ -182,7 +203,7 @@ bool MemMapping::MapBlockFile(const std::string& filename) {
   return true;
 }
 
-bool MemMapping::MapFile(const std::string& fn) {
+bool MemMapping::MapFile(const std::string& fn, const MappingLimits& limits) {
   if (fn.empty()) {
     LOG(ERROR) << "Empty filename";
     return false;
@@ -190,7 +211,7 @@ bool MemMapping::MapFile(const std::string& fn) {
 
   if (fn[0] == '@') {
     // Block map file "@/cache/recovery/block.map".
-    if (!MapBlockFile(fn.substr(1))) {
+    if (!MapBlockFile(fn.substr(1), limits)) {
       LOG(ERROR) << "Map of '" << fn << "' failed";
       return false;
     }
@@ -202,7 +223,7 @@ bool MemMapping::MapFile(const std::string& fn) {
       return false;
     }
 
-    if (!MapFD(fd)) {
+    if (!MapFD(fd, limits)) {
       LOG(ERROR) << "Map of '" << fn << "' failed";
       return false;
     }
@@ -219,7 +240,233 @@ MemMapping::~MemMapping() {
   ranges_.clear();
 }
 
+MappedWindows::~MappedWindows() {
+  for (const auto& window : windows_) {
+    Unmap(window);
+  }
+}
+
+bool MappedWindows::Open(const std::string& filename, const MappingLimits& limits) {
+  if (filename.empty()) {
+    LOG(ERROR) << "Empty filename";
+    return false;
+  }
+
+  for (const auto& window : windows_) {
+    Unmap(window);
+  }
+  windows_.clear();
+  block_ranges_.clear();
+  range_starts_.clear();
+  block_size_ = 0;
+
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  std::string path = filename;
+  if (filename[0] == '@') {
+    auto block_map_data = BlockMapData::ParseBlockMapFile(filename.substr(1));
+    if (!block_map_data) {
+      return false;
+    }
+    path = block_map_data.path();
+    length_ = block_map_data.file_size();
+    block_size_ = block_map_data.block_size();
+    uint64_t start = 0;
+    for (const auto& range : block_map_data.block_ranges()) {
+      block_ranges_.push_back(range);
+      range_starts_.push_back(start);
+      start += range.second - range.first;
+    }
+    alignment_ = std::lcm<size_t>(page_size, block_size_);
+  } else {
+    alignment_ = page_size;
+  }
+
+  fd_.reset(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY)));
+  if (fd_ == -1) {
+    PLOG(ERROR) << "Failed to open " << path;
+    return false;
+  }
+  if (block_size_ == 0) {
+    struct stat sb;
+    if (fstat(fd_.get(), &sb) == -1) {
+      PLOG(ERROR) << "Failed to stat " << path;
+      return false;
+    }
+    length_ = sb.st_size;
+  }
+
+  limits_ = limits;
+  limits_.window_size = std::max<size_t>(limits.window_size / alignment_, 1) * alignment_;
+  limits_.max_windows = std::max<size_t>(limits.max_windows, 1);
+  limits_.max_vmas = std::max<size_t>(limits.max_vmas, 1);
+  LOG(INFO) << "Mapping " << length_ << " bytes of " << filename << " in " << limits_.max_windows
+            << " windows of " << limits_.window_size << " bytes";
+  return true;
+}
+
+const uint8_t* MappedWindows::Access(uint64_t offset, size_t size) {
+  if (size == 0 || size > length_ || offset > length_ - size) {
+    LOG(ERROR) << "Out of bound access, offset: " << offset << ", size: " << size
+               << ", length: " << length_;
+    return nullptr;
+  }
+
+  for (auto it = windows_.begin(); it != windows_.end(); ++it) {
+    if (it->offset <= offset && offset + size <= it->offset + it->length) {
+      stats_.hits++;
+      windows_.splice(windows_.begin(), windows_, it);
+      return it->addr + (offset - it->offset);
+    }
+  }
+
+  uint64_t start = offset / alignment_ * alignment_;
+  const Window* window = MapWindow(start, offset + size - start);
+  if (window == nullptr) {
+    return nullptr;
+  }
+  return window->addr + (offset - start);
+}
+
+bool MappedWindows::ReadAt(uint8_t* buffer, size_t size, uint64_t offset) {
+  if (size > length_ || offset > length_ - size) {
+    LOG(ERROR) << "Out of bound read, offset: " << offset << ", size: " << size
+               << ", length: " << length_;
+    return false;
+  }
+
+  while (size > 0) {
+    // Stay within the window that Access() maps for |offset|.
+    size_t chunk = std::min<size_t>(size, limits_.window_size - offset % alignment_);
+    const uint8_t* data = Access(offset, chunk);
+    if (data == nullptr) {
+      return false;
+    }
+    memcpy(buffer, data, chunk);
+    buffer += chunk;
+    offset += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+const MappedWindows::Window* MappedWindows::MapWindow(uint64_t offset, size_t size) {
+  size_t length = std::max<size_t>(size, std::min<uint64_t>(limits_.window_size, length_ - offset));
+  size_t mapped_length = (length + alignment_ - 1) / alignment_ * alignment_;
+  if (mapped_length > limits_.max_flat_size) {
+    LOG(ERROR) << "Can't map " << length << " bytes at once, over the limit of "
+               << limits_.max_flat_size;
+    return nullptr;
+  }
+
+  // A window of an ordinary file takes one VMA. One of a block map takes one per range it spans,
+  // unless that's more than the whole budget (or the blocks aren't page aligned), in which case
+  // it's read into memory instead.
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t vmas = 1;
+  if (block_size_ != 0) {
+    vmas = 0;
+    ForEachPiece(offset, mapped_length, [&vmas](size_t, off64_t, size_t) {
+      vmas++;
+      return true;
+    });
+  }
+  bool read = vmas > limits_.max_vmas || (block_size_ != 0 && block_size_ % page_size != 0);
+  if (read) {
+    vmas = 1;
+  }
+
+  while (!windows_.empty() &&
+         (windows_.size() >= limits_.max_windows || vmas_ + vmas > limits_.max_vmas)) {
+    Unmap(windows_.back());
+    windows_.pop_back();
+    stats_.evictions++;
+  }
+
+  void* addr;
+  if (block_size_ == 0) {
+    addr = mmap(nullptr, mapped_length, PROT_READ, MAP_PRIVATE, fd_.get(), offset);
+    if (addr == MAP_FAILED) {
+      PLOG(ERROR) << "Failed to map " << mapped_length << " bytes at " << offset;
+      return nullptr;
+    }
+  } else {
+    addr = mmap(nullptr, mapped_length, read ? PROT_READ | PROT_WRITE : PROT_NONE,
+                MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (addr == MAP_FAILED) {
+      PLOG(ERROR) << "Failed to reserve " << mapped_length << " bytes";
+      return nullptr;
+    }
+    auto base = static_cast<uint8_t*>(addr);
+    bool success = ForEachPiece(
+        offset, mapped_length,
+        [this, base, read](size_t window_offset, off64_t device_offset, size_t piece_size) {
+          if (read) {
+            if (!android::base::ReadFullyAtOffset(fd_.get(), base + window_offset, piece_size,
+                                                  device_offset)) {
+              PLOG(ERROR) << "Failed to read " << piece_size << " bytes at " << device_offset;
+              return false;
+            }
+            return true;
+          }
+          if (mmap(base + window_offset, piece_size, PROT_READ, MAP_PRIVATE | MAP_FIXED,
+                   fd_.get(), device_offset) == MAP_FAILED) {
+            PLOG(ERROR) << "Failed to map " << piece_size << " bytes at " << device_offset;
+            return false;
+          }
+          return true;
+        });
+    if (!success) {
+      munmap(addr, mapped_length);
+      return nullptr;
+    }
+    if (read) {
+      mprotect(addr, mapped_length, PROT_READ);
+      stats_.reads++;
+    }
+  }
+
+  windows_.push_front(
+      Window{ offset, length, static_cast<uint8_t*>(addr), mapped_length, vmas });
+  vmas_ += vmas;
+  mapped_bytes_ += mapped_length;
+  stats_.maps++;
+  stats_.peak_vmas = std::max(stats_.peak_vmas, vmas_);
+  stats_.peak_mapped_bytes = std::max(stats_.peak_mapped_bytes, mapped_bytes_);
+  return &windows_.front();
+}
+
+bool MappedWindows::ForEachPiece(uint64_t offset, size_t length,
+                                 const std::function<bool(size_t, off64_t, size_t)>& fn) const {
+  uint64_t first_block = offset / block_size_;
+  uint64_t end_block = (offset + length + block_size_ - 1) / block_size_;
+  // The range that holds |first_block|.
+  size_t index = std::upper_bound(range_starts_.begin(), range_starts_.end(), first_block) -
+                 range_starts_.begin() - 1;
+  for (uint64_t block = first_block; block < end_block && index < block_ranges_.size(); index++) {
+    const auto& [start, end] = block_ranges_[index];
+    uint64_t skipped = block - range_starts_[index];
+    uint64_t count = std::min<uint64_t>(end - start - skipped, end_block - block);
+    if (!fn((block - first_block) * block_size_,
+            static_cast<off64_t>(start + skipped) * block_size_, count * block_size_)) {
+      return false;
+    }
+    block += count;
+  }
+  return true;
+}
+
+void MappedWindows::Unmap(const Window& window) {
+  if (munmap(window.addr, window.mapped_length) == -1) {
+    PLOG(ERROR) << "Failed to munmap(" << static_cast<void*>(window.addr) << ", "
+                << window.mapped_length << ")";
+  }
+  vmas_ -= window.vmas;
+  mapped_bytes_ -= window.mapped_length;
+}
+
 void Reboot(std::string_view target) {
+  // Get the logs out before init kills us.
+  FlushAsyncLogging();
   std::string cmd = "reboot," + std::string(target);
   // Honor the quiescent mode if applicable.
   if (target != "bootloader" && target != "fastboot" &&
@@ -234,6 +481,7 @@ void Reboot(std::string_view target) {
 }
 
 bool Shutdown(std::string_view target) {
+  FlushAsyncLogging();
   std::string cmd = "shutdown," + std::string(target);
   return android::base::SetProperty(ANDROID_RB_PROPERTY, cmd);
 }
@@ -31,6 +31,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <functional>
 #include <iterator>
 #include <memory>
@@ -54,12 +55,14 @@
 #include "install/snapshot_utils.h"
 #include "install/wipe_data.h"
 #include "install/wipe_device.h"
+#include "otautil/async_logger.h"
 #include "otautil/boot_state.h"
 #include "otautil/dirutil.h"
 #include "otautil/error_code.h"
 #include "otautil/package.h"
 #include "otautil/paths.h"
 #include "otautil/sysutil.h"
+#include "recovery_ui/property_snapshot.h"
 #include "recovery_ui/screen_ui.h"
 #include "recovery_ui/ui.h"
 #include "recovery_utils/battery_utils.h"
@@ -134,6 +137,14 @@ static bool IsRoDebuggable() {
   return android::base::GetBoolProperty("ro.debuggable", false);
 }
 
+// The read-only properties that the recovery screens depend on. They can't change while recovery
+// is running, so they're read once.
+static const PropertySnapshot& GetScreenProperties() {
+  static const PropertySnapshot properties({ "ro.aospa.version", "ro.build.ab_update",
+                                             "ro.boot.slot_suffix", "ro.virtual_ab.enabled" });
+  return properties;
+}
+
 // Clear the recovery command and prepare to boot a (hopefully working) system,
 // copy our log file to cache as well (for the system to read). This function is
 // idempotent: call it as many times as you like.
@@ -282,6 +293,7 @@ static void choose_recovery_file(Device* device) {
     }
     if (entries[chosen_item] == "Back") break;
 
+    FlushAsyncLogging();
     device->GetUI()->ShowFile(entries[chosen_item]);
   }
 }
@@ -414,8 +426,9 @@ static void WriteUpdateInProgress() {
 }
 
 static bool AskToReboot(Device* device, Device::BuiltinAction chosen_action) {
-  bool is_non_ab = android::base::GetProperty("ro.boot.slot_suffix", "").empty();
-  bool is_virtual_ab = android::base::GetBoolProperty("ro.virtual_ab.enabled", false);
+  const auto& properties = GetScreenProperties();
+  bool is_non_ab = properties.Get("ro.boot.slot_suffix").empty();
+  bool is_virtual_ab = properties.GetBool("ro.virtual_ab.enabled", false);
   if (!is_non_ab && !is_virtual_ab) {
     // Only prompt for non-A/B or Virtual A/B devices.
     return true;
@@ -586,8 +599,11 @@ static Device::BuiltinAction PromptAndWait(Device* device, InstallResult status)
             return Device::NO_ACTION;  // reboot if logs aren't visible
           }
         } else {
-          ui->SetBackground(RecoveryUI::ERROR);
-          ui->Print("Installation aborted.\n");
+          {
+            ScopedUiUpdate update(ui);
+            ui->SetBackground(RecoveryUI::ERROR);
+            ui->Print("Installation aborted.\n");
+          }
           copy_logs(save_current_log);
         }
         break;
@@ -634,8 +650,10 @@ static bool IsBatteryOk(int* required_battery_level) {
   // level against a slightly lower limit.
   constexpr int BATTERY_OK_PERCENTAGE = 20;
   constexpr int BATTERY_WITH_CHARGER_OK_PERCENTAGE = 15;
+  // The level barely changes within a minute, so a value read since recovery started will do.
+  constexpr std::chrono::seconds BATTERY_INFO_MAX_AGE(60);
 
-  auto battery_info = GetBatteryInfo();
+  auto battery_info = BatteryMonitor::Get().GetInfo(BATTERY_INFO_MAX_AGE);
   *required_battery_level =
       battery_info.charging ? BATTERY_WITH_CHARGER_OK_PERCENTAGE : BATTERY_OK_PERCENTAGE;
   return battery_info.capacity >= *required_battery_level;
@@ -814,10 +832,11 @@ Device::BuiltinAction start_recovery(Device* device, const std::vector<std::stri
     ui->SetStage(st_cur, st_max);
   }
 
+  const auto& properties = GetScreenProperties();
   std::vector<std::string> title_lines =
-      android::base::Split(android::base::GetProperty("ro.aospa.version", ""), ":");
-  if (android::base::GetBoolProperty("ro.build.ab_update", false)) {
-    std::string slot = android::base::GetProperty("ro.boot.slot_suffix", "");
+      android::base::Split(properties.Get("ro.aospa.version"), ":");
+  if (properties.GetBool("ro.build.ab_update", false)) {
+    std::string slot = properties.Get("ro.boot.slot_suffix");
     if (android::base::StartsWith(slot, "_")) slot.erase(0, 1);
     title_lines.push_back("Active slot: " + slot);
   }
@@ -882,9 +901,10 @@ Device::BuiltinAction start_recovery(Device* device, const std::vector<std::stri
         status = InstallPackage(memory_package.get(), update_package, should_wipe_cache,
                                 retry_count, device);
       } else {
-        // We may fail to memory map the package on 32 bit builds for packages with 2GiB+ size.
-        // In such cases, we will try to install the package with fuse. This is not the default
-        // installation method because it introduces a layer of indirection from the kernel space.
+        // We fail to memory map packages over the MappingLimits, e.g. 1GiB+ packages on 32 bit
+        // builds, or block maps too fragmented for the VMA budget. In such cases, we will try to
+        // install the package with fuse. This is not the default installation method because it
+        // introduces a layer of indirection from the kernel space.
         LOG(WARNING) << "Failed to memory map package " << update_package
                      << "; falling back to install with fuse";
         status = InstallWithFuseFromPath(update_package, device);
@@ -923,8 +943,11 @@ Device::BuiltinAction start_recovery(Device* device, const std::vector<std::stri
     // Trigger the logging to capture the cause, even if user chooses to not wipe data.
     save_current_log = true;
 
-    ui->ShowText(true);
-    ui->SetBackground(RecoveryUI::ERROR);
+    {
+      ScopedUiUpdate update(ui);
+      ui->ShowText(true);
+      ui->SetBackground(RecoveryUI::ERROR);
+    }
     status = prompt_and_wipe_data(device);
     if (status != INSTALL_KEY_INTERRUPTED) {
       ui->ShowText(false);
@@ -958,9 +981,9 @@ Device::BuiltinAction start_recovery(Device* device, const std::vector<std::stri
     status = ApplyFromAdb(device, true /* rescue_mode */, &next_action);
     ui->Print("\nInstall from ADB complete (status: %d).\n", status);
   } else if (!just_exit) {
-    // Always show menu if no command is specified.
-    // Note that this should be called before setting the background to avoid
-    // flickering the background image.
+    // Always show menu if no command is specified. Both changes get drawn at once, so that the
+    // background image doesn't flicker.
+    ScopedUiUpdate update(ui);
     ui->ShowText(true);
     status = INSTALL_NONE;  // No command specified
     ui->SetBackground(RecoveryUI::NO_COMMAND);
@@ -50,6 +50,7 @@
 
 #include "fastboot/fastboot.h"
 #include "install/wipe_data.h"
+#include "otautil/async_logger.h"
 #include "otautil/boot_state.h"
 #include "otautil/paths.h"
 #include "otautil/sysutil.h"
@@ -57,6 +58,7 @@
 #include "recovery_ui/device.h"
 #include "recovery_ui/stub_ui.h"
 #include "recovery_ui/ui.h"
+#include "recovery_utils/battery_utils.h"
 #include "recovery_utils/logging.h"
 #include "recovery_utils/roots.h"
 
@@ -96,9 +98,11 @@ std::string get_build_type() {
 static std::vector<std::string> get_args(const int argc, char** const argv, std::string* stage) {
   CHECK_GT(argc, 0);
 
+  // The BCB gets read here and updated below, through the same misc session.
   bootloader_message boot = {};
   std::string err;
-  if (!read_bootloader_message(&boot, &err)) {
+  auto misc = MiscPartition::Open(true, &err);
+  if (!misc || !misc->ReadBootloaderMessage(&boot, &err)) {
     LOG(ERROR) << err;
     // If fails, leave a zeroed bootloader_message.
     boot = {};
@@ -160,7 +164,10 @@ static std::vector<std::string> get_args(const int argc, char** const argv, std:
   // bootloader control block. So the device will always boot into recovery to
   // finish the pending work, until FinishRecovery() is called.
   std::vector<std::string> options(args.cbegin() + 1, args.cend());
-  if (!update_bootloader_message(options, &err)) {
+  bootloader_message updated;
+  if (!misc || !misc->ReadBootloaderMessage(&updated, &err) ||
+      !update_bootloader_message_in_struct(&updated, options) ||
+      !misc->WriteBootloaderMessage(updated, &err) || !misc->Commit(&err)) {
     LOG(ERROR) << "Failed to set BCB message: " << err;
   }
 
@@ -322,8 +329,9 @@ static void redirect_stdio(const char* filename) {
 
 int main(int argc, char** argv) {
   // We don't have logcat yet under recovery; so we'll print error on screen and log to stdout
-  // (which is redirected to recovery.log) as we used to do.
-  android::base::InitLogging(argv, &UiLogger);
+  // (which is redirected to recovery.log) as we used to do. The writes happen in the background,
+  // so that slow consoles don't hold up the install.
+  android::base::InitLogging(argv, StartAsyncLogging(&UiLogger));
 
   // Take last pmsg contents and rewrite it to the current pmsg session.
   static constexpr const char filter[] = "recovery/";
@@ -390,6 +398,12 @@ int main(int argc, char** argv) {
   optind = 1;
   opterr = 1;
 
+  // Installs check the battery level before they start. Read it in the background from now on, as
+  // the health service may take a while, and a fake capacity takes up to 10s to rule out.
+  if (!fastboot) {
+    BatteryMonitor::Get().Start();
+  }
+
   if (locale.empty()) {
     if (HasCache()) {
       locale = load_locale_from_cache();
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "recovery_ui/backlight.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <android-base/logging.h>
+
+Backlight::Backlight(const std::string& brightness_file) : brightness_file_(brightness_file) {}
+
+Backlight::~Backlight() {
+  Stop();
+}
+
+bool Backlight::Start() {
+  fd_.reset(TEMP_FAILURE_RETRY(open(brightness_file_.c_str(), O_WRONLY | O_CLOEXEC)));
+  if (fd_ == -1) {
+    PLOG(WARNING) << "Failed to open " << brightness_file_;
+    return false;
+  }
+  thread_ = std::thread(&Backlight::Run, this);
+  return true;
+}
+
+void Backlight::Set(unsigned int value, bool ramp) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    target_ = value;
+    ramp_ = ramp;
+    pending_ = true;
+  }
+  cv_.notify_all();
+}
+
+bool Backlight::WaitIdle(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return cv_.wait_for(lock, timeout, [this] { return !pending_ && !busy_; });
+}
+
+void Backlight::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool Backlight::Write(unsigned int value) {
+  std::string content = std::to_string(value);
+  if (TEMP_FAILURE_RETRY(pwrite(fd_.get(), content.data(), content.size(), 0)) !=
+      static_cast<ssize_t>(content.size())) {
+    PLOG(WARNING) << "Failed to set brightness to " << value;
+    return false;
+  }
+  return true;
+}
+
+void Backlight::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return pending_ || stopped_; });
+    if (!pending_) {
+      break;
+    }
+
+    unsigned int target = target_;
+    // Don't keep the caller of Stop() waiting on a ramp. Nor is there anything to ramp from before
+    // the first write.
+    int steps = (ramp_ && !stopped_ && current_) ? kRampSteps : 1;
+    pending_ = false;
+    busy_ = true;
+
+    int64_t from = current_.value_or(target);
+    for (int step = 1; step <= steps && current_ != target; step++) {
+      auto value = static_cast<unsigned int>(from + (target - from) * step / steps);
+      lock.unlock();
+      bool written = Write(value);
+      lock.lock();
+      if (!written) {
+        break;
+      }
+      current_ = value;
+
+      // A newer request replaces the rest of this one. On Stop(), finish it in one write instead.
+      if (step < steps &&
+          cv_.wait_for(lock, kRampStepInterval, [this] { return pending_ || stopped_; })) {
+        pending_ = true;
+        break;
+      }
+    }
+
+    busy_ = false;
+    cv_.notify_all();
+  }
+}
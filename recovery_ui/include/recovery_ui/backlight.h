@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RECOVERY_BACKLIGHT_H
+#define RECOVERY_BACKLIGHT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include <android-base/unique_fd.h>
+
+// Sets the backlight brightness from a worker thread, so that callers (e.g. the key handling that
+// wakes up the screen) never wait on the sysfs write, which takes tens of milliseconds on some
+// panels. Requests made while the worker is busy are coalesced: only the latest one is written.
+class Backlight {
+ public:
+  explicit Backlight(const std::string& brightness_file);
+
+  // Stops the worker, writing the last requested value first.
+  virtual ~Backlight();
+
+  // Opens the brightness file, which stays open, and starts the worker. Returns false if the file
+  // can't be opened for writing.
+  bool Start();
+
+  // Requests the brightness |value|. With |ramp|, it gets there in kRampSteps steps over about
+  // kRampSteps * kRampStepInterval; otherwise it's written at once. Never blocks on the write.
+  void Set(unsigned int value, bool ramp);
+
+  // Waits until the last requested value has been written, for up to |timeout|. Returns false on
+  // timeout.
+  bool WaitIdle(std::chrono::milliseconds timeout);
+
+  // Stops the worker after writing the last requested value, without ramping. Subclasses that
+  // override Write() must call it in their destructor.
+  void Stop();
+
+  static constexpr int kRampSteps = 8;
+  static constexpr std::chrono::milliseconds kRampStepInterval{ 16 };
+
+ protected:
+  // Writes |value| to the brightness file. Called on the worker thread only.
+  virtual bool Write(unsigned int value);
+
+ private:
+  void Run();
+
+  const std::string brightness_file_;
+  android::base::unique_fd fd_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  // The latest requested value, and whether it's yet to be picked up by the worker.
+  unsigned int target_{ 0 };
+  bool ramp_{ false };
+  bool pending_{ false };
+  // Whether the worker is writing, including the waits between the steps of a ramp.
+  bool busy_{ false };
+  bool stopped_{ false };
+  // The last value written, unknown until the first write. Only accessed by the worker thread.
+  std::optional<unsigned int> current_;
+
+  std::thread thread_;
+};
+
+#endif  // RECOVERY_BACKLIGHT_H
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RECOVERY_PROPERTY_SNAPSHOT_H
+#define RECOVERY_PROPERTY_SNAPSHOT_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+// The values of a set of system properties, read once up front. Meant for the read-only properties
+// shown on the recovery and fastboot screens, which would otherwise be looked up one at a time
+// whenever a screen is built.
+class PropertySnapshot {
+ public:
+  explicit PropertySnapshot(const std::vector<std::string>& names);
+
+  // Returns the value of |name| as of the snapshot, or |default_value| if it was unset or empty.
+  // Names that aren't part of the snapshot are read from the system.
+  std::string Get(const std::string& name, const std::string& default_value = "") const;
+
+  // Same as above, parsing the value as a boolean like android::base::GetBoolProperty().
+  bool GetBool(const std::string& name, bool default_value) const;
+
+ private:
+  std::map<std::string, std::string> values_;
+};
+
+#endif  // RECOVERY_PROPERTY_SNAPSHOT_H
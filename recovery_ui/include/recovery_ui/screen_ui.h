@@ -17,10 +17,12 @@
 #ifndef RECOVERY_SCREEN_UI_H
 #define RECOVERY_SCREEN_UI_H
 
+#include <stdint.h>
 #include <stdio.h>
 
 #include <atomic>
 #include <functional>
+#include <map>
 #include <memory>
 #include <string>
 #include <thread>
@@ -78,9 +80,34 @@ class DrawInterface {
   virtual int DrawWrappedTextLines(int x, int y, const std::vector<std::string>& lines) const = 0;
 };
 
+// What a drawn menu looks like: where its rows are, which items they show and which one is
+// highlighted. See Menu::GetView().
+struct MenuView {
+  // Identifies the positions of the rows; 0 if the menu hasn't been laid out.
+  uint64_t layout{ 0 };
+  // The first visible item.
+  size_t start{ 0 };
+  size_t selection{ 0 };
+};
+
+// Describes how to turn a drawn menu into another view of it, without redrawing the whole screen.
+// See Menu::GetDamage().
+struct MenuDamage {
+  // If |scroll_dy| is non-zero, the pixel rows [scroll_top, scroll_bottom) need to be moved by that
+  // many rows first.
+  int scroll_top{ 0 };
+  int scroll_bottom{ 0 };
+  int scroll_dy{ 0 };
+  // The menu rows to clear and redraw, as indices into the drawn layout (see Menu::DrawRows()).
+  std::vector<int> rows;
+};
+
 // Interface for classes that maintain the menu selection and display.
 class Menu {
  public:
+  // The row that shows the current selection in the menu header, if any.
+  static constexpr int kStatusRow = -1;
+
   virtual ~Menu() = default;
   // Returns the current menu selection.
   size_t selection() const;
@@ -92,6 +119,20 @@ class Menu {
   // Iterates over the menu items and displays each of them at offset x, y.
   virtual int DrawItems(int x, int y, int screen_width, bool long_press) const = 0;
 
+  // Support for updating the menu in place. DrawHeader() and DrawItems() lay out the rows, and
+  // GetView() identifies what would be on screen if drawn now. GetDamage() then tells which rows
+  // to redraw to turn a previously |drawn| view into the current one. If |can_scroll| is set, it
+  // may ask for the drawn items to be moved instead of redrawing them. Returns false if that's not
+  // possible (e.g. the layout has changed since), in which case the caller should redraw
+  // everything.
+  virtual MenuView GetView() const;
+  virtual bool GetDamage(const MenuView& drawn, bool can_scroll, MenuDamage* damage) const;
+  // Gets the pixel rows [*top, *bottom) covered by |row| of the current layout. Returns false if
+  // there is no such row.
+  virtual bool GetRowSpan(int row, int* top, int* bottom) const;
+  // Redraws |rows| of the current layout (already cleared by the caller).
+  virtual void DrawRows(const std::vector<int>& rows, bool long_press) const;
+
  protected:
   Menu(size_t initial_selection, const DrawInterface& draw_func);
   // Current menu selection.
@@ -113,6 +154,11 @@ class TextMenu : public Menu {
   int DrawHeader(int x, int y) const override;
   int DrawItems(int x, int y, int screen_width, bool long_press) const override;
 
+  MenuView GetView() const override;
+  bool GetDamage(const MenuView& drawn, bool can_scroll, MenuDamage* damage) const override;
+  bool GetRowSpan(int row, int* top, int* bottom) const override;
+  void DrawRows(const std::vector<int>& rows, bool long_press) const override;
+
   bool scrollable() const {
     return scrollable_;
   }
@@ -138,13 +184,29 @@ class TextMenu : public Menu {
   //                                 /cache/recovery/last_log.2
   //                                 ...
   const std::vector<std::string>& text_headers() const;
-  std::string TextItem(size_t index) const;
+  const std::string& TextItem(size_t index) const;
 
   // Checks if the menu items fit vertically on the screen. Returns true and set the
   // |cur_selection_str| if the items exceed the screen limit.
   bool ItemsOverflow(std::string* cur_selection_str) const;
 
  private:
+  // Where the last DrawHeader() / DrawItems() calls have put things on the screen, so that a
+  // selection change only needs to touch the rows that changed.
+  struct Layout {
+    // Unique among all the menus for each distinct layout; 0 until drawn.
+    uint64_t id{ 0 };
+    int x{ 0 };
+    int screen_width{ 0 };
+    // Position of the "Current item" line of scrollable menus, or -1 if not shown.
+    int status_y{ -1 };
+    // Position of each visible item.
+    std::vector<int> item_y;
+  };
+
+  // Draws the item |index| (with the highlight bar if selected) at x, y.
+  int DrawItem(size_t index, int x, int y, int screen_width, bool long_press) const;
+
   // The menu is scrollable to display more items. Used on wear devices who have smaller screens.
   const bool scrollable_;
   // The max number of menu items to fit vertically on a screen.
@@ -160,6 +222,10 @@ class TextMenu : public Menu {
 
   // Height in pixels of each character.
   int char_height_;
+
+  mutable Layout layout_;
+  // The layout being recorded by DrawHeader() / DrawItems().
+  mutable Layout pending_layout_;
 };
 
 // This class uses GRSurface's as the menu header and items.
@@ -229,6 +295,10 @@ class ScreenRecoveryUI : public RecoveryUI, public DrawInterface {
 
   void KeyLongPress(int) override;
 
+  void BeginUpdate() override;
+  void EndUpdate() override;
+
+  // Redraws the screen, unless in a batch of updates.
   void Redraw();
 
   // Checks the background text image, for debugging purpose. It iterates the locales embedded in
@@ -262,6 +332,9 @@ class ScreenRecoveryUI : public RecoveryUI, public DrawInterface {
   // The scale factor from dp to pixels. 1.0 for mdpi, 4.0 for xxxhdpi.
   const float density_;
 
+  // Initializes minui, waiting a while for the display to show up.
+  virtual bool InitGraphics();
+
   virtual bool InitTextParams();
 
   virtual bool LoadWipeDataMenuText();
@@ -297,7 +370,14 @@ class ScreenRecoveryUI : public RecoveryUI, public DrawInterface {
   virtual void draw_screen_locked();
   virtual void draw_menu_and_text_buffer_locked(const std::vector<std::string>& help_message);
   virtual void update_screen_locked();
+  // Redraws the screen, or leaves it to EndUpdate() if in a batch of updates.
+  void request_update_locked();
   virtual void update_progress_locked();
+  virtual void update_menu_selection_locked();
+  void record_menu_frame_locked();
+  // Restores the text mode background of the pixel rows [top, bottom), so that a menu row can be
+  // redrawn in place. Returns false if that's not possible for part of the screen.
+  virtual bool draw_menu_row_background_locked(int top, int bottom);
 
   const GRSurface* GetCurrentFrame() const;
   const GRSurface* GetCurrentText() const;
@@ -390,6 +470,11 @@ class ScreenRecoveryUI : public RecoveryUI, public DrawInterface {
   bool scrollable_menu_;
   std::unique_ptr<Menu> menu_;
 
+  // What the menu looked like in the last few frames, by flip count. A frame that isn't listed
+  // either didn't show the menu, or differs from the current screen in more than the menu (e.g. it
+  // misses the lines printed since).
+  std::map<uint64_t, MenuView> menu_frames_;
+
   // An alternate text screen, swapped with 'text_' when we're viewing a log file.
   char** file_viewer_text_;
 
@@ -407,12 +492,22 @@ class ScreenRecoveryUI : public RecoveryUI, public DrawInterface {
 
   std::mutex updateMutex;
 
+  // The nesting depth of BeginUpdate() calls, and whether a redraw was deferred until they end.
+  int update_depth_{ 0 };
+  bool update_deferred_{ false };
+
   // Switch the display to active one after graphics is ready
   bool is_graphics_available;
 
  private:
   void SetLocale(const std::string&);
 
+  // Suspends batching while waiting for keys, as the changes made in the meantime (e.g. by other
+  // threads) would otherwise not show up. The next redraw includes the changes batched so far.
+  // Returns the depth to pass to ResumeUpdates() afterwards.
+  int SuspendUpdates();
+  void ResumeUpdates(int depth);
+
   // Display the background texts for "erasing", "error", "no_command" and "installing" for the
   // selected locale.
   void SelectAndShowBackgroundText(const std::vector<std::string>& locales_entries, size_t sel);
@@ -23,11 +23,13 @@
 #include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+class Backlight;
 class Device;
 
 static constexpr const char* DEFAULT_LOCALE = "en-US";
@@ -201,6 +203,15 @@ class RecoveryUI {
   // default.
   virtual void SetEnableReboot(bool enabled);
 
+  // --- batched updates ---
+
+  // Defers redrawing the screen until the matching EndUpdate(), so that a series of changes (e.g.
+  // the title, background and text visibility for a new screen) gets drawn in a single pass. Calls
+  // may nest; the screen is redrawn when the outermost batch ends, and only if anything changed.
+  // Showing a menu or a file draws the batched changes right away, as it waits for keys.
+  virtual void BeginUpdate() {}
+  virtual void EndUpdate() {}
+
   // --- menu display ---
 
   virtual void SetTitle(const std::vector<std::string>& lines) = 0;
@@ -330,6 +341,27 @@ class RecoveryUI {
   // brightness_dimmed_ respectively.
   unsigned int brightness_normal_value_;
   unsigned int brightness_dimmed_value_;
+
+  // Writes the brightness values off the input thread. Null if the screensaver is disabled.
+  std::unique_ptr<Backlight> backlight_;
+};
+
+// Batches the UI changes made during its lifetime. See RecoveryUI::BeginUpdate().
+class ScopedUiUpdate {
+ public:
+  explicit ScopedUiUpdate(RecoveryUI* ui) : ui_(ui) {
+    ui_->BeginUpdate();
+  }
+
+  ~ScopedUiUpdate() {
+    ui_->EndUpdate();
+  }
+
+  ScopedUiUpdate(const ScopedUiUpdate&) = delete;
+  ScopedUiUpdate& operator=(const ScopedUiUpdate&) = delete;
+
+ private:
+  RecoveryUI* const ui_;
 };
 
 #endif  // RECOVERY_UI_H
@@ -17,29 +17,49 @@
 #ifndef RECOVERY_VR_UI_H
 #define RECOVERY_VR_UI_H
 
+#include <memory>
 #include <string>
 
 #include "screen_ui.h"
 
+// The UI for VR headsets, with the screen split in two halves, one per eye. The scene is drawn once
+// for one eye into an offscreen surface, which then gets copied to both halves with the stereo
+// offset applied.
 class VrRecoveryUI : public ScreenRecoveryUI {
  public:
   VrRecoveryUI();
+  ~VrRecoveryUI() override;
 
  protected:
   // Pixel offsets to move drawing functions to visible range.
   // Can vary per device depending on screen size and lens distortion.
   const int stereo_offset_;
 
+  // The size of the view of one eye, in which all the drawing functions work.
   int ScreenWidth() const override;
   int ScreenHeight() const override;
 
-  void DrawSurface(const GRSurface* surface, int sx, int sy, int w, int h, int dx,
-                   int dy) const override;
   int DrawHorizontalRule(int y) const override;
   void DrawHighlightBar(int x, int y, int width, int height) const override;
-  void DrawFill(int x, int y, int w, int h) const override;
-  void DrawTextIcon(int x, int y, const GRSurface* surface) const override;
-  int DrawTextLine(int x, int y, const std::string& line, bool bold) const override;
+
+  void draw_screen_locked() override;
+  // The menu can't be updated in place on the screen, as it's only drawn for one eye; this redraws
+  // the whole scene instead.
+  void update_menu_selection_locked() override;
+  // Likewise for the progress bar and the animation.
+  void update_progress_locked() override;
+
+  // Draws anything that differs between the eyes, on top of the scene copied to the eye whose view
+  // starts at |left| on the screen. Nothing by default. Should only be called with updateMutex
+  // locked.
+  virtual void draw_eye_overlay_locked(int /* left */) {}
+
+ private:
+  // Copies the scene to the view starting at |left| on the screen, clipped to the screen.
+  void copy_to_eye_locked(int left);
+
+  // The scene as seen by one eye.
+  std::unique_ptr<GRSurface> eye_surface_;
 };
 
 #endif  // RECOVERY_VR_UI_H
@@ -36,10 +36,15 @@ class WearRecoveryUI : public ScreenRecoveryUI {
   // Recovery, build id and etc) and the bottom lines that may otherwise go out of the screen.
   const int menu_unusable_rows_;
 
+  // Whether the display is round, in which case drawing is clipped to the inscribed circle.
+  const bool round_screen_;
+
   std::unique_ptr<Menu> CreateMenu(const std::vector<std::string>& text_headers,
                                    const std::vector<std::string>& text_items,
                                    size_t initial_selection) const override;
 
+  bool InitGraphics() override;
+
   int GetProgressBaseline() const override;
 
   void update_progress_locked() override;
@@ -47,6 +52,7 @@ class WearRecoveryUI : public ScreenRecoveryUI {
  private:
   void draw_background_locked() override;
   void draw_screen_locked() override;
+  bool draw_menu_row_background_locked(int top, int bottom) override;
 };
 
 #endif  // RECOVERY_WEAR_UI_H
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "recovery_ui/property_snapshot.h"
+
+#include <android-base/parsebool.h>
+#include <android-base/properties.h>
+
+PropertySnapshot::PropertySnapshot(const std::vector<std::string>& names) {
+  for (const auto& name : names) {
+    values_.emplace(name, android::base::GetProperty(name, ""));
+  }
+}
+
+std::string PropertySnapshot::Get(const std::string& name, const std::string& default_value) const {
+  auto it = values_.find(name);
+  if (it == values_.end()) {
+    return android::base::GetProperty(name, default_value);
+  }
+  return it->second.empty() ? default_value : it->second;
+}
+
+bool PropertySnapshot::GetBool(const std::string& name, bool default_value) const {
+  switch (android::base::ParseBool(Get(name))) {
+    case android::base::ParseBoolResult::kTrue:
+      return true;
+    case android::base::ParseBoolResult::kFalse:
+      return false;
+    default:
+      return default_value;
+  }
+}
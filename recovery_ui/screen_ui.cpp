@@ -30,20 +30,24 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <memory>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <android-base/chrono_utils.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
+#include <android-base/scopeguard.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 
 #include "minui/minui.h"
+#include "otautil/async_logger.h"
 #include "otautil/paths.h"
 #include "recovery_ui/device.h"
 #include "recovery_ui/ui.h"
@@ -67,6 +71,21 @@ size_t Menu::selection() const {
   return selection_;
 }
 
+MenuView Menu::GetView() const {
+  return { 0, 0, selection_ };
+}
+
+bool Menu::GetDamage(const MenuView& /* drawn */, bool /* can_scroll */,
+                     MenuDamage* /* damage */) const {
+  return false;
+}
+
+bool Menu::GetRowSpan(int /* row */, int* /* top */, int* /* bottom */) const {
+  return false;
+}
+
+void Menu::DrawRows(const std::vector<int>& /* rows */, bool /* long_press */) const {}
+
 TextMenu::TextMenu(bool scrollable, size_t max_items, size_t max_length,
                    const std::vector<std::string>& headers, const std::vector<std::string>& items,
                    size_t initial_selection, int char_height, const DrawInterface& draw_funcs)
@@ -92,7 +111,7 @@ const std::vector<std::string>& TextMenu::text_headers() const {
   return text_headers_;
 }
 
-std::string TextMenu::TextItem(size_t index) const {
+const std::string& TextMenu::TextItem(size_t index) const {
   CHECK_LT(index, text_items_.size());
 
   return text_items_[index];
@@ -157,6 +176,7 @@ int TextMenu::Select(int sel) {
 int TextMenu::DrawHeader(int x, int y) const {
   int offset = 0;
 
+  pending_layout_.status_y = -1;
   draw_funcs_.SetColor(UIElement::HEADER);
   if (!scrollable()) {
     offset += draw_funcs_.DrawWrappedTextLines(x, y + offset, text_headers());
@@ -166,6 +186,7 @@ int TextMenu::DrawHeader(int x, int y) const {
     // screen.
     std::string cur_selection_str;
     if (ItemsOverflow(&cur_selection_str)) {
+      pending_layout_.status_y = y + offset;
       offset += draw_funcs_.DrawTextLine(x, y + offset, cur_selection_str, true);
     }
   }
@@ -173,34 +194,141 @@ int TextMenu::DrawHeader(int x, int y) const {
   return offset;
 }
 
+int TextMenu::DrawItem(size_t index, int x, int y, int screen_width, bool long_press) const {
+  bool bold = false;
+  if (index == selection()) {
+    // Draw the highlight bar.
+    draw_funcs_.SetColor(long_press ? UIElement::MENU_SEL_BG_ACTIVE : UIElement::MENU_SEL_BG);
+
+    int bar_height = char_height_ + 4;
+    draw_funcs_.DrawHighlightBar(0, y - 2, screen_width, bar_height);
+
+    // Bold white text for the selected item.
+    draw_funcs_.SetColor(UIElement::MENU_SEL_FG);
+    bold = true;
+  }
+  int offset = draw_funcs_.DrawTextLine(x, y, TextItem(index), bold);
+
+  draw_funcs_.SetColor(UIElement::MENU);
+  return offset;
+}
+
 int TextMenu::DrawItems(int x, int y, int screen_width, bool long_press) const {
   int offset = 0;
 
+  pending_layout_.x = x;
+  pending_layout_.screen_width = screen_width;
+  pending_layout_.item_y.clear();
+
   draw_funcs_.SetColor(UIElement::MENU);
   // Do not draw the horizontal rule for wear devices.
   if (!scrollable()) {
     offset += draw_funcs_.DrawHorizontalRule(y + offset) + 4;
   }
   for (size_t i = MenuStart(); i < MenuEnd(); ++i) {
-    bool bold = false;
-    if (i == selection()) {
-      // Draw the highlight bar.
-      draw_funcs_.SetColor(long_press ? UIElement::MENU_SEL_BG_ACTIVE : UIElement::MENU_SEL_BG);
+    pending_layout_.item_y.push_back(y + offset);
+    offset += DrawItem(i, x, y + offset, screen_width, long_press);
+  }
+  offset += draw_funcs_.DrawHorizontalRule(y + offset);
 
-      int bar_height = char_height_ + 4;
-      draw_funcs_.DrawHighlightBar(0, y + offset - 2, screen_width, bar_height);
+  if (layout_.id == 0 || pending_layout_.x != layout_.x ||
+      pending_layout_.screen_width != layout_.screen_width ||
+      pending_layout_.status_y != layout_.status_y || pending_layout_.item_y != layout_.item_y) {
+    static std::atomic<uint64_t> next_layout_id{ 1 };
+    layout_ = pending_layout_;
+    layout_.id = next_layout_id++;
+  }
 
-      // Bold white text for the selected item.
-      draw_funcs_.SetColor(UIElement::MENU_SEL_FG);
-      bold = true;
+  return offset;
+}
+
+MenuView TextMenu::GetView() const {
+  return { layout_.id, MenuStart(), selection() };
+}
+
+bool TextMenu::GetDamage(const MenuView& drawn, bool can_scroll, MenuDamage* damage) const {
+  size_t rows = layout_.item_y.size();
+  if (layout_.id == 0 || drawn.layout != layout_.id || rows != MenuEnd() - MenuStart()) {
+    return false;
+  }
+
+  *damage = {};
+  // Marks the row showing item |index| (if visible) as stale.
+  auto add_item = [&](size_t index) {
+    if (index >= MenuStart() && index < MenuEnd()) {
+      damage->rows.push_back(index - MenuStart());
     }
-    offset += draw_funcs_.DrawTextLine(x, y + offset, TextItem(i), bold);
+  };
 
-    draw_funcs_.SetColor(UIElement::MENU);
+  if (MenuStart() == drawn.start) {
+    if (selection_ != drawn.selection) {
+      add_item(drawn.selection);
+      add_item(selection_);
+    }
+  } else {
+    // The rows are evenly spaced, so scrolling moves the drawn items by a multiple of that. Do so
+    // if allowed, and only draw the newly exposed rows plus the ones whose highlight changed.
+    int pitch = rows > 1 ? layout_.item_y[1] - layout_.item_y[0] : 0;
+    bool forward = MenuStart() > drawn.start;
+    size_t distance = forward ? MenuStart() - drawn.start : drawn.start - MenuStart();
+    if (can_scroll && distance < rows && pitch > 0) {
+      GetRowSpan(0, &damage->scroll_top, nullptr);
+      GetRowSpan(rows - 1, nullptr, &damage->scroll_bottom);
+      damage->scroll_dy = static_cast<int>(distance) * (forward ? -pitch : pitch);
+      for (size_t i = 0; i < distance; ++i) {
+        add_item(forward ? MenuEnd() - 1 - i : MenuStart() + i);
+      }
+      add_item(drawn.selection);
+      add_item(selection_);
+    } else {
+      for (size_t i = 0; i < rows; ++i) {
+        damage->rows.push_back(i);
+      }
+    }
   }
-  offset += draw_funcs_.DrawHorizontalRule(y + offset);
 
-  return offset;
+  if (layout_.status_y >= 0 && selection_ != drawn.selection) {
+    damage->rows.push_back(kStatusRow);
+  }
+
+  std::sort(damage->rows.begin(), damage->rows.end());
+  damage->rows.erase(std::unique(damage->rows.begin(), damage->rows.end()), damage->rows.end());
+  return true;
+}
+
+bool TextMenu::GetRowSpan(int row, int* top, int* bottom) const {
+  int row_top, row_bottom;
+  if (row == kStatusRow && layout_.status_y >= 0) {
+    // Just the text; the line spacing below may be covered by the highlight bar of the first item.
+    row_top = layout_.status_y;
+    row_bottom = layout_.status_y + char_height_;
+  } else if (row >= 0 && static_cast<size_t>(row) < layout_.item_y.size()) {
+    // Same area as the highlight bar drawn by DrawItem().
+    row_top = layout_.item_y[row] - 2;
+    row_bottom = row_top + char_height_ + 4;
+  } else {
+    return false;
+  }
+
+  if (top != nullptr) *top = row_top;
+  if (bottom != nullptr) *bottom = row_bottom;
+  return true;
+}
+
+void TextMenu::DrawRows(const std::vector<int>& rows, bool long_press) const {
+  for (int row : rows) {
+    if (row == kStatusRow) {
+      std::string cur_selection_str;
+      if (layout_.status_y >= 0 && ItemsOverflow(&cur_selection_str)) {
+        draw_funcs_.SetColor(UIElement::HEADER);
+        draw_funcs_.DrawTextLine(layout_.x, layout_.status_y, cur_selection_str, true);
+      }
+    } else if (row >= 0 && static_cast<size_t>(row) < layout_.item_y.size()) {
+      draw_funcs_.SetColor(UIElement::MENU);
+      DrawItem(MenuStart() + row, layout_.x, layout_.item_y[row], layout_.screen_width,
+               long_press);
+    }
+  }
 }
 
 GraphicMenu::GraphicMenu(const GRSurface* graphic_headers,
@@ -679,7 +807,9 @@ int ScreenRecoveryUI::DrawWrappedTextLines(int x, int y,
 }
 
 void ScreenRecoveryUI::SetTitle(const std::vector<std::string>& lines) {
+  std::lock_guard<std::mutex> lg(updateMutex);
   title_lines_ = lines;
+  menu_frames_.clear();
 }
 
 std::vector<std::string> ScreenRecoveryUI::GetMenuHelpMessage() const {
@@ -757,6 +887,91 @@ void ScreenRecoveryUI::draw_menu_and_text_buffer_locked(
 void ScreenRecoveryUI::update_screen_locked() {
   draw_screen_locked();
   gr_flip();
+  // The older frames still in the other buffers may miss whatever else changed on screen (e.g.
+  // printed lines), so they can't be caught up with menu rows alone.
+  menu_frames_.clear();
+  record_menu_frame_locked();
+  update_deferred_ = false;
+}
+
+// Should only be called with updateMutex locked.
+void ScreenRecoveryUI::request_update_locked() {
+  // Something other than the menu selection has changed, which a menu row update can't show.
+  menu_frames_.clear();
+  if (update_depth_ > 0) {
+    update_deferred_ = true;
+    return;
+  }
+  update_screen_locked();
+}
+
+bool ScreenRecoveryUI::draw_menu_row_background_locked(int top, int bottom) {
+  bottom = std::min(bottom, gr_fb_height());
+  if (top < bottom) {
+    gr_color(0, 0, 0, 255);
+    gr_fill(0, top, gr_fb_width(), bottom);
+  }
+  return true;
+}
+
+// Updates the screen after the menu selection has changed, by redrawing only the menu rows that
+// changed rather than the whole screen. Should only be called with updateMutex locked.
+void ScreenRecoveryUI::update_menu_selection_locked() {
+  // The draw surface may hold an older frame than the one on screen (e.g. double buffering). Find
+  // out what the menu looks like in there.
+  int age = gr_draw_buffer_age();
+  auto drawn = menu_frames_.find(gr_flip_count() + 1 - age);
+  MenuDamage damage;
+  bool in_place = show_text && menu_ && age > 0 && drawn != menu_frames_.end() &&
+                  menu_->GetDamage(drawn->second, true, &damage);
+  if (in_place && damage.scroll_dy != 0) {
+    // Long menus may run off the screen. Only the rows on screen can be moved; the ones that should
+    // move up from below it need to be drawn instead, and so does any row cut by the bottom edge
+    // (a full redraw leaves out text that doesn't fit, but the blit may have moved some in).
+    int screen_bottom = std::min(damage.scroll_bottom, gr_fb_height());
+    if (gr_scroll(damage.scroll_top, screen_bottom, damage.scroll_dy)) {
+      int exposed = screen_bottom + std::min(damage.scroll_dy, 0);
+      int top, bottom;
+      for (int row = 0; menu_->GetRowSpan(row, &top, &bottom); ++row) {
+        if (bottom > exposed && top < screen_bottom) {
+          damage.rows.push_back(row);
+        }
+      }
+      std::sort(damage.rows.begin(), damage.rows.end());
+      damage.rows.erase(std::unique(damage.rows.begin(), damage.rows.end()), damage.rows.end());
+    } else {
+      in_place = menu_->GetDamage(drawn->second, false, &damage);
+    }
+  }
+  for (auto it = damage.rows.begin(); in_place && it != damage.rows.end(); ++it) {
+    int top, bottom;
+    in_place = menu_->GetRowSpan(*it, &top, &bottom) &&
+               draw_menu_row_background_locked(top, bottom);
+  }
+
+  if (in_place) {
+    menu_->DrawRows(damage.rows, IsLongPress());
+  } else {
+    // Unlike update_screen_locked(), this keeps the older frames: only the selection has changed
+    // since, so the next update can still catch them up in place.
+    draw_screen_locked();
+  }
+  gr_flip();
+  record_menu_frame_locked();
+}
+
+// Remembers what the menu looks like in the frame just flipped. Should only be called with
+// updateMutex locked.
+void ScreenRecoveryUI::record_menu_frame_locked() {
+  // Keeps the last three frames, enough for triple buffering.
+  constexpr uint64_t kMaxMenuFrames = 3;
+  uint64_t frame = gr_flip_count();
+  while (!menu_frames_.empty() && menu_frames_.begin()->first + kMaxMenuFrames <= frame) {
+    menu_frames_.erase(menu_frames_.begin());
+  }
+  if (show_text && menu_) {
+    menu_frames_[frame] = menu_->GetView();
+  }
 }
 
 // Updates only the progress bar, if possible, otherwise redraws the screen.
@@ -808,7 +1023,8 @@ void ScreenRecoveryUI::ProgressThreadLoop() {
         }
       }
 
-      if (redraw) update_progress_locked();
+      // Leave the redraw to the end of a batch of updates, if any.
+      if (redraw && update_depth_ == 0) update_progress_locked();
     }
 
     double end = now();
@@ -888,7 +1104,7 @@ bool ScreenRecoveryUI::LoadWipeDataMenuText() {
   return true;
 }
 
-static bool InitGraphics() {
+bool ScreenRecoveryUI::InitGraphics() {
   // Timeout is same as init wait for file default of 5 seconds and is arbitrary
   const unsigned timeout = 500;  // 10ms increments
   for (auto retry = timeout; retry > 0; --retry) {
@@ -1011,7 +1227,7 @@ void ScreenRecoveryUI::SetBackground(Icon icon) {
   std::lock_guard<std::mutex> lg(updateMutex);
 
   current_icon_ = icon;
-  update_screen_locked();
+  request_update_locked();
 }
 
 void ScreenRecoveryUI::SetProgressType(ProgressType type) {
@@ -1062,6 +1278,8 @@ void ScreenRecoveryUI::PrintV(const char* fmt, bool copy_to_stdout, va_list ap)
   android::base::StringAppendV(&str, fmt, ap);
 
   if (copy_to_stdout) {
+    // stdout shares recovery.log with the log sink; drain queued lines so they stay in order.
+    FlushAsyncLogging();
     fputs(str.c_str(), stdout);
   }
 
@@ -1076,7 +1294,7 @@ void ScreenRecoveryUI::PrintV(const char* fmt, bool copy_to_stdout, va_list ap)
       if (*ptr != '\n') text_[text_row_][text_col_++] = *ptr;
     }
     text_[text_row_][text_col_] = '\0';
-    update_screen_locked();
+    request_update_locked();
   }
 }
 
@@ -1096,6 +1314,7 @@ void ScreenRecoveryUI::PrintOnScreenOnly(const char* fmt, ...) {
 
 void ScreenRecoveryUI::PutChar(char ch) {
   std::lock_guard<std::mutex> lg(updateMutex);
+  menu_frames_.clear();
   if (ch != '\n') text_[text_row_][text_col_++] = ch;
   if (ch == '\n' || text_col_ >= text_cols_) {
     text_col_ = 0;
@@ -1105,6 +1324,7 @@ void ScreenRecoveryUI::PutChar(char ch) {
 
 void ScreenRecoveryUI::ClearText() {
   std::lock_guard<std::mutex> lg(updateMutex);
+  menu_frames_.clear();
   text_col_ = 0;
   text_row_ = 0;
   for (size_t i = 0; i < text_rows_; ++i) {
@@ -1113,6 +1333,10 @@ void ScreenRecoveryUI::ClearText() {
 }
 
 void ScreenRecoveryUI::ShowFile(FILE* fp) {
+  int update_depth = SuspendUpdates();
+  auto resume_updates =
+      android::base::make_scope_guard([this, update_depth] { ResumeUpdates(update_depth); });
+
   std::vector<off_t> offsets;
   offsets.push_back(ftello(fp));
   ClearText();
@@ -1223,7 +1447,7 @@ int ScreenRecoveryUI::SelectMenu(int sel) {
     sel = menu_->Select(sel);
 
     if (sel != old_sel) {
-      update_screen_locked();
+      update_menu_selection_locked();
     }
   }
   return sel;
@@ -1240,8 +1464,11 @@ size_t ScreenRecoveryUI::ShowMenu(std::unique_ptr<Menu>&& menu, bool menu_only,
 
   CHECK(menu != nullptr);
 
-  // Starts and displays the menu
+  // Starts and displays the menu, along with any batched changes.
   menu_ = std::move(menu);
+  int update_depth = SuspendUpdates();
+  auto resume_updates =
+      android::base::make_scope_guard([this, update_depth] { ResumeUpdates(update_depth); });
   Redraw();
 
   int selected = menu_->selection();
@@ -1344,12 +1571,35 @@ void ScreenRecoveryUI::ShowText(bool visible) {
   std::lock_guard<std::mutex> lg(updateMutex);
   show_text = visible;
   if (show_text) show_text_ever = true;
-  update_screen_locked();
+  request_update_locked();
 }
 
 void ScreenRecoveryUI::Redraw() {
   std::lock_guard<std::mutex> lg(updateMutex);
-  update_screen_locked();
+  request_update_locked();
+}
+
+void ScreenRecoveryUI::BeginUpdate() {
+  std::lock_guard<std::mutex> lg(updateMutex);
+  ++update_depth_;
+}
+
+void ScreenRecoveryUI::EndUpdate() {
+  std::lock_guard<std::mutex> lg(updateMutex);
+  CHECK_GT(update_depth_, 0);
+  if (--update_depth_ == 0 && update_deferred_) {
+    update_screen_locked();
+  }
+}
+
+int ScreenRecoveryUI::SuspendUpdates() {
+  std::lock_guard<std::mutex> lg(updateMutex);
+  return std::exchange(update_depth_, 0);
+}
+
+void ScreenRecoveryUI::ResumeUpdates(int depth) {
+  std::lock_guard<std::mutex> lg(updateMutex);
+  update_depth_ += depth;
 }
 
 void ScreenRecoveryUI::KeyLongPress(int) {
@@ -39,6 +39,7 @@
 
 #include "minui/minui.h"
 #include "otautil/sysutil.h"
+#include "recovery_ui/backlight.h"
 
 using namespace std::chrono_literals;
 
@@ -141,11 +142,12 @@ bool RecoveryUI::InitScreensaver() {
 
   brightness_normal_value_ = max_value * brightness_normal_ / 100.0;
   brightness_dimmed_value_ = max_value * brightness_dimmed_ / 100.0;
-  if (!android::base::WriteStringToFile(std::to_string(brightness_normal_value_),
-                                        brightness_file_)) {
-    PLOG(WARNING) << "Failed to set brightness";
+  backlight_ = std::make_unique<Backlight>(brightness_file_);
+  if (!backlight_->Start()) {
+    backlight_.reset();
     return false;
   }
+  backlight_->Set(brightness_normal_value_, false);
 
   LOG(INFO) << "Brightness: " << brightness_normal_value_ << " (" << brightness_normal_ << "%)";
   screensaver_state_ = ScreensaverState::NORMAL;
@@ -425,38 +427,29 @@ void RecoveryUI::EnqueueKey(int key_code) {
 }
 
 void RecoveryUI::SetScreensaverState(ScreensaverState state) {
+  if (!backlight_) {
+    return;
+  }
+  // The writes happen on the backlight thread, so that the input thread never waits on them. Waking
+  // up takes effect at once, while dimming and turning off ramp down.
   switch (state) {
     case ScreensaverState::NORMAL:
-      if (android::base::WriteStringToFile(std::to_string(brightness_normal_value_),
-                                           brightness_file_)) {
-        screensaver_state_ = ScreensaverState::NORMAL;
-        LOG(INFO) << "Brightness: " << brightness_normal_value_ << " (" << brightness_normal_
-                  << "%)";
-      } else {
-        LOG(WARNING) << "Unable to set brightness to normal";
-      }
+      backlight_->Set(brightness_normal_value_, false);
+      LOG(INFO) << "Brightness: " << brightness_normal_value_ << " (" << brightness_normal_ << "%)";
       break;
     case ScreensaverState::DIMMED:
-      if (android::base::WriteStringToFile(std::to_string(brightness_dimmed_value_),
-                                           brightness_file_)) {
-        LOG(INFO) << "Brightness: " << brightness_dimmed_value_ << " (" << brightness_dimmed_
-                  << "%)";
-        screensaver_state_ = ScreensaverState::DIMMED;
-      } else {
-        LOG(WARNING) << "Unable to set brightness to dim";
-      }
+      backlight_->Set(brightness_dimmed_value_, true);
+      LOG(INFO) << "Brightness: " << brightness_dimmed_value_ << " (" << brightness_dimmed_ << "%)";
       break;
     case ScreensaverState::OFF:
-      if (android::base::WriteStringToFile("0", brightness_file_)) {
-        LOG(INFO) << "Brightness: 0 (off)";
-        screensaver_state_ = ScreensaverState::OFF;
-      } else {
-        LOG(WARNING) << "Unable to set brightness to off";
-      }
+      backlight_->Set(0, true);
+      LOG(INFO) << "Brightness: 0 (off)";
       break;
     default:
       LOG(ERROR) << "Invalid screensaver state";
+      return;
   }
+  screensaver_state_ = state;
 }
 
 int RecoveryUI::WaitKey() {
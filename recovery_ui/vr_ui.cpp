@@ -16,6 +16,9 @@
 
 #include "recovery_ui/vr_ui.h"
 
+#include <algorithm>
+
+#include <android-base/logging.h>
 #include <android-base/properties.h>
 
 #include "minui/minui.h"
@@ -26,6 +29,8 @@ VrRecoveryUI::VrRecoveryUI()
     : stereo_offset_(
           android::base::GetIntProperty("ro.recovery.ui.stereo_offset", kDefaultStereoOffset)) {}
 
+VrRecoveryUI::~VrRecoveryUI() = default;
+
 int VrRecoveryUI::ScreenWidth() const {
   return gr_fb_width() / 2;
 }
@@ -34,39 +39,61 @@ int VrRecoveryUI::ScreenHeight() const {
   return gr_fb_height();
 }
 
-void VrRecoveryUI::DrawSurface(const GRSurface* surface, int sx, int sy, int w, int h, int dx,
-                               int dy) const {
-  gr_blit(surface, sx, sy, w, h, dx + stereo_offset_, dy);
-  gr_blit(surface, sx, sy, w, h, dx - stereo_offset_ + ScreenWidth(), dy);
+int VrRecoveryUI::DrawHorizontalRule(int y) const {
+  y += 4;
+  gr_fill(margin_width_, y, ScreenWidth() - margin_width_, y + 2);
+  return y + 4;
 }
 
-void VrRecoveryUI::DrawTextIcon(int x, int y, const GRSurface* surface) const {
-  gr_texticon(x + stereo_offset_, y, surface);
-  gr_texticon(x - stereo_offset_ + ScreenWidth(), y, surface);
+void VrRecoveryUI::DrawHighlightBar(int /* x */, int y, int /* width */, int height) const {
+  gr_fill(margin_width_, y, ScreenWidth() - margin_width_, y + height);
 }
 
-int VrRecoveryUI::DrawTextLine(int x, int y, const std::string& line, bool bold) const {
-  gr_text(gr_sys_font(), x + stereo_offset_, y, line.c_str(), bold);
-  gr_text(gr_sys_font(), x - stereo_offset_ + ScreenWidth(), y, line.c_str(), bold);
-  return char_height_ + 4;
+// Should only be called with updateMutex locked.
+void VrRecoveryUI::draw_screen_locked() {
+  int width = ScreenWidth();
+  int height = ScreenHeight();
+  if (!eye_surface_ || eye_surface_->width != static_cast<size_t>(width) ||
+      eye_surface_->height != static_cast<size_t>(height)) {
+    eye_surface_ = GRSurface::Create(width, height, width * 4, 4);
+    if (!eye_surface_) {
+      LOG(ERROR) << "Failed to allocate the " << width << "x" << height << " eye surface";
+      return;
+    }
+  }
+
+  gr_set_draw_target(eye_surface_.get());
+  ScreenRecoveryUI::draw_screen_locked();
+  gr_set_draw_target(nullptr);
+
+  // The views only cover the whole screen if they aren't offset.
+  if (stereo_offset_ != 0 || gr_fb_width() != 2 * width) {
+    gr_color(0, 0, 0, 255);
+    gr_clear();
+  }
+  for (int left : { stereo_offset_, width - stereo_offset_ }) {
+    copy_to_eye_locked(left);
+    draw_eye_overlay_locked(left);
+  }
 }
 
-int VrRecoveryUI::DrawHorizontalRule(int y) const {
-  y += 4;
-  gr_fill(margin_width_ + stereo_offset_, y, ScreenWidth() - margin_width_ + stereo_offset_, y + 2);
-  gr_fill(ScreenWidth() + margin_width_ - stereo_offset_, y,
-          gr_fb_width() - margin_width_ - stereo_offset_, y + 2);
-  return y + 4;
+// Should only be called with updateMutex locked.
+void VrRecoveryUI::update_menu_selection_locked() {
+  update_screen_locked();
 }
 
-void VrRecoveryUI::DrawHighlightBar(int /* x */, int y, int /* width */, int height) const {
-  gr_fill(margin_width_ + stereo_offset_, y, ScreenWidth() - margin_width_ + stereo_offset_,
-          y + height);
-  gr_fill(ScreenWidth() + margin_width_ - stereo_offset_, y,
-          gr_fb_width() - margin_width_ - stereo_offset_, y + height);
+// Should only be called with updateMutex locked.
+void VrRecoveryUI::update_progress_locked() {
+  draw_screen_locked();
+  gr_flip();
 }
 
-void VrRecoveryUI::DrawFill(int x, int y, int w, int h) const {
-  gr_fill(x + stereo_offset_, y, w, h);
-  gr_fill(x - stereo_offset_ + ScreenWidth(), y, w, h);
+// Should only be called with updateMutex locked.
+void VrRecoveryUI::copy_to_eye_locked(int left) {
+  int sx = std::max(0, -left);
+  int dx = std::max(0, left);
+  int width = std::min(static_cast<int>(eye_surface_->width) - sx, gr_fb_width() - dx);
+  if (width > 0) {
+    gr_blit(eye_surface_.get(), sx, 0, width, eye_surface_->height, dx, 0);
+  }
 }
@@ -33,12 +33,24 @@ WearRecoveryUI::WearRecoveryUI()
       progress_bar_baseline_(android::base::GetIntProperty("ro.recovery.ui.progress_bar_baseline",
                                                            kDefaultProgressBarBaseline)),
       menu_unusable_rows_(android::base::GetIntProperty("ro.recovery.ui.menu_unusable_rows",
-                                                        kDefaultMenuUnusableRows)) {
+                                                        kDefaultMenuUnusableRows)),
+      round_screen_(android::base::GetBoolProperty("ro.recovery.ui.round_screen", false)) {
   // TODO: menu_unusable_rows_ should be computed based on the lines in draw_screen_locked().
 
   touch_screen_allowed_ = true;
 }
 
+bool WearRecoveryUI::InitGraphics() {
+  if (!ScreenRecoveryUI::InitGraphics()) {
+    return false;
+  }
+  // Nothing outside the circle is visible, so don't spend time drawing there.
+  if (round_screen_) {
+    gr_set_clip_spans(gr_round_clip_spans(gr_fb_width(), gr_fb_height()));
+  }
+  return true;
+}
+
 int WearRecoveryUI::GetProgressBaseline() const {
   return progress_bar_baseline_;
 }
@@ -87,6 +99,12 @@ void WearRecoveryUI::draw_screen_locked() {
   }
 }
 
+bool WearRecoveryUI::draw_menu_row_background_locked(int top, int bottom) {
+  // The text fill is translucent, so rows can't be redrawn over an icon.
+  if (current_icon_ != NONE) return false;
+  return ScreenRecoveryUI::draw_menu_row_background_locked(top, bottom);
+}
+
 // TODO merge drawing routines with screen_ui
 void WearRecoveryUI::update_progress_locked() {
   draw_screen_locked();
@@ -17,44 +17,35 @@
 #include "recovery_utils/battery_utils.h"
 
 #include <stdint.h>
-#include <unistd.h>
+
+#include <algorithm>
+#include <optional>
+#include <utility>
 
 #include <android-base/logging.h>
 #include <android/binder_manager.h>
 #include <health-shim/shim.h>
 #include <healthhalutils/HealthHalUtils.h>
 
-BatteryInfo GetBatteryInfo() {
-  using android::hardware::health::V2_0::get_health_service;
-  using HidlHealth = android::hardware::health::V2_0::IHealth;
-  using aidl::android::hardware::health::BatteryStatus;
-  using aidl::android::hardware::health::HealthShim;
-  using aidl::android::hardware::health::IHealth;
-  using aidl::android::hardware::health::toString;
-  using std::string_literals::operator""s;
-
-  auto service_name = IHealth::descriptor + "/default"s;
-  std::shared_ptr<IHealth> health;
-  if (AServiceManager_isDeclared(service_name.c_str())) {
-    ndk::SpAIBinder binder(AServiceManager_waitForService(service_name.c_str()));
-    health = IHealth::fromBinder(binder);
-  }
-  if (health == nullptr) {
-    LOG(INFO) << "Unable to get AIDL health service, trying HIDL...";
-    android::sp<HidlHealth> hidl_health = get_health_service();
-    if (hidl_health != nullptr) {
-      health = ndk::SharedRefBase::make<HealthShim>(hidl_health);
+using aidl::android::hardware::health::IHealth;
+using namespace std::chrono_literals;
+
+namespace {
+
+class HealthHalBackend : public HealthBackend {
+ public:
+  BatteryInfo Read() override {
+    using aidl::android::hardware::health::BatteryStatus;
+    using aidl::android::hardware::health::toString;
+
+    if (!connected_) {
+      health_ = Connect();
+      connected_ = true;
     }
-  }
-  if (health == nullptr) {
-    LOG(WARNING) << "No health implementation is found; assuming defaults";
-  }
 
-  int wait_second = 0;
-  while (true) {
     auto charge_status = BatteryStatus::UNKNOWN;
-    if (health != nullptr) {
-      auto res = health->getChargeStatus(&charge_status);
+    if (health_ != nullptr) {
+      auto res = health_->getChargeStatus(&charge_status);
       if (!res.isOk()) {
         LOG(WARNING) << "Unable to call getChargeStatus: " << res.getDescription();
         charge_status = BatteryStatus::UNKNOWN;
@@ -67,8 +58,8 @@ BatteryInfo GetBatteryInfo() {
                      charge_status != BatteryStatus::NOT_CHARGING);
 
     int32_t capacity = INT32_MIN;
-    if (health != nullptr) {
-      auto res = health->getCapacity(&capacity);
+    if (health_ != nullptr) {
+      auto res = health_->getCapacity(&capacity);
       if (!res.isOk()) {
         LOG(WARNING) << "Unable to call getCapacity: " << res.getDescription();
         capacity = INT32_MIN;
@@ -77,30 +68,145 @@ BatteryInfo GetBatteryInfo() {
 
     LOG(INFO) << "charge_status " << toString(charge_status) << ", charging " << charging
               << ", capacity " << capacity;
+    return BatteryInfo{ charging, capacity };
+  }
+
+ private:
+  static std::shared_ptr<IHealth> Connect() {
+    using android::hardware::health::V2_0::get_health_service;
+    using HidlHealth = android::hardware::health::V2_0::IHealth;
+    using aidl::android::hardware::health::HealthShim;
+    using std::string_literals::operator""s;
 
-    constexpr int BATTERY_READ_TIMEOUT_IN_SEC = 10;
-    // At startup, the battery drivers in devices like N5X/N6P take some time to load
-    // the battery profile. Before the load finishes, it reports value 50 as a fake
-    // capacity. BATTERY_READ_TIMEOUT_IN_SEC is set that the battery drivers are expected
-    // to finish loading the battery profile earlier than 10 seconds after kernel startup.
-    if (capacity == 50) {
-      if (wait_second < BATTERY_READ_TIMEOUT_IN_SEC) {
-        LOG(INFO) << "Battery capacity == 50, waiting "
-                  << (BATTERY_READ_TIMEOUT_IN_SEC - wait_second)
-                  << " seconds to ensure this is not a fake value...";
-        sleep(1);
-        wait_second++;
-        continue;
+    auto service_name = IHealth::descriptor + "/default"s;
+    std::shared_ptr<IHealth> health;
+    if (AServiceManager_isDeclared(service_name.c_str())) {
+      ndk::SpAIBinder binder(AServiceManager_waitForService(service_name.c_str()));
+      health = IHealth::fromBinder(binder);
+    }
+    if (health == nullptr) {
+      LOG(INFO) << "Unable to get AIDL health service, trying HIDL...";
+      android::sp<HidlHealth> hidl_health = get_health_service();
+      if (hidl_health != nullptr) {
+        health = ndk::SharedRefBase::make<HealthShim>(hidl_health);
       }
     }
+    if (health == nullptr) {
+      LOG(WARNING) << "No health implementation is found; assuming defaults";
+    }
+    return health;
+  }
+
+  bool connected_{ false };
+  std::shared_ptr<IHealth> health_;
+};
+
+}  // namespace
+
+std::unique_ptr<HealthBackend> CreateHealthHalBackend() {
+  return std::make_unique<HealthHalBackend>();
+}
+
+BatteryMonitor& BatteryMonitor::Get() {
+  static BatteryMonitor* monitor = new BatteryMonitor(CreateHealthHalBackend());
+  return *monitor;
+}
+
+BatteryMonitor::BatteryMonitor(std::unique_ptr<HealthBackend> backend,
+                               std::chrono::milliseconds settle_timeout,
+                               std::chrono::milliseconds settle_interval)
+    : backend_(std::move(backend)),
+      settle_timeout_(settle_timeout),
+      settle_interval_(settle_interval) {}
+
+BatteryMonitor::~BatteryMonitor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void BatteryMonitor::Start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (thread_.joinable() || stopped_) {
+    return;
+  }
+  thread_ = std::thread(&BatteryMonitor::Run, this);
+}
+
+BatteryInfo BatteryMonitor::GetInfo(std::chrono::milliseconds max_age) {
+  Start();
+  auto since = std::chrono::steady_clock::now() - max_age;
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto fresh = [this, since]() { return has_info_ && info_.time >= since; };
+  if (!fresh()) {
+    wanted_since_ = std::max(wanted_since_, since);
+    cv_.notify_all();
+    cv_.wait(lock, fresh);
+  }
+  return info_;
+}
+
+size_t BatteryMonitor::reads() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return reads_;
+}
+
+void BatteryMonitor::Run() {
+  // When the capacity was first read as 50, until it's settled.
+  std::optional<std::chrono::steady_clock::time_point> fake_since;
+  bool settled = false;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopped_) {
+    lock.unlock();
+    // The value is as old as the start of the read.
+    auto now = std::chrono::steady_clock::now();
+    BatteryInfo info = backend_->Read();
+    info.time = now;
+    lock.lock();
+    reads_++;
+
+    if (!settled) {
+      if (info.capacity == 50) {
+        if (!fake_since) {
+          fake_since = info.time;
+        }
+        auto waited = info.time - *fake_since;
+        if (waited < settle_timeout_) {
+          LOG(INFO) << "Battery capacity == 50, waiting "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(settle_timeout_ -
+                                                                             waited)
+                           .count()
+                    << " ms to ensure this is not a fake value...";
+          cv_.wait_for(lock, settle_interval_, [this]() { return stopped_; });
+          continue;
+        }
+      }
+      settled = true;
+    }
+
     // If we can't read battery percentage, it may be a device without battery. In this
     // situation, use 100 as a fake battery percentage.
-    if (capacity == INT32_MIN) {
+    if (info.capacity == INT32_MIN) {
       LOG(WARNING) << "Using fake battery capacity 100.";
-      capacity = 100;
+      info.capacity = 100;
     }
+    LOG(INFO) << "BatteryMonitor reporting charging " << info.charging << ", capacity "
+              << info.capacity;
+    info_ = info;
+    has_info_ = true;
+    cv_.notify_all();
 
-    LOG(INFO) << "GetBatteryInfo() reporting charging " << charging << ", capacity " << capacity;
-    return BatteryInfo{ charging, capacity };
+    // Sleep until someone needs a newer value.
+    cv_.wait(lock, [this]() { return stopped_ || info_.time < wanted_since_; });
   }
 }
+
+BatteryInfo GetBatteryInfo() {
+  return BatteryMonitor::Get().GetInfo(0ms);
+}
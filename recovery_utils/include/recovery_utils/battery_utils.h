@@ -18,6 +18,12 @@
 
 #include <stdint.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 struct BatteryInfo {
   // Whether the device is on charger. Note that the value will be `true` if the battery status is
   // unknown (BATTERY_STATUS_UNKNOWN).
@@ -27,7 +33,79 @@ struct BatteryInfo {
   // hardware/interfaces/health/2.0/IHealth.hal. Returns 100 in case it fails to read a value from
   // the health HAL.
   int32_t capacity;
+
+  // When the values above were read.
+  std::chrono::steady_clock::time_point time{};
+};
+
+// Where the battery state comes from, i.e. the health HAL, or a fake one in tests.
+class HealthBackend {
+ public:
+  virtual ~HealthBackend() = default;
+
+  // Reads the current battery state as reported, with a capacity of INT32_MIN if it's unknown.
+  // May block, e.g. while waiting for the health service to come up.
+  virtual BatteryInfo Read() = 0;
+};
+
+// Returns a backend that reads the AIDL health HAL, or the HIDL one as a fallback. The service is
+// looked up upon the first Read().
+std::unique_ptr<HealthBackend> CreateHealthHalBackend();
+
+// Reads the battery state on a background thread, so that callers get a cached value instead of
+// waiting on the health service. At startup, the battery drivers of some devices (e.g. N5X/N6P)
+// report a fake capacity of 50 until they have loaded the battery profile. The monitor keeps
+// re-reading such a value every |settle_interval|, and only trusts it once it has lasted for
+// |settle_timeout|; a capacity of 50 seen after that is taken as is.
+class BatteryMonitor {
+ public:
+  static constexpr std::chrono::milliseconds kSettleTimeout{ 10000 };
+  static constexpr std::chrono::milliseconds kSettleInterval{ 1000 };
+
+  // The monitor that reads the health HAL. Never destroyed, so that process exit doesn't wait for
+  // a read in progress.
+  static BatteryMonitor& Get();
+
+  explicit BatteryMonitor(std::unique_ptr<HealthBackend> backend,
+                          std::chrono::milliseconds settle_timeout = kSettleTimeout,
+                          std::chrono::milliseconds settle_interval = kSettleInterval);
+  ~BatteryMonitor();
+
+  BatteryMonitor(const BatteryMonitor&) = delete;
+  BatteryMonitor& operator=(const BatteryMonitor&) = delete;
+
+  // Starts reading in the background. Should be called as early as possible, so that the fake
+  // capacity is settled by the time a value is needed. Idempotent.
+  void Start();
+
+  // Returns a value read no longer than |max_age| before the call, starting the monitor if needed.
+  // Returns the cached value at once if it's recent enough; otherwise waits for a new read, or for
+  // the fake capacity to be settled. A |max_age| of 0 always waits for a new read.
+  BatteryInfo GetInfo(std::chrono::milliseconds max_age);
+
+  // Returns the number of reads from the backend so far.
+  size_t reads() const;
+
+ private:
+  void Run();
+
+  const std::unique_ptr<HealthBackend> backend_;
+  const std::chrono::milliseconds settle_timeout_;
+  const std::chrono::milliseconds settle_interval_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  // The last settled value, if any.
+  BatteryInfo info_{};
+  bool has_info_{ false };
+  // The latest time a caller needs a value from; the thread reads again if the cached value is
+  // older.
+  std::chrono::steady_clock::time_point wanted_since_{};
+  size_t reads_{ 0 };
+  bool stopped_{ false };
+  std::thread thread_;
 };
 
-// Returns the battery status for OTA installation purpose.
+// Returns the battery status for OTA installation purpose, freshly read through
+// BatteryMonitor::Get().
 BatteryInfo GetBatteryInfo();
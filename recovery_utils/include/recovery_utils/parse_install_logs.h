@@ -16,15 +16,89 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
 constexpr const char* LAST_INSTALL_FILE = "/data/misc/recovery/last_install";
 constexpr const char* LAST_INSTALL_FILE_IN_CACHE = "/cache/recovery/last_install";
 
+// How the value of a key in last_install is parsed.
+enum class InstallLogValueType {
+  kInt,           // A plain integer, e.g. "error: 22".
+  kSeconds,       // A duration in seconds. Also accepts values with an "s" or "ms" suffix.
+  kMilliseconds,  // A duration in milliseconds. Also accepts values with an "s" or "ms" suffix.
+  kBytes,         // A byte count. Also accepts values with a "k", "m" or "g" suffix.
+  kHistogram,     // Space-separated "bucket=count" pairs, e.g. "0=12 10=40 20=3".
+};
+
+// An entry in the schema of last_install.
+struct InstallLogKey {
+  const char* name;
+  InstallLogValueType type;
+  // Whether |name| is the prefix of one key per stage (e.g. per partition), such as
+  // "bytes_written_system" and "bytes_written_vendor" for "bytes_written".
+  bool per_stage;
+};
+
+// The content of a last_install file, parsed according to a schema.
+struct InstallLog {
+  // The first two lines: the package and the install result.
+  std::string package;
+  int64_t result{ -1 };
+
+  // Values of the keys in the schema, converted to the unit of their type (seconds, milliseconds
+  // or bytes). If a key shows up more than once, the first value is kept.
+  std::map<std::string, int64_t> values;
+  // Values of the per-stage keys, keyed by stage and then by the key prefix.
+  std::map<std::string, std::map<std::string, int64_t>> stages;
+  // Histograms keyed by name, as bucket: count. Repeated lines are merged by adding the counts.
+  std::map<std::string, std::map<int64_t, int64_t>> histograms;
+  // Keys that aren't in the schema, with their raw values.
+  std::map<std::string, std::string> unknown;
+  // Lines that couldn't be parsed, e.g. with no ':' or a value that doesn't fit the type.
+  size_t malformed_lines{ 0 };
+};
+
+// Parses last_install as a stream, so that the whole file never needs to be in memory. Lines are
+// looked up in a table (the schema) rather than being matched against each key in turn.
+class InstallLogParser {
+ public:
+  // Uses the schema of the keys written by recovery, the updater and uncrypt.
+  InstallLogParser();
+  explicit InstallLogParser(const std::vector<InstallLogKey>& schema);
+
+  // Parses the next |data| of the file. A line may be split across calls.
+  void Feed(std::string_view data);
+
+  // Parses a complete line, without the trailing newline.
+  void ParseLine(std::string_view line);
+
+  // Parses whatever is left after the last newline, and returns the result.
+  InstallLog Finish();
+
+ private:
+  bool ParseValue(const InstallLogKey& key, std::string_view value, const std::string& name,
+                  std::map<std::string, int64_t>* values);
+
+  std::map<std::string, InstallLogKey, std::less<>> keys_;
+  std::vector<InstallLogKey> per_stage_keys_;
+
+  size_t line_count_{ 0 };
+  std::string partial_line_;
+  InstallLog log_;
+};
+
+// Parses the last_install file at |file_name| into |log|. Returns false if the file can't be read.
+bool ParseInstallLog(const std::string& file_name, InstallLog* log);
+
+// Returns the update metrics in |log|, as "metrics_name: value".
+std::map<std::string, int64_t> GetRecoveryUpdateMetrics(const InstallLog& log);
+
 // Parses the metrics of update applied under recovery mode in |lines|, and returns a map with
 // "name: value".
 std::map<std::string, int64_t> ParseRecoveryUpdateMetrics(const std::vector<std::string>& lines);
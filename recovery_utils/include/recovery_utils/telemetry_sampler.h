@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+// One point of the time series. Kept small so that a long install fits in the ring buffer.
+struct TelemetrySample {
+  // Milliseconds since the sampler started.
+  uint32_t time_ms;
+  // Maximum temperature among all thermal zones, in millidegree Celsius; -1 if unavailable.
+  int32_t max_temperature;
+  // Sectors (512 bytes) read and written by all the physical block devices since the previous
+  // sample.
+  uint32_t read_sectors;
+  uint32_t write_sectors;
+  // Milliseconds the block devices spent doing I/O since the previous sample (io_ticks).
+  uint32_t io_ticks;
+};
+
+// Samples the thermal zones and the block device stats periodically during an install. All the
+// sysfs nodes are opened once upon Start() and re-read with pread(2) on each tick, so that a tick
+// doesn't need to scan directories or open files. The samples go into a fixed-size ring buffer,
+// while the summary (see GetSummary()) covers the entire run.
+class TelemetrySampler {
+ public:
+  static constexpr std::chrono::milliseconds kMinInterval{ 250 };
+  static constexpr std::chrono::milliseconds kMaxInterval{ 1000 };
+  static constexpr std::chrono::milliseconds kDefaultInterval{ 500 };
+  // One hour worth of samples at the default interval, i.e. 144 KiB.
+  static constexpr size_t kDefaultCapacity = 7200;
+
+  // |interval| will be clamped into [kMinInterval, kMaxInterval]. The sysfs directories can be
+  // overridden for testing.
+  explicit TelemetrySampler(std::chrono::milliseconds interval = kDefaultInterval,
+                            size_t capacity = kDefaultCapacity,
+                            std::string thermal_dir = "/sys/class/thermal",
+                            std::string block_dir = "/sys/block");
+  ~TelemetrySampler();
+
+  TelemetrySampler(const TelemetrySampler&) = delete;
+  TelemetrySampler& operator=(const TelemetrySampler&) = delete;
+
+  // Opens the sysfs nodes, takes the first sample and starts the sampling thread.
+  void Start();
+  // Takes a final sample and stops the sampling thread. Also called by the destructor.
+  void Stop();
+
+  // Takes a sample synchronously. Start() calls Open() and samples via this function.
+  void SampleOnce();
+  // Opens the sysfs nodes without starting the thread. Returns the number of opened nodes.
+  size_t Open();
+
+  // Returns the samples in the ring buffer in chronological order.
+  std::vector<TelemetrySample> GetSamples() const;
+
+  // Returns the "key: value" lines to be written to last_install. The maximum temperature is
+  // already reported as temperature_max, so the summary focuses on the time series.
+  std::vector<std::string> GetSummary() const;
+
+  // The highest temperature seen so far (-1 if none).
+  int MaxTemperature() const;
+
+  std::chrono::milliseconds interval() const {
+    return interval_;
+  }
+
+ private:
+  struct BlockStat {
+    android::base::unique_fd fd;
+    uint64_t read_sectors;
+    uint64_t write_sectors;
+    uint64_t io_ticks;
+  };
+
+  int ReadMaxTemperature();
+  void ReadBlockStats(uint64_t* read_sectors, uint64_t* write_sectors, uint64_t* io_ticks);
+  void Run();
+
+  const std::chrono::milliseconds interval_;
+  const size_t capacity_;
+  const std::string thermal_dir_;
+  const std::string block_dir_;
+
+  std::vector<android::base::unique_fd> thermal_fds_;
+  std::vector<BlockStat> block_stats_;
+  std::chrono::steady_clock::time_point start_time_;
+
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  bool running_{ false };
+  std::thread thread_;
+
+  // The ring buffer; |next_| is where the next sample goes.
+  std::vector<TelemetrySample> samples_;
+  size_t next_{ 0 };
+  bool wrapped_{ false };
+
+  // Aggregates over all the samples, including the ones that have been overwritten.
+  uint64_t sample_count_{ 0 };
+  uint64_t temperature_sample_count_{ 0 };
+  int64_t temperature_sum_{ 0 };
+  int max_temperature_{ -1 };
+  uint64_t total_read_sectors_{ 0 };
+  uint64_t total_write_sectors_{ 0 };
+  uint64_t total_io_ticks_{ 0 };
+  uint64_t peak_write_kbps_{ 0 };
+  uint64_t peak_read_kbps_{ 0 };
+  uint32_t last_time_ms_{ 0 };
+};
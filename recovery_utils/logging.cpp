@@ -36,6 +36,7 @@
 #include <private/android_logger.h>            /* private pmsg functions */
 #include <selinux/label.h>
 
+#include "otautil/async_logger.h"
 #include "otautil/dirutil.h"
 #include "otautil/paths.h"
 #include "recovery_utils/roots.h"
@@ -210,6 +211,9 @@ void copy_logs(bool save_current_log) {
     return;
   }
 
+  // Drain any queued lines first so the copies below see the whole session.
+  FlushAsyncLogging();
+
   // Always write to pmsg, this allows the OTA logs to be caught in `logcat -L`.
   copy_log_file_to_pmsg(Paths::Get().temporary_log_file(), LAST_LOG_FILE);
   copy_log_file_to_pmsg(Paths::Get().temporary_install_file(), LAST_INSTALL_FILE);
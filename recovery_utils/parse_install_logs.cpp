@@ -16,15 +16,20 @@
 
 #include "recovery_utils/parse_install_logs.h"
 
+#include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <limits>
 #include <optional>
+#include <utility>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
 #include <android-base/properties.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 
 constexpr const char* OTA_SIDELOAD_METRICS = "ota_sideload";
 
@@ -33,48 +38,246 @@ constexpr const char* OTA_SIDELOAD_METRICS = "ota_sideload";
 // time_total: 101
 // bytes_written_vendor: 51074
 // bytes_stashed_vendor: 200
-std::map<std::string, int64_t> ParseRecoveryUpdateMetrics(const std::vector<std::string>& lines) {
-  constexpr unsigned int kMiB = 1024 * 1024;
-  std::optional<int64_t> bytes_written_in_mib;
-  std::optional<int64_t> bytes_stashed_in_mib;
-  std::map<std::string, int64_t> metrics;
-  for (const auto& line : lines) {
-    size_t num_index = line.find(':');
-    if (num_index == std::string::npos) {
-      LOG(WARNING) << "Skip parsing " << line;
-      continue;
+static const std::vector<InstallLogKey> kInstallLogSchema = {
+  // Written by recovery (install/install.cpp).
+  { "time_total", InstallLogValueType::kSeconds, false },
+  { "retry", InstallLogValueType::kInt, false },
+  { "source_build", InstallLogValueType::kInt, false },
+  { "target_build", InstallLogValueType::kInt, false },
+  { "error", InstallLogValueType::kInt, false },
+  { "cause", InstallLogValueType::kInt, false },
+  { "temperature_start", InstallLogValueType::kInt, false },
+  { "temperature_end", InstallLogValueType::kInt, false },
+  { "temperature_max", InstallLogValueType::kInt, false },
+  { "temperature_avg", InstallLogValueType::kInt, false },
+  { "telemetry_interval_ms", InstallLogValueType::kMilliseconds, false },
+  { "telemetry_samples", InstallLogValueType::kInt, false },
+  { "io_read_bytes", InstallLogValueType::kBytes, false },
+  { "io_write_bytes", InstallLogValueType::kBytes, false },
+  { "io_busy_ms", InstallLogValueType::kMilliseconds, false },
+  { "io_read_peak_kbps", InstallLogValueType::kInt, false },
+  { "io_write_peak_kbps", InstallLogValueType::kInt, false },
+  // Written by the updater (updater/blockimg.cpp) from the storage benchmark.
+  { "storage_seq_read_kbps", InstallLogValueType::kInt, false },
+  { "storage_seq_write_kbps", InstallLogValueType::kInt, false },
+  { "storage_rand_read_kbps", InstallLogValueType::kInt, false },
+  { "storage_rand_write_kbps", InstallLogValueType::kInt, false },
+  { "storage_sync_us", InstallLogValueType::kInt, false },
+  { "io_read_chunk_bytes", InstallLogValueType::kBytes, false },
+  { "io_write_chunk_bytes", InstallLogValueType::kBytes, false },
+  // Written by uncrypt.
+  { "uncrypt_time", InstallLogValueType::kSeconds, false },
+  { "uncrypt_error", InstallLogValueType::kInt, false },
+  { "uncrypt_map_syncs", InstallLogValueType::kInt, false },
+  { "uncrypt_map_time_ms", InstallLogValueType::kMilliseconds, false },
+  // Written by the updater (updater/blockimg.cpp), once per partition.
+  { "bytes_written", InstallLogValueType::kBytes, true },
+  { "bytes_stashed", InstallLogValueType::kBytes, true },
+};
+
+// Maps the keys in last_install to the names of the metrics they're reported as.
+static const std::map<std::string, std::string> kMetricNames = {
+  { "time_total", "ota_time_total" },
+  { "uncrypt_time", "ota_uncrypt_time" },
+  { "source_build", "ota_source_version" },
+  { "temperature_start", "ota_temperature_start" },
+  { "temperature_end", "ota_temperature_end" },
+  { "temperature_max", "ota_temperature_max" },
+  { "error", "ota_non_ab_error_code" },
+  { "cause", "ota_non_ab_cause_code" },
+};
+
+// Parses a duration such as "12", "12s" or "1500ms" into the unit of |type|.
+static bool ParseDuration(std::string_view value, InstallLogValueType type, int64_t* result) {
+  int64_t scale_num = 1;
+  int64_t scale_den = 1;
+  if (android::base::EndsWith(value, "ms")) {
+    value.remove_suffix(2);
+    if (type == InstallLogValueType::kSeconds) scale_den = 1000;
+  } else if (android::base::EndsWith(value, "s")) {
+    value.remove_suffix(1);
+    if (type == InstallLogValueType::kMilliseconds) scale_num = 1000;
+  }
+
+  int64_t parsed;
+  if (!android::base::ParseInt(std::string(value), &parsed, int64_t{ 0 }) ||
+      __builtin_mul_overflow(parsed, scale_num, &parsed)) {
+    return false;
+  }
+  *result = parsed / scale_den;
+  return true;
+}
+
+InstallLogParser::InstallLogParser() : InstallLogParser(kInstallLogSchema) {}
+
+InstallLogParser::InstallLogParser(const std::vector<InstallLogKey>& schema) {
+  for (const auto& key : schema) {
+    if (key.per_stage) {
+      per_stage_keys_.push_back(key);
+    } else {
+      keys_.emplace(key.name, key);
+    }
+  }
+}
+
+void InstallLogParser::Feed(std::string_view data) {
+  while (!data.empty()) {
+    size_t newline = data.find('\n');
+    if (newline == std::string_view::npos) {
+      partial_line_.append(data);
+      return;
+    }
+    if (partial_line_.empty()) {
+      ParseLine(data.substr(0, newline));
+    } else {
+      partial_line_.append(data.substr(0, newline));
+      ParseLine(partial_line_);
+      partial_line_.clear();
+    }
+    data.remove_prefix(newline + 1);
+  }
+}
+
+InstallLog InstallLogParser::Finish() {
+  if (!partial_line_.empty()) {
+    ParseLine(partial_line_);
+    partial_line_.clear();
+  }
+  line_count_ = 0;
+  return std::exchange(log_, {});
+}
+
+bool InstallLogParser::ParseValue(const InstallLogKey& key, std::string_view value,
+                                  const std::string& name, std::map<std::string, int64_t>* values) {
+  int64_t parsed;
+  switch (key.type) {
+    case InstallLogValueType::kInt:
+      if (!android::base::ParseInt(std::string(value), &parsed)) return false;
+      break;
+    case InstallLogValueType::kSeconds:
+    case InstallLogValueType::kMilliseconds:
+      if (!ParseDuration(value, key.type, &parsed)) return false;
+      break;
+    case InstallLogValueType::kBytes: {
+      uint64_t bytes;
+      if (!android::base::ParseByteCount(std::string(value), &bytes) ||
+          bytes > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+        return false;
+      }
+      parsed = static_cast<int64_t>(bytes);
+      break;
+    }
+    case InstallLogValueType::kHistogram: {
+      // Parse all the buckets first, so that a bad line doesn't get merged halfway.
+      std::vector<std::pair<int64_t, int64_t>> buckets;
+      for (const auto& pair : android::base::Split(std::string(value), " ")) {
+        if (pair.empty()) continue;
+        size_t eq = pair.find('=');
+        int64_t bucket, count;
+        if (eq == std::string::npos || !android::base::ParseInt(pair.substr(0, eq), &bucket) ||
+            !android::base::ParseInt(pair.substr(eq + 1), &count, int64_t{ 0 })) {
+          return false;
+        }
+        buckets.emplace_back(bucket, count);
+      }
+      auto& histogram = log_.histograms[name];
+      for (const auto& [bucket, count] : buckets) {
+        histogram[bucket] += count;
+      }
+      return true;
+    }
+  }
+  values->emplace(name, parsed);
+  return true;
+}
+
+void InstallLogParser::ParseLine(std::string_view line) {
+  size_t line_index = line_count_++;
+
+  size_t colon = line.find(':');
+  if (colon == std::string_view::npos) {
+    // The first two lines hold the package and the install result.
+    if (line_index == 0) {
+      log_.package = android::base::Trim(line);
+      return;
     }
+    if (line_index == 1 && android::base::ParseInt(android::base::Trim(line), &log_.result)) {
+      return;
+    }
+    LOG(WARNING) << "Skip parsing " << line;
+    log_.malformed_lines++;
+    return;
+  }
 
-    std::string num_string = android::base::Trim(line.substr(num_index + 1));
-    int64_t parsed_num;
-    if (!android::base::ParseInt(num_string, &parsed_num)) {
+  std::string name = android::base::Trim(line.substr(0, colon));
+  std::string value = android::base::Trim(line.substr(colon + 1));
+
+  if (auto it = keys_.find(name); it != keys_.end()) {
+    if (!ParseValue(it->second, value, name, &log_.values)) {
       LOG(ERROR) << "Failed to parse numbers in " << line;
-      continue;
+      log_.malformed_lines++;
+    }
+    return;
+  }
+
+  for (const auto& key : per_stage_keys_) {
+    size_t prefix_length = strlen(key.name);
+    if (name.size() > prefix_length + 1 && name.compare(0, prefix_length, key.name) == 0 &&
+        name[prefix_length] == '_') {
+      if (!ParseValue(key, value, key.name, &log_.stages[name.substr(prefix_length + 1)])) {
+        LOG(ERROR) << "Failed to parse numbers in " << line;
+        log_.malformed_lines++;
+      }
+      return;
+    }
+  }
+
+  log_.unknown.emplace(std::move(name), std::move(value));
+}
+
+bool ParseInstallLog(const std::string& file_name, InstallLog* log) {
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(file_name.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd == -1) {
+    PLOG(ERROR) << "Failed to open " << file_name;
+    return false;
+  }
+
+  InstallLogParser parser;
+  char buffer[16 * 1024];
+  while (true) {
+    ssize_t n = TEMP_FAILURE_RETRY(read(fd.get(), buffer, sizeof(buffer)));
+    if (n == -1) {
+      PLOG(ERROR) << "Failed to read " << file_name;
+      return false;
     }
+    if (n == 0) break;
+    parser.Feed(std::string_view(buffer, n));
+  }
+  *log = parser.Finish();
+  return true;
+}
+
+std::map<std::string, int64_t> GetRecoveryUpdateMetrics(const InstallLog& log) {
+  constexpr unsigned int kMiB = 1024 * 1024;
 
-    if (android::base::StartsWith(line, "bytes_written")) {
-      bytes_written_in_mib = bytes_written_in_mib.value_or(0) + parsed_num / kMiB;
-    } else if (android::base::StartsWith(line, "bytes_stashed")) {
-      bytes_stashed_in_mib = bytes_stashed_in_mib.value_or(0) + parsed_num / kMiB;
-    } else if (android::base::StartsWith(line, "time")) {
-      metrics.emplace("ota_time_total", parsed_num);
-    } else if (android::base::StartsWith(line, "uncrypt_time")) {
-      metrics.emplace("ota_uncrypt_time", parsed_num);
-    } else if (android::base::StartsWith(line, "source_build")) {
-      metrics.emplace("ota_source_version", parsed_num);
-    } else if (android::base::StartsWith(line, "temperature_start")) {
-      metrics.emplace("ota_temperature_start", parsed_num);
-    } else if (android::base::StartsWith(line, "temperature_end")) {
-      metrics.emplace("ota_temperature_end", parsed_num);
-    } else if (android::base::StartsWith(line, "temperature_max")) {
-      metrics.emplace("ota_temperature_max", parsed_num);
-    } else if (android::base::StartsWith(line, "error")) {
-      metrics.emplace("ota_non_ab_error_code", parsed_num);
-    } else if (android::base::StartsWith(line, "cause")) {
-      metrics.emplace("ota_non_ab_cause_code", parsed_num);
+  std::map<std::string, int64_t> metrics;
+  for (const auto& [key, metric] : kMetricNames) {
+    if (auto it = log.values.find(key); it != log.values.end()) {
+      metrics.emplace(metric, it->second);
     }
   }
 
+  // Bytes are reported in MiBs, rounded down for each partition.
+  std::optional<int64_t> bytes_written_in_mib;
+  std::optional<int64_t> bytes_stashed_in_mib;
+  for (const auto& [stage, values] : log.stages) {
+    if (auto it = values.find("bytes_written"); it != values.end()) {
+      bytes_written_in_mib = bytes_written_in_mib.value_or(0) + it->second / kMiB;
+    }
+    if (auto it = values.find("bytes_stashed"); it != values.end()) {
+      bytes_stashed_in_mib = bytes_stashed_in_mib.value_or(0) + it->second / kMiB;
+    }
+  }
   if (bytes_written_in_mib) {
     metrics.emplace("ota_written_in_MiBs", bytes_written_in_mib.value());
   }
@@ -85,27 +288,33 @@ std::map<std::string, int64_t> ParseRecoveryUpdateMetrics(const std::vector<std:
   return metrics;
 }
 
+std::map<std::string, int64_t> ParseRecoveryUpdateMetrics(const std::vector<std::string>& lines) {
+  InstallLogParser parser;
+  for (const auto& line : lines) {
+    parser.ParseLine(line);
+  }
+  return GetRecoveryUpdateMetrics(parser.Finish());
+}
+
 std::map<std::string, int64_t> ParseLastInstall(const std::string& file_name) {
   if (access(file_name.c_str(), F_OK) != 0) {
     return {};
   }
 
-  std::string content;
-  if (!android::base::ReadFileToString(file_name, &content)) {
-    PLOG(ERROR) << "Failed to read " << file_name;
+  InstallLog log;
+  if (!ParseInstallLog(file_name, &log)) {
     return {};
   }
 
-  if (content.empty()) {
+  if (log.package.empty() && log.values.empty() && log.stages.empty() && log.unknown.empty()) {
     LOG(INFO) << "Empty last_install file";
     return {};
   }
 
-  std::vector<std::string> lines = android::base::Split(content, "\n");
-  auto metrics = ParseRecoveryUpdateMetrics(lines);
+  auto metrics = GetRecoveryUpdateMetrics(log);
 
   // LAST_INSTALL starts with "/sideload/package.zip" after a sideload.
-  if (android::base::Trim(lines[0]) == "/sideload/package.zip") {
+  if (log.package == "/sideload/package.zip") {
     int type = (android::base::GetProperty("ro.build.type", "") == "user") ? 1 : 0;
     metrics.emplace(OTA_SIDELOAD_METRICS, type);
   }
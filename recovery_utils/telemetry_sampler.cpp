@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "recovery_utils/telemetry_sampler.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+
+// Reads the content of a sysfs node from the start into |buffer|, and returns it as a
+// null-terminated string. Returns nullptr on failure.
+template <size_t N>
+static const char* PreadNode(int fd, char (&buffer)[N]) {
+  ssize_t len = TEMP_FAILURE_RETRY(pread(fd, buffer, N - 1, 0));
+  if (len <= 0) {
+    return nullptr;
+  }
+  buffer[len] = '\0';
+  return buffer;
+}
+
+static std::vector<std::string> ListDir(const std::string& dir) {
+  std::unique_ptr<DIR, decltype(&closedir)> d(opendir(dir.c_str()), closedir);
+  if (!d) {
+    PLOG(WARNING) << "Failed to open " << dir;
+    return {};
+  }
+  std::vector<std::string> names;
+  dirent* de;
+  while ((de = readdir(d.get())) != nullptr) {
+    if (de->d_name[0] == '.') continue;
+    names.emplace_back(de->d_name);
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+static uint32_t SaturateToUint32(uint64_t value) {
+  return static_cast<uint32_t>(std::min<uint64_t>(value, std::numeric_limits<uint32_t>::max()));
+}
+
+TelemetrySampler::TelemetrySampler(std::chrono::milliseconds interval, size_t capacity,
+                                   std::string thermal_dir, std::string block_dir)
+    : interval_(std::clamp(interval, kMinInterval, kMaxInterval)),
+      capacity_(std::max<size_t>(capacity, 1)),
+      thermal_dir_(std::move(thermal_dir)),
+      block_dir_(std::move(block_dir)) {
+  samples_.reserve(capacity_);
+}
+
+TelemetrySampler::~TelemetrySampler() {
+  Stop();
+}
+
+size_t TelemetrySampler::Open() {
+  thermal_fds_.clear();
+  block_stats_.clear();
+  start_time_ = std::chrono::steady_clock::now();
+
+  for (const auto& name : ListDir(thermal_dir_)) {
+    if (!android::base::StartsWith(name, "thermal_zone")) continue;
+    std::string path = thermal_dir_ + "/" + name + "/temp";
+    android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+      PLOG(WARNING) << "Failed to open " << path;
+      continue;
+    }
+    thermal_fds_.push_back(std::move(fd));
+  }
+
+  // Only count the physical devices (the ones backed by a "device"), as loop, dm and zram devices
+  // would count the same I/O more than once.
+  for (const auto& name : ListDir(block_dir_)) {
+    std::string dir = block_dir_ + "/" + name;
+    if (access((dir + "/device").c_str(), F_OK) != 0) continue;
+    std::string path = dir + "/stat";
+    android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+      PLOG(WARNING) << "Failed to open " << path;
+      continue;
+    }
+    block_stats_.push_back({ std::move(fd), 0, 0, 0 });
+  }
+  // Establish the baseline for the deltas.
+  uint64_t read_sectors, write_sectors, io_ticks;
+  ReadBlockStats(&read_sectors, &write_sectors, &io_ticks);
+
+  LOG(INFO) << "Sampling " << thermal_fds_.size() << " thermal zone(s) and " << block_stats_.size()
+            << " block device(s) every " << interval_.count() << " ms";
+  return thermal_fds_.size() + block_stats_.size();
+}
+
+int TelemetrySampler::ReadMaxTemperature() {
+  int max_temperature = -1;
+  char buffer[32];
+  for (const auto& fd : thermal_fds_) {
+    const char* content = PreadNode(fd, buffer);
+    if (content == nullptr) continue;
+    char* end;
+    long temperature = strtol(content, &end, 10);
+    if (end == content) continue;
+    max_temperature = std::max(max_temperature, static_cast<int>(temperature));
+  }
+  return max_temperature;
+}
+
+void TelemetrySampler::ReadBlockStats(uint64_t* read_sectors, uint64_t* write_sectors,
+                                      uint64_t* io_ticks) {
+  *read_sectors = *write_sectors = *io_ticks = 0;
+  // See Documentation/block/stat.rst. We need field 3 (read sectors), 7 (write sectors) and 10
+  // (io_ticks).
+  char buffer[256];
+  for (auto& stat : block_stats_) {
+    const char* content = PreadNode(stat.fd, buffer);
+    if (content == nullptr) continue;
+
+    uint64_t fields[10];
+    const char* pos = content;
+    size_t parsed = 0;
+    for (; parsed < std::size(fields); parsed++) {
+      char* end;
+      fields[parsed] = strtoull(pos, &end, 10);
+      if (end == pos) break;
+      pos = end;
+    }
+    if (parsed != std::size(fields)) continue;
+
+    // The counters may wrap around (or the device may get reset); count such a tick as zero.
+    auto delta = [](uint64_t current, uint64_t* previous) {
+      uint64_t result = current >= *previous ? current - *previous : 0;
+      *previous = current;
+      return result;
+    };
+    *read_sectors += delta(fields[2], &stat.read_sectors);
+    *write_sectors += delta(fields[6], &stat.write_sectors);
+    *io_ticks += delta(fields[9], &stat.io_ticks);
+  }
+}
+
+void TelemetrySampler::SampleOnce() {
+  uint32_t time_ms = SaturateToUint32(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                          std::chrono::steady_clock::now() - start_time_)
+                                          .count());
+  int temperature = ReadMaxTemperature();
+  uint64_t read_sectors, write_sectors, io_ticks;
+  ReadBlockStats(&read_sectors, &write_sectors, &io_ticks);
+
+  TelemetrySample sample{ time_ms, temperature, SaturateToUint32(read_sectors),
+                          SaturateToUint32(write_sectors), SaturateToUint32(io_ticks) };
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (samples_.size() < capacity_) {
+    samples_.push_back(sample);
+  } else {
+    samples_[next_] = sample;
+    wrapped_ = true;
+  }
+  next_ = (next_ + 1) % capacity_;
+
+  if (sample_count_ > 0 && time_ms > last_time_ms_) {
+    // KiB/s = sectors * 512 / 1024 / (ms / 1000).
+    uint32_t elapsed_ms = time_ms - last_time_ms_;
+    peak_read_kbps_ = std::max(peak_read_kbps_, read_sectors * 500 / elapsed_ms);
+    peak_write_kbps_ = std::max(peak_write_kbps_, write_sectors * 500 / elapsed_ms);
+  }
+  last_time_ms_ = time_ms;
+  sample_count_++;
+  if (temperature >= 0) {
+    temperature_sample_count_++;
+    temperature_sum_ += temperature;
+    max_temperature_ = std::max(max_temperature_, temperature);
+  }
+  total_read_sectors_ += read_sectors;
+  total_write_sectors_ += write_sectors;
+  total_io_ticks_ += io_ticks;
+}
+
+void TelemetrySampler::Run() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (!cv_.wait_for(lock, interval_, [this] { return !running_; })) {
+    lock.unlock();
+    SampleOnce();
+    lock.lock();
+  }
+}
+
+void TelemetrySampler::Start() {
+  Open();
+  SampleOnce();
+  std::lock_guard<std::mutex> lock(mtx_);
+  running_ = true;
+  thread_ = std::thread(&TelemetrySampler::Run, this);
+}
+
+void TelemetrySampler::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!running_) return;
+    running_ = false;
+  }
+  cv_.notify_one();
+  thread_.join();
+  SampleOnce();
+}
+
+std::vector<TelemetrySample> TelemetrySampler::GetSamples() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (!wrapped_) {
+    return samples_;
+  }
+  std::vector<TelemetrySample> result(samples_.begin() + next_, samples_.end());
+  result.insert(result.end(), samples_.begin(), samples_.begin() + next_);
+  return result;
+}
+
+int TelemetrySampler::MaxTemperature() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return max_temperature_;
+}
+
+std::vector<std::string> TelemetrySampler::GetSummary() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  std::vector<std::string> summary{
+    "telemetry_interval_ms: " + std::to_string(interval_.count()),
+    "telemetry_samples: " + std::to_string(sample_count_),
+  };
+  if (temperature_sample_count_ > 0) {
+    summary.push_back("temperature_avg: " +
+                      std::to_string(temperature_sum_ /
+                                     static_cast<int64_t>(temperature_sample_count_)));
+  }
+  if (!block_stats_.empty()) {
+    summary.push_back("io_read_bytes: " + std::to_string(total_read_sectors_ * 512));
+    summary.push_back("io_write_bytes: " + std::to_string(total_write_sectors_ * 512));
+    summary.push_back("io_busy_ms: " + std::to_string(total_io_ticks_));
+    summary.push_back("io_read_peak_kbps: " + std::to_string(peak_read_kbps_));
+    summary.push_back("io_write_peak_kbps: " + std::to_string(peak_write_kbps_));
+  }
+  return summary;
+}
@@ -16,7 +16,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -185,6 +187,61 @@ TEST_F(ApplyPatchModesTest, CheckMode) {
   ASSERT_EQ(0, InvokeApplyPatchModes({ "applypatch", "--check", source }));
 }
 
+// Returns the peak RSS of this process in KiB.
+static long GetPeakRssKb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+  return usage.ru_maxrss;
+}
+
+TEST_F(ApplyPatchModesTest, CheckModeLargePartition) {
+  // Build a file-backed partition much larger than the hashing window, one chunk at a time so
+  // that the test itself doesn't bump the peak RSS.
+  constexpr size_t kChunkSize = 1024 * 1024;
+  constexpr size_t kPartitionSize = 128 * kChunkSize;
+  TemporaryFile partition_file;
+  std::string chunk(kChunkSize, '\0');
+  SHA_CTX ctx;
+  SHA1_Init(&ctx);
+  for (size_t i = 0; i < kPartitionSize / kChunkSize; i++) {
+    for (size_t j = 0; j < chunk.size(); j += 4096) {
+      chunk[j] = static_cast<char>(i + j / 4096);
+    }
+    ASSERT_TRUE(android::base::WriteFully(partition_file.fd, chunk.data(), chunk.size()));
+    SHA1_Update(&ctx, chunk.data(), chunk.size());
+  }
+  uint8_t digest[SHA_DIGEST_LENGTH];
+  SHA1_Final(digest, &ctx);
+  std::string().swap(chunk);
+
+  std::string partition = "EMMC:"s + partition_file.path + ":" + std::to_string(kPartitionSize) +
+                          ":" + print_sha1(digest);
+
+  long rss_before_kb = GetPeakRssKb();
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(0, InvokeApplyPatchModes({ "applypatch", "--check", partition }));
+  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  long rss_growth_kb = GetPeakRssKb() - rss_before_kb;
+
+  RecordProperty("check_wall_ms", std::to_string(duration.count()));
+  RecordProperty("check_peak_rss_growth_kb", std::to_string(rss_growth_kb));
+  GTEST_LOG_(INFO) << "--check on " << kPartitionSize << " bytes: " << duration.count() << "ms, "
+                   << "peak RSS growth " << rss_growth_kb << "KiB";
+  // Holding the whole partition would grow the peak RSS by (at least) its size.
+  ASSERT_LT(rss_growth_kb, static_cast<long>(kPartitionSize / 1024 / 8));
+
+  // Expecting more bytes than the partition has fails without hashing anything.
+  std::string oversized = "EMMC:"s + partition_file.path + ":" +
+                          std::to_string(kPartitionSize + 1) + ":" + print_sha1(digest);
+  ASSERT_NE(0, InvokeApplyPatchModes({ "applypatch", "--check", oversized }));
+
+  // A shorter prefix hashes differently.
+  std::string truncated = "EMMC:"s + partition_file.path + ":" +
+                          std::to_string(kPartitionSize - 1) + ":" + print_sha1(digest);
+  ASSERT_NE(0, InvokeApplyPatchModes({ "applypatch", "--check", truncated }));
+}
+
 TEST_F(ApplyPatchModesTest, CheckModeInvalidArgs) {
   ASSERT_EQ(2, InvokeApplyPatchModes({ "applypatch", "--check" }));
 }
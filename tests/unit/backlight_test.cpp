@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "recovery_ui/backlight.h"
+
+using namespace std::chrono_literals;
+
+// Records the written values, taking |write_time| for each write to mimic a slow panel.
+class FakeBacklight : public Backlight {
+ public:
+  FakeBacklight(const std::string& brightness_file, std::chrono::milliseconds write_time)
+      : Backlight(brightness_file), write_time_(write_time) {}
+
+  ~FakeBacklight() override {
+    Stop();
+  }
+
+  std::vector<unsigned int> values() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return values_;
+  }
+
+ protected:
+  bool Write(unsigned int value) override {
+    std::this_thread::sleep_for(write_time_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    values_.push_back(value);
+    return true;
+  }
+
+ private:
+  const std::chrono::milliseconds write_time_;
+  std::mutex mutex_;
+  std::vector<unsigned int> values_;
+};
+
+class BacklightTest : public ::testing::Test {
+ protected:
+  TemporaryFile brightness_file_;
+};
+
+TEST_F(BacklightTest, Start_MissingFile) {
+  Backlight backlight("/doesntexist");
+  ASSERT_FALSE(backlight.Start());
+}
+
+TEST_F(BacklightTest, Set_WritesFile) {
+  Backlight backlight(brightness_file_.path);
+  ASSERT_TRUE(backlight.Start());
+
+  backlight.Set(255, false);
+  ASSERT_TRUE(backlight.WaitIdle(1s));
+  std::string content;
+  ASSERT_TRUE(android::base::ReadFileToString(brightness_file_.path, &content));
+  ASSERT_EQ("255", content);
+}
+
+TEST_F(BacklightTest, Set_DoesntBlockOnWrite) {
+  FakeBacklight backlight(brightness_file_.path, 50ms);
+  ASSERT_TRUE(backlight.Start());
+
+  auto start = std::chrono::steady_clock::now();
+  backlight.Set(100, false);
+  backlight.Set(0, true);
+  backlight.Set(100, false);
+  auto latency = std::chrono::steady_clock::now() - start;
+  RecordProperty("set_latency_us",
+                 std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+  ASSERT_LT(latency, 50ms);
+
+  ASSERT_TRUE(backlight.WaitIdle(1s));
+  ASSERT_EQ(100u, backlight.values().back());
+}
+
+TEST_F(BacklightTest, Set_Coalesced) {
+  FakeBacklight backlight(brightness_file_.path, 30ms);
+  ASSERT_TRUE(backlight.Start());
+
+  backlight.Set(10, false);
+  std::this_thread::sleep_for(5ms);
+  // All of these arrive while the first write is in progress; only the last one gets written.
+  for (unsigned int value = 11; value <= 20; value++) {
+    backlight.Set(value, false);
+  }
+  ASSERT_TRUE(backlight.WaitIdle(1s));
+  ASSERT_EQ((std::vector<unsigned int>{ 10, 20 }), backlight.values());
+}
+
+TEST_F(BacklightTest, Set_Ramp) {
+  FakeBacklight backlight(brightness_file_.path, 0ms);
+  ASSERT_TRUE(backlight.Start());
+
+  backlight.Set(200, false);
+  ASSERT_TRUE(backlight.WaitIdle(1s));
+  backlight.Set(40, true);
+  ASSERT_TRUE(backlight.WaitIdle(1s));
+
+  auto values = backlight.values();
+  ASSERT_EQ(static_cast<size_t>(Backlight::kRampSteps + 1), values.size());
+  ASSERT_EQ(200u, values.front());
+  for (size_t i = 1; i < values.size(); i++) {
+    ASSERT_LT(values[i], values[i - 1]);
+  }
+  ASSERT_EQ(40u, values.back());
+}
+
+TEST_F(BacklightTest, Set_WakeInterruptsRamp) {
+  FakeBacklight backlight(brightness_file_.path, 0ms);
+  ASSERT_TRUE(backlight.Start());
+
+  backlight.Set(200, false);
+  ASSERT_TRUE(backlight.WaitIdle(1s));
+  backlight.Set(0, true);
+  std::this_thread::sleep_for(Backlight::kRampStepInterval * 2);
+
+  // A key press wakes up the screen without waiting for the ramp to finish.
+  auto start = std::chrono::steady_clock::now();
+  backlight.Set(200, false);
+  ASSERT_TRUE(backlight.WaitIdle(1s));
+  auto latency = std::chrono::steady_clock::now() - start;
+  RecordProperty("wake_latency_us",
+                 std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+  ASSERT_LT(latency, Backlight::kRampStepInterval * 2);
+
+  auto values = backlight.values();
+  ASSERT_LT(values.size(), static_cast<size_t>(Backlight::kRampSteps + 2));
+  ASSERT_EQ(200u, values.back());
+}
+
+TEST_F(BacklightTest, Stop_WritesLastValue) {
+  FakeBacklight backlight(brightness_file_.path, 0ms);
+  ASSERT_TRUE(backlight.Start());
+
+  backlight.Set(200, false);
+  backlight.Set(0, true);
+  backlight.Stop();
+  ASSERT_FALSE(backlight.values().empty());
+  ASSERT_EQ(0u, backlight.values().back());
+
+  // Stopping twice is fine.
+  backlight.Stop();
+}
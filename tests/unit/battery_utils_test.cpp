@@ -14,6 +14,17 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include <android-base/logging.h>
 #include <gtest/gtest.h>
 
@@ -25,3 +36,98 @@ TEST(BatteryInfoTest, GetBatteryInfo) {
   ASSERT_LE(0, info.capacity);
   ASSERT_LE(info.capacity, 100);
 }
+
+using namespace std::chrono_literals;
+
+// Reports the given capacities in turn, repeating the last one, and takes |delay| per read.
+class FakeHealthBackend : public HealthBackend {
+ public:
+  FakeHealthBackend(std::vector<int32_t> capacities, std::chrono::milliseconds delay)
+      : capacities_(std::move(capacities)), delay_(delay) {}
+
+  BatteryInfo Read() override {
+    std::this_thread::sleep_for(delay_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    int32_t capacity = capacities_[std::min(next_++, capacities_.size() - 1)];
+    return BatteryInfo{ false, capacity };
+  }
+
+ private:
+  std::mutex mutex_;
+  const std::vector<int32_t> capacities_;
+  const std::chrono::milliseconds delay_;
+  size_t next_{ 0 };
+};
+
+static std::unique_ptr<BatteryMonitor> CreateMonitor(std::vector<int32_t> capacities,
+                                                     std::chrono::milliseconds delay,
+                                                     std::chrono::milliseconds settle_timeout) {
+  return std::make_unique<BatteryMonitor>(
+      std::make_unique<FakeHealthBackend>(std::move(capacities), delay), settle_timeout, 10ms);
+}
+
+TEST(BatteryMonitorTest, SettlesFakeCapacity) {
+  auto monitor = CreateMonitor({ 50, 50, 80 }, 0ms, 10s);
+  auto info = monitor->GetInfo(1min);
+  ASSERT_EQ(80, info.capacity);
+  ASSERT_FALSE(info.charging);
+  ASSERT_EQ(3, monitor->reads());
+
+  // Once settled, 50 is a real value.
+  monitor = CreateMonitor({ 80, 50 }, 0ms, 10s);
+  ASSERT_EQ(80, monitor->GetInfo(1min).capacity);
+  ASSERT_EQ(50, monitor->GetInfo(0ms).capacity);
+}
+
+TEST(BatteryMonitorTest, TrustsCapacity50AfterTimeout) {
+  auto monitor = CreateMonitor({ 50 }, 0ms, 100ms);
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(50, monitor->GetInfo(0ms).capacity);
+  ASSERT_GE(std::chrono::steady_clock::now() - start, 100ms);
+}
+
+TEST(BatteryMonitorTest, UnknownCapacity) {
+  auto monitor = CreateMonitor({ INT32_MIN }, 0ms, 10s);
+  ASSERT_EQ(100, monitor->GetInfo(0ms).capacity);
+}
+
+TEST(BatteryMonitorTest, ReturnsCachedValue) {
+  // A slow health service with a battery driver that takes a while to load.
+  auto monitor = CreateMonitor({ 50, 50, 50, 42 }, 20ms, 10s);
+  monitor->Start();
+  auto info = monitor->GetInfo(1min);
+  ASSERT_EQ(42, info.capacity);
+  size_t reads = monitor->reads();
+  ASSERT_EQ(4, reads);
+
+  // Where an install starts: a recent enough value comes right away.
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(42, monitor->GetInfo(1min).capacity);
+  auto cached = std::chrono::steady_clock::now() - start;
+  ASSERT_EQ(reads, monitor->reads());
+  ASSERT_LT(cached, 20ms);
+
+  // An older one gets read again, without settling again.
+  start = std::chrono::steady_clock::now();
+  auto fresh_info = monitor->GetInfo(0ms);
+  auto fresh = std::chrono::steady_clock::now() - start;
+  ASSERT_EQ(42, fresh_info.capacity);
+  ASSERT_GT(fresh_info.time, info.time);
+  ASSERT_EQ(reads + 1, monitor->reads());
+  ASSERT_GE(fresh, 20ms);
+
+  using std::chrono::microseconds;
+  RecordProperty("cached_us", std::to_string(duration_cast<microseconds>(cached).count()));
+  RecordProperty("fresh_us", std::to_string(duration_cast<microseconds>(fresh).count()));
+}
+
+TEST(BatteryMonitorTest, ConcurrentCallers) {
+  auto monitor = CreateMonitor({ 50, 60 }, 5ms, 10s);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; i++) {
+    threads.emplace_back([&monitor]() { ASSERT_EQ(60, monitor->GetInfo(0ms).capacity); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
@@ -14,6 +14,9 @@
  * limitations under the License.
  */
 
+#include <stddef.h>
+#include <unistd.h>
+
 #include <string>
 #include <string_view>
 #include <vector>
@@ -118,3 +121,120 @@ TEST(BootloaderMessageTest, update_bootloader_message_recovery_options_long) {
   ASSERT_EQ(std::string(sizeof(boot.reserved), '\0'),
             std::string(boot.reserved, sizeof(boot.reserved)));
 }
+
+class MiscPartitionTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // A zero-filled misc image covering the BCB, vendor space, wipe package and system space.
+    ASSERT_EQ(0, ftruncate(temp_misc_.fd, SYSTEM_SPACE_OFFSET_IN_MISC + SYSTEM_SPACE_SIZE_IN_MISC));
+  }
+
+  std::string ReadImage(size_t offset, size_t size) {
+    std::string content;
+    EXPECT_TRUE(android::base::ReadFileToString(temp_misc_.path, &content));
+    return content.substr(offset, size);
+  }
+
+  TemporaryFile temp_misc_;
+};
+
+TEST_F(MiscPartitionTest, ReadCached) {
+  std::string err;
+  auto misc = MiscPartition::Open(temp_misc_.path, false, &err);
+  ASSERT_NE(nullptr, misc) << err;
+
+  bootloader_message boot;
+  ASSERT_TRUE(misc->ReadBootloaderMessage(&boot, &err)) << err;
+  ASSERT_TRUE(misc->ReadBootloaderMessage(&boot, &err)) << err;
+  // The stage field lies within the BCB that's already cached.
+  char stage[sizeof(boot.stage)];
+  ASSERT_TRUE(misc->Read(stage, sizeof(stage), offsetof(bootloader_message, stage), &err));
+
+  ASSERT_EQ(1u, misc->stats().opens);
+  ASSERT_EQ(1u, misc->stats().reads);
+  ASSERT_EQ(0u, misc->stats().writes);
+  ASSERT_EQ(0u, misc->stats().fsyncs);
+
+  // Writing to a read-only session fails.
+  ASSERT_FALSE(misc->WriteBootloaderMessage(boot, &err));
+}
+
+TEST_F(MiscPartitionTest, UpdateAndCommit) {
+  std::string err;
+  auto misc = MiscPartition::Open(temp_misc_.path, true, &err);
+  ASSERT_NE(nullptr, misc) << err;
+
+  // The sequence from setting up an install: read the BCB, update it, then write the wipe package.
+  bootloader_message boot;
+  ASSERT_TRUE(misc->ReadBootloaderMessage(&boot, &err)) << err;
+  ASSERT_TRUE(update_bootloader_message_in_struct(&boot, { "--wipe_ab" }));
+  ASSERT_TRUE(misc->WriteBootloaderMessage(boot, &err)) << err;
+  strlcpy(boot.stage, "2/3", sizeof(boot.stage));
+  ASSERT_TRUE(misc->WriteBootloaderMessage(boot, &err)) << err;
+  std::string wipe_package(1024, 'w');
+  ASSERT_TRUE(misc->WriteWipePackage(wipe_package, &err)) << err;
+
+  // Nothing hits the device until Commit().
+  ASSERT_EQ(std::string(sizeof(boot), '\0'), ReadImage(0, sizeof(boot)));
+  ASSERT_EQ(0u, misc->stats().writes);
+
+  ASSERT_TRUE(misc->Commit(&err)) << err;
+  ASSERT_EQ(1u, misc->stats().reads);
+  ASSERT_EQ(2u, misc->stats().writes);
+  ASSERT_EQ(1u, misc->stats().fsyncs);
+  ASSERT_EQ(std::string(reinterpret_cast<const char*>(&boot), sizeof(boot)),
+            ReadImage(0, sizeof(boot)));
+  ASSERT_EQ(wipe_package, ReadImage(WIPE_PACKAGE_OFFSET_IN_MISC, wipe_package.size()));
+
+  // Committing again with nothing dirty doesn't sync.
+  ASSERT_TRUE(misc->Commit(&err)) << err;
+  ASSERT_EQ(2u, misc->stats().writes);
+  ASSERT_EQ(1u, misc->stats().fsyncs);
+
+  // The rest of the session is served from the cache.
+  std::string wipe_package_verify;
+  ASSERT_TRUE(misc->ReadWipePackage(&wipe_package_verify, wipe_package.size(), &err)) << err;
+  ASSERT_EQ(wipe_package, wipe_package_verify);
+  ASSERT_EQ(1u, misc->stats().reads);
+  ASSERT_EQ(1u, misc->stats().opens);
+}
+
+TEST_F(MiscPartitionTest, AdjacentWritesCoalesced) {
+  std::string err;
+  auto misc = MiscPartition::Open(temp_misc_.path, true, &err);
+  ASSERT_NE(nullptr, misc) << err;
+
+  ASSERT_TRUE(misc->Write("abcd", 4, VENDOR_SPACE_OFFSET_IN_MISC, &err)) << err;
+  ASSERT_TRUE(misc->Write("efgh", 4, VENDOR_SPACE_OFFSET_IN_MISC + 8, &err)) << err;
+  ASSERT_TRUE(misc->Write("1234", 4, VENDOR_SPACE_OFFSET_IN_MISC + 4, &err)) << err;
+  ASSERT_TRUE(misc->Commit(&err)) << err;
+
+  ASSERT_EQ(1u, misc->stats().writes);
+  ASSERT_EQ(1u, misc->stats().fsyncs);
+  ASSERT_EQ("abcd1234efgh", ReadImage(VENDOR_SPACE_OFFSET_IN_MISC, 12));
+}
+
+TEST_F(MiscPartitionTest, ReadAroundWrites) {
+  ASSERT_TRUE(android::base::WriteFully(temp_misc_.fd, "0123456789", 10));
+
+  std::string err;
+  auto misc = MiscPartition::Open(temp_misc_.path, true, &err);
+  ASSERT_NE(nullptr, misc) << err;
+
+  // Only the bytes around the pending write get read from the device.
+  ASSERT_TRUE(misc->Write("ab", 2, 4, &err)) << err;
+  char buffer[10];
+  ASSERT_TRUE(misc->Read(buffer, sizeof(buffer), 0, &err)) << err;
+  ASSERT_EQ("0123ab6789", std::string(buffer, sizeof(buffer)));
+  ASSERT_EQ(2u, misc->stats().reads);
+}
+
+TEST_F(MiscPartitionTest, UncommittedChangesDropped) {
+  std::string err;
+  {
+    auto misc = MiscPartition::Open(temp_misc_.path, true, &err);
+    ASSERT_NE(nullptr, misc) << err;
+    ASSERT_TRUE(misc->WriteWipePackage("package", &err)) << err;
+  }
+  ASSERT_EQ(std::string(7, '\0'), ReadImage(WIPE_PACKAGE_OFFSET_IN_MISC, 7));
+}
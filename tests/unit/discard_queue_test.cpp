@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "otautil/rangeset.h"
+#include "private/discard_queue.h"
+
+using namespace std::chrono_literals;
+
+static constexpr size_t kBlockSize = 4096;
+
+// Records the discarded block ranges, optionally sleeping in each call to mimic the device latency.
+class FakeDevice {
+ public:
+  explicit FakeDevice(std::chrono::microseconds latency = 0us) : latency_(latency) {}
+
+  DiscardQueue::Discarder discarder() {
+    return [this](uint64_t offset, uint64_t size) {
+      std::this_thread::sleep_for(latency_);
+      std::lock_guard<std::mutex> lock(mutex_);
+      discarded_.emplace_back(offset / kBlockSize, (offset + size) / kBlockSize);
+      return !fail_;
+    };
+  }
+
+  std::vector<Range> discarded() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return discarded_;
+  }
+
+  void set_fail(bool fail) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fail_ = fail;
+  }
+
+ private:
+  const std::chrono::microseconds latency_;
+  std::mutex mutex_;
+  std::vector<Range> discarded_;
+  bool fail_{ false };
+};
+
+TEST(DiscardQueueTest, CoalescesAdjacentRanges) {
+  FakeDevice device;
+  DiscardQueue queue(kBlockSize, device.discarder());
+  queue.Add(RangeSet::Parse("4,10,20,30,40"));
+  queue.Add(RangeSet::Parse("4,20,30,50,60"));
+  queue.Add(RangeSet::Parse("2,0,5"));
+  ASSERT_TRUE(queue.Finish());
+
+  std::vector<Range> expected{ { 0, 5 }, { 10, 40 }, { 50, 60 } };
+  ASSERT_EQ(expected, device.discarded());
+  ASSERT_EQ(3, queue.discards_issued());
+  ASSERT_FALSE(queue.busy());
+}
+
+TEST(DiscardQueueTest, BarrierOnlyWaitsForOverlappingBlocks) {
+  FakeDevice device(20ms);
+  DiscardQueue queue(kBlockSize, device.discarder());
+  queue.Add(RangeSet::Parse("2,0,10"));
+
+  // Disjoint blocks don't force the queued ranges out.
+  ASSERT_TRUE(queue.Barrier(RangeSet::Parse("2,10,20")));
+  ASSERT_TRUE(device.discarded().empty());
+  ASSERT_EQ(0, queue.barrier_waits());
+
+  // Overlapping blocks wait for the discard to land.
+  ASSERT_TRUE(queue.Barrier(RangeSet::Parse("2,9,11")));
+  std::vector<Range> expected{ { 0, 10 } };
+  ASSERT_EQ(expected, device.discarded());
+  ASSERT_EQ(1, queue.barrier_waits());
+  ASSERT_FALSE(queue.busy());
+}
+
+TEST(DiscardQueueTest, SubmitsFullBatches) {
+  FakeDevice device;
+  DiscardQueue queue(kBlockSize, device.discarder(), 16);
+  queue.Add(RangeSet::Parse("2,0,8"));
+  queue.Add(RangeSet::Parse("2,8,16"));
+  // The batch goes out without any barrier.
+  while (queue.busy()) {
+    std::this_thread::sleep_for(1ms);
+  }
+  std::vector<Range> expected{ { 0, 16 } };
+  ASSERT_EQ(expected, device.discarded());
+}
+
+TEST(DiscardQueueTest, ReportsFailure) {
+  FakeDevice device;
+  device.set_fail(true);
+  DiscardQueue queue(kBlockSize, device.discarder());
+  queue.Add(RangeSet::Parse("2,0,10"));
+  ASSERT_FALSE(queue.Barrier(RangeSet::Parse("2,0,1")));
+  ASSERT_FALSE(queue.Finish());
+}
+
+// Replays a fragmented erase pattern, where each erase command is followed by some other work on
+// unrelated blocks, against a device with an artificial discard latency.
+TEST(DiscardQueueTest, OverlapsDiscardLatency) {
+  constexpr size_t kCommands = 64;
+  constexpr size_t kRangesPerErase = 4;
+  constexpr auto kLatency = 500us;
+  constexpr auto kWorkPerCommand = 1ms;
+  // Hands a batch to the worker every 4 commands, to be discarded while the next ones run.
+  constexpr size_t kBatchBlocks = 4 * kRangesPerErase * 16;
+
+  std::vector<RangeSet> erases;
+  for (size_t i = 0; i < kCommands; i++) {
+    RangeSet erase;
+    for (size_t j = 0; j < kRangesPerErase; j++) {
+      size_t begin = (i * kRangesPerErase + j) * 16;
+      ASSERT_TRUE(erase.PushBack({ begin, begin + 16 }));
+    }
+    erases.push_back(std::move(erase));
+  }
+  // All the other commands write above the erased area.
+  RangeSet work_blocks = RangeSet::Parse("2,100000,100010");
+
+  // Baseline: one synchronous discard per range on the executor thread.
+  FakeDevice sync_device(kLatency);
+  auto discard = sync_device.discarder();
+  auto start = std::chrono::steady_clock::now();
+  for (const auto& erase : erases) {
+    for (const auto& [begin, end] : erase) {
+      ASSERT_TRUE(discard(begin * kBlockSize, (end - begin) * kBlockSize));
+    }
+    std::this_thread::sleep_for(kWorkPerCommand);
+  }
+  auto sync_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+
+  FakeDevice async_device(kLatency);
+  start = std::chrono::steady_clock::now();
+  {
+    DiscardQueue queue(kBlockSize, async_device.discarder(), kBatchBlocks);
+    for (const auto& erase : erases) {
+      queue.Add(erase);
+      ASSERT_TRUE(queue.Barrier(work_blocks));
+      std::this_thread::sleep_for(kWorkPerCommand);
+    }
+    // The discards ran in the background, rather than all at the end.
+    ASSERT_GT(queue.discards_issued(), 0U);
+    ASSERT_TRUE(queue.Finish());
+    ASSERT_EQ(0, queue.barrier_waits());
+  }
+  auto async_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+
+  // The ranges of each batch are contiguous, so each batch takes (at most) a single discard.
+  auto discarded = async_device.discarded();
+  ASSERT_LE(discarded.size(), kCommands / 4);
+  size_t discarded_end = 0;
+  for (const auto& [begin, end] : discarded) {
+    ASSERT_EQ(discarded_end, begin);
+    discarded_end = end;
+  }
+  ASSERT_EQ(kCommands * kRangesPerErase * 16, discarded_end);
+  ASSERT_EQ(kCommands * kRangesPerErase, sync_device.discarded().size());
+
+  RecordProperty("sync_erase_us", std::to_string(sync_us.count()));
+  RecordProperty("async_erase_us", std::to_string(async_us.count()));
+  GTEST_LOG_(INFO) << "erase with " << kLatency.count() << "us discard latency: sync "
+                   << sync_us.count() << "us, async " << async_us.count() << "us";
+  ASSERT_LT(async_us, sync_us);
+}
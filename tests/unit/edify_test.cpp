@@ -14,17 +14,23 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
+
+#include <chrono>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include <android-base/stringprintf.h>
 #include <gtest/gtest.h>
 
 #include "edify/expr.h"
 
 static void expect(const std::string& expr_str, const char* expected) {
-  std::unique_ptr<Expr> e;
+  ExprArena arena;
+  Expr* e;
   int error_count = 0;
-  EXPECT_EQ(0, ParseString(expr_str, &e, &error_count));
+  EXPECT_EQ(0, ParseString(expr_str, &arena, &e, &error_count));
   EXPECT_EQ(0, error_count);
 
   State state(expr_str, nullptr);
@@ -150,18 +156,154 @@ TEST_F(EdifyTest, big_string) {
 
 TEST_F(EdifyTest, unknown_function) {
   const char* script1 = "unknown_function()";
-  std::unique_ptr<Expr> expr;
+  ExprArena arena;
+  Expr* expr;
   int error_count = 0;
-  EXPECT_EQ(1, ParseString(script1, &expr, &error_count));
+  EXPECT_EQ(1, ParseString(script1, &arena, &expr, &error_count));
   EXPECT_EQ(1, error_count);
 
   const char* script2 = "abc; unknown_function()";
   error_count = 0;
-  EXPECT_EQ(1, ParseString(script2, &expr, &error_count));
+  EXPECT_EQ(1, ParseString(script2, &arena, &expr, &error_count));
   EXPECT_EQ(1, error_count);
 
   const char* script3 = "unknown_function1() || yes";
   error_count = 0;
-  EXPECT_EQ(1, ParseString(script3, &expr, &error_count));
+  EXPECT_EQ(1, ParseString(script3, &arena, &expr, &error_count));
   EXPECT_EQ(1, error_count);
 }
+
+TEST_F(EdifyTest, escaped_strings) {
+  expect("\"a\\tb\\nc\"", "a\tb\nc");
+  expect("\"\\\"quoted\\\" \\\\ \\x41\\x42\"", "\"quoted\" \\ AB");
+  expect("\"multi\nline\" + x", "multi\nlinex");
+  // A backslash that doesn't start an escape sequence is kept.
+  expect("\"a\\qb\"", "a\\qb");
+  expect("concat(\"x\\x31\", \"y\")", "x1y");
+}
+
+TEST_F(EdifyTest, assert_message_points_into_script) {
+  // Parse twice, so that the second tree would have stale offsets if the lexer kept its position.
+  for (int i = 0; i < 2; i++) {
+    std::string script = "a; assert(b, \"\" + \"\", c)";
+    ExprArena arena;
+    Expr* e;
+    int error_count = 0;
+    ASSERT_EQ(0, ParseString(script, &arena, &e, &error_count));
+    ASSERT_EQ(0, error_count);
+
+    State state(script, nullptr);
+    std::string result;
+    ASSERT_FALSE(Evaluate(&state, e, &result));
+    ASSERT_EQ("assert failed: \"\" + \"\"", state.errmsg);
+  }
+}
+
+TEST_F(EdifyTest, literals_point_into_script) {
+  std::string script = "concat(abc, \"def\", \"g\\x68\")";
+  ExprArena arena;
+  Expr* e;
+  int error_count = 0;
+  ASSERT_EQ(0, ParseString(script, &arena, &e, &error_count));
+  ASSERT_EQ(0, error_count);
+
+  ASSERT_EQ("concat", e->name);
+  ASSERT_EQ(3U, e->argv.size());
+  ASSERT_EQ("abc", e->argv[0]->name);
+  ASSERT_EQ(script.data() + 7, e->argv[0]->name.data());
+  ASSERT_EQ("def", e->argv[1]->name);
+  ASSERT_EQ(script.data() + 13, e->argv[1]->name.data());
+  // Escaped strings are decoded into the arena.
+  ASSERT_EQ("gh", e->argv[2]->name);
+}
+
+// A device extension function written against the signature from before the arena.
+static Value* LegacyJoinFn(const char* name, State* state,
+                           const std::vector<std::unique_ptr<Expr>>& argv) {
+  if (argv.empty()) {
+    state->errmsg = std::string(name) + "() expects at least 1 argument";
+    return nullptr;
+  }
+  std::string separator;
+  if (!Evaluate(state, argv[0], &separator)) {
+    return nullptr;
+  }
+  std::vector<std::string> args;
+  if (!ReadArgs(state, argv, &args, 1, argv.size() - 1)) {
+    return nullptr;
+  }
+  std::string result;
+  for (const auto& arg : args) {
+    result += (result.empty() ? "" : separator) + arg;
+  }
+  return StringValue(result);
+}
+
+TEST_F(EdifyTest, legacy_function) {
+  RegisterFunction("legacy_join", LegacyJoinFn);
+  expect("legacy_join(\",\", a, b + c, \"d\")", "a,bc,d");
+  expect("legacy_join(\"-\", legacy_join(\"+\", a, b), c)", "a+b-c");
+  expect("legacy_join(\",\", abort())", nullptr);
+  expect("legacy_join()", nullptr);
+}
+
+TEST(ExprArenaTest, Allocate) {
+  ExprArena arena;
+  auto* c = arena.New<char>('x');
+  auto* i = arena.New<int64_t>(42);
+  ASSERT_EQ('x', *c);
+  ASSERT_EQ(42, *i);
+  ASSERT_EQ(0U, reinterpret_cast<uintptr_t>(i) % alignof(int64_t));
+
+  Expr** args = arena.NewArray<Expr*>(3);
+  for (size_t n = 0; n < 3; n++) {
+    ASSERT_EQ(nullptr, args[n]);
+  }
+
+  std::string_view copy = arena.CopyString("abc");
+  ASSERT_EQ("abc", copy);
+  ASSERT_EQ('\0', copy.data()[copy.size()]);
+
+  // Allocations larger than a block still succeed, and don't disturb the current block.
+  std::string big(1024 * 1024, 'b');
+  ASSERT_EQ(big, arena.CopyString(big));
+  ASSERT_EQ("def", arena.CopyString("def"));
+  ASSERT_GE(arena.bytes_used(), big.size());
+}
+
+// Parses and runs a script with tens of thousands of calls, in the shape of a generated
+// updater-script. The parse and evaluation times are recorded as test properties.
+TEST_F(EdifyTest, large_script) {
+  constexpr size_t kStatements = 20000;
+  std::string script;
+  for (size_t i = 0; i < kStatements; i++) {
+    script += android::base::StringPrintf(
+        "ifelse(is_substring(\"part%zu\", concat(\"/dev/block/\", \"part%zu\")) && "
+        "\"build\\x2f%zu\" == \"build/%zu\", \"ok\", abort(\"mismatch at %zu\"));\n",
+        i, i, i, i, i);
+  }
+  script += "done";
+
+  ExprArena arena;
+  Expr* e;
+  int error_count = 0;
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(0, ParseString(script, &arena, &e, &error_count));
+  auto parsed = std::chrono::steady_clock::now();
+  ASSERT_EQ(0, error_count);
+
+  State state(script, nullptr);
+  std::string result;
+  ASSERT_TRUE(Evaluate(&state, e, &result)) << state.errmsg;
+  auto evaluated = std::chrono::steady_clock::now();
+  ASSERT_EQ("done", result);
+
+  auto us = [](auto duration) {
+    using std::chrono::microseconds;
+    return static_cast<int>(std::chrono::duration_cast<microseconds>(duration).count());
+  };
+  RecordProperty("script_bytes", static_cast<int>(script.size()));
+  RecordProperty("arena_bytes", static_cast<int>(arena.bytes_used()));
+  RecordProperty("parse_us", us(parsed - start));
+  RecordProperty("evaluate_us", us(evaluated - parsed));
+}
@@ -14,14 +14,17 @@
  * limitations under the License.
  */
 
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include <android-base/file.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <gtest/gtest.h>
 
 #include "fuse_provider.h"
@@ -74,29 +77,26 @@ TEST(SideloadTest, run_fuse_sideload) {
   auto provider = std::make_unique<FuseFileDataProvider>(temp_file.path, 4096);
   ASSERT_TRUE(provider->Valid());
   TemporaryDir mount_point;
+  android::base::unique_fd ready_read_fd, ready_write_fd;
+  ASSERT_TRUE(android::base::Pipe(&ready_read_fd, &ready_write_fd));
   pid_t pid = fork();
   if (pid == 0) {
-    ASSERT_EQ(0, run_fuse_sideload(std::move(provider), mount_point.path));
+    ready_read_fd.reset();
+    ASSERT_EQ(0, run_fuse_sideload(std::move(provider), mount_point.path,
+                                   std::bind(&NotifyFuseSideloadReady, ready_write_fd.get())));
     _exit(EXIT_SUCCESS);
   }
+  ready_write_fd.reset();
+
+  static constexpr int kSideloadInstallTimeoutMs = 10000;
+  ASSERT_EQ(FuseReadyStatus::kReady,
+            WaitForFuseSideloadReady(ready_read_fd, kSideloadInstallTimeoutMs));
 
   std::string package = std::string(mount_point.path) + "/" + FUSE_SIDELOAD_HOST_FILENAME;
   int status;
-  static constexpr int kSideloadInstallTimeout = 10;
-  for (int i = 0; i < kSideloadInstallTimeout; ++i) {
-    ASSERT_NE(-1, waitpid(pid, &status, WNOHANG));
-
-    struct stat sb;
-    if (stat(package.c_str(), &sb) == 0) {
-      break;
-    }
-
-    if (errno == ENOENT && i < kSideloadInstallTimeout - 1) {
-      sleep(1);
-      continue;
-    }
-    FAIL() << "Timed out waiting for the fuse-provided package.";
-  }
+  struct stat package_sb;
+  ASSERT_EQ(0, stat(package.c_str(), &package_sb));
+  ASSERT_EQ(content.size(), static_cast<size_t>(package_sb.st_size));
 
   std::string content_via_fuse;
   ASSERT_TRUE(android::base::ReadFileToString(package, &content_via_fuse));
@@ -110,3 +110,77 @@ TEST(SideloadTest, run_fuse_sideload) {
   ASSERT_EQ(0, WEXITSTATUS(status));
   ASSERT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
 }
+
+TEST(SideloadTest, run_fuse_sideload_ready_latency) {
+  TemporaryDir mount_point;
+  android::base::unique_fd ready_read_fd, ready_write_fd;
+  ASSERT_TRUE(android::base::Pipe(&ready_read_fd, &ready_write_fd));
+
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    ready_read_fd.reset();
+    auto provider = std::make_unique<FuseTestDataProvider>(65536, 4096);
+    int result = run_fuse_sideload(std::move(provider), mount_point.path,
+                                   std::bind(&NotifyFuseSideloadReady, ready_write_fd.get()));
+    _exit(result == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  ready_write_fd.reset();
+
+  ASSERT_EQ(FuseReadyStatus::kReady, WaitForFuseSideloadReady(ready_read_fd, 10000));
+  auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  RecordProperty("ready_latency_us", std::to_string(latency.count()));
+
+  // The package must be accessible as soon as the ready signal arrives, without any polling.
+  std::string package = std::string(mount_point.path) + "/" + FUSE_SIDELOAD_HOST_FILENAME;
+  struct stat sb;
+  ASSERT_EQ(0, stat(package.c_str(), &sb));
+  ASSERT_EQ(65536, sb.st_size);
+
+  // The old polling loop would have taken at least a second before retrying.
+  ASSERT_LT(latency, std::chrono::seconds(1));
+
+  std::string exit_flag = std::string(mount_point.path) + "/" + FUSE_SIDELOAD_HOST_EXIT_FLAG;
+  ASSERT_EQ(0, stat(exit_flag.c_str(), &sb));
+
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+}
+
+TEST(SideloadTest, run_fuse_sideload_exit_before_ready) {
+  android::base::unique_fd ready_read_fd, ready_write_fd;
+  ASSERT_TRUE(android::base::Pipe(&ready_read_fd, &ready_write_fd));
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    ready_read_fd.reset();
+    // A block size that's too small fails before mounting.
+    auto provider = std::make_unique<FuseTestDataProvider>(4096, 4095);
+    int result = run_fuse_sideload(std::move(provider), FUSE_SIDELOAD_HOST_MOUNTPOINT,
+                                   std::bind(&NotifyFuseSideloadReady, ready_write_fd.get()));
+    _exit(result == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  ready_write_fd.reset();
+
+  // The parent shouldn't wait for the full timeout when the child has already exited.
+  ASSERT_EQ(FuseReadyStatus::kExited, WaitForFuseSideloadReady(ready_read_fd, 10000));
+
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(EXIT_FAILURE, WEXITSTATUS(status));
+}
+
+TEST(SideloadTest, run_fuse_sideload_ready_callback_abort) {
+  TemporaryDir mount_point;
+  auto provider = std::make_unique<FuseTestDataProvider>(4096, 4096);
+  bool called = false;
+  ASSERT_EQ(-1, run_fuse_sideload(std::move(provider), mount_point.path, [&called]() {
+    called = true;
+    return false;
+  }));
+  ASSERT_TRUE(called);
+}
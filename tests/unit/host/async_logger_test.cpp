@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <gtest/gtest.h>
+
+#include "otautil/async_logger.h"
+
+using namespace std::chrono_literals;
+
+// Collects the messages handed over by AsyncLogger, optionally taking |delay| for each like a slow
+// console would.
+class RecordingSink {
+ public:
+  explicit RecordingSink(std::chrono::microseconds delay = 0us) : delay_(delay) {}
+
+  android::base::LogFunction Get() {
+    return [this](android::base::LogId, android::base::LogSeverity, const char*, const char*,
+                  unsigned int, const char* message) {
+      if (delay_ > 0us) {
+        std::this_thread::sleep_for(delay_);
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      messages_.emplace_back(message);
+    };
+  }
+
+  std::vector<std::string> messages() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return messages_;
+  }
+
+ private:
+  const std::chrono::microseconds delay_;
+  std::mutex mutex_;
+  std::vector<std::string> messages_;
+};
+
+static void Info(AsyncLogger* logger, const std::string& message) {
+  logger->Log(android::base::DEFAULT, android::base::INFO, "test", __FILE__, __LINE__,
+              message.c_str());
+}
+
+TEST(AsyncLoggerTest, DeliversInOrder) {
+  RecordingSink sink;
+  AsyncLogger::Options options;
+  // Small enough for the threads to fill it up.
+  options.capacity = 16;
+  AsyncLogger logger(sink.Get(), options);
+
+  constexpr size_t kThreads = 4;
+  constexpr size_t kMessages = 5000;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; t++) {
+    threads.emplace_back([&logger, t] {
+      for (size_t i = 0; i < kMessages; i++) {
+        Info(&logger, std::to_string(t) + ":" + std::to_string(i));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  logger.Flush();
+
+  auto messages = sink.messages();
+  ASSERT_EQ(kThreads * kMessages, messages.size());
+  std::vector<size_t> next(kThreads, 0);
+  for (const auto& message : messages) {
+    size_t t = std::stoul(message.substr(0, message.find(':')));
+    ASSERT_EQ(std::to_string(t) + ":" + std::to_string(next[t]), message);
+    next[t]++;
+  }
+  ASSERT_EQ(kThreads * kMessages, logger.stats().delivered);
+  ASSERT_EQ(0, logger.stats().synchronous);
+}
+
+TEST(AsyncLoggerTest, RateLimitsRepeats) {
+  RecordingSink sink;
+  AsyncLogger logger(sink.Get());
+  for (size_t i = 0; i < 100; i++) {
+    Info(&logger, "retrying");
+  }
+  Info(&logger, "done");
+  logger.Flush();
+
+  // The first one, 3 repeats, and then the summary before the next message.
+  ASSERT_EQ((std::vector<std::string>{ "retrying", "retrying", "retrying", "retrying",
+                                       "(last message repeated 96 more times)", "done" }),
+            sink.messages());
+  ASSERT_EQ(96, logger.stats().suppressed);
+
+  // A flush summarizes the run so far.
+  for (size_t i = 0; i < 10; i++) {
+    Info(&logger, "done");
+  }
+  logger.Flush();
+  ASSERT_EQ("(last message repeated 7 more times)", sink.messages().back());
+}
+
+TEST(AsyncLoggerTest, SummarizesRepeatsAfterWindow) {
+  RecordingSink sink;
+  AsyncLogger::Options options;
+  options.repeat_window = 50ms;
+  AsyncLogger logger(sink.Get(), options);
+  for (size_t i = 0; i < 5; i++) {
+    Info(&logger, "retrying");
+  }
+
+  // The summary shows up once the window is over, without a flush or another message.
+  for (size_t i = 0; i < 100 && sink.messages().size() < 5; i++) {
+    std::this_thread::sleep_for(10ms);
+  }
+  ASSERT_EQ("(last message repeated 1 more times)", sink.messages().back());
+}
+
+TEST(AsyncLoggerTest, ErrorsFlushSynchronously) {
+  RecordingSink sink(100us);
+  AsyncLogger logger(sink.Get());
+  for (size_t i = 0; i < 20; i++) {
+    Info(&logger, std::to_string(i));
+  }
+  logger.Log(android::base::DEFAULT, android::base::ERROR, "test", __FILE__, __LINE__, "failed");
+
+  // Everything is out by the time the error returns, in order.
+  auto messages = sink.messages();
+  ASSERT_EQ(21, messages.size());
+  ASSERT_EQ("19", messages[19]);
+  ASSERT_EQ("failed", messages[20]);
+  ASSERT_EQ(1, logger.stats().synchronous);
+}
+
+TEST(AsyncLoggerTest, LongMessagesGoSynchronously) {
+  RecordingSink sink;
+  AsyncLogger::Options options;
+  options.max_message_size = 16;
+  AsyncLogger logger(sink.Get(), options);
+  Info(&logger, "short");
+  std::string long_message(100, 'x');
+  Info(&logger, long_message);
+
+  ASSERT_EQ((std::vector<std::string>{ "short", long_message }), sink.messages());
+}
+
+TEST(AsyncLoggerTest, DetachedLogsSynchronously) {
+  RecordingSink sink;
+  AsyncLogger logger(sink.Get());
+  logger.DetachAfterFork();
+  Info(&logger, "child");
+  ASSERT_EQ(std::vector<std::string>{ "child" }, sink.messages());
+}
+
+TEST(AsyncLoggerTest, Overhead) {
+  // A console that takes 50 us per line.
+  constexpr auto kSinkDelay = 50us;
+  constexpr size_t kMessages = 2000;
+  auto time_messages = [&](const android::base::LogFunction& log) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kMessages; i++) {
+      log(android::base::DEFAULT, android::base::INFO, "test", __FILE__, __LINE__,
+          "performing command: bsdiff 0 1234 2,100,200");
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                start) /
+           kMessages;
+  };
+
+  RecordingSink sync_sink(kSinkDelay);
+  auto sync_ns = time_messages(sync_sink.Get());
+
+  RecordingSink async_sink(kSinkDelay);
+  AsyncLogger::Options options;
+  options.capacity = kMessages;
+  // Identical messages would be rate-limited rather than delivered.
+  options.max_repeats = kMessages;
+  AsyncLogger logger(async_sink.Get(), options);
+  auto async_ns = time_messages([&logger](android::base::LogId id,
+                                          android::base::LogSeverity severity, const char* tag,
+                                          const char* file, unsigned int line,
+                                          const char* message) {
+    logger.Log(id, severity, tag, file, line, message);
+  });
+  logger.Flush();
+  ASSERT_EQ(kMessages, async_sink.messages().size());
+
+  ASSERT_LT(async_ns, sync_ns);
+  RecordProperty("sync_ns_per_message", std::to_string(sync_ns.count()));
+  RecordProperty("async_ns_per_message", std::to_string(async_ns.count()));
+}
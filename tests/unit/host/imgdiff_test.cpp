@@ -15,6 +15,7 @@
  */
 
 #include <stdio.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <string>
@@ -23,6 +24,7 @@
 
 #include <android-base/file.h>
 #include <android-base/memory.h>
+#include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <applypatch/imgdiff.h>
@@ -1111,3 +1113,118 @@ TEST(ImgdiffTest, zip_mode_large_apk_skipped_small_target_chunk) {
   // src_piece 1: a-0 1 block, CD
   GenerateAndCheckSplitTarget(debug_dir.path, 2, tgt);
 }
+
+TEST(ImgdiffTest, SelectSplitCandidate) {
+  // block_limit, pieces, patch_size, apply_memory
+  std::vector<SplitPatchStats> candidates = {
+    { 64, 8, 9000, 300000 },
+    { 128, 4, 7000, 600000 },
+    { 256, 2, 6000, 1200000 },
+    { 512, 1, 6000, 2200000 },
+  };
+
+  // Without a memory limit, the smallest patch wins; the ties go to the lower memory.
+  ASSERT_EQ(2U, ZipModeImage::SelectSplitCandidate(candidates, 0));
+  ASSERT_EQ(2U, ZipModeImage::SelectSplitCandidate(candidates, 1200000));
+  ASSERT_EQ(1U, ZipModeImage::SelectSplitCandidate(candidates, 1000000));
+  ASSERT_EQ(0U, ZipModeImage::SelectSplitCandidate(candidates, 300000));
+  // Nothing fits; fall back to the least memory.
+  ASSERT_EQ(0U, ZipModeImage::SelectSplitCandidate(candidates, 1000));
+}
+
+TEST(ImgdiffTest, zip_mode_large_apk_block_limit_candidates) {
+  // Same layout as zip_mode_store_large_apk.
+  TemporaryFile tgt_file;
+  FILE* tgt_file_ptr = fdopen(tgt_file.release(), "wb");
+  ZipWriter tgt_writer(tgt_file_ptr);
+  construct_store_entry(
+      { { "a", 3, 'a' }, { "b", 3, 'b' }, { "c", 8, 'c' }, { "d", 12, 'd' }, { "e", 3, 'e' } },
+      &tgt_writer);
+  ASSERT_EQ(0, tgt_writer.Finish());
+  ASSERT_EQ(0, fclose(tgt_file_ptr));
+
+  TemporaryFile src_file;
+  FILE* src_file_ptr = fdopen(src_file.release(), "wb");
+  ZipWriter src_writer(src_file_ptr);
+  construct_store_entry({ { "d", 12, 'd' }, { "c", 8, 'c' }, { "b", 3, 'b' }, { "a", 3, 'a' } },
+                        &src_writer);
+  ASSERT_EQ(0, src_writer.Finish());
+  ASSERT_EQ(0, fclose(src_file_ptr));
+
+  TemporaryFile patch_file;
+  TemporaryFile split_info_file;
+  TemporaryFile split_report_file;
+  TemporaryDir debug_dir;
+  std::string split_info_arg = android::base::StringPrintf("--split-info=%s", split_info_file.path);
+  std::string split_report_arg =
+      android::base::StringPrintf("--split-report=%s", split_report_file.path);
+  std::string debug_dir_arg = android::base::StringPrintf("--debug-dir=%s", debug_dir.path);
+  std::vector<const char*> args = {
+    "imgdiff",     "-z",          "--block-limit=10,40", split_info_arg.c_str(),
+    split_report_arg.c_str(),     debug_dir_arg.c_str(), src_file.path,
+    tgt_file.path, patch_file.path,
+  };
+  ASSERT_EQ(0, imgdiff(args.size(), args.data()));
+
+  // Line 0 holds the selected limit, followed by a line for each candidate.
+  std::string report;
+  ASSERT_TRUE(android::base::ReadFileToString(split_report_file.path, &report));
+  std::vector<std::string> lines = android::base::Split(android::base::Trim(report), "\n");
+  ASSERT_EQ(3U, lines.size());
+  size_t selected;
+  ASSERT_TRUE(android::base::ParseUint(lines[0], &selected));
+
+  std::vector<std::vector<std::string>> rows;
+  for (size_t i = 1; i < lines.size(); i++) {
+    rows.push_back(android::base::Split(lines[i], " "));
+    ASSERT_EQ(5U, rows.back().size());
+  }
+  ASSERT_EQ("10", rows[0][0]);
+  ASSERT_EQ("40", rows[1][0]);
+  // A larger limit splits into fewer pieces but needs more memory to apply.
+  size_t pieces[2];
+  size_t patch_size[2];
+  size_t apply_memory[2];
+  for (size_t i = 0; i < 2; i++) {
+    ASSERT_TRUE(android::base::ParseUint(rows[i][1], &pieces[i]));
+    ASSERT_TRUE(android::base::ParseUint(rows[i][2], &patch_size[i]));
+    ASSERT_TRUE(android::base::ParseUint(rows[i][3], &apply_memory[i]));
+  }
+  ASSERT_EQ(4U, pieces[0]);
+  ASSERT_LT(pieces[1], pieces[0]);
+  ASSERT_LT(apply_memory[0], apply_memory[1]);
+  size_t best = patch_size[1] < patch_size[0] ? 1 : 0;
+  ASSERT_EQ(best == 0 ? 10U : 40U, selected);
+
+  // The selected patch and split info are in place, and the other candidate's are gone.
+  std::string patch;
+  ASSERT_TRUE(android::base::ReadFileToString(patch_file.path, &patch));
+  ASSERT_EQ(patch_size[best], patch.size());
+  for (const char* limit : { ".10", ".40" }) {
+    ASSERT_EQ(-1, access((std::string(patch_file.path) + limit).c_str(), F_OK));
+    ASSERT_EQ(-1, access((std::string(split_info_file.path) + limit).c_str(), F_OK));
+  }
+
+  std::string tgt;
+  ASSERT_TRUE(android::base::ReadFileToString(tgt_file.path, &tgt));
+  for (size_t i = 0; i < 2; i++) {
+    std::string candidate_dir = android::base::StringPrintf("%s/block-limit-%s", debug_dir.path,
+                                                            rows[i][0].c_str());
+    GenerateAndCheckSplitTarget(candidate_dir, pieces[i], tgt);
+    ASSERT_EQ(0, rmdir(candidate_dir.c_str()));
+  }
+
+  // A memory limit below the larger candidate's needs picks the smaller limit.
+  std::string memory_limit_arg =
+      android::base::StringPrintf("--memory-limit=%zu", apply_memory[0]);
+  args.insert(args.begin() + 1, memory_limit_arg.c_str());
+  ASSERT_EQ(0, imgdiff(args.size(), args.data()));
+  ASSERT_TRUE(android::base::ReadFileToString(split_report_file.path, &report));
+  ASSERT_TRUE(android::base::StartsWith(report, "10\n"));
+  for (size_t i = 0; i < 2; i++) {
+    std::string candidate_dir = android::base::StringPrintf("%s/block-limit-%s", debug_dir.path,
+                                                            rows[i][0].c_str());
+    GenerateAndCheckSplitTarget(candidate_dir, pieces[i], tgt);
+    ASSERT_EQ(0, rmdir(candidate_dir.c_str()));
+  }
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <android-base/strings.h>
+#include <gtest/gtest.h>
+
+#include "private/commands.h"
+#include "updater/transfer_list_optimizer.h"
+
+static TransferList ParseTransferList(const std::vector<std::string>& lines) {
+  std::string err;
+  TransferList transfer_list = TransferList::Parse(android::base::Join(lines, '\n'), &err);
+  EXPECT_TRUE(transfer_list) << err;
+  return transfer_list;
+}
+
+static std::vector<std::string> CommandLines(const std::vector<Command>& commands) {
+  std::vector<std::string> result;
+  for (const auto& command : commands) {
+    result.push_back(command.cmdline());
+  }
+  return result;
+}
+
+TEST(TransferListOptimizerTest, ComputeStats) {
+  TransferList transfer_list = ParseTransferList({
+      "4",
+      "4",
+      "1",
+      "2",
+      "stash aaaa 2,0,2",
+      "move bbbb 2,10,12 2 2,20,22",
+      "move cccc 2,0,2 2 - aaaa:2,0,2",
+      "free aaaa",
+      // Overlapping source and target get stashed by the executor.
+      "move dddd 2,30,34 4 2,31,35",
+  });
+
+  TransferListStats stats = ComputeTransferListStats(transfer_list.commands());
+  ASSERT_EQ(4, stats.stash_max_blocks);
+  ASSERT_EQ(1, stats.stash_max_entries);
+  ASSERT_EQ(2, stats.stashed_blocks);
+  // 0 -> 0..2, 2 -> 20..22, 22 -> 10..12, 12 -> 0..2, 2 -> 31..35, 35 -> 30..34.
+  ASSERT_EQ(0 + 18 + 12 + 12 + 29 + 5, stats.seek_blocks);
+}
+
+TEST(TransferListOptimizerTest, ComputeStats_OverlapWithStashedSource) {
+  TransferList transfer_list = ParseTransferList({
+      "4",
+      "4",
+      "1",
+      "6",
+      "stash aaaa 2,0,2",
+      // The executor stashes all 4 source blocks, including the 2 loaded from aaaa.
+      "bsdiff 0 10 eeee ffff 2,10,14 4 2,11,13 2,0,2 aaaa:2,2,4",
+      "free aaaa",
+  });
+
+  TransferListStats stats = ComputeTransferListStats(transfer_list.commands());
+  ASSERT_EQ(2 + 4, stats.stash_max_blocks);
+  ASSERT_EQ(1, stats.stash_max_entries);
+  ASSERT_EQ(2, stats.stashed_blocks);
+}
+
+TEST(TransferListOptimizerTest, DropsStashNoLongerNeeded) {
+  // Block 0 gets overwritten before its stashed copy is used, which the optimizer can avoid by
+  // moving the load ahead of the write.
+  TransferList transfer_list = ParseTransferList({
+      "4",
+      "4",
+      "1",
+      "1",
+      "stash aaaa 2,0,1",
+      "move bbbb 2,6,7 1 2,4,5",
+      "move cccc 2,0,1 1 2,2,3",
+      "move aaaa 2,3,4 1 - aaaa:2,0,1",
+      "free aaaa",
+  });
+
+  std::vector<Command> commands;
+  std::string err;
+  ASSERT_TRUE(OptimizeTransferList(transfer_list, &commands, &err)) << err;
+  std::vector<std::string> expected{
+    "move bbbb 2,6,7 1 2,4,5",
+    "move aaaa 2,3,4 1 2,0,1",
+    "move cccc 2,0,1 1 2,2,3",
+  };
+  ASSERT_EQ(expected, CommandLines(commands));
+
+  TransferListStats stats = ComputeTransferListStats(commands);
+  ASSERT_EQ(0, stats.stash_max_blocks);
+  ASSERT_EQ(0, stats.stashed_blocks);
+  ASSERT_TRUE(CheckTransferListsEquivalent(transfer_list.commands(), commands, &err)) << err;
+}
+
+TEST(TransferListOptimizerTest, KeepsStashesForOverwrittenBlocks) {
+  // The swap of blocks 0 and 1 can't be done without stashing one of them.
+  TransferList transfer_list = ParseTransferList({
+      "4",
+      "2",
+      "1",
+      "1",
+      "stash aaaa 2,0,1",
+      "move bbbb 2,0,1 1 2,1,2",
+      "move aaaa 2,1,2 1 - aaaa:2,0,1",
+      "free aaaa",
+  });
+
+  std::vector<Command> commands;
+  std::string err;
+  ASSERT_TRUE(OptimizeTransferList(transfer_list, &commands, &err)) << err;
+  ASSERT_EQ(CommandLines(transfer_list.commands()), CommandLines(commands));
+}
+
+TEST(TransferListOptimizerTest, ReducesSeekDistance) {
+  TransferList transfer_list = ParseTransferList({
+      "4",
+      "40",
+      "0",
+      "0",
+      "new 2,1000,1010",
+      "zero 2,0,10",
+      "zero 2,2000,2010",
+      "zero 2,10,20",
+  });
+
+  std::vector<Command> commands;
+  std::string err;
+  ASSERT_TRUE(OptimizeTransferList(transfer_list, &commands, &err)) << err;
+  std::vector<std::string> expected{
+    "zero 2,0,10",
+    "zero 2,10,20",
+    "new 2,1000,1010",
+    "zero 2,2000,2010",
+  };
+  ASSERT_EQ(expected, CommandLines(commands));
+  ASSERT_LT(ComputeTransferListStats(commands).seek_blocks,
+            ComputeTransferListStats(transfer_list.commands()).seek_blocks);
+}
+
+TEST(TransferListOptimizerTest, KeepsNewDataInOrder) {
+  TransferList transfer_list = ParseTransferList({
+      "4",
+      "20",
+      "0",
+      "0",
+      "new 2,100,110",
+      "new 2,0,10",
+  });
+
+  std::vector<Command> commands;
+  std::string err;
+  ASSERT_TRUE(OptimizeTransferList(transfer_list, &commands, &err)) << err;
+  ASSERT_EQ(CommandLines(transfer_list.commands()), CommandLines(commands));
+}
+
+TEST(TransferListOptimizerTest, CheckEquivalent_DetectsReorderedWrites) {
+  TransferList transfer_list = ParseTransferList({
+      "4",
+      "2",
+      "0",
+      "0",
+      "move aaaa 2,10,11 1 2,0,1",
+      "zero 2,0,1",
+  });
+  std::vector<Command> swapped{ transfer_list.commands()[1], transfer_list.commands()[0] };
+
+  std::string err;
+  ASSERT_TRUE(
+      CheckTransferListsEquivalent(transfer_list.commands(), transfer_list.commands(), &err));
+  ASSERT_FALSE(CheckTransferListsEquivalent(transfer_list.commands(), swapped, &err));
+}
+
+TEST(TransferListOptimizerTest, FormatTransferList) {
+  TransferList transfer_list = ParseTransferList({
+      "4",
+      "4",
+      "1",
+      "1",
+      "stash aaaa 2,0,1",
+      "move bbbb 2,6,7 1 2,4,5",
+      "move cccc 2,0,1 1 2,2,3",
+      "move aaaa 2,3,4 1 - aaaa:2,0,1",
+      "free aaaa",
+  });
+
+  std::vector<Command> commands;
+  std::string err;
+  ASSERT_TRUE(OptimizeTransferList(transfer_list, &commands, &err)) << err;
+  std::string output = FormatTransferList(transfer_list, commands);
+  ASSERT_EQ(
+      "4\n4\n0\n0\n"
+      "move bbbb 2,6,7 1 2,4,5\n"
+      "move aaaa 2,3,4 1 2,0,1\n"
+      "move cccc 2,0,1 1 2,2,3\n",
+      output);
+
+  TransferList reparsed = TransferList::Parse(output, &err);
+  ASSERT_TRUE(reparsed) << err;
+  ASSERT_EQ(3, reparsed.commands().size());
+}
@@ -30,11 +30,13 @@
 
 #include "otautil/paths.h"
 #include "otautil/print_sha1.h"
+#include "private/commands.h"
 #include "updater/blockimg.h"
 #include "updater/build_info.h"
 #include "updater/install.h"
 #include "updater/simulator_runtime.h"
 #include "updater/target_files.h"
+#include "updater/transfer_list_optimizer.h"
 #include "updater/updater.h"
 
 using std::string;
@@ -401,3 +403,69 @@ TEST_F(DISABLED_UpdateSimulatorTest, RunUpdateApplyPatchFailed) {
 
   RunSimulation(src_tf.path, ota_package.path, false);
 }
+
+TEST_F(DISABLED_UpdateSimulatorTest, RunUpdateOptimizedTransferList) {
+  // A raw system image with 8 blocks, filled with 'a' to 'h' respectively.
+  std::vector<string> blocks;
+  for (char c = 'a'; c < 'i'; c++) {
+    blocks.emplace_back(4096, c);
+  }
+  std::map<string, string> src_entries{
+    { "META/misc_info.txt", "fstab_version=2" },
+    { "IMAGES/system.img", android::base::Join(blocks, "") },
+    { "RECOVERY/RAMDISK/etc/recovery.fstab", fstab_content_ },
+    { "SYSTEM/build.prop", build_prop_string_ },
+  };
+
+  TemporaryFile src_tf;
+  AddZipEntries(src_tf.release(), src_entries);
+
+  // Block 0 is stashed because it gets overwritten before being moved to block 3.
+  string hash0 = CalculateSha1(blocks[0]);
+  std::vector<string> transfer_list_lines{
+    "4",
+    "3",
+    "1",
+    "1",
+    "stash " + hash0 + " 2,0,1",
+    "move " + CalculateSha1(blocks[4]) + " 2,6,7 1 2,4,5",
+    "move " + CalculateSha1(blocks[2]) + " 2,0,1 1 2,2,3",
+    "move " + hash0 + " 2,3,4 1 - " + hash0 + ":2,0,1",
+    "free " + hash0,
+  };
+  string original = android::base::Join(transfer_list_lines, '\n');
+
+  string err;
+  TransferList transfer_list = TransferList::Parse(original, &err);
+  ASSERT_TRUE(transfer_list) << err;
+  std::vector<Command> commands;
+  ASSERT_TRUE(OptimizeTransferList(transfer_list, &commands, &err)) << err;
+  ASSERT_EQ(0, ComputeTransferListStats(commands).stashed_blocks);
+  string optimized = FormatTransferList(transfer_list, commands);
+
+  string expected_sha1 = CalculateSha1(blocks[2] + blocks[1] + blocks[2] + blocks[0] + blocks[4] +
+                                       blocks[5] + blocks[4] + blocks[7]);
+  std::vector<string> updater_commands = {
+    R"(block_image_update("/dev/block/by-name/system", )"
+    R"(package_extract_file("system.transfer.list"), "system.new.dat", "system.patch.dat") || )"
+    R"(abort("Failed to update system.");)",
+    R"(range_sha1("/dev/block/by-name/system", "2,0,8") == ")" + expected_sha1 +
+        R"(" || abort("Unexpected system contents.");)",
+  };
+  string updater_script = android::base::Join(updater_commands, '\n');
+
+  // Both orders must succeed and produce the same partition contents.
+  for (const auto& transfer_list_string : { original, optimized }) {
+    std::map<string, string> ota_entries{
+      { "system.new.dat", "" },
+      { "system.patch.dat", "" },
+      { "system.transfer.list", transfer_list_string },
+      { "META-INF/com/google/android/updater-script", updater_script },
+    };
+
+    TemporaryFile ota_package;
+    AddZipEntries(ota_package.release(), ota_entries);
+
+    RunSimulation(src_tf.path, ota_package.path, true);
+  }
+}
@@ -192,26 +192,27 @@ static void VerifyAbUpdateCommands(const std::string& serialno, bool success = t
   ASSERT_EQ(0, OpenArchive(temp_file.path, &zip));
   ZipEntry64 payload_entry;
   ASSERT_EQ(0, FindEntry(zip, "payload.bin", &payload_entry));
+  CloseArchive(zip);
 
+  auto package = Package::CreateFilePackage(temp_file.path, nullptr);
+  ASSERT_NE(nullptr, package);
   std::map<std::string, std::string> metadata;
-  ASSERT_TRUE(ReadMetadataFromPackage(zip, &metadata));
+  ASSERT_TRUE(ReadMetadataFromPackage(package.get(), &metadata));
   if (success) {
     ASSERT_TRUE(CheckPackageMetadata(metadata, OtaType::AB));
 
     int status_fd = 10;
-    std::string package = "/path/to/update.zip";
     std::vector<std::string> cmd;
-    ASSERT_TRUE(SetUpAbUpdateCommands(package, zip, status_fd, &cmd));
+    ASSERT_TRUE(SetUpAbUpdateCommands(package.get(), status_fd, &cmd));
     ASSERT_EQ(5U, cmd.size());
     ASSERT_EQ("/system/bin/update_engine_sideload", cmd[0]);
-    ASSERT_EQ("--payload=file://" + package, cmd[1]);
+    ASSERT_EQ("--payload=file://" + std::string(temp_file.path), cmd[1]);
     ASSERT_EQ("--offset=" + std::to_string(payload_entry.offset), cmd[2]);
     ASSERT_EQ("--headers=" + properties, cmd[3]);
     ASSERT_EQ("--status_fd=" + std::to_string(status_fd), cmd[4]);
   } else {
     ASSERT_FALSE(CheckPackageMetadata(metadata, OtaType::AB));
   }
-  CloseArchive(zip);
 }
 
 TEST(InstallTest, SetUpAbUpdateCommands) {
@@ -239,13 +240,11 @@ TEST(InstallTest, SetUpAbUpdateCommands_MissingPayloadPropertiesTxt) {
       },
       temp_file.release(), kCompressStored);
 
-  ZipArchiveHandle zip;
-  ASSERT_EQ(0, OpenArchive(temp_file.path, &zip));
+  auto package = Package::CreateFilePackage(temp_file.path, nullptr);
+  ASSERT_NE(nullptr, package);
   int status_fd = 10;
-  std::string package = "/path/to/update.zip";
   std::vector<std::string> cmd;
-  ASSERT_FALSE(SetUpAbUpdateCommands(package, zip, status_fd, &cmd));
-  CloseArchive(zip);
+  ASSERT_FALSE(SetUpAbUpdateCommands(package.get(), status_fd, &cmd));
 }
 
 TEST(InstallTest, SetUpAbUpdateCommands_MultipleSerialnos) {
@@ -277,6 +276,54 @@ TEST(InstallTest, SetUpAbUpdateCommands_MultipleSerialnos) {
   VerifyAbUpdateCommands(long_serialno);
 }
 
+TEST(InstallTest, PackageEntryCache) {
+  TemporaryFile temp_file;
+  const std::string properties = "FILE_HASH=abc\nPOWERWASH=1\n";
+  BuildZipArchive({ { "payload.bin", std::string(4096, 'p') },
+                    { "payload_properties.txt", properties },
+                    { "META-INF/com/android/metadata", "ota-type=AB\npre-device=foo\n" } },
+                  temp_file.release(), kCompressDeflated);
+
+  auto package = Package::CreateFilePackage(temp_file.path, nullptr);
+  ASSERT_NE(nullptr, package);
+
+  // The metadata gets read once to install, then again to check the package for a wipe.
+  for (size_t i = 0; i < 2; i++) {
+    std::map<std::string, std::string> metadata;
+    ASSERT_TRUE(ReadMetadataFromPackage(package.get(), &metadata));
+    ASSERT_EQ("AB", metadata["ota-type"]);
+    ASSERT_EQ("foo", metadata["pre-device"]);
+  }
+
+  // The payload properties get read both raw (for the update_engine headers) and parsed (for the
+  // powerwash check).
+  const std::string* raw = package->ReadCachedEntry("payload_properties.txt");
+  ASSERT_NE(nullptr, raw);
+  ASSERT_EQ(properties, *raw);
+  const auto* parsed = package->ReadCachedProperties("payload_properties.txt");
+  ASSERT_NE(nullptr, parsed);
+  ASSERT_EQ("1", parsed->at("POWERWASH"));
+  ASSERT_EQ(raw, package->ReadCachedEntry("payload_properties.txt"));
+
+  ZipEntry64 entry;
+  ASSERT_TRUE(package->LookupEntry("payload.bin", &entry));
+  ASSERT_EQ(4096u, entry.uncompressed_length);
+  ASSERT_FALSE(package->LookupEntry("recovery.wipe", &entry));
+  ASSERT_EQ(nullptr, package->ReadCachedEntry("recovery.wipe"));
+
+  // Everything above came out of a single pass over the central directory, and each entry got
+  // extracted no more than once.
+  const auto& stats = package->GetEntryCacheStats();
+  ASSERT_EQ(1u, stats.scans);
+  ASSERT_EQ(2u, stats.extractions);
+  ASSERT_EQ(6u, stats.reads);
+  ASSERT_EQ(5u, stats.lookups);
+  RecordProperty("entry_reads", stats.reads);
+  RecordProperty("entry_extractions", stats.extractions);
+  RecordProperty("entry_lookups", stats.lookups);
+  RecordProperty("central_directory_scans", stats.scans);
+}
+
 static void TestCheckPackageMetadata(const std::string& metadata_string, OtaType ota_type,
                                      bool exptected_result) {
   TemporaryFile temp_file;
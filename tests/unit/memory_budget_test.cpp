@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "otautil/memory_budget.h"
+
+static constexpr const char kNoPressure[] =
+    "some avg10=0.00 avg60=0.00 avg300=0.00 total=0\n"
+    "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+
+static std::string Meminfo(size_t available_kib) {
+  return "MemTotal:        4000000 kB\n"
+         "MemFree:          100000 kB\n"
+         "MemAvailable:    " +
+         std::to_string(available_kib) +
+         " kB\n"
+         "Buffers:           10000 kB\n";
+}
+
+class MemoryBudgetTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(android::base::WriteStringToFile(Meminfo(1024 * 1024), meminfo_.path));
+    ASSERT_TRUE(android::base::WriteStringToFile(kNoPressure, psi_.path));
+  }
+
+  TemporaryFile meminfo_;
+  TemporaryFile psi_;
+};
+
+TEST_F(MemoryBudgetTest, InitReadsMemAvailable) {
+  MemoryBudget budget(meminfo_.path, psi_.path);
+  budget.Init();
+  ASSERT_EQ(1024 * 1024 * 1024, budget.limit());
+  ASSERT_FALSE(budget.degraded());
+  ASSERT_EQ(256 * 1024 * 1024, budget.Budget(MemoryConsumer::kTransferBuffer));
+  ASSERT_EQ(64 * 1024 * 1024, budget.Budget(MemoryConsumer::kVerifyWindow));
+  ASSERT_EQ(128 * 1024 * 1024, budget.Budget(MemoryConsumer::kPatchData));
+
+  // The limit is only read once.
+  ASSERT_TRUE(android::base::WriteStringToFile(Meminfo(2048), meminfo_.path));
+  budget.Init();
+  ASSERT_EQ(1024 * 1024 * 1024, budget.limit());
+}
+
+TEST_F(MemoryBudgetTest, ExplicitLimit) {
+  MemoryBudget budget(meminfo_.path, psi_.path);
+  ASSERT_EQ(SIZE_MAX, budget.Budget(MemoryConsumer::kTransferBuffer));
+
+  budget.set_limit(8 * 1024 * 1024);
+  budget.Init();
+  ASSERT_EQ(8 * 1024 * 1024, budget.limit());
+  ASSERT_EQ(2 * 1024 * 1024, budget.Budget(MemoryConsumer::kTransferBuffer));
+
+  // Budgets don't go below the minimum.
+  budget.set_limit(1024);
+  ASSERT_EQ(MemoryBudget::kMinBudget, budget.Budget(MemoryConsumer::kVerifyWindow));
+}
+
+TEST_F(MemoryBudgetTest, DegradedOnPsiStall) {
+  ASSERT_TRUE(android::base::WriteStringToFile(
+      "some avg10=25.00 avg60=5.00 avg300=1.00 total=1000\n", psi_.path));
+  MemoryBudget budget(meminfo_.path, psi_.path);
+  budget.Init();
+  ASSERT_TRUE(budget.degraded());
+  ASSERT_EQ(64 * 1024 * 1024, budget.Budget(MemoryConsumer::kTransferBuffer));
+}
+
+TEST_F(MemoryBudgetTest, DegradedOnMemAvailableDrop) {
+  MemoryBudget budget(meminfo_.path, psi_.path);
+  budget.Init();
+  ASSERT_TRUE(android::base::WriteStringToFile(Meminfo(400 * 1024), meminfo_.path));
+  ASSERT_TRUE(budget.degraded());
+  // The budgets still derive from the initial figure.
+  ASSERT_EQ(1024 * 1024 * 1024, budget.limit());
+  ASSERT_EQ(32 * 1024 * 1024, budget.Budget(MemoryConsumer::kPatchData));
+}
+
+TEST_F(MemoryBudgetTest, MissingPressureFiles) {
+  MemoryBudget budget("/nonexistent/meminfo", "/nonexistent/pressure");
+  budget.Init();
+  ASSERT_EQ(0, budget.limit());
+  ASSERT_FALSE(budget.degraded());
+  ASSERT_EQ(SIZE_MAX, budget.Budget(MemoryConsumer::kPatchData));
+}
+
+TEST_F(MemoryBudgetTest, TracksUsage) {
+  MemoryBudget budget(meminfo_.path, psi_.path);
+  budget.SetUsage(MemoryConsumer::kTransferBuffer, 4096);
+  budget.SetUsage(MemoryConsumer::kVerifyWindow, 1024);
+  ASSERT_EQ(5120, budget.usage());
+  budget.SetUsage(MemoryConsumer::kTransferBuffer, 0);
+  budget.SetUsage(MemoryConsumer::kVerifyWindow, 0);
+  ASSERT_EQ(0, budget.usage());
+  ASSERT_EQ(5120, budget.peak_usage());
+}
@@ -16,12 +16,16 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <chrono>
 #include <limits>
+#include <string>
 #include <vector>
 
 #include <gtest/gtest.h>
 
+#include "minui/graphics_memory.h"
 #include "minui/minui.h"
 
 TEST(GRSurfaceTest, Create_aligned) {
@@ -52,3 +56,188 @@ TEST(GRSurfaceTest, Clone) {
   ASSERT_EQ(std::vector(image->data(), image->data() + image->data_size()),
             std::vector(image_copy->data(), image_copy->data() + image->data_size()));
 }
+
+static uint64_t SpanPixels(const std::vector<GRSpan>& spans) {
+  uint64_t pixels = 0;
+  for (const auto& span : spans) {
+    pixels += span.x2 - span.x1;
+  }
+  return pixels;
+}
+
+TEST(GraphicsTest, RoundClipSpans) {
+  auto spans = gr_round_clip_spans(100, 100);
+  ASSERT_EQ(100, spans.size());
+  for (int y = 0; y < 100; y++) {
+    // Symmetric, both ways.
+    ASSERT_EQ(spans[y].x1, 100 - spans[y].x2) << "row " << y;
+    ASSERT_EQ(spans[y].x1, spans[99 - y].x1) << "row " << y;
+  }
+  ASSERT_EQ(0, spans[49].x1);
+  ASSERT_EQ(0, spans[50].x1);
+  ASSERT_LT(0, spans[0].x1);
+  ASSERT_LT(spans[0].x1, spans[0].x2);
+
+  // A bit more than the pi / 4 of the area, as the pixels on the outline are kept.
+  uint64_t pixels = SpanPixels(spans);
+  ASSERT_GT(pixels, 7854);
+  ASSERT_LT(pixels, 8200);
+
+  ASSERT_TRUE(gr_round_clip_spans(0, 0).empty());
+}
+
+TEST(GraphicsTest, ClipSpans) {
+  ASSERT_EQ(0, gr_init({ GraphicsBackend::MEMORY }));
+  int width = gr_fb_width();
+  int height = gr_fb_height();
+  auto spans = gr_round_clip_spans(width, height);
+  auto image = GRSurface::Create(width, height, width * 4, 4);
+  ASSERT_NE(nullptr, image);
+  memset(image->data(), 0x80, image->data_size());
+
+  // Draws a frame the way the recovery UI does, and returns how many pixels that touched.
+  auto draw_frame = [&]() {
+    uint64_t start = gr_pixels_drawn();
+    gr_color(0, 0, 0, 255);
+    gr_clear();
+    gr_color(0, 0, 255, 128);
+    gr_fill(0, 0, width, height);
+    gr_blit(image.get(), 0, 0, width, height, 0, 0);
+    return gr_pixels_drawn() - start;
+  };
+
+  uint64_t unclipped = draw_frame();
+  ASSERT_EQ(3ULL * width * height, unclipped);
+
+  gr_color(255, 255, 255, 255);
+  gr_clear();
+  gr_set_clip_spans(spans);
+  uint64_t clipped = draw_frame();
+  ASSERT_EQ(3 * SpanPixels(spans), clipped);
+
+  // An icon in the corner is left out entirely.
+  auto icon = GRSurface::Create(10, 10, 10, 1);
+  ASSERT_NE(nullptr, icon);
+  memset(icon->data(), 0xff, icon->data_size());
+  uint64_t start = gr_pixels_drawn();
+  gr_texticon(0, 0, icon.get());
+  ASSERT_EQ(start, gr_pixels_drawn());
+
+  // The corners keep what was there, while the rest got drawn.
+  gr_flip();
+  const GRSurface* frame = MinuiBackendMemory::DisplayedFrame();
+  ASSERT_NE(nullptr, frame);
+  auto pixel = [frame](int x, int y) {
+    return reinterpret_cast<const uint32_t*>(frame->data() + y * frame->row_bytes)[x];
+  };
+  ASSERT_EQ(0xffffffff, pixel(0, 0));
+  ASSERT_EQ(0xffffffff, pixel(width - 1, height - 1));
+  ASSERT_EQ(0x80808080, pixel(width / 2, height / 2));
+  ASSERT_EQ(0x80808080, pixel(0, height / 2));
+
+  RecordProperty("unclipped_pixels", std::to_string(unclipped));
+  RecordProperty("clipped_pixels", std::to_string(clipped));
+
+  gr_exit();
+}
+
+TEST(GraphicsTest, RotateAtFlip) {
+  // Where the top-left pixel of the rotated screen lands in the 720 x 1280 framebuffer.
+  const struct {
+    GRRotation rotation;
+    int x;
+    int y;
+  } cases[] = {
+    { GRRotation::NONE, 0, 0 },
+    { GRRotation::RIGHT, 719, 0 },
+    { GRRotation::DOWN, 719, 1279 },
+    { GRRotation::LEFT, 0, 1279 },
+  };
+  for (const auto& c : cases) {
+    ASSERT_EQ(0, gr_init({ GraphicsBackend::MEMORY }));
+    gr_rotate(c.rotation);
+    gr_color(0, 0, 0, 255);
+    gr_clear();
+    gr_color(255, 0, 0, 255);
+    gr_fill(0, 0, 1, 1);
+    gr_flip();
+
+    const GRSurface* frame = MinuiBackendMemory::DisplayedFrame();
+    ASSERT_NE(nullptr, frame);
+    auto pixel = [frame](int x, int y) {
+      return reinterpret_cast<const uint32_t*>(frame->data() + y * frame->row_bytes)[x];
+    };
+    ASSERT_EQ(0xff0000ff, pixel(c.x, c.y)) << static_cast<int>(c.rotation);
+    ASSERT_EQ(0xff000000, pixel(360, 640)) << static_cast<int>(c.rotation);
+    gr_exit();
+  }
+}
+
+TEST(GraphicsTest, RotateOnlyDamage) {
+  ASSERT_EQ(0, gr_init({ GraphicsBackend::MEMORY }));
+  gr_rotate(GRRotation::RIGHT);
+  ASSERT_EQ(1280, gr_fb_width());
+  ASSERT_EQ(720, gr_fb_height());
+
+  // Both framebuffers need the whole frame once.
+  uint64_t start = gr_pixels_rotated();
+  gr_flip();
+  gr_flip();
+  ASSERT_EQ(2ULL * 1280 * 720, gr_pixels_rotated() - start);
+  // The canvas carries over, so a small change only costs its tile, in each framebuffer.
+  ASSERT_EQ(1, gr_draw_buffer_age());
+  gr_color(255, 255, 255, 255);
+  gr_fill(40, 40, 50, 50);
+  start = gr_pixels_rotated();
+  gr_flip();
+  ASSERT_EQ(32 * 32, gr_pixels_rotated() - start);
+  gr_flip();
+  ASSERT_EQ(2 * 32 * 32, gr_pixels_rotated() - start);
+  gr_flip();
+  ASSERT_EQ(2 * 32 * 32, gr_pixels_rotated() - start);
+
+  const GRSurface* frame = MinuiBackendMemory::DisplayedFrame();
+  ASSERT_NE(nullptr, frame);
+  // Screen (45, 45) is framebuffer (719 - 45, 45).
+  ASSERT_EQ(0xffffffff,
+            reinterpret_cast<const uint32_t*>(frame->data() + 45 * frame->row_bytes)[674]);
+  gr_exit();
+}
+
+TEST(GraphicsTest, RotatedThroughput) {
+  const struct {
+    GRRotation rotation;
+    const char* name;
+  } cases[] = {
+    { GRRotation::NONE, "none" },
+    { GRRotation::RIGHT, "right" },
+    { GRRotation::DOWN, "down" },
+    { GRRotation::LEFT, "left" },
+  };
+  constexpr int kFrames = 20;
+  for (const auto& c : cases) {
+    ASSERT_EQ(0, gr_init({ GraphicsBackend::MEMORY }));
+    gr_rotate(c.rotation);
+    int width = gr_fb_width();
+    int height = gr_fb_height();
+    auto image = GRSurface::Create(width, height / 2, width * 4, 4);
+    ASSERT_NE(nullptr, image);
+    memset(image->data(), 0x80, image->data_size());
+
+    // Full redraws, the worst case for the rotation at flip time.
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kFrames; i++) {
+      gr_color(0, 0, 0, 255);
+      gr_clear();
+      gr_color(0, 0, 255, 128);
+      gr_fill(0, 0, width, height / 2);
+      gr_blit(image.get(), 0, 0, width, height / 2, 0, height / 2);
+      gr_flip();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    RecordProperty(std::string(c.name) + "_us_per_frame",
+                   std::to_string(elapsed.count() / kFrames));
+    gr_exit();
+  }
+}
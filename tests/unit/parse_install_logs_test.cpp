@@ -14,8 +14,11 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <android-base/file.h>
@@ -72,3 +75,121 @@ TEST(ParseInstallLogsTest, ParseRecoveryUpdateMetrics) {
 
   ASSERT_EQ(expected_result, metrics);
 }
+
+TEST(ParseInstallLogsTest, TypedSchema) {
+  InstallLogParser parser({
+      { "time_total", InstallLogValueType::kSeconds, false },
+      { "io_busy_ms", InstallLogValueType::kMilliseconds, false },
+      { "io_write_bytes", InstallLogValueType::kBytes, false },
+      { "error", InstallLogValueType::kInt, false },
+      { "latency_ms", InstallLogValueType::kHistogram, false },
+      { "bytes_written", InstallLogValueType::kBytes, true },
+      { "stage_time", InstallLogValueType::kMilliseconds, true },
+  });
+  for (const auto& line : std::vector<std::string>{
+           "/cache/recovery/ota.zip",
+           "1",
+           "time_total: 1500ms",
+           "io_busy_ms: 2s",
+           "io_write_bytes: 3m",
+           "error: 22",
+           "error: 23",
+           "latency_ms: 0=10 10=4",
+           "latency_ms: 10=1 20=2",
+           "bytes_written_system: 1024",
+           "bytes_written_system_ext: 2k",
+           "stage_time_system: 300",
+           "retry_reason: device busy",
+           "error: not_a_number",
+           "no colon here",
+       }) {
+    parser.ParseLine(line);
+  }
+  InstallLog log = parser.Finish();
+
+  ASSERT_EQ("/cache/recovery/ota.zip", log.package);
+  ASSERT_EQ(1, log.result);
+  std::map<std::string, int64_t> expected_values = {
+    { "time_total", 1 },
+    { "io_busy_ms", 2000 },
+    { "io_write_bytes", 3 * 1024 * 1024 },
+    { "error", 22 },
+  };
+  ASSERT_EQ(expected_values, log.values);
+
+  std::map<std::string, std::map<std::string, int64_t>> expected_stages = {
+    { "system", { { "bytes_written", 1024 }, { "stage_time", 300 } } },
+    { "system_ext", { { "bytes_written", 2048 } } },
+  };
+  ASSERT_EQ(expected_stages, log.stages);
+
+  std::map<int64_t, int64_t> expected_histogram = { { 0, 10 }, { 10, 5 }, { 20, 2 } };
+  ASSERT_EQ(expected_histogram, log.histograms["latency_ms"]);
+
+  std::map<std::string, std::string> expected_unknown = { { "retry_reason", "device busy" } };
+  ASSERT_EQ(expected_unknown, log.unknown);
+  ASSERT_EQ(2U, log.malformed_lines);
+}
+
+TEST(ParseInstallLogsTest, StreamedInChunks) {
+  std::string content =
+      "/sideload/package.zip\n0\ntime_total: 300\nbytes_written_system: 2097152\n"
+      "io_read_bytes: 4096\nunknown_key: value";
+
+  InstallLogParser whole;
+  whole.Feed(content);
+  InstallLog expected = whole.Finish();
+
+  // Lines split across any boundary parse the same.
+  for (size_t chunk = 1; chunk < 8; chunk++) {
+    InstallLogParser parser;
+    for (size_t i = 0; i < content.size(); i += chunk) {
+      parser.Feed(std::string_view(content).substr(i, chunk));
+    }
+    InstallLog log = parser.Finish();
+    ASSERT_EQ(expected.package, log.package);
+    ASSERT_EQ(expected.values, log.values);
+    ASSERT_EQ(expected.stages, log.stages);
+    ASSERT_EQ(expected.unknown, log.unknown);
+  }
+  ASSERT_EQ(300, expected.values["time_total"]);
+  ASSERT_EQ(4096, expected.values["io_read_bytes"]);
+  ASSERT_EQ("value", expected.unknown["unknown_key"]);
+}
+
+// Writes a synthetic last_install with |stages| partitions, and returns the time to parse it.
+static std::chrono::nanoseconds TimeParseLastInstall(size_t stages) {
+  TemporaryFile last_install;
+  std::string content = "/sideload/package.zip\n0\ntime_total: 300\n";
+  for (size_t i = 0; i < stages; i++) {
+    auto stage = std::to_string(i);
+    content += "bytes_written_p" + stage + ": " + std::to_string(i * 1024 * 1024) + "\n";
+    content += "bytes_stashed_p" + stage + ": " + std::to_string(i * 4096) + "\n";
+    content += "extra_key_" + stage + ": " + stage + "\n";
+  }
+  EXPECT_TRUE(android::base::WriteStringToFile(content, last_install.path));
+
+  auto best = std::chrono::nanoseconds::max();
+  for (size_t run = 0; run < 3; run++) {
+    auto start = std::chrono::steady_clock::now();
+    InstallLog log;
+    EXPECT_TRUE(ParseInstallLog(last_install.path, &log));
+    best = std::min(best, std::chrono::steady_clock::now() - start);
+    EXPECT_EQ(stages, log.stages.size());
+    EXPECT_EQ(stages, log.unknown.size());
+  }
+  return best;
+}
+
+TEST(ParseInstallLogsTest, ScalesLinearly) {
+  constexpr size_t kSmall = 4000;
+  constexpr size_t kLarge = kSmall * 8;
+  auto small = TimeParseLastInstall(kSmall);
+  auto large = TimeParseLastInstall(kLarge);
+
+  RecordProperty("parse_ns_per_line_small", small.count() / (kSmall * 3));
+  RecordProperty("parse_ns_per_line_large", large.count() / (kLarge * 3));
+  // Eight times the lines shouldn't take much more than eight times as long. The map inserts add a
+  // log factor, and the rest is slack for noisy machines.
+  ASSERT_LT(large.count(), small.count() * 8 * 3);
+}
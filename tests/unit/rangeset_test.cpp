@@ -17,8 +17,12 @@
 #include <signal.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <chrono>
 #include <limits>
 #include <optional>
+#include <random>
+#include <string>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -124,6 +128,128 @@ TEST(RangeSetTest, Overlaps) {
   ASSERT_FALSE(RangeSet::Parse("2,5,7").Overlaps(RangeSet::Parse("2,3,5")));
 }
 
+TEST(RangeSetTest, Normalized) {
+  ASSERT_EQ(RangeSet::Parse("4,0,8,10,15"), RangeSet::Parse("6,10,15,0,5,5,8").Normalized());
+  ASSERT_EQ(RangeSet::Parse("2,0,20"), RangeSet::Parse("4,0,20,5,10").Normalized());
+  ASSERT_EQ(RangeSet::Parse("4,1,3,5,7"), RangeSet::Parse("4,1,3,5,7").Normalized());
+  ASSERT_FALSE(RangeSet().Normalized());
+}
+
+TEST(RangeSetTest, SetOperations) {
+  RangeSet r1 = RangeSet::Parse("6,10,20,0,5,30,40");
+  RangeSet r2 = RangeSet::Parse("6,3,12,18,32,38,50");
+
+  ASSERT_EQ(RangeSet::Parse("2,0,50"), r1.Union(r2));
+  ASSERT_EQ(RangeSet::Parse("10,3,5,10,12,18,20,30,32,38,40"), r1.Intersection(r2));
+  ASSERT_EQ(RangeSet::Parse("6,0,3,12,18,32,38"), r1.Difference(r2));
+  ASSERT_EQ(RangeSet::Parse("6,5,10,20,30,40,50"), r2.Difference(r1));
+  ASSERT_EQ(static_cast<size_t>(10), r1.OverlapBlocks(r2));
+  ASSERT_EQ(static_cast<size_t>(10), r2.OverlapBlocks(r1));
+  ASSERT_EQ(r1.Intersection(r2).blocks(), r1.OverlapBlocks(r2));
+
+  // Adjacent ranges merge, but don't overlap.
+  RangeSet r3 = RangeSet::Parse("2,40,45");
+  ASSERT_EQ(RangeSet::Parse("6,0,5,10,20,30,45"), r1.Union(r3));
+  ASSERT_FALSE(r1.Intersection(r3));
+  ASSERT_EQ(r1.Normalized(), r1.Difference(r3));
+
+  ASSERT_TRUE(r1.Contains(RangeSet::Parse("4,32,35,1,3")));
+  ASSERT_FALSE(r1.Contains(RangeSet::Parse("4,32,35,4,6")));
+  ASSERT_TRUE(r1.Contains(RangeSet()));
+  ASSERT_TRUE(r1.Contains(r1));
+
+  // Empty sets.
+  ASSERT_EQ(r1.Normalized(), r1.Union(RangeSet()));
+  ASSERT_EQ(r1.Normalized(), RangeSet().Union(r1));
+  ASSERT_FALSE(r1.Intersection(RangeSet()));
+  ASSERT_FALSE(RangeSet().Difference(r1));
+  ASSERT_FALSE(r1.Difference(r1));
+  ASSERT_EQ(static_cast<size_t>(0), RangeSet().OverlapBlocks(r1));
+}
+
+// Returns a RangeSet of |count| ranges in [0, |limit|), in random order and possibly overlapping.
+static RangeSet RandomRangeSet(std::mt19937* rng, size_t count, size_t limit, size_t max_length) {
+  std::uniform_int_distribution<size_t> start_dist(0, limit - max_length);
+  std::uniform_int_distribution<size_t> length_dist(1, max_length);
+  RangeSet rs;
+  for (size_t i = 0; i < count; i++) {
+    size_t start = start_dist(*rng);
+    rs.PushBack({ start, start + length_dist(*rng) });
+  }
+  return rs;
+}
+
+static std::vector<bool> ToBitmap(const RangeSet& rs, size_t limit) {
+  std::vector<bool> bitmap(limit);
+  for (const auto& [begin, end] : rs) {
+    std::fill(bitmap.begin() + begin, bitmap.begin() + end, true);
+  }
+  return bitmap;
+}
+
+// Checks that |rs| is normalized and holds exactly the blocks in |bitmap|.
+static void CheckAgainstBitmap(const RangeSet& rs, const std::vector<bool>& bitmap) {
+  for (size_t i = 1; i < rs.size(); i++) {
+    ASSERT_LT(rs[i - 1].second, rs[i].first) << rs.ToString();
+  }
+  ASSERT_EQ(bitmap, ToBitmap(rs, bitmap.size()));
+  ASSERT_EQ(static_cast<size_t>(std::count(bitmap.begin(), bitmap.end(), true)), rs.blocks());
+}
+
+TEST(RangeSetTest, SetOperations_Randomized) {
+  constexpr size_t kLimit = 1 << 20;
+  std::mt19937 rng(20261018);
+  for (size_t max_length : { 1, 16, 4096 }) {
+    RangeSet r1 = RandomRangeSet(&rng, 20000, kLimit, max_length);
+    RangeSet r2 = RandomRangeSet(&rng, 20000, kLimit, max_length);
+    std::vector<bool> b1 = ToBitmap(r1, kLimit);
+    std::vector<bool> b2 = ToBitmap(r2, kLimit);
+
+    std::vector<bool> expected_union(kLimit);
+    std::vector<bool> expected_intersection(kLimit);
+    std::vector<bool> expected_difference(kLimit);
+    for (size_t i = 0; i < kLimit; i++) {
+      expected_union[i] = b1[i] || b2[i];
+      expected_intersection[i] = b1[i] && b2[i];
+      expected_difference[i] = b1[i] && !b2[i];
+    }
+
+    CheckAgainstBitmap(r1.Normalized(), b1);
+    CheckAgainstBitmap(r1.Union(r2), expected_union);
+    CheckAgainstBitmap(r1.Intersection(r2), expected_intersection);
+    CheckAgainstBitmap(r1.Difference(r2), expected_difference);
+
+    size_t overlap = std::count(expected_intersection.begin(), expected_intersection.end(), true);
+    ASSERT_EQ(overlap, r1.OverlapBlocks(r2));
+    ASSERT_EQ(overlap != 0, r1.Overlaps(r2));
+    ASSERT_TRUE(r1.Union(r2).Contains(r2));
+    ASSERT_EQ(overlap == r2.Normalized().blocks(), r1.Contains(r2));
+  }
+}
+
+TEST(RangeSetTest, SetOperations_Scaling) {
+  // Nested loops over 2 x 400k ranges would take hours; merging takes milliseconds.
+  std::mt19937 rng(20261018);
+  for (size_t count : { 100000, 400000 }) {
+    size_t limit = count * 16;
+    RangeSet r1 = RandomRangeSet(&rng, count, limit, 8).Normalized();
+    RangeSet r2 = RandomRangeSet(&rng, count, limit, 8).Normalized();
+
+    auto start = std::chrono::steady_clock::now();
+    RangeSet all = r1.Union(r2);
+    RangeSet both = r1.Intersection(r2);
+    RangeSet only = r1.Difference(r2);
+    size_t overlap = r1.OverlapBlocks(r2);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    ASSERT_EQ(both.blocks(), overlap);
+    ASSERT_EQ(r1.blocks(), both.blocks() + only.blocks());
+    ASSERT_EQ(r1.blocks() + r2.blocks(), all.blocks() + both.blocks());
+    RecordProperty("us_for_" + std::to_string(count) + "_ranges", std::to_string(elapsed.count()));
+  }
+}
+
 TEST(RangeSetTest, Split) {
   RangeSet rs1 = RangeSet::Parse("2,1,2");
   ASSERT_TRUE(rs1);
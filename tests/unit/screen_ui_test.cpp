@@ -16,7 +16,10 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <map>
 #include <memory>
@@ -25,16 +28,20 @@
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <gtest/gtest.h>
 #include <gtest/gtest_prod.h>
 
 #include "common/test_constants.h"
+#include "minui/graphics_memory.h"
 #include "minui/minui.h"
 #include "otautil/paths.h"
 #include "private/resources.h"
 #include "recovery_ui/device.h"
+#include "recovery_ui/property_snapshot.h"
 #include "recovery_ui/screen_ui.h"
+#include "recovery_ui/vr_ui.h"
 
 static const std::vector<std::string> HEADERS{ "header" };
 static const std::vector<std::string> ITEMS{ "item1", "item2", "item3", "item4", "1234567890" };
@@ -65,9 +72,34 @@ class MockDrawFunctions : public DrawInterface {
   }
 };
 
+// Lays text out like ScreenRecoveryUI does, for checking the row positions that menus record.
+class LayoutDrawFunctions : public MockDrawFunctions {
+ public:
+  static constexpr int kCharHeight = 20;
+  static constexpr int kLineHeight = kCharHeight + 4;
+
+ private:
+  int DrawHorizontalRule(int /* y */) const override {
+    return 8;
+  }
+  int DrawTextLine(int /* x */, int /* y */, const std::string& /* line */,
+                   bool /* bold */) const override {
+    return kLineHeight;
+  }
+  int DrawTextLines(int /* x */, int /* y */,
+                    const std::vector<std::string>& lines) const override {
+    return kLineHeight * lines.size();
+  }
+  int DrawWrappedTextLines(int /* x */, int /* y */,
+                           const std::vector<std::string>& lines) const override {
+    return kLineHeight * lines.size();
+  }
+};
+
 class ScreenUITest : public testing::Test {
  protected:
   MockDrawFunctions draw_funcs_;
+  LayoutDrawFunctions layout_funcs_;
 };
 
 TEST_F(ScreenUITest, StartPhoneMenuSmoke) {
@@ -277,6 +309,136 @@ TEST_F(ScreenUITest, GraphicMenuValidate) {
   ASSERT_FALSE(GraphicMenu::Validate(200, 249, header.get(), items));
 }
 
+TEST_F(ScreenUITest, TextMenuDamageRequiresLayout) {
+  TextMenu menu(false, 10, 20, HEADERS, ITEMS, 0, LayoutDrawFunctions::kCharHeight, layout_funcs_);
+  MenuView view = menu.GetView();
+  ASSERT_EQ(0u, view.layout);
+  menu.Select(1);
+
+  MenuDamage damage;
+  ASSERT_FALSE(menu.GetDamage(view, true, &damage));
+
+  // Views of another layout (even of another menu) don't help either.
+  menu.DrawItems(0, 0, 100, false);
+  TextMenu other(false, 10, 20, HEADERS, ITEMS, 0, LayoutDrawFunctions::kCharHeight,
+                 layout_funcs_);
+  other.DrawItems(0, 0, 100, false);
+  ASSERT_NE(0u, menu.GetView().layout);
+  ASSERT_NE(menu.GetView().layout, other.GetView().layout);
+  ASSERT_FALSE(menu.GetDamage(other.GetView(), true, &damage));
+
+  view = menu.GetView();
+  menu.DrawItems(0, 50, 100, false);
+  ASSERT_FALSE(menu.GetDamage(view, true, &damage));
+
+  // Redrawing at the same place keeps the layout.
+  view = menu.GetView();
+  menu.DrawItems(0, 50, 100, false);
+  ASSERT_EQ(view.layout, menu.GetView().layout);
+
+  // The base class doesn't support incremental updates at all.
+  auto image = GRSurface::Create(50, 50, 50, 1);
+  GraphicMenu graphic_menu(image.get(), { image.get(), image.get() }, 0, layout_funcs_);
+  graphic_menu.DrawItems(0, 0, 100, false);
+  view = graphic_menu.GetView();
+  graphic_menu.Select(1);
+  ASSERT_FALSE(graphic_menu.GetDamage(view, true, &damage));
+}
+
+TEST_F(ScreenUITest, PhoneMenuDamageOnSelect) {
+  constexpr int kMenuY = 100;
+  TextMenu menu(false, 10, 20, HEADERS, ITEMS, 0, LayoutDrawFunctions::kCharHeight, layout_funcs_);
+  menu.DrawHeader(0, 0);
+  menu.DrawItems(0, kMenuY, 100, false);
+  MenuView drawn = menu.GetView();
+
+  // Nothing changed since the draw.
+  MenuDamage damage;
+  ASSERT_TRUE(menu.GetDamage(drawn, true, &damage));
+  ASSERT_TRUE(damage.rows.empty());
+
+  // Only the rows of the old and new selection need a redraw, whatever the menu length.
+  menu.Select(3);
+  ASSERT_TRUE(menu.GetDamage(drawn, true, &damage));
+  ASSERT_EQ(0, damage.scroll_dy);
+  ASSERT_EQ((std::vector<int>{ 0, 3 }), damage.rows);
+
+  // Rows start below the horizontal rule (8 + 4), and match the highlight bar.
+  int top, bottom;
+  ASSERT_TRUE(menu.GetRowSpan(3, &top, &bottom));
+  ASSERT_EQ(kMenuY + 12 + 3 * LayoutDrawFunctions::kLineHeight - 2, top);
+  ASSERT_EQ(top + LayoutDrawFunctions::kLineHeight, bottom);
+  ASSERT_FALSE(menu.GetRowSpan(5, &top, &bottom));
+  ASSERT_FALSE(menu.GetRowSpan(Menu::kStatusRow, &top, &bottom));
+
+  // Catching up from an older view (e.g. double buffering) touches the rows of both changes.
+  MenuView previous = drawn;
+  drawn = menu.GetView();
+  menu.Select(4);
+  ASSERT_TRUE(menu.GetDamage(drawn, true, &damage));
+  ASSERT_EQ((std::vector<int>{ 3, 4 }), damage.rows);
+  ASSERT_TRUE(menu.GetDamage(previous, true, &damage));
+  ASSERT_EQ((std::vector<int>{ 0, 4 }), damage.rows);
+
+  // Wrapping around is no different.
+  drawn = menu.GetView();
+  menu.Select(5);
+  ASSERT_TRUE(menu.GetDamage(drawn, true, &damage));
+  ASSERT_EQ((std::vector<int>{ 0, 4 }), damage.rows);
+}
+
+TEST_F(ScreenUITest, WearMenuDamageOnScroll) {
+  TextMenu menu(true, 3, 20, HEADERS, ITEMS, 2, LayoutDrawFunctions::kCharHeight, layout_funcs_);
+  int offset = menu.DrawHeader(0, 0);
+  menu.DrawItems(0, offset, 100, false);
+
+  // Moving within the visible rows also updates the "Current item" line.
+  MenuView drawn = menu.GetView();
+  menu.Select(1);
+  MenuDamage damage;
+  ASSERT_TRUE(menu.GetDamage(drawn, true, &damage));
+  ASSERT_EQ((std::vector<int>{ Menu::kStatusRow, 1, 2 }), damage.rows);
+  int top, bottom;
+  ASSERT_TRUE(menu.GetRowSpan(Menu::kStatusRow, &top, &bottom));
+  ASSERT_EQ(LayoutDrawFunctions::kLineHeight, top);
+
+  // Scrolling down moves the visible items up by one row, and exposes the last row.
+  menu.Select(2);
+  drawn = menu.GetView();
+  menu.Select(3);
+  ASSERT_EQ(1u, menu.MenuStart());
+  ASSERT_TRUE(menu.GetDamage(drawn, true, &damage));
+  ASSERT_EQ(-LayoutDrawFunctions::kLineHeight, damage.scroll_dy);
+  ASSERT_TRUE(menu.GetRowSpan(0, &top, nullptr));
+  ASSERT_EQ(top, damage.scroll_top);
+  ASSERT_TRUE(menu.GetRowSpan(2, nullptr, &bottom));
+  ASSERT_EQ(bottom, damage.scroll_bottom);
+  ASSERT_EQ((std::vector<int>{ Menu::kStatusRow, 1, 2 }), damage.rows);
+
+  // Without scrolling, all the rows need a redraw.
+  ASSERT_TRUE(menu.GetDamage(drawn, false, &damage));
+  ASSERT_EQ(0, damage.scroll_dy);
+  ASSERT_EQ((std::vector<int>{ Menu::kStatusRow, 0, 1, 2 }), damage.rows);
+
+  // Scrolling by two rows at once exposes two rows.
+  menu.Select(4);
+  ASSERT_EQ(2u, menu.MenuStart());
+  ASSERT_TRUE(menu.GetDamage(drawn, true, &damage));
+  ASSERT_EQ(-2 * LayoutDrawFunctions::kLineHeight, damage.scroll_dy);
+  // The old selection (item 2) moved to the first row, and needs its highlight removed.
+  ASSERT_EQ((std::vector<int>{ Menu::kStatusRow, 0, 1, 2 }), damage.rows);
+
+  // Scrolling back up exposes the first row instead.
+  menu.Select(3);
+  menu.Select(2);
+  drawn = menu.GetView();
+  menu.Select(1);
+  ASSERT_EQ(1u, menu.MenuStart());
+  ASSERT_TRUE(menu.GetDamage(drawn, true, &damage));
+  ASSERT_EQ(LayoutDrawFunctions::kLineHeight, damage.scroll_dy);
+  ASSERT_EQ((std::vector<int>{ Menu::kStatusRow, 0, 1 }), damage.rows);
+}
+
 static constexpr int kMagicAction = 101;
 
 enum class KeyCode : int {
@@ -301,6 +463,9 @@ static const std::map<KeyCode, int> kKeyMapping{
 
 class TestableScreenRecoveryUI : public ScreenRecoveryUI {
  public:
+  explicit TestableScreenRecoveryUI(bool scrollable_menu = false)
+      : ScreenRecoveryUI(scrollable_menu) {}
+
   int WaitKey() override;
 
   void SetKeyBuffer(const std::vector<KeyCode>& buffer);
@@ -560,3 +725,343 @@ TEST_F(DISABLED_ScreenRecoveryUITest, LoadAnimation_MissingAnimation) {
 }
 
 #undef RETURN_IF_NO_GRAPHICS
+
+// Runs ScreenRecoveryUI against the memory-backed minui, to check and time what ends up on screen
+// without a graphics device.
+class MemoryScreenRecoveryUI : public TestableScreenRecoveryUI {
+ public:
+  explicit MemoryScreenRecoveryUI(bool scrollable_menu)
+      : TestableScreenRecoveryUI(scrollable_menu) {}
+
+  int WaitKey() override {
+    key_times_.push_back(std::chrono::steady_clock::now());
+    return TestableScreenRecoveryUI::WaitKey();
+  }
+
+  // Shows a menu without waiting for keys, to move its selection with SelectMenu().
+  void StartMenu(const std::vector<std::string>& items, size_t initial_selection) {
+    menu_ = CreateMenu(HEADERS, items, initial_selection);
+    ASSERT_NE(nullptr, menu_);
+    Redraw();
+  }
+
+  using ScreenRecoveryUI::SelectMenu;
+
+  // The time each WaitKey() got called; the gap between two calls is the time it takes to handle
+  // a key and flip the resulting frame.
+  std::vector<std::chrono::steady_clock::time_point> key_times_;
+
+ protected:
+  bool InitGraphics() override {
+    return gr_init({ GraphicsBackend::MEMORY }) == 0;
+  }
+};
+
+class ScreenRecoveryUIMemoryTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    testdata_dir_ = from_testdata_base("");
+    Paths::Get().set_resource_dir(testdata_dir_);
+    res_set_resource_dir(testdata_dir_);
+  }
+
+  void Init(bool scrollable_menu) {
+    ui_ = std::make_unique<MemoryScreenRecoveryUI>(scrollable_menu);
+    ASSERT_TRUE(ui_->Init("en-US"));
+    ui_->ShowText(true);
+  }
+
+  static std::unique_ptr<GRSurface> CaptureScreen() {
+    const GRSurface* frame = MinuiBackendMemory::DisplayedFrame();
+    return frame == nullptr ? nullptr : frame->Clone();
+  }
+
+  // Checks that the screen shows the same as a full redraw of the current state.
+  void CheckScreenMatchesRedraw() {
+    auto screen = CaptureScreen();
+    ASSERT_NE(nullptr, screen);
+    ui_->Redraw();
+    auto redrawn = CaptureScreen();
+    ASSERT_EQ(screen->data_size(), redrawn->data_size());
+    ASSERT_EQ(0, memcmp(screen->data(), redrawn->data(), screen->data_size()));
+  }
+
+  std::string testdata_dir_;
+  std::unique_ptr<MemoryScreenRecoveryUI> ui_;
+};
+
+static std::vector<std::string> MakeItems(size_t count) {
+  std::vector<std::string> items;
+  for (size_t i = 0; i < count; i++) {
+    items.push_back(android::base::StringPrintf("/cache/recovery/last_log.%zu", i));
+  }
+  return items;
+}
+
+TEST_F(ScreenRecoveryUIMemoryTest, SelectMenuRedrawsInPlace) {
+  ASSERT_NO_FATAL_FAILURE(Init(false));
+  ASSERT_NO_FATAL_FAILURE(ui_->StartMenu(MakeItems(100), 0));
+
+  // One frame per selection change, each matching what a full redraw would show (including the
+  // moves into a double-buffered surface, and the wrap-arounds).
+  int sel = 0;
+  for (int i = 0; i < 5; i++) {
+    uint64_t flips = gr_flip_count();
+    sel = ui_->SelectMenu(sel + 1);
+    ASSERT_EQ(flips + 1, gr_flip_count());
+    ASSERT_NO_FATAL_FAILURE(CheckScreenMatchesRedraw());
+  }
+  for (int i = 0; i < 3; i++) {
+    sel = ui_->SelectMenu(sel + 1);
+    sel = ui_->SelectMenu(sel - 1);
+    sel = ui_->SelectMenu(-1);
+  }
+  ASSERT_NO_FATAL_FAILURE(CheckScreenMatchesRedraw());
+}
+
+TEST_F(ScreenRecoveryUIMemoryTest, SelectMenuAfterPrint) {
+  ASSERT_NO_FATAL_FAILURE(Init(false));
+  ASSERT_NO_FATAL_FAILURE(ui_->StartMenu(MakeItems(10), 0));
+  int sel = ui_->SelectMenu(1);
+  sel = ui_->SelectMenu(sel + 1);
+
+  // The other buffer holds the frame from before the print, which doesn't have the new line.
+  ui_->Print("Installing update...\n");
+  sel = ui_->SelectMenu(sel + 1);
+  ASSERT_NO_FATAL_FAILURE(CheckScreenMatchesRedraw());
+
+  // Same for lines printed in a batch of updates, before the redraw.
+  ui_->BeginUpdate();
+  ui_->Print("Verifying update package...\n");
+  sel = ui_->SelectMenu(sel + 1);
+  ui_->EndUpdate();
+  sel = ui_->SelectMenu(sel + 1);
+  ASSERT_NO_FATAL_FAILURE(CheckScreenMatchesRedraw());
+
+  ui_->SetTitle({ "Android Recovery" });
+  sel = ui_->SelectMenu(sel + 1);
+  ASSERT_NO_FATAL_FAILURE(CheckScreenMatchesRedraw());
+}
+
+TEST_F(ScreenRecoveryUIMemoryTest, SelectMenuScrolls) {
+  ASSERT_NO_FATAL_FAILURE(Init(true));
+  ASSERT_NO_FATAL_FAILURE(ui_->StartMenu(MakeItems(500), 0));
+
+  // Scroll well past the first screen and back, checking the screen on the way.
+  int sel = 0;
+  for (int i = 0; i < 120; i++) {
+    sel = ui_->SelectMenu(sel + 1);
+    if (i % 40 == 39) ASSERT_NO_FATAL_FAILURE(CheckScreenMatchesRedraw());
+  }
+  ASSERT_EQ(120, sel);
+  for (int i = 0; i < 60; i++) {
+    sel = ui_->SelectMenu(sel - 1);
+    if (i % 20 == 19) ASSERT_NO_FATAL_FAILURE(CheckScreenMatchesRedraw());
+  }
+  ASSERT_EQ(60, sel);
+}
+
+TEST_F(ScreenRecoveryUIMemoryTest, ShowMenuKeyToFrameLatency) {
+  ASSERT_NO_FATAL_FAILURE(Init(true));
+
+  constexpr size_t kMoves = 400;
+  std::vector<KeyCode> keys(kMoves, KeyCode::DOWN);
+  keys.push_back(KeyCode::ENTER);
+  ui_->SetKeyBuffer(keys);
+
+  uint64_t flips = gr_flip_count();
+  ASSERT_EQ(kMoves, ui_->ShowMenu(HEADERS, MakeItems(1000), 0, true,
+                                  std::bind(&TestableScreenRecoveryUI::KeyHandler, ui_.get(),
+                                            std::placeholders::_1, std::placeholders::_2)));
+  // One frame per key, plus showing and dismissing the menu.
+  ASSERT_EQ(flips + kMoves + 2, gr_flip_count());
+
+  ASSERT_EQ(kMoves + 1, ui_->key_times_.size());
+  std::vector<int64_t> latencies;
+  for (size_t i = 1; i < ui_->key_times_.size(); i++) {
+    latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                            ui_->key_times_[i] - ui_->key_times_[i - 1])
+                            .count());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  int64_t median = latencies[latencies.size() / 2];
+  int64_t worst = latencies.back();
+
+  // For reference, the cost of redrawing the whole screen with the same menu shown.
+  ui_->StartMenu(MakeItems(1000), kMoves);
+  auto start = std::chrono::steady_clock::now();
+  ui_->Redraw();
+  int64_t full_redraw = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+
+  RecordProperty("key_to_frame_median_us", median);
+  RecordProperty("key_to_frame_max_us", worst);
+  RecordProperty("full_redraw_us", full_redraw);
+  GTEST_LOG_(INFO) << "key to frame latency: median " << median << "us, max " << worst
+                   << "us; full redraw " << full_redraw << "us";
+}
+
+TEST_F(ScreenRecoveryUIMemoryTest, BatchedUpdatesDrawOnce) {
+  ASSERT_NO_FATAL_FAILURE(Init(false));
+  ui_->ShowText(false);
+
+  // Switching to the text screen with a new title and background takes a single frame.
+  uint64_t flips = gr_flip_count();
+  {
+    ScopedUiUpdate update(ui_.get());
+    ui_->SetTitle({ "title" });
+    ui_->SetBackground(RecoveryUI::NO_COMMAND);
+    ui_->ShowText(true);
+    ui_->Print("line\n");
+    ASSERT_EQ(flips, gr_flip_count());
+  }
+  ASSERT_EQ(flips + 1, gr_flip_count());
+  ASSERT_NO_FATAL_FAILURE(CheckScreenMatchesRedraw());
+
+  // Nested batches draw when the outermost one ends, and not at all if nothing changed.
+  flips = gr_flip_count();
+  {
+    ScopedUiUpdate outer(ui_.get());
+    {
+      ScopedUiUpdate inner(ui_.get());
+      ui_->SetBackground(RecoveryUI::ERROR);
+    }
+    ASSERT_EQ(flips, gr_flip_count());
+  }
+  ASSERT_EQ(flips + 1, gr_flip_count());
+  {
+    ScopedUiUpdate update(ui_.get());
+  }
+  ASSERT_EQ(flips + 1, gr_flip_count());
+}
+
+TEST_F(ScreenRecoveryUIMemoryTest, ShowMenuInBatchedUpdate) {
+  ASSERT_NO_FATAL_FAILURE(Init(false));
+  ui_->ShowText(false);
+  ui_->SetKeyBuffer({ KeyCode::DOWN, KeyCode::ENTER });
+
+  uint64_t flips = gr_flip_count();
+  {
+    // As in StartFastboot(): the title and the text screen show up along with the menu.
+    ScopedUiUpdate update(ui_.get());
+    ui_->SetTitle({ "title" });
+    ui_->ShowText(true);
+    ASSERT_EQ(1u, ui_->ShowMenu(HEADERS, MakeItems(10), 0, true,
+                                std::bind(&TestableScreenRecoveryUI::KeyHandler, ui_.get(),
+                                          std::placeholders::_1, std::placeholders::_2)));
+    // Showing the menu, moving the selection and dismissing the menu.
+    ASSERT_EQ(flips + 3, gr_flip_count());
+
+    // Batching resumes once the menu is gone.
+    ui_->SetBackground(RecoveryUI::ERROR);
+    ASSERT_EQ(flips + 3, gr_flip_count());
+  }
+  ASSERT_EQ(flips + 4, gr_flip_count());
+}
+
+class MemoryVrRecoveryUI : public VrRecoveryUI {
+ public:
+  void StartMenu(const std::vector<std::string>& items) {
+    menu_ = CreateMenu(HEADERS, items, 0);
+    ASSERT_NE(nullptr, menu_);
+    Redraw();
+  }
+
+  // The number of eye views drawn so far.
+  int eye_overlays_{ 0 };
+
+ protected:
+  bool InitGraphics() override {
+    return gr_init({ GraphicsBackend::MEMORY }) == 0;
+  }
+
+  void draw_eye_overlay_locked(int /* left */) override {
+    eye_overlays_++;
+  }
+};
+
+// Returns how long a full redraw of |ui| takes, in microseconds, as the median of a few runs.
+static int64_t TimeRedraw(ScreenRecoveryUI* ui) {
+  std::vector<int64_t> times;
+  for (int i = 0; i < 9; i++) {
+    auto start = std::chrono::steady_clock::now();
+    ui->Redraw();
+    times.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+TEST_F(ScreenRecoveryUIMemoryTest, VrDrawsBothEyes) {
+  auto vr_ui = std::make_unique<MemoryVrRecoveryUI>();
+  ASSERT_TRUE(vr_ui->Init("en-US"));
+  vr_ui->ShowText(true);
+  ASSERT_NO_FATAL_FAILURE(vr_ui->StartMenu(MakeItems(100)));
+  for (int i = 0; i < 50; i++) {
+    vr_ui->Print("line %d\n", i);
+  }
+
+  // With no stereo offset, both halves of the screen show the same, non-empty scene.
+  const GRSurface* frame = MinuiBackendMemory::DisplayedFrame();
+  ASSERT_NE(nullptr, frame);
+  size_t half = frame->width / 2 * frame->pixel_bytes;
+  bool drawn = false;
+  for (size_t y = 0; y < frame->height; y++) {
+    const uint8_t* row = frame->data() + y * frame->row_bytes;
+    ASSERT_EQ(0, memcmp(row, row + half, half)) << "row " << y;
+    drawn = drawn || std::any_of(row, row + half, [](uint8_t b) { return b != 0 && b != 0xff; });
+  }
+  ASSERT_TRUE(drawn);
+
+  int64_t vr_redraw = TimeRedraw(vr_ui.get());
+  vr_ui.reset();
+
+  // For reference, drawing the same screen once without the split.
+  ASSERT_NO_FATAL_FAILURE(Init(false));
+  ASSERT_NO_FATAL_FAILURE(ui_->StartMenu(MakeItems(100), 0));
+  for (int i = 0; i < 50; i++) {
+    ui_->Print("line %d\n", i);
+  }
+  int64_t mono_redraw = TimeRedraw(ui_.get());
+
+  RecordProperty("vr_redraw_us", vr_redraw);
+  RecordProperty("mono_redraw_us", mono_redraw);
+  GTEST_LOG_(INFO) << "full redraw: vr " << vr_redraw << "us, mono " << mono_redraw << "us";
+}
+
+TEST_F(ScreenRecoveryUIMemoryTest, VrProgressDrawsBothEyes) {
+  auto vr_ui = std::make_unique<MemoryVrRecoveryUI>();
+  ASSERT_TRUE(vr_ui->Init("en-US"));
+  // An icon that isn't animated, so that only the calls below draw.
+  vr_ui->SetBackground(RecoveryUI::ERROR);
+
+  // Only the first progress update needs the whole screen on a flat display, but each one has to
+  // go through the scene to reach both eyes.
+  for (int i = 0; i < 3; i++) {
+    int eye_overlays = vr_ui->eye_overlays_;
+    vr_ui->SetProgressType(RecoveryUI::INDETERMINATE);
+    ASSERT_EQ(eye_overlays + 2, vr_ui->eye_overlays_);
+  }
+}
+
+TEST(PropertySnapshotTest, ReadOnce) {
+  static constexpr const char* kName = "debug.recovery.test.property_snapshot";
+  ASSERT_TRUE(android::base::SetProperty(kName, "1"));
+  PropertySnapshot properties({ kName });
+  ASSERT_TRUE(android::base::SetProperty(kName, "0"));
+
+  ASSERT_EQ("1", properties.Get(kName));
+  ASSERT_TRUE(properties.GetBool(kName, false));
+
+  // Names outside of the snapshot are read as they are now.
+  PropertySnapshot empty({});
+  ASSERT_EQ("0", empty.Get(kName));
+  ASSERT_FALSE(empty.GetBool(kName, true));
+
+  ASSERT_TRUE(android::base::SetProperty(kName, ""));
+  ASSERT_EQ("default", empty.Get(kName, "default"));
+  ASSERT_TRUE(empty.GetBool(kName, true));
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "otautil/storage_benchmark.h"
+
+using namespace std::chrono_literals;
+
+// A device model that charges each request a fixed overhead plus its size over the bandwidth, and
+// serves up to |channels| requests in parallel.
+struct FakeStorageDevice : public StorageDevice {
+  uint64_t size() const override {
+    return 4 * 1024 * 1024;
+  }
+
+  bool Run(const std::vector<IoRequest>& requests, size_t queue_depth,
+           std::chrono::nanoseconds* elapsed) override {
+    double parallel_ns = 0;
+    double serial_ns = 0;
+    for (const auto& request : requests) {
+      switch (request.type) {
+        case IoRequest::Type::kRead:
+          parallel_ns += read_overhead_ns + request.size * 1e9 / read_bandwidth;
+          break;
+        case IoRequest::Type::kWrite:
+          parallel_ns += write_overhead_ns + request.size * 1e9 / write_bandwidth;
+          break;
+        case IoRequest::Type::kSync:
+          serial_ns += sync_ns;
+          break;
+      }
+    }
+    size_t parallelism = std::min(std::max<size_t>(queue_depth, 1), channels);
+    *elapsed =
+        std::chrono::nanoseconds(static_cast<int64_t>(parallel_ns / parallelism + serial_ns));
+    total_ns += elapsed->count();
+    return true;
+  }
+
+  double read_overhead_ns = 100'000;
+  double read_bandwidth = 100e6;
+  double write_overhead_ns = 1'000'000;
+  double write_bandwidth = 50e6;
+  double sync_ns = 3'000'000;
+  size_t channels = 1;
+
+  int64_t total_ns = 0;
+};
+
+static BenchmarkConfig UnlimitedConfig() {
+  BenchmarkConfig config;
+  config.time_limit = 1h;
+  return config;
+}
+
+TEST(StorageBenchmarkTest, PicksSmallestRequestSizeNearPeak) {
+  FakeStorageDevice device;
+  BenchmarkConfig config = UnlimitedConfig();
+  StorageProfile profile;
+  ASSERT_TRUE(BenchmarkStorage(&device, config, &profile));
+
+  // (5 sequential + 2 random sizes) x 2 queue depths, for reads and writes.
+  ASSERT_EQ(28, profile.samples.size());
+  // The 4 KiB write (1 ms + 81.92 us) and the sync (3 ms).
+  ASSERT_EQ(std::chrono::nanoseconds(4'081'920), profile.sync_latency);
+
+  IoParameters parameters = ChooseIoParameters(profile);
+  // 256 KiB reads get 96% of the 1 MiB throughput, while 64 KiB reads get 88%.
+  ASSERT_EQ(256 * 1024, parameters.read_chunk_size);
+  // Writes have a larger fixed cost, so only 1 MiB gets within 90%.
+  ASSERT_EQ(1024 * 1024, parameters.write_chunk_size);
+}
+
+TEST(StorageBenchmarkTest, MeasuresQueueDepth) {
+  FakeStorageDevice device;
+  device.channels = 4;
+  StorageProfile profile;
+  ASSERT_TRUE(BenchmarkStorage(&device, UnlimitedConfig(), &profile));
+
+  double qd1 = 0;
+  double qd4 = 0;
+  for (const auto& sample : profile.samples) {
+    if (!sample.write && !sample.sequential && sample.request_size == 4096) {
+      (sample.queue_depth == 1 ? qd1 : qd4) = sample.bytes_per_second;
+    }
+  }
+  ASSERT_GT(qd1, 0);
+  ASSERT_NEAR(qd4 / qd1, 4.0, 0.01);
+}
+
+TEST(StorageBenchmarkTest, StopsAtTimeLimit) {
+  FakeStorageDevice device;
+  BenchmarkConfig config;
+  config.time_limit = 50ms;
+  StorageProfile profile;
+  ASSERT_TRUE(BenchmarkStorage(&device, config, &profile));
+
+  // The sample that crosses the limit completes, but nothing starts after it.
+  ASSERT_LT(profile.samples.size(), 28);
+  ASSERT_LT(device.total_ns, std::chrono::nanoseconds(100ms).count());
+
+  // Anything not measured keeps its default.
+  IoParameters parameters = ChooseIoParameters(profile);
+  ASSERT_EQ(IoParameters().write_chunk_size, parameters.write_chunk_size);
+}
+
+TEST(StorageBenchmarkTest, FileStorageDevice) {
+  TemporaryDir temp_dir;
+  std::string path = std::string(temp_dir.path) + "/scratch";
+  {
+    auto device = FileStorageDevice::Create(path, 1024 * 1024);
+    ASSERT_NE(nullptr, device);
+    ASSERT_EQ(1024 * 1024, device->size());
+
+    BenchmarkConfig config;
+    config.sequential_request_sizes = { 4096, 65536 };
+    config.random_request_sizes = { 4096 };
+    config.bytes_per_sample = 128 * 1024;
+    StorageProfile profile;
+    ASSERT_TRUE(BenchmarkStorage(device.get(), config, &profile));
+    ASSERT_EQ(12, profile.samples.size());
+    ASSERT_GT(profile.BestThroughput(false, true), 0);
+    ASSERT_GT(profile.BestThroughput(true, false), 0);
+    ASSERT_GT(profile.sync_latency.count(), 0);
+  }
+  // The scratch file goes away with the device.
+  ASSERT_EQ(-1, access(path.c_str(), F_OK));
+}
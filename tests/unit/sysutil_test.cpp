@@ -14,7 +14,13 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
 #include <string>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/strings.h>
@@ -188,6 +194,182 @@ TEST(SysUtilTest, MapFileBlockMapInvalidBlockMap) {
   ASSERT_FALSE(mapping.MapFile(filename));
 }
 
+TEST(SysUtilTest, MapFileOverLimits) {
+  TemporaryFile package;
+  ASSERT_TRUE(android::base::WriteStringToFile(std::string(4096 * 10, 'a'), package.path));
+
+  MappingLimits limits;
+  limits.max_flat_size = 4096 * 8;
+  MemMapping mapping;
+  ASSERT_FALSE(mapping.MapFile(package.path, limits));
+
+  TemporaryFile block_map_file;
+  std::string filename = std::string("@") + block_map_file.path;
+  std::string block_map_content =
+      std::string(package.path) + "\n40960 4096\n3\n0 3\n3 5\n5 10\n";
+  ASSERT_TRUE(android::base::WriteStringToFile(block_map_content, block_map_file.path));
+  ASSERT_FALSE(mapping.MapFile(filename, limits));
+
+  // Too many ranges.
+  limits = {};
+  limits.max_vmas = 2;
+  ASSERT_FALSE(mapping.MapFile(filename, limits));
+  limits.max_vmas = 3;
+  ASSERT_TRUE(mapping.MapFile(filename, limits));
+  ASSERT_EQ(3U, mapping.ranges());
+}
+
+// Returns |size| bytes that differ from block to block.
+static std::string MakeContent(size_t size) {
+  std::string content(size, '\0');
+  std::mt19937 random(size);
+  std::generate(content.begin(), content.end(), [&random]() { return random() & 0xff; });
+  return content;
+}
+
+TEST(SysUtilTest, MappedWindowsRegularFile) {
+  constexpr size_t kWindowSize = 65536;
+  std::string content = MakeContent(kWindowSize * 8 + 1000);
+  TemporaryFile package;
+  ASSERT_TRUE(android::base::WriteStringToFile(content, package.path));
+
+  MappingLimits limits;
+  limits.window_size = kWindowSize;
+  limits.max_windows = 2;
+  MappedWindows windows;
+  ASSERT_TRUE(windows.Open(package.path, limits));
+  ASSERT_EQ(content.size(), windows.length());
+
+  // Reads that span windows, up to the end of the file.
+  std::string read(content.size(), '\0');
+  auto buffer = reinterpret_cast<uint8_t*>(read.data());
+  ASSERT_TRUE(windows.ReadAt(buffer, 100, kWindowSize - 50));
+  ASSERT_EQ(content.substr(kWindowSize - 50, 100), read.substr(0, 100));
+  ASSERT_TRUE(windows.ReadAt(buffer, content.size(), 0));
+  ASSERT_EQ(content, read);
+
+  // An access that's larger than a window gets a window of its own.
+  const uint8_t* data = windows.Access(1, kWindowSize * 3);
+  ASSERT_NE(nullptr, data);
+  ASSERT_EQ(content.substr(1, kWindowSize * 3),
+            std::string(reinterpret_cast<const char*>(data), kWindowSize * 3));
+
+  ASSERT_EQ(nullptr, windows.Access(content.size() - 10, 11));
+  ASSERT_FALSE(windows.ReadAt(buffer, 2, content.size() - 1));
+
+  const auto& stats = windows.stats();
+  ASSERT_LE(stats.peak_vmas, 2);
+  ASSERT_LE(stats.peak_mapped_bytes, kWindowSize * 4);
+  ASSERT_EQ(stats.maps, stats.evictions + 2);
+}
+
+class MappedWindowsBlockMapTest : public ::testing::Test {
+ protected:
+  static constexpr size_t kBlockSize = 4096;
+  static constexpr size_t kBlocks = 64;
+
+  // Writes a "block device" with the blocks of the package content in reverse order, and a block
+  // map with a range for each block.
+  void SetUp() override {
+    content_ = MakeContent(kBlocks * kBlockSize - 100);
+    std::string device(kBlocks * kBlockSize, '\0');
+    std::string block_map = std::string(device_.path) + "\n" + std::to_string(content_.size()) +
+                            " " + std::to_string(kBlockSize) + "\n" + std::to_string(kBlocks) +
+                            "\n";
+    for (size_t i = 0; i < kBlocks; i++) {
+      size_t device_block = kBlocks - 1 - i;
+      std::string block = content_.substr(i * kBlockSize, kBlockSize);
+      std::copy(block.begin(), block.end(), device.begin() + device_block * kBlockSize);
+      block_map += std::to_string(device_block) + " " + std::to_string(device_block + 1) + "\n";
+    }
+    ASSERT_TRUE(android::base::WriteStringToFile(device, device_.path));
+    ASSERT_TRUE(android::base::WriteStringToFile(block_map, block_map_.path));
+    filename_ = std::string("@") + block_map_.path;
+  }
+
+  TemporaryFile device_;
+  TemporaryFile block_map_;
+  std::string filename_;
+  std::string content_;
+};
+
+TEST_F(MappedWindowsBlockMapTest, VmaCap) {
+  // All the ranges at once would be over the budget.
+  MappingLimits limits;
+  limits.max_vmas = 16;
+  MemMapping mapping;
+  ASSERT_FALSE(mapping.MapFile(filename_, limits));
+
+  // Windows of 4 blocks take 4 VMAs each, so no more than 4 of them fit.
+  limits.window_size = kBlockSize * 4;
+  limits.max_windows = 8;
+  MappedWindows windows;
+  ASSERT_TRUE(windows.Open(filename_, limits));
+  ASSERT_EQ(content_.size(), windows.length());
+
+  std::string read(content_.size(), '\0');
+  ASSERT_TRUE(windows.ReadAt(reinterpret_cast<uint8_t*>(read.data()), read.size(), 0));
+  ASSERT_EQ(content_, read);
+
+  const auto& stats = windows.stats();
+  ASSERT_EQ(16, stats.maps);
+  ASSERT_EQ(12, stats.evictions);
+  ASSERT_EQ(0, stats.reads);
+  ASSERT_EQ(16, stats.peak_vmas);
+}
+
+TEST_F(MappedWindowsBlockMapTest, ReadsWindowsOverVmaCap) {
+  // A window spans more ranges than the whole budget, so it's read rather than mapped.
+  MappingLimits limits;
+  limits.max_vmas = 2;
+  limits.window_size = kBlockSize * 8;
+  MappedWindows windows;
+  ASSERT_TRUE(windows.Open(filename_, limits));
+
+  const uint8_t* data = windows.Access(kBlockSize * 3 + 10, kBlockSize * 2);
+  ASSERT_NE(nullptr, data);
+  ASSERT_EQ(content_.substr(kBlockSize * 3 + 10, kBlockSize * 2),
+            std::string(reinterpret_cast<const char*>(data), kBlockSize * 2));
+  ASSERT_EQ(1, windows.stats().reads);
+  ASSERT_EQ(1, windows.stats().peak_vmas);
+
+  // The tail of the file.
+  data = windows.Access(content_.size() - 5, 5);
+  ASSERT_NE(nullptr, data);
+  ASSERT_EQ(content_.substr(content_.size() - 5),
+            std::string(reinterpret_cast<const char*>(data), 5));
+}
+
+TEST_F(MappedWindowsBlockMapTest, Churn) {
+  // Two windows of 8 blocks, i.e. 64 KiB of address space.
+  MappingLimits limits;
+  limits.window_size = kBlockSize * 8;
+  limits.max_windows = 2;
+  MappedWindows windows;
+  ASSERT_TRUE(windows.Open(filename_, limits));
+
+  // Random small reads, as when looking up zip entries.
+  std::mt19937 random(0);
+  std::string read(256, '\0');
+  auto start = std::chrono::steady_clock::now();
+  constexpr size_t kReads = 10000;
+  for (size_t i = 0; i < kReads; i++) {
+    size_t offset = random() % (content_.size() - read.size());
+    ASSERT_TRUE(windows.ReadAt(reinterpret_cast<uint8_t*>(read.data()), read.size(), offset));
+    ASSERT_EQ(content_.substr(offset, read.size()), read);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  const auto& stats = windows.stats();
+  ASSERT_LE(stats.peak_mapped_bytes, limits.window_size * 2);
+  ASSERT_EQ(stats.maps, stats.evictions + 2);
+  RecordProperty("random_read_hits", std::to_string(stats.hits));
+  RecordProperty("random_read_maps", std::to_string(stats.maps));
+  RecordProperty(
+      "random_read_us",
+      std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+}
+
 TEST(SysUtilTest, StringVectorToNullTerminatedArray) {
   std::vector<std::string> args{ "foo", "bar", "baz" };
   auto args_with_nullptr = StringVectorToNullTerminatedArray(args);
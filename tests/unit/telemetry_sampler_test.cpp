@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+
+#include "recovery_utils/telemetry_sampler.h"
+
+using namespace std::chrono_literals;
+
+// Builds a fake sysfs tree with thermal zones and block devices under a temporary dir.
+class TelemetrySamplerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    thermal_dir_ = std::string(root_.path) + "/thermal";
+    block_dir_ = std::string(root_.path) + "/block";
+    ASSERT_EQ(0, mkdir(thermal_dir_.c_str(), 0755));
+    ASSERT_EQ(0, mkdir(block_dir_.c_str(), 0755));
+  }
+
+  void AddThermalZone(const std::string& name, int temperature) {
+    std::string dir = thermal_dir_ + "/" + name;
+    mkdir(dir.c_str(), 0755);
+    ASSERT_TRUE(
+        android::base::WriteStringToFile(std::to_string(temperature) + "\n", dir + "/temp"));
+  }
+
+  void SetBlockStat(const std::string& name, bool physical, uint64_t read_sectors,
+                    uint64_t write_sectors, uint64_t io_ticks) {
+    std::string dir = block_dir_ + "/" + name;
+    mkdir(dir.c_str(), 0755);
+    if (physical) {
+      mkdir((dir + "/device").c_str(), 0755);
+    }
+    std::string stat = android::base::StringPrintf(
+        "%8u %8u %8" PRIu64 " %8u %8u %8u %8" PRIu64 " %8u %8u %8" PRIu64 " %8u\n", 10, 0,
+        read_sectors, 5, 20, 0, write_sectors, 7, 0, io_ticks, 12);
+    ASSERT_TRUE(android::base::WriteStringToFile(stat, dir + "/stat"));
+  }
+
+  TemporaryDir root_;
+  std::string thermal_dir_;
+  std::string block_dir_;
+};
+
+TEST_F(TelemetrySamplerTest, sample_fake_sysfs) {
+  AddThermalZone("thermal_zone0", 30000);
+  AddThermalZone("thermal_zone1", 45000);
+  AddThermalZone("cooling_device0", 99000);
+  SetBlockStat("sda", true, 100, 200, 10);
+  SetBlockStat("sdb", true, 0, 0, 0);
+  // Virtual devices shouldn't be counted.
+  SetBlockStat("dm-0", false, 100, 200, 10);
+
+  TelemetrySampler sampler(500ms, 16, thermal_dir_, block_dir_);
+  ASSERT_EQ(4U, sampler.Open());
+  sampler.SampleOnce();
+
+  // The files are rewritten in place, while the sampler keeps its fds.
+  AddThermalZone("thermal_zone1", 52000);
+  SetBlockStat("sda", true, 150, 1200, 30);
+  SetBlockStat("sdb", true, 8, 16, 5);
+  SetBlockStat("dm-0", false, 1000, 2000, 100);
+  sampler.SampleOnce();
+
+  auto samples = sampler.GetSamples();
+  ASSERT_EQ(2U, samples.size());
+  ASSERT_EQ(45000, samples[0].max_temperature);
+  ASSERT_EQ(0U, samples[0].read_sectors);
+  ASSERT_EQ(0U, samples[0].write_sectors);
+
+  ASSERT_EQ(52000, samples[1].max_temperature);
+  ASSERT_EQ(58U, samples[1].read_sectors);
+  ASSERT_EQ(1016U, samples[1].write_sectors);
+  ASSERT_EQ(25U, samples[1].io_ticks);
+  ASSERT_EQ(52000, sampler.MaxTemperature());
+
+  auto summary = sampler.GetSummary();
+  auto has_line = [&summary](const std::string& line) {
+    return std::find(summary.begin(), summary.end(), line) != summary.end();
+  };
+  ASSERT_TRUE(has_line("telemetry_interval_ms: 500"));
+  ASSERT_TRUE(has_line("telemetry_samples: 2"));
+  ASSERT_TRUE(has_line("temperature_avg: 48500"));
+  ASSERT_TRUE(has_line("io_read_bytes: " + std::to_string(58 * 512)));
+  ASSERT_TRUE(has_line("io_write_bytes: " + std::to_string(1016 * 512)));
+  ASSERT_TRUE(has_line("io_busy_ms: 25"));
+}
+
+TEST_F(TelemetrySamplerTest, ring_buffer_wraps) {
+  AddThermalZone("thermal_zone0", 0);
+  TelemetrySampler sampler(250ms, 3, thermal_dir_, block_dir_);
+  ASSERT_EQ(1U, sampler.Open());
+  for (int i = 1; i <= 5; i++) {
+    AddThermalZone("thermal_zone0", i * 1000);
+    sampler.SampleOnce();
+  }
+
+  auto samples = sampler.GetSamples();
+  ASSERT_EQ(3U, samples.size());
+  ASSERT_EQ(3000, samples[0].max_temperature);
+  ASSERT_EQ(4000, samples[1].max_temperature);
+  ASSERT_EQ(5000, samples[2].max_temperature);
+
+  // The summary still covers the overwritten samples.
+  auto summary = sampler.GetSummary();
+  ASSERT_NE(summary.end(), std::find(summary.begin(), summary.end(), "telemetry_samples: 5"));
+  ASSERT_NE(summary.end(), std::find(summary.begin(), summary.end(), "temperature_avg: 3000"));
+}
+
+TEST_F(TelemetrySamplerTest, interval_is_clamped) {
+  ASSERT_EQ(TelemetrySampler::kMinInterval,
+            TelemetrySampler(10ms, 1, thermal_dir_, block_dir_).interval());
+  ASSERT_EQ(TelemetrySampler::kMaxInterval,
+            TelemetrySampler(20s, 1, thermal_dir_, block_dir_).interval());
+}
+
+TEST_F(TelemetrySamplerTest, start_stop) {
+  AddThermalZone("thermal_zone0", 40000);
+  SetBlockStat("mmcblk0", true, 0, 0, 0);
+  TelemetrySampler sampler(250ms, 16, thermal_dir_, block_dir_);
+  sampler.Start();
+  std::this_thread::sleep_for(600ms);
+  sampler.Stop();
+
+  // One sample upon Start(), at least two ticks, and one upon Stop().
+  auto samples = sampler.GetSamples();
+  ASSERT_GE(samples.size(), 4U);
+  for (size_t i = 1; i < samples.size(); i++) {
+    ASSERT_LE(samples[i - 1].time_ms, samples[i].time_ms);
+  }
+  ASSERT_EQ(40000, sampler.MaxTemperature());
+}
+
+TEST_F(TelemetrySamplerTest, sample_overhead) {
+  for (int i = 0; i < 32; i++) {
+    AddThermalZone("thermal_zone" + std::to_string(i), 30000 + i);
+  }
+  for (int i = 0; i < 8; i++) {
+    SetBlockStat("sd" + std::string(1, 'a' + i), true, i, i, i);
+  }
+
+  constexpr size_t kIterations = 2000;
+  TelemetrySampler sampler(250ms, kIterations, thermal_dir_, block_dir_);
+  ASSERT_EQ(40U, sampler.Open());
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kIterations; i++) {
+    sampler.SampleOnce();
+  }
+  auto per_sample = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start) /
+                    kIterations;
+  RecordProperty("ns_per_sample", std::to_string(per_sample.count()));
+  ASSERT_EQ(30031, sampler.MaxTemperature());
+  // A tick should be far cheaper than the sampling interval.
+  ASSERT_LT(per_sample, 5ms);
+}
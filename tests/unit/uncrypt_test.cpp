@@ -21,7 +21,11 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <chrono>
+#include <limits>
+#include <map>
 #include <string>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -30,6 +34,9 @@
 #include <bootloader_message/bootloader_message.h>
 #include <gtest/gtest.h>
 
+#include "otautil/error_code.h"
+#include "uncrypt/block_map.h"
+
 using namespace std::string_literals;
 
 static const std::string UNCRYPT_SOCKET = "/dev/socket/uncrypt";
@@ -196,3 +203,98 @@ TEST_F(UncryptTest, setup_bcb) {
   message_in_bcb = "recovery\n--wipe_ab\n--wipe_package_size=345\n--reason=wipePackage\n";
   SetupOrClearBcb(true, message, message_in_bcb);
 }
+
+// Maps block N to physical block 1000 + N, once its allocation has been forced by the given number
+// of syncs. Counts the calls, and sleeps without waiting.
+class FakeBlockMapper : public BlockMapper {
+ public:
+  explicit FakeBlockMapper(std::map<int, size_t> syncs_to_allocate)
+      : syncs_to_allocate_(std::move(syncs_to_allocate)) {}
+
+  bool Sync() override {
+    syncs++;
+    return !fail_sync;
+  }
+
+  bool Map(int block, int* physical_block) override {
+    mapped.push_back(block);
+    auto it = syncs_to_allocate_.find(block);
+    size_t needed = (it == syncs_to_allocate_.end()) ? 1 : it->second;
+    *physical_block = (syncs >= needed) ? 1000 + block : 0;
+    return true;
+  }
+
+  void Sleep(std::chrono::milliseconds duration) override {
+    sleeps.push_back(duration);
+  }
+
+  size_t syncs{ 0 };
+  bool fail_sync{ false };
+  std::vector<int> mapped;
+  std::vector<std::chrono::milliseconds> sleeps;
+
+ private:
+  std::map<int, size_t> syncs_to_allocate_;
+};
+
+TEST(UncryptBlockMapTest, SyncsOnceUpFront) {
+  // All the blocks are pending delayed allocation, until the first sync.
+  FakeBlockMapper mapper({});
+  std::vector<int> blocks;
+  BlockMapStats stats;
+  ASSERT_EQ(kUncryptNoError, MapFileBlocks(&mapper, 1000, &blocks, &stats));
+
+  ASSERT_EQ(1000U, blocks.size());
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(1000 + i, blocks[i]);
+  }
+  ASSERT_EQ(1U, mapper.syncs);
+  ASSERT_EQ(1000U, mapper.mapped.size());
+  ASSERT_TRUE(mapper.sleeps.empty());
+  ASSERT_EQ(1U, stats.syncs);
+  ASSERT_EQ(0U, stats.retries);
+  RecordProperty("syncs", stats.syncs);
+}
+
+TEST(UncryptBlockMapTest, RetriesOnlyUnmappedBlocks) {
+  // Blocks 10 and 11 stay holes until the third sync, block 500 until the second one.
+  FakeBlockMapper mapper({ { 10, 3 }, { 11, 3 }, { 500, 2 } });
+  std::vector<int> blocks;
+  BlockMapStats stats;
+  ASSERT_EQ(kUncryptNoError, MapFileBlocks(&mapper, 1000, &blocks, &stats));
+
+  ASSERT_EQ(1010, blocks[10]);
+  ASSERT_EQ(1011, blocks[11]);
+  ASSERT_EQ(1500, blocks[500]);
+  ASSERT_EQ(3U, mapper.syncs);
+  // The retries map the holes only: three of them first, then the two left.
+  std::vector<int> retried(mapper.mapped.begin() + 1000, mapper.mapped.end());
+  ASSERT_EQ((std::vector<int>{ 10, 11, 500, 10, 11 }), retried);
+  ASSERT_EQ((std::vector<std::chrono::milliseconds>{ kBlockMapInitialBackoff,
+                                                     kBlockMapInitialBackoff * 2 }),
+            mapper.sleeps);
+  ASSERT_EQ(3U, stats.syncs);
+  ASSERT_EQ(2U, stats.retries);
+  ASSERT_EQ(5U, stats.retried_blocks);
+}
+
+TEST(UncryptBlockMapTest, GivesUpOnPersistentHoles) {
+  FakeBlockMapper mapper({ { 7, std::numeric_limits<size_t>::max() } });
+  std::vector<int> blocks;
+  BlockMapStats stats;
+  ASSERT_EQ(kUncryptIoctlError, MapFileBlocks(&mapper, 100, &blocks, &stats));
+
+  ASSERT_EQ(kBlockMapRetryLimit, mapper.sleeps.size());
+  ASSERT_EQ(kBlockMapRetryLimit + 1, mapper.syncs);
+  ASSERT_EQ(100 + kBlockMapRetryLimit, mapper.mapped.size());
+  ASSERT_EQ(kBlockMapRetryLimit, stats.retries);
+}
+
+TEST(UncryptBlockMapTest, SyncFailure) {
+  FakeBlockMapper mapper({});
+  mapper.fail_sync = true;
+  std::vector<int> blocks;
+  BlockMapStats stats;
+  ASSERT_EQ(kUncryptFileSyncError, MapFileBlocks(&mapper, 100, &blocks, &stats));
+  ASSERT_TRUE(mapper.mapped.empty());
+}
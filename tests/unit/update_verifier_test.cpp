@@ -16,6 +16,9 @@
 
 #include <update_verifier/update_verifier.h>
 
+#include <sys/stat.h>
+
+#include <chrono>
 #include <functional>
 #include <string>
 #include <unordered_map>
@@ -23,6 +26,7 @@
 
 #include <android-base/file.h>
 #include <android-base/properties.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <google/protobuf/repeated_field.h>
 #include <gtest/gtest.h>
@@ -82,6 +86,47 @@ class UpdateVerifierTest : public ::testing::Test {
     return result.SerializeAsString();
   }
 
+  // Points the verifier at a fake sysfs tree and /dev/block under |fake_block_dir_|.
+  void UseFakeDmDevices(size_t io_concurrency) {
+    sysfs_block_dir_ = fake_block_dir_.path + "/sys/block/"s;
+    dev_block_dir_ = fake_block_dir_.path + "/dev/block/"s;
+    ASSERT_EQ(0, mkdir((fake_block_dir_.path + "/sys"s).c_str(), 0755));
+    ASSERT_EQ(0, mkdir(sysfs_block_dir_.c_str(), 0755));
+    ASSERT_EQ(0, mkdir((fake_block_dir_.path + "/dev"s).c_str(), 0755));
+    ASSERT_EQ(0, mkdir(dev_block_dir_.c_str(), 0755));
+    verifier_.set_block_dirs(sysfs_block_dir_, dev_block_dir_);
+    verifier_.set_io_concurrency(io_concurrency);
+  }
+
+  // Adds "dm-<index>" named |dm_name|, backed by a file of |blocks| blocks.
+  void AddDmDevice(size_t index, const std::string& dm_name, size_t blocks) {
+    std::string device = android::base::StringPrintf("dm-%zu", index);
+    std::string sysfs_dir = sysfs_block_dir_ + device;
+    ASSERT_EQ(0, mkdir(sysfs_dir.c_str(), 0755));
+    ASSERT_EQ(0, mkdir((sysfs_dir + "/dm").c_str(), 0755));
+    ASSERT_TRUE(android::base::WriteStringToFile(dm_name + "\n", sysfs_dir + "/dm/name"));
+    ASSERT_TRUE(android::base::WriteStringToFile(std::string(blocks * 4096, 'x'),
+                                                 dev_block_dir_ + device));
+  }
+
+  // Writes a care map for |partitions|, a list of <name, ranges>.
+  void WriteCareMap(const std::vector<std::pair<std::string, std::string>>& partitions) {
+    std::vector<std::unordered_map<std::string, std::string>> infos;
+    for (const auto& [name, ranges] : partitions) {
+      infos.push_back({
+          { "name", name },
+          { "ranges", ranges },
+          { "id", property_id_ },
+          { "fingerprint", fingerprint_ },
+      });
+    }
+    ASSERT_TRUE(android::base::WriteStringToFile(ConstructProto(infos), care_map_pb_));
+  }
+
+  const std::map<std::string, UpdateVerifier::PartitionResult>& partition_results() const {
+    return verifier_.partition_results_;
+  }
+
   bool verity_supported;
   UpdateVerifier verifier_;
 
@@ -92,6 +137,10 @@ class UpdateVerifierTest : public ::testing::Test {
 
   std::string property_id_;
   std::string fingerprint_;
+
+  TemporaryDir fake_block_dir_;
+  std::string sysfs_block_dir_;
+  std::string dev_block_dir_;
 };
 
 TEST_F(UpdateVerifierTest, verify_image_no_care_map) {
@@ -217,3 +266,68 @@ TEST_F(UpdateVerifierTest, verify_image_protobuf_fingerprint_mismatch) {
   ASSERT_TRUE(android::base::WriteStringToFile(proto, care_map_pb_));
   ASSERT_FALSE(verifier_.ParseCareMap());
 }
+
+TEST_F(UpdateVerifierTest, verify_fake_dm_partitions) {
+  UseFakeDmDevices(2);
+  AddDmDevice(0, "system-verity", 6000);
+  AddDmDevice(1, "vendor-verity", 300);
+  AddDmDevice(2, "product-verity", 2500);
+  WriteCareMap({
+      { "system", "4,0,2000,3000,5000" },
+      { "vendor", "2,10,300" },
+      { "product", "2,0,2500" },
+  });
+  ASSERT_TRUE(verifier_.ParseCareMap());
+
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_TRUE(verifier_.VerifyPartitions());
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  RecordProperty("verify_us", static_cast<int>(
+      std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+
+  // Each partition reports its own outcome.
+  const auto& results = partition_results();
+  ASSERT_EQ(3U, results.size());
+  std::map<std::string, std::pair<std::string, size_t>> expected = {
+    { "system", { "dm-0", 4000 } },
+    { "vendor", { "dm-1", 290 } },
+    { "product", { "dm-2", 2500 } },
+  };
+  for (const auto& [name, result] : results) {
+    ASSERT_TRUE(result.success) << name;
+    ASSERT_EQ(dev_block_dir_ + expected.at(name).first, result.block_device);
+    ASSERT_EQ(expected.at(name).second, result.blocks_read);
+    ASSERT_LE(result.duration, elapsed);
+  }
+}
+
+TEST_F(UpdateVerifierTest, verify_fake_dm_partitions_short_device) {
+  UseFakeDmDevices(4);
+  AddDmDevice(0, "system-verity", 4000);
+  // The care map covers more blocks than the device has.
+  AddDmDevice(1, "vendor-verity", 100);
+  WriteCareMap({
+      { "system", "2,0,4000" },
+      { "vendor", "2,0,200" },
+  });
+  ASSERT_TRUE(verifier_.ParseCareMap());
+  ASSERT_FALSE(verifier_.VerifyPartitions());
+
+  const auto& results = partition_results();
+  ASSERT_EQ(2U, results.size());
+  ASSERT_FALSE(results.at("vendor").success);
+  ASSERT_LT(results.at("vendor").blocks_read, 200U);
+}
+
+TEST_F(UpdateVerifierTest, verify_fake_dm_partitions_missing_device) {
+  UseFakeDmDevices(4);
+  AddDmDevice(0, "system-verity", 10);
+  WriteCareMap({
+      { "system", "2,0,10" },
+      { "vendor", "2,0,10" },
+  });
+  ASSERT_TRUE(verifier_.ParseCareMap());
+  ASSERT_FALSE(verifier_.VerifyPartitions());
+  // Nothing gets read without a device for every partition.
+  ASSERT_TRUE(partition_results().empty());
+}
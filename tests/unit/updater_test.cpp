@@ -14,8 +14,10 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -31,8 +33,10 @@
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
 #include <android-base/properties.h>
+#include <android-base/scopeguard.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <bootloader_message/bootloader_message.h>
 #include <brotli/encode.h>
 #include <bsdiff/bsdiff.h>
@@ -45,6 +49,7 @@
 #include "common/test_constants.h"
 #include "edify/expr.h"
 #include "otautil/error_code.h"
+#include "otautil/memory_budget.h"
 #include "otautil/paths.h"
 #include "otautil/print_sha1.h"
 #include "otautil/sysutil.h"
@@ -60,9 +65,10 @@ using PackageEntries = std::unordered_map<std::string, std::string>;
 
 static void expect(const char* expected, const std::string& expr_str, CauseCode cause_code,
                    Updater* updater) {
-  std::unique_ptr<Expr> e;
+  ExprArena arena;
+  Expr* e;
   int error_count = 0;
-  ASSERT_EQ(0, ParseString(expr_str, &e, &error_count));
+  ASSERT_EQ(0, ParseString(expr_str, &arena, &e, &error_count));
   ASSERT_EQ(0, error_count);
 
   State state(expr_str, updater);
@@ -112,8 +118,7 @@ static std::string GetSha1(std::string_view content) {
   return print_sha1(digest);
 }
 
-static Value* BlobToString(const char* name, State* state,
-                           const std::vector<std::unique_ptr<Expr>>& argv) {
+static Value* BlobToString(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 1) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 1 arg, got %zu", name, argv.size());
   }
@@ -736,6 +741,75 @@ TEST_F(UpdaterTest, block_image_update_patch_underrun) {
   RunBlockImageUpdate(false, entries, image_file_, "", kPatchApplicationFailure);
 }
 
+TEST_F(UpdaterTest, block_image_update_memory_budget) {
+  // Move 32 MiB of blocks under an 8 MiB memory budget. Only the source blocks are held in memory;
+  // the target blocks are verified in windows.
+  constexpr size_t kBlocks = 8192;
+  constexpr size_t kMoveSize = kBlocks * 4096;
+  MemoryBudget& budget = MemoryBudget::Get();
+  size_t saved_limit = budget.limit();
+  budget.set_limit(8 * 1024 * 1024);
+  auto restore_limit =
+      android::base::make_scope_guard([&budget, saved_limit] { budget.set_limit(saved_limit); });
+
+  // The source blocks come first, followed by the same number of zeroed target blocks. Write them
+  // out one at a time to keep the test's own memory out of the measurement.
+  SHA_CTX ctx;
+  SHA1_Init(&ctx);
+  {
+    android::base::unique_fd fd(open(image_file_.c_str(), O_WRONLY | O_TRUNC));
+    ASSERT_NE(-1, fd);
+    std::string block(4096, '\0');
+    for (size_t i = 0; i < kBlocks; i++) {
+      std::fill(block.begin(), block.end(), static_cast<char>(i % 251));
+      memcpy(block.data(), &i, sizeof(i));
+      SHA1_Update(&ctx, block.data(), block.size());
+      ASSERT_TRUE(android::base::WriteFully(fd, block.data(), block.size()));
+    }
+    ASSERT_EQ(0, ftruncate(fd, kMoveSize * 2));
+  }
+  uint8_t digest[SHA_DIGEST_LENGTH];
+  SHA1_Final(digest, &ctx);
+  std::string hash = print_sha1(digest);
+
+  std::vector<std::string> transfer_list{
+    // clang-format off
+    "4",
+    std::to_string(kBlocks),
+    "0",
+    "0",
+    android::base::StringPrintf("move %s 2,%zu,%zu %zu 2,0,%zu", hash.c_str(), kBlocks,
+                                kBlocks * 2, kBlocks, kBlocks),
+    // clang-format on
+  };
+  PackageEntries entries{
+    { "new_data", "" },
+    { "patch_data", "" },
+    { "transfer_list", android::base::Join(transfer_list, '\n') },
+  };
+
+  rusage before;
+  ASSERT_EQ(0, getrusage(RUSAGE_SELF, &before));
+  RunBlockImageUpdate(false, entries, image_file_, "t");
+  rusage after;
+  ASSERT_EQ(0, getrusage(RUSAGE_SELF, &after));
+
+  std::string updated;
+  ASSERT_TRUE(android::base::ReadFileToString(image_file_, &updated));
+  ASSERT_EQ(kMoveSize * 2, updated.size());
+  ASSERT_EQ(hash, GetSha1(std::string_view(updated).substr(kMoveSize)));
+  updated.clear();
+
+  // Loading the whole target next to the source would take twice the move size.
+  size_t peak_rss_growth = (after.ru_maxrss - before.ru_maxrss) * 1024;
+  RecordProperty("peak_rss_growth_kb", std::to_string(peak_rss_growth / 1024));
+  ASSERT_LT(peak_rss_growth, kMoveSize * 3 / 2);
+
+  // The command buffer is over its budget, so it's not kept after the command.
+  ASSERT_EQ(0, budget.usage());
+  ASSERT_LE(kMoveSize, budget.peak_usage());
+}
+
 TEST_F(UpdaterTest, block_image_update_fail) {
   std::string src_content(4096 * 2, 'e');
   std::string src_hash = GetSha1(src_content);
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "bootloader_message/wait_for_path.h"
+
+using namespace std::chrono_literals;
+
+TEST(WaitForPathTest, existing_path) {
+  TemporaryFile temp_file;
+  std::chrono::microseconds elapsed;
+  ASSERT_TRUE(WaitForPath(temp_file.path, 1000ms, &elapsed));
+  ASSERT_LT(elapsed, 100ms);
+}
+
+TEST(WaitForPathTest, timeout) {
+  TemporaryDir td;
+  std::string path = std::string(td.path) + "/missing";
+  std::chrono::microseconds elapsed;
+  ASSERT_FALSE(WaitForPath(path, 200ms, &elapsed));
+  ASSERT_GE(elapsed, 200ms);
+}
+
+TEST(WaitForPathTest, delayed_creation) {
+  TemporaryDir td;
+  std::string path = std::string(td.path) + "/node";
+
+  std::chrono::steady_clock::time_point created;
+  std::thread creator([&path, &created]() {
+    std::this_thread::sleep_for(300ms);
+    created = std::chrono::steady_clock::now();
+    ASSERT_TRUE(android::base::WriteStringToFile("", path));
+  });
+
+  std::chrono::microseconds elapsed;
+  bool found = WaitForPath(path, 5000ms, &elapsed);
+  auto returned = std::chrono::steady_clock::now();
+  creator.join();
+
+  ASSERT_TRUE(found);
+  ASSERT_GE(elapsed, 300ms);
+  // Event driven; shouldn't take anywhere near the old 1s polling interval to notice the node.
+  auto latency = std::chrono::duration_cast<std::chrono::microseconds>(returned - created);
+  RecordProperty("wait_latency_us", std::to_string(latency.count()));
+  ASSERT_LT(latency, 200ms);
+}
+
+TEST(WaitForPathTest, delayed_creation_of_parent_dirs) {
+  TemporaryDir td;
+  std::string dir = std::string(td.path) + "/block";
+  std::string subdir = dir + "/by-name";
+  std::string path = subdir + "/misc";
+
+  std::thread creator([&]() {
+    std::this_thread::sleep_for(100ms);
+    ASSERT_EQ(0, mkdir(dir.c_str(), 0755));
+    std::this_thread::sleep_for(100ms);
+    ASSERT_EQ(0, mkdir(subdir.c_str(), 0755));
+    std::this_thread::sleep_for(100ms);
+    ASSERT_EQ(0, symlink(td.path, path.c_str()));
+  });
+
+  std::chrono::microseconds elapsed;
+  bool found = WaitForPath(path, 5000ms, &elapsed);
+  creator.join();
+
+  ASSERT_TRUE(found);
+  ASSERT_GE(elapsed, 300ms);
+  ASSERT_LT(elapsed, 1000ms);
+}
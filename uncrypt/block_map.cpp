@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "uncrypt/block_map.h"
+
+#include <errno.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include <android-base/logging.h>
+
+#include "otautil/error_code.h"
+
+bool FileBlockMapper::Sync() {
+  struct fiemap fm = {};
+  fm.fm_length = FIEMAP_MAX_OFFSET;
+  fm.fm_flags = FIEMAP_FLAG_SYNC;
+  // With no room for extents, the ioctl only syncs the file and counts its extents.
+  fm.fm_extent_count = 0;
+  if (ioctl(fd_, FS_IOC_FIEMAP, &fm) == 0) {
+    return true;
+  }
+  if (errno != ENOTTY && errno != EOPNOTSUPP) {
+    PLOG(WARNING) << "FS_IOC_FIEMAP failed on \"" << name_ << "\", falling back to fsync";
+  }
+
+  if (fsync(fd_) == -1) {
+    PLOG(ERROR) << "failed to fsync \"" << name_ << "\"";
+    return false;
+  }
+  return true;
+}
+
+bool FileBlockMapper::Map(int block, int* physical_block) {
+  *physical_block = block;
+  if (ioctl(fd_, FIBMAP, physical_block) != 0) {
+    PLOG(ERROR) << "failed to find block " << block;
+    return false;
+  }
+  return true;
+}
+
+void FileBlockMapper::Sleep(std::chrono::milliseconds duration) {
+  std::this_thread::sleep_for(duration);
+}
+
+int MapFileBlocks(BlockMapper* mapper, int block_count, std::vector<int>* physical_blocks,
+                  BlockMapStats* stats) {
+  auto start = std::chrono::steady_clock::now();
+  *stats = {};
+  auto finish = [&](int status) {
+    stats->duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    return status;
+  };
+
+  // Allocate the whole file at once, instead of syncing whenever a hole shows up.
+  stats->syncs++;
+  if (!mapper->Sync()) {
+    return finish(kUncryptFileSyncError);
+  }
+
+  physical_blocks->assign(block_count, 0);
+  std::vector<int> unmapped;
+  for (int block = 0; block < block_count; block++) {
+    if (!mapper->Map(block, &(*physical_blocks)[block])) {
+      return finish(kUncryptIoctlError);
+    }
+    if ((*physical_blocks)[block] == 0) {
+      unmapped.push_back(block);
+    }
+  }
+
+  auto backoff = kBlockMapInitialBackoff;
+  for (size_t i = 0; i < kBlockMapRetryLimit && !unmapped.empty(); i++) {
+    LOG(WARNING) << unmapped.size() << " block(s) not mapped yet, starting with block "
+                 << unmapped.front() << "; retrying in " << backoff.count() << "ms";
+    mapper->Sleep(backoff);
+    backoff *= 2;
+
+    stats->retries++;
+    stats->retried_blocks += unmapped.size();
+    stats->syncs++;
+    if (!mapper->Sync()) {
+      return finish(kUncryptFileSyncError);
+    }
+
+    std::vector<int> still_unmapped;
+    for (int block : unmapped) {
+      if (!mapper->Map(block, &(*physical_blocks)[block])) {
+        return finish(kUncryptIoctlError);
+      }
+      if ((*physical_blocks)[block] == 0) {
+        still_unmapped.push_back(block);
+      }
+    }
+    unmapped = std::move(still_unmapped);
+  }
+
+  if (!unmapped.empty()) {
+    LOG(ERROR) << "fibmap of " << unmapped.size() << " block(s), starting with block "
+               << unmapped.front() << ", always returns 0";
+    return finish(kUncryptIoctlError);
+  }
+  return finish(kUncryptNoError);
+}
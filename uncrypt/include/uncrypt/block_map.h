@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// The file system operations needed to find where the blocks of a file are on the block device.
+// Tests may provide a fake one.
+class BlockMapper {
+ public:
+  virtual ~BlockMapper() = default;
+
+  // Forces the allocation of all the blocks of the file (e.g. the ones pending delayed allocation
+  // on f2fs). Returns false on error.
+  virtual bool Sync() = 0;
+
+  // Finds the physical block of the file's block |block|, or 0 if it hasn't been allocated yet.
+  // Returns false on error.
+  virtual bool Map(int block, int* physical_block) = 0;
+
+  // Waits for |duration| before retrying the blocks that are still unmapped.
+  virtual void Sleep(std::chrono::milliseconds duration) = 0;
+};
+
+// Maps the blocks of an open file with FIBMAP.
+class FileBlockMapper : public BlockMapper {
+ public:
+  FileBlockMapper(int fd, const std::string& name) : fd_(fd), name_(name) {}
+
+  // Uses FS_IOC_FIEMAP with FIEMAP_FLAG_SYNC, which syncs the file's data (and so allocates its
+  // blocks) without waiting on its metadata. Falls back to fsync() if the ioctl isn't supported.
+  bool Sync() override;
+  bool Map(int block, int* physical_block) override;
+  void Sleep(std::chrono::milliseconds duration) override;
+
+ private:
+  int fd_;
+  std::string name_;
+};
+
+struct BlockMapStats {
+  size_t syncs{ 0 };    // Calls to BlockMapper::Sync().
+  size_t retries{ 0 };  // Rounds of retries for the blocks found unmapped.
+  size_t retried_blocks{ 0 };
+  std::chrono::milliseconds duration{ 0 };
+};
+
+// The number of rounds of retries for unmapped blocks, and the wait before the first one. The wait
+// doubles with each round, which adds up to about the same total wait as before (3 x 1s), but
+// lets most holes resolve after a few milliseconds.
+constexpr size_t kBlockMapRetryLimit = 8;
+constexpr std::chrono::milliseconds kBlockMapInitialBackoff{ 10 };
+
+// Maps all the |block_count| blocks of a file into |physical_blocks|. Syncs the whole file once up
+// front; blocks that are still unmapped afterwards get retried, one sync per round, with
+// exponential backoff. Returns kUncryptNoError or the uncrypt error code on failure. Fills |stats|
+// either way.
+int MapFileBlocks(BlockMapper* mapper, int block_count, std::vector<int>* physical_blocks,
+                  BlockMapStats* stats);
@@ -94,6 +94,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -118,12 +119,12 @@
 #include <fstab/fstab.h>
 
 #include "otautil/error_code.h"
+#include "uncrypt/block_map.h"
 
 using android::fs_mgr::Fstab;
 using android::fs_mgr::ReadDefaultFstab;
 
 static constexpr int WINDOW_SIZE = 5;
-static constexpr int FIBMAP_RETRY_LIMIT = 3;
 
 // uncrypt provides three services: SETUP_BCB, CLEAR_BCB and UNCRYPT.
 //
@@ -220,28 +221,9 @@ static bool FindUncryptPackage(const std::string& uncrypt_path_file, std::string
   return true;
 }
 
-static int RetryFibmap(int fd, const std::string& name, int* block, const int head_block) {
-  CHECK(block != nullptr);
-  for (size_t i = 0; i < FIBMAP_RETRY_LIMIT; i++) {
-    if (fsync(fd) == -1) {
-      PLOG(ERROR) << "failed to fsync \"" << name << "\"";
-      return kUncryptFileSyncError;
-    }
-    if (ioctl(fd, FIBMAP, block) != 0) {
-      PLOG(ERROR) << "failed to find block " << head_block;
-      return kUncryptIoctlError;
-    }
-    if (*block != 0) {
-      return kUncryptNoError;
-    }
-    sleep(1);
-  }
-  LOG(ERROR) << "fibmap of " << head_block << " always returns 0";
-  return kUncryptIoctlError;
-}
-
 static int ProductBlockMap(const std::string& path, const std::string& map_file,
-                           const std::string& blk_dev, bool encrypted, bool f2fs_fs, int socket) {
+                           const std::string& blk_dev, bool encrypted, bool f2fs_fs, int socket,
+                           BlockMapStats* map_stats) {
   std::string err;
   if (!android::base::RemoveFileIfExists(map_file, &err)) {
     LOG(ERROR) << "failed to remove the existing map file " << map_file << ": " << err;
@@ -329,6 +311,17 @@ static int ProductBlockMap(const std::string& path, const std::string& map_file,
         }
     }
 
+    // Find all the blocks up front, which allocates the whole file in one go.
+    std::vector<int> physical_blocks;
+    FileBlockMapper mapper(fd, path);
+    int mapped_blocks = static_cast<int>((sb.st_size + sb.st_blksize - 1) / sb.st_blksize);
+    if (int error = MapFileBlocks(&mapper, mapped_blocks, &physical_blocks, map_stats);
+        error != kUncryptNoError) {
+        return error;
+    }
+    LOG(INFO) << "mapped " << mapped_blocks << " blocks in " << map_stats->duration.count()
+              << "ms with " << map_stats->syncs << " sync(s)";
+
     off64_t pos = 0;
     int last_progress = 0;
     while (pos < sb.st_size) {
@@ -341,20 +334,7 @@ static int ProductBlockMap(const std::string& path, const std::string& map_file,
 
         if ((tail+1) % WINDOW_SIZE == head) {
             // write out head buffer
-            int block = head_block;
-            if (ioctl(fd, FIBMAP, &block) != 0) {
-                PLOG(ERROR) << "failed to find block " << head_block;
-                return kUncryptIoctlError;
-            }
-
-            if (block == 0) {
-                LOG(ERROR) << "failed to find block " << head_block << ", retrying";
-                int error = RetryFibmap(fd, path, &block, head_block);
-                if (error != kUncryptNoError) {
-                    return error;
-                }
-            }
-
+            int block = physical_blocks[head_block];
             add_block_to_ranges(ranges, block);
             if (encrypted) {
                 if (write_at_offset(buffers[head].data(), sb.st_blksize, wfd,
@@ -386,20 +366,7 @@ static int ProductBlockMap(const std::string& path, const std::string& map_file,
 
     while (head != tail) {
         // write out head buffer
-        int block = head_block;
-        if (ioctl(fd, FIBMAP, &block) != 0) {
-            PLOG(ERROR) << "failed to find block " << head_block;
-            return kUncryptIoctlError;
-        }
-
-        if (block == 0) {
-            LOG(ERROR) << "failed to find block " << head_block << ", retrying";
-            int error = RetryFibmap(fd, path, &block, head_block);
-            if (error != kUncryptNoError) {
-                return error;
-            }
-        }
-
+        int block = physical_blocks[head_block];
         add_block_to_ranges(ranges, block);
         if (encrypted) {
             if (write_at_offset(buffers[head].data(), sb.st_blksize, wfd,
@@ -466,7 +433,8 @@ static int ProductBlockMap(const std::string& path, const std::string& map_file,
     return 0;
 }
 
-static int Uncrypt(const std::string& input_path, const std::string& map_file, int socket) {
+static int Uncrypt(const std::string& input_path, const std::string& map_file, int socket,
+                   BlockMapStats* map_stats) {
   LOG(INFO) << "update package is \"" << input_path << "\"";
 
   // Turn the name of the file we're supposed to convert into an absolute path, so we can find what
@@ -498,7 +466,7 @@ static int Uncrypt(const std::string& input_path, const std::string& map_file, i
   // mounting the partition. On /cache and /sdcard we leave the file alone.
   if (android::base::StartsWith(path, "/data/")) {
     LOG(INFO) << "writing block map " << map_file;
-    return ProductBlockMap(path, map_file, blk_dev, encrypted, f2fs_fs, socket);
+    return ProductBlockMap(path, map_file, blk_dev, encrypted, f2fs_fs, socket, map_stats);
   }
 
   return 0;
@@ -528,11 +496,17 @@ static bool uncrypt_wrapper(const char* input_path, const char* map_file, const
     CHECK(map_file != nullptr);
 
     auto start = std::chrono::system_clock::now();
-    int status = Uncrypt(input_path, map_file, socket);
+    BlockMapStats map_stats;
+    int status = Uncrypt(input_path, map_file, socket, &map_stats);
     std::chrono::duration<double> duration = std::chrono::system_clock::now() - start;
     int count = static_cast<int>(duration.count());
 
     std::string uncrypt_message = android::base::StringPrintf("uncrypt_time: %d\n", count);
+    if (map_stats.syncs > 0) {
+        uncrypt_message += android::base::StringPrintf(
+            "uncrypt_map_syncs: %zu\nuncrypt_map_time_ms: %lld\n", map_stats.syncs,
+            static_cast<long long>(map_stats.duration.count()));
+    }
     if (status != 0) {
         // Log the time cost and error code if uncrypt fails.
         uncrypt_message += android::base::StringPrintf("uncrypt_error: %d\n", status);
@@ -594,18 +568,26 @@ static bool setup_bcb(const int socket) {
         }
     }
 
-    // c8. setup the bcb command
+    // c8. setup the bcb command, along with the wipe package if any, with a single sync.
     std::string err;
-    if (!write_bootloader_message(options, &err)) {
+    auto misc = MiscPartition::Open(true, &err);
+    bootloader_message boot = {};
+    update_bootloader_message_in_struct(&boot, options);
+    if (!misc || !misc->WriteBootloaderMessage(boot, &err)) {
         LOG(ERROR) << "failed to set bootloader message: " << err;
         write_status_to_socket(-1, socket);
         return false;
     }
-    if (!wipe_package.empty() && !write_wipe_package(wipe_package, &err)) {
+    if (!wipe_package.empty() && !misc->WriteWipePackage(wipe_package, &err)) {
         PLOG(ERROR) << "failed to set wipe package: " << err;
         write_status_to_socket(-1, socket);
         return false;
     }
+    if (!misc->Commit(&err)) {
+        LOG(ERROR) << "failed to set bootloader message: " << err;
+        write_status_to_socket(-1, socket);
+        return false;
+    }
     // c10. send "100" status
     write_status_to_socket(100, socket);
     return true;
@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <stddef.h>
+
+#include <chrono>
 #include <functional>
 #include <map>
 #include <string>
@@ -51,16 +54,30 @@ class UpdateVerifier {
 
  private:
   friend class UpdateVerifierTest;
+
+  // The outcome of reading the cared blocks of one partition.
+  struct PartitionResult {
+    std::string block_device;
+    bool success = false;
+    size_t blocks_read = 0;
+    // From the first read issued for the partition to the last one completed.
+    std::chrono::milliseconds duration{ 0 };
+  };
+
   // Finds all the dm-enabled partitions, and returns a map of <partition_name, block_device>.
   std::map<std::string, std::string> FindDmPartitions();
 
-  // Returns true if we successfully read the blocks in |ranges| of the |dm_block_device|.
-  bool ReadBlocks(const std::string partition_name, const std::string& dm_block_device,
-                  const RangeSet& ranges);
+  // Reads the cared blocks of all the partitions in |partition_map_| from |dm_block_devices|. The
+  // reads of all partitions share one pool of |io_concurrency_| threads, and the outcome of each
+  // partition goes into |partition_results_|. Returns true if all the blocks were read.
+  bool ReadBlocks(const std::map<std::string, std::string>& dm_block_devices);
 
   // Functions to override the care_map_prefix_ and property_reader_, used in test only.
   void set_care_map_prefix(const std::string& prefix);
   void set_property_reader(const std::function<std::string(const std::string&)>& property_reader);
+  // Overrides the "/sys/block/" and "/dev/block/" directories and the thread count; test only.
+  void set_block_dirs(const std::string& sysfs_block_dir, const std::string& dev_block_dir);
+  void set_io_concurrency(size_t io_concurrency);
 
   std::map<std::string, RangeSet> partition_map_;
   // The path to the care_map excluding the filename extension; default value:
@@ -70,6 +87,15 @@ class UpdateVerifier {
   // The function to read the device property; default value: android::base::GetProperty()
   std::function<std::string(const std::string&)> property_reader_;
 
+  // Where to look for the dm-X devices; default values: "/sys/block/" and "/dev/block/".
+  std::string sysfs_block_dir_;
+  std::string dev_block_dir_;
+
+  // The number of threads that scan and read the partitions.
+  size_t io_concurrency_;
+
+  std::map<std::string, PartitionResult> partition_results_;
+
   // Check if snapuserd daemon has already completed the update verification
   // Applicable only for VABC with userspace snapshots
   bool CheckVerificationStatus();
@@ -49,7 +49,9 @@
 #include <unistd.h>
 
 #include <algorithm>
-#include <future>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <thread>
 
 #include <BootControlClient.h>
@@ -78,19 +80,42 @@ static int dm_name_filter(const dirent* de) {
   return 0;
 }
 
+// Runs |task| for each index in [0, count) on up to |concurrency| threads, handing out the indices
+// in order. The task also gets the number of the thread running it, in [0, concurrency).
+static void RunTasks(size_t count, size_t concurrency,
+                     const std::function<void(size_t thread, size_t index)>& task) {
+  std::atomic<size_t> next_index{ 0 };
+  auto worker = [&](size_t thread) {
+    for (size_t i = next_index++; i < count; i = next_index++) {
+      task(thread, i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t thread = 1; thread < std::min(concurrency, count); thread++) {
+    threads.emplace_back(worker, thread);
+  }
+  worker(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
 UpdateVerifier::UpdateVerifier()
     : care_map_prefix_(kDefaultCareMapPrefix),
-      property_reader_([](const std::string& id) { return android::base::GetProperty(id, ""); }) {}
+      property_reader_([](const std::string& id) { return android::base::GetProperty(id, ""); }),
+      sysfs_block_dir_("/sys/block/"),
+      dev_block_dir_("/dev/block/"),
+      io_concurrency_(std::thread::hardware_concurrency() ?: 4) {}
 
 // Iterate the content of "/sys/block/dm-X/dm/name" and find all the dm-wrapped block devices.
 // We will later read all the ("cared") blocks from "/dev/block/dm-X" to ensure the target
 // partition's integrity.
 std::map<std::string, std::string> UpdateVerifier::FindDmPartitions() {
-  static constexpr auto DM_PATH_PREFIX = "/sys/block/";
   dirent** namelist = nullptr;
-  int n = scandir(DM_PATH_PREFIX, &namelist, dm_name_filter, alphasort);
+  int n = scandir(sysfs_block_dir_.c_str(), &namelist, dm_name_filter, alphasort);
   if (n == -1) {
-    PLOG(ERROR) << "Failed to scan dir " << DM_PATH_PREFIX;
+    PLOG(ERROR) << "Failed to scan dir " << sysfs_block_dir_;
     return {};
   }
   if (n == 0) {
@@ -98,86 +123,163 @@ std::map<std::string, std::string> UpdateVerifier::FindDmPartitions() {
     return {};
   }
 
+  std::vector<std::string> devices;
+  for (int i = 0; i < n; i++) {
+    devices.emplace_back(namelist[i]->d_name);
+    free(namelist[i]);
+  }
+  free(namelist);
+
+  // Read the names of all the devices at once.
   static constexpr auto DM_PATH_SUFFIX = "/dm/name";
-  static constexpr auto DEV_PATH = "/dev/block/";
-  std::map<std::string, std::string> dm_block_devices;
-  while (n--) {
-    std::string path = DM_PATH_PREFIX + std::string(namelist[n]->d_name) + DM_PATH_SUFFIX;
-    std::string content;
-    if (!android::base::ReadFileToString(path, &content)) {
+  std::vector<std::string> names(devices.size());
+  std::vector<uint8_t> name_read(devices.size(), 0);
+  RunTasks(devices.size(), io_concurrency_, [&](size_t /* thread */, size_t i) {
+    std::string path = sysfs_block_dir_ + devices[i] + DM_PATH_SUFFIX;
+    if (!android::base::ReadFileToString(path, &names[i])) {
       PLOG(WARNING) << "Failed to read " << path;
-    } else {
-      std::string dm_block_name = android::base::Trim(content);
-      // AVB is using 'vroot' for the root block device but we're expecting 'system'.
-      if (dm_block_name == "vroot") {
-        dm_block_name = "system";
-      } else if (android::base::EndsWith(dm_block_name, "-verity")) {
-        auto npos = dm_block_name.rfind("-verity");
-        dm_block_name = dm_block_name.substr(0, npos);
-      } else if (!android::base::GetProperty("ro.boot.avb_version", "").empty()) {
-        // Verified Boot 1.0 doesn't add a -verity suffix. On AVB 2 devices,
-        // if DAP is enabled, then a -verity suffix must be used to
-        // differentiate between dm-linear and dm-verity devices. If we get
-        // here, we're AVB 2 and looking at a non-verity partition.
-        continue;
-      }
+      return;
+    }
+    name_read[i] = 1;
+  });
 
-      dm_block_devices.emplace(dm_block_name, DEV_PATH + std::string(namelist[n]->d_name));
+  bool avb_2 = !property_reader_("ro.boot.avb_version").empty();
+  std::map<std::string, std::string> dm_block_devices;
+  // Walk the devices backwards, so that the highest numbered dm-X wins a name that appears twice.
+  for (size_t i = devices.size(); i-- > 0;) {
+    if (!name_read[i]) {
+      continue;
     }
-    free(namelist[n]);
+    std::string dm_block_name = android::base::Trim(names[i]);
+    // AVB is using 'vroot' for the root block device but we're expecting 'system'.
+    if (dm_block_name == "vroot") {
+      dm_block_name = "system";
+    } else if (android::base::EndsWith(dm_block_name, "-verity")) {
+      auto npos = dm_block_name.rfind("-verity");
+      dm_block_name = dm_block_name.substr(0, npos);
+    } else if (avb_2) {
+      // Verified Boot 1.0 doesn't add a -verity suffix. On AVB 2 devices,
+      // if DAP is enabled, then a -verity suffix must be used to
+      // differentiate between dm-linear and dm-verity devices. If we get
+      // here, we're AVB 2 and looking at a non-verity partition.
+      continue;
+    }
+
+    dm_block_devices.emplace(dm_block_name, dev_block_dir_ + devices[i]);
   }
-  free(namelist);
 
   return dm_block_devices;
 }
 
-bool UpdateVerifier::ReadBlocks(const std::string partition_name,
-                                const std::string& dm_block_device, const RangeSet& ranges) {
-  // RangeSet::Split() splits the ranges into multiple groups with same number of blocks (except for
-  // the last group).
-  size_t thread_num = std::thread::hardware_concurrency() ?: 4;
-  std::vector<RangeSet> groups = ranges.Split(thread_num);
-
-  std::vector<std::future<bool>> threads;
-  for (const auto& group : groups) {
-    auto thread_func = [&group, &dm_block_device, &partition_name]() {
-      android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(dm_block_device.c_str(), O_RDONLY)));
-      if (fd.get() == -1) {
-        PLOG(ERROR) << "Error reading " << dm_block_device << " for partition " << partition_name;
-        return false;
-      }
+bool UpdateVerifier::ReadBlocks(const std::map<std::string, std::string>& dm_block_devices) {
+  static constexpr size_t kBlockSize = 4096;
+  // The unit of work handed to a thread.
+  static constexpr size_t kReadChunkBlocks = 1024;
+
+  struct Partition {
+    std::string name;
+    android::base::unique_fd fd;
+    std::chrono::steady_clock::time_point first_start;
+    std::chrono::steady_clock::time_point last_end;
+    bool started = false;
+    bool read_error = false;
+  };
+  struct ReadJob {
+    size_t partition;
+    size_t start_block;
+    size_t end_block;
+  };
+
+  partition_results_.clear();
+  std::vector<Partition> partitions;
+  std::vector<std::vector<ReadJob>> partition_jobs;
+  for (const auto& [partition_name, ranges] : partition_map_) {
+    const auto& dm_block_device = dm_block_devices.at(partition_name);
+    auto& result = partition_results_[partition_name];
+    result.block_device = dm_block_device;
 
-      static constexpr size_t kBlockSize = 4096;
-      std::vector<uint8_t> buf(1024 * kBlockSize);
-
-      for (const auto& [range_start, range_end] : group) {
-        if (lseek64(fd.get(), static_cast<off64_t>(range_start) * kBlockSize, SEEK_SET) == -1) {
-          PLOG(ERROR) << "lseek to " << range_start << " failed";
-          return false;
-        }
-
-        size_t remain = (range_end - range_start) * kBlockSize;
-        while (remain > 0) {
-          size_t to_read = std::min(remain, 1024 * kBlockSize);
-          if (!android::base::ReadFully(fd.get(), buf.data(), to_read)) {
-            PLOG(ERROR) << "Failed to read blocks " << range_start << " to " << range_end;
-            return false;
-          }
-          remain -= to_read;
-        }
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(dm_block_device.c_str(), O_RDONLY)));
+    if (fd.get() == -1) {
+      PLOG(ERROR) << "Error reading " << dm_block_device << " for partition " << partition_name;
+      return false;
+    }
+
+    std::vector<ReadJob> jobs;
+    for (const auto& [range_start, range_end] : ranges) {
+      for (size_t block = range_start; block < range_end; block += kReadChunkBlocks) {
+        jobs.push_back({ partitions.size(), block, std::min(block + kReadChunkBlocks, range_end) });
       }
-      return true;
-    };
+    }
+    partitions.push_back({ partition_name, std::move(fd) });
+    partition_jobs.push_back(std::move(jobs));
+  }
 
-    threads.emplace_back(std::async(std::launch::async, thread_func));
+  // Interleave the partitions, so that they all make progress together.
+  std::vector<ReadJob> jobs;
+  size_t max_jobs = 0;
+  for (const auto& partition : partition_jobs) {
+    max_jobs = std::max(max_jobs, partition.size());
+  }
+  for (size_t round = 0; round < max_jobs; round++) {
+    for (const auto& partition : partition_jobs) {
+      if (round < partition.size()) {
+        jobs.push_back(partition[round]);
+      }
+    }
   }
 
+  std::mutex mutex;
+  std::atomic<bool> failed{ false };
+  size_t thread_num = std::min(io_concurrency_, std::max<size_t>(jobs.size(), 1));
+  std::vector<std::vector<uint8_t>> buffers(thread_num,
+                                            std::vector<uint8_t>(kReadChunkBlocks * kBlockSize));
+  RunTasks(jobs.size(), thread_num, [&](size_t thread, size_t i) {
+    // Don't start more reads once any partition has failed.
+    if (failed) {
+      return;
+    }
+    const auto& job = jobs[i];
+    auto& partition = partitions[job.partition];
+    auto start = std::chrono::steady_clock::now();
+    size_t to_read = (job.end_block - job.start_block) * kBlockSize;
+    bool success = android::base::ReadFullyAtOffset(
+        partition.fd.get(), buffers[thread].data(), to_read,
+        static_cast<off64_t>(job.start_block) * kBlockSize);
+    if (!success) {
+      PLOG(ERROR) << "Failed to read blocks " << job.start_block << " to " << job.end_block
+                  << " of partition " << partition.name;
+      failed = true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& result = partition_results_[partition.name];
+    if (success) {
+      result.blocks_read += job.end_block - job.start_block;
+    } else {
+      partition.read_error = true;
+    }
+    if (!partition.started) {
+      partition.started = true;
+      partition.first_start = start;
+    }
+    partition.last_end = std::chrono::steady_clock::now();
+  });
+
   bool ret = true;
-  for (auto& t : threads) {
-    ret = t.get() && ret;
+  for (size_t i = 0; i < partitions.size(); i++) {
+    const auto& partition = partitions[i];
+    auto& result = partition_results_[partition.name];
+    size_t blocks = partition_map_.at(partition.name).blocks();
+    result.success = result.blocks_read == blocks;
+    result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        partition.last_end - partition.first_start);
+    ret = ret && result.success;
+    const char* status = result.success ? "Finished" : partition.read_error ? "Failed" : "Stopped";
+    LOG(INFO) << status << " reading blocks on partition "
+              << partition.name << " @ " << result.block_device << ": " << result.blocks_read
+              << " of " << blocks << " blocks in " << result.duration.count() << " ms";
   }
-  LOG(INFO) << "Finished reading blocks on partition " << partition_name << " @ " << dm_block_device
-            << " with " << thread_num << " threads.";
+  LOG(INFO) << "Read " << partitions.size() << " partitions with " << thread_num << " threads.";
   return ret;
 }
 
@@ -203,6 +305,7 @@ bool UpdateVerifier::VerifyPartitions() {
 
   LOG(INFO) << "Partitions not verified by snapuserd daemon";
 
+  auto start = std::chrono::steady_clock::now();
   auto dm_block_devices = FindDmPartitions();
   if (dm_block_devices.empty()) {
     LOG(ERROR) << "No dm-enabled block device is found.";
@@ -214,13 +317,14 @@ bool UpdateVerifier::VerifyPartitions() {
       LOG(ERROR) << "Failed to find dm block device for " << partition_name;
       return false;
     }
-
-    if (!ReadBlocks(partition_name, dm_block_devices.at(partition_name), ranges)) {
-      return false;
-    }
   }
 
-  return true;
+  bool ret = ReadBlocks(dm_block_devices);
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  LOG(INFO) << (ret ? "Verified " : "Failed to verify ") << partition_map_.size()
+            << " partitions in " << elapsed.count() << " ms";
+  return ret;
 }
 
 bool UpdateVerifier::ParseCareMap() {
@@ -288,7 +392,8 @@ bool UpdateVerifier::ParseCareMap() {
       continue;
     }
 
-    partition_map_.emplace(partition.name(), ranges);
+    // Blocks listed more than once only need to be read once, and in order.
+    partition_map_.emplace(partition.name(), ranges.Normalized());
   }
 
   if (partition_map_.empty()) {
@@ -308,6 +413,16 @@ void UpdateVerifier::set_property_reader(
   property_reader_ = property_reader;
 }
 
+void UpdateVerifier::set_block_dirs(const std::string& sysfs_block_dir,
+                                    const std::string& dev_block_dir) {
+  sysfs_block_dir_ = sysfs_block_dir;
+  dev_block_dir_ = dev_block_dir;
+}
+
+void UpdateVerifier::set_io_concurrency(size_t io_concurrency) {
+  io_concurrency_ = io_concurrency;
+}
+
 static int reboot_device() {
   if (android_reboot(ANDROID_RB_RESTART2, 0, nullptr) == -1) {
     LOG(ERROR) << "Failed to reboot.";
@@ -32,6 +32,8 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <limits>
 #include <memory>
@@ -42,6 +44,7 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
+#include <android-base/scopeguard.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
@@ -56,10 +59,13 @@
 #include "edify/updater_interface.h"
 #include "otautil/dirutil.h"
 #include "otautil/error_code.h"
+#include "otautil/memory_budget.h"
 #include "otautil/paths.h"
 #include "otautil/print_sha1.h"
 #include "otautil/rangeset.h"
+#include "otautil/storage_benchmark.h"
 #include "private/commands.h"
+#include "private/discard_queue.h"
 #include "updater/install.h"
 
 #ifdef __ANDROID__
@@ -535,6 +541,9 @@ struct CommandParameters {
     bool canwrite;
     int createdstash;
     android::base::unique_fd fd;
+    // Issues the erase commands' discards in the background. Declared after fd so that it's
+    // destroyed (and drained) first.
+    std::unique_ptr<DiscardQueue> discards;
     bool foundwrites;
     bool isunresumable;
     int version;
@@ -543,10 +552,24 @@ struct CommandParameters {
     NewThreadInfo nti;
     pthread_t thread;
     std::vector<uint8_t> buffer;
-    uint8_t* patch_start;
+    size_t maxalloc;
+    UpdaterInterface* updater;
+    uint64_t patch_offset;  // Of the patch data entry in the package.
     bool target_verified;  // The target blocks have expected contents already.
 };
 
+// Frees the command buffer if it has outgrown its memory budget, so that one large command doesn't
+// keep the memory for the rest of the update.
+static void TrimBuffer(CommandParameters& params) {
+  MemoryBudget& budget = MemoryBudget::Get();
+  params.maxalloc = std::max(params.maxalloc, params.buffer.size());
+  budget.SetUsage(MemoryConsumer::kTransferBuffer, params.buffer.capacity());
+  if (params.buffer.capacity() > budget.Budget(MemoryConsumer::kTransferBuffer)) {
+    std::vector<uint8_t>().swap(params.buffer);
+    budget.SetUsage(MemoryConsumer::kTransferBuffer, 0);
+  }
+}
+
 // Print the hash in hex for corrupted source blocks (excluding the stashed blocks which is
 // handled separately).
 static void PrintHashForCorruptedSourceBlocks(const CommandParameters& params,
@@ -650,6 +673,48 @@ static void PrintHashForMissingStashedBlocks(const std::string& id, int fd) {
   PrintHashForCorruptedStashedBlocks(id, buffer, src);
 }
 
+// Hashes the blocks in 'ranges' in windows no larger than the verify budget, instead of loading
+// them all at once, and checks the digest against 'expected'. Sets 'verified' to the result, or
+// returns -1 on read errors.
+static int VerifyRangeBlocks(const std::string& expected, const RangeSet& ranges, int fd,
+                             bool* verified) {
+  MemoryBudget& budget = MemoryBudget::Get();
+  size_t window_blocks =
+      std::max<size_t>(budget.Budget(MemoryConsumer::kVerifyWindow) / BLOCKSIZE, 1);
+  std::vector<uint8_t> window(std::min(window_blocks, ranges.blocks()) * BLOCKSIZE);
+  budget.SetUsage(MemoryConsumer::kVerifyWindow, window.size());
+
+  SHA_CTX ctx;
+  SHA1_Init(&ctx);
+  int rc = 0;
+  for (const auto& [begin, end] : ranges) {
+    if (!check_lseek(fd, static_cast<off64_t>(begin) * BLOCKSIZE, SEEK_SET)) {
+      rc = -1;
+      break;
+    }
+    for (size_t pos = begin; pos < end; pos += window_blocks) {
+      size_t size = std::min(window_blocks, end - pos) * BLOCKSIZE;
+      if (!android::base::ReadFully(fd, window.data(), size)) {
+        failure_type = errno == EIO ? kEioFailure : kFreadFailure;
+        PLOG(ERROR) << "Failed to read " << size << " bytes of data";
+        rc = -1;
+        break;
+      }
+      SHA1_Update(&ctx, window.data(), size);
+    }
+    if (rc == -1) break;
+  }
+  budget.SetUsage(MemoryConsumer::kVerifyWindow, 0);
+  if (rc == -1) {
+    return -1;
+  }
+
+  uint8_t digest[SHA_DIGEST_LENGTH];
+  SHA1_Final(digest, &ctx);
+  *verified = print_sha1(digest) == expected;
+  return 0;
+}
+
 static int VerifyBlocks(const std::string& expected, const std::vector<uint8_t>& buffer,
                         const size_t blocks, bool printerror) {
   uint8_t digest[SHA_DIGEST_LENGTH];
@@ -1112,13 +1177,12 @@ static int LoadSrcTgtVersion3(CommandParameters& params, RangeSet* tgt, size_t*
   *tgt = RangeSet::Parse(params.tokens[params.cpos++]);
   CHECK(static_cast<bool>(*tgt));
 
-  std::vector<uint8_t> tgtbuffer(tgt->blocks() * BLOCKSIZE);
-  if (ReadBlocks(*tgt, &tgtbuffer, params.fd) == -1) {
+  // Return now if target blocks already have expected content.
+  bool target_verified;
+  if (VerifyRangeBlocks(tgthash, *tgt, params.fd, &target_verified) == -1) {
     return -1;
   }
-
-  // Return now if target blocks already have expected content.
-  if (VerifyBlocks(tgthash, tgtbuffer, tgt->blocks(), false) == 0) {
+  if (target_verified) {
     return 1;
   }
 
@@ -1283,8 +1347,10 @@ static int PerformCommandZero(CommandParameters& params) {
 
   LOG(INFO) << "  zeroing " << tgt.blocks() << " blocks";
 
-  allocate(BLOCKSIZE, &params.buffer);
-  memset(params.buffer.data(), 0, BLOCKSIZE);
+  size_t chunk_blocks =
+      std::max<size_t>(IoTuning::Get().parameters().write_chunk_size / BLOCKSIZE, 1);
+  allocate(chunk_blocks * BLOCKSIZE, &params.buffer);
+  memset(params.buffer.data(), 0, chunk_blocks * BLOCKSIZE);
 
   if (params.canwrite) {
     for (const auto& [begin, end] : tgt) {
@@ -1298,10 +1364,11 @@ static int PerformCommandZero(CommandParameters& params) {
         return -1;
       }
 
-      for (size_t j = begin; j < end; ++j) {
-        if (!android::base::WriteFully(params.fd, params.buffer.data(), BLOCKSIZE)) {
+      for (size_t j = begin; j < end; j += chunk_blocks) {
+        size_t to_write = std::min(chunk_blocks, end - j) * BLOCKSIZE;
+        if (!android::base::WriteFully(params.fd, params.buffer.data(), to_write)) {
           failure_type = errno == EIO ? kEioFailure : kFwriteFailure;
-          PLOG(ERROR) << "Failed to write " << BLOCKSIZE << " bytes of data";
+          PLOG(ERROR) << "Failed to write " << to_write << " bytes of data";
           return -1;
         }
       }
@@ -1391,9 +1458,21 @@ static int PerformCommandDiff(CommandParameters& params) {
   if (params.canwrite) {
     if (status == 0) {
       LOG(INFO) << "patching " << blocks << " blocks to " << tgt.blocks();
-      Value patch_value(
-          Value::Type::BLOB,
-          std::string(reinterpret_cast<const char*>(params.patch_start + offset), len));
+      const uint8_t* patch_data = params.updater->GetPackageData(params.patch_offset + offset, len);
+      if (patch_data == nullptr) {
+        LOG(ERROR) << "failed to read " << len << " bytes of patch at " << offset;
+        return -1;
+      }
+      Value patch_value(Value::Type::BLOB,
+                        std::string(reinterpret_cast<const char*>(patch_data), len));
+      MemoryBudget& budget = MemoryBudget::Get();
+      budget.SetUsage(MemoryConsumer::kPatchData, len);
+      auto patch_usage_guard = android::base::make_scope_guard(
+          [&budget] { budget.SetUsage(MemoryConsumer::kPatchData, 0); });
+      // The patch has been copied out, so its pages in the mapped package aren't needed anymore.
+      if (budget.degraded() || len > budget.Budget(MemoryConsumer::kPatchData)) {
+        params.updater->ReleasePackageData(params.patch_offset + offset, len);
+      }
 
       RangeSinkWriter writer(params.fd, tgt);
       if (params.cmdname[0] == 'i') {  // imgdiff
@@ -1465,6 +1544,11 @@ static int PerformCommandErase(CommandParameters& params) {
   if (params.canwrite) {
     LOG(INFO) << " erasing " << tgt.blocks() << " blocks";
 
+    if (params.discards) {
+      params.discards->Add(tgt);
+      return 0;
+    }
+
     for (const auto& [begin, end] : tgt) {
       off64_t offset = static_cast<off64_t>(begin) * BLOCKSIZE;
       size_t size = (end - begin) * BLOCKSIZE;
@@ -1477,6 +1561,32 @@ static int PerformCommandErase(CommandParameters& params) {
   return 0;
 }
 
+// Waits for the queued discards that overlap with the blocks the given command reads or writes.
+static bool WaitForPendingDiscards(const CommandParameters& params, const std::string& line,
+                                   size_t cmdindex) {
+  if (!params.discards || !params.discards->busy()) {
+    return true;
+  }
+
+  std::string err;
+  Command command = Command::Parse(line, cmdindex, &err);
+  if (!command) {
+    // Let the command report the parsing error itself, after all the discards are done.
+    return params.discards->Finish();
+  }
+
+  const HashTreeInfo& hash_tree_info = command.hash_tree_info();
+  for (const RangeSet* blocks :
+       { &command.target().ranges(), &command.source().ranges(), &command.stash().ranges(),
+         &hash_tree_info.hash_tree_ranges(), &hash_tree_info.source_ranges() }) {
+    if (*blocks && !params.discards->Barrier(*blocks)) {
+      LOG(ERROR) << "failed to discard the erased blocks before [" << line << "]";
+      return false;
+    }
+  }
+  return true;
+}
+
 static int PerformCommandAbort(CommandParameters&) {
   LOG(INFO) << "Aborting as instructed";
   return -1;
@@ -1623,8 +1733,54 @@ static bool Sha1DevicePath(const std::string& path, uint8_t digest[SHA_DIGEST_LE
   return true;
 }
 
-static Value* PerformBlockImageUpdate(const char* name, State* state,
-                                      const std::vector<std::unique_ptr<Expr>>& argv,
+// Size of the scratch file that the storage benchmark runs against.
+static constexpr uint64_t kBenchmarkScratchSize = 4 * 1024 * 1024;
+
+// Benchmarks the storage that holds the stash (normally /cache) before the first partition update
+// of the install, and tunes the I/O parameters to it. The results are logged to last_install.
+static void TuneIoParameters(UpdaterInterface* updater) {
+  static bool tuned = false;
+  if (tuned) {
+    return;
+  }
+  tuned = true;
+
+  std::string scratch = Paths::Get().stash_directory_base() + "/io_benchmark";
+  auto device = FileStorageDevice::Create(scratch, kBenchmarkScratchSize);
+  BenchmarkConfig config;
+  StorageProfile profile;
+  if (!device || !BenchmarkStorage(device.get(), config, &profile)) {
+    LOG(WARNING) << "Storage benchmark failed; keeping the default I/O parameters";
+    return;
+  }
+  device.reset();
+
+  IoParameters parameters = ChooseIoParameters(profile);
+  IoTuning::Get().set_parameters(parameters);
+  LOG(INFO) << "Storage profile: " << profile;
+  LOG(INFO) << "I/O parameters: " << parameters;
+
+  auto kbps = [&profile](bool write, bool sequential) {
+    return static_cast<uint64_t>(profile.BestThroughput(write, sequential) / 1024);
+  };
+  std::vector<std::string> lines{
+    android::base::StringPrintf("storage_seq_read_kbps: %" PRIu64, kbps(false, true)),
+    android::base::StringPrintf("storage_seq_write_kbps: %" PRIu64, kbps(true, true)),
+    android::base::StringPrintf("storage_rand_read_kbps: %" PRIu64, kbps(false, false)),
+    android::base::StringPrintf("storage_rand_write_kbps: %" PRIu64, kbps(true, false)),
+    android::base::StringPrintf(
+        "storage_sync_us: %" PRId64,
+        static_cast<int64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(profile.sync_latency).count())),
+    android::base::StringPrintf("io_read_chunk_bytes: %zu", parameters.read_chunk_size),
+    android::base::StringPrintf("io_write_chunk_bytes: %zu", parameters.write_chunk_size),
+  };
+  for (size_t i = 0; i < lines.size(); i++) {
+    updater->WriteToCommandPipe("log " + lines[i], i + 1 == lines.size());
+  }
+}
+
+static Value* PerformBlockImageUpdate(const char* name, State* state, const ExprArgs& argv,
                                       const CommandMap& command_map, bool dryrun) {
   CommandParameters params{};
   stash_map.clear();
@@ -1692,7 +1848,8 @@ static Value* PerformBlockImageUpdate(const char* name, State* state,
     LOG(ERROR) << name << "(): no file \"" << patch_data_fn->data << "\" in package";
     return StringValue("");
   }
-  params.patch_start = updater->GetMappedPackageAddress() + patch_entry.offset;
+  params.updater = updater;
+  params.patch_offset = patch_entry.offset;
 
   std::string_view new_data(new_data_fn->data);
   ZipEntry64 new_entry;
@@ -1714,6 +1871,22 @@ static Value* PerformBlockImageUpdate(const char* name, State* state,
   }
   params.stashbase = print_sha1(digest);
 
+  if (params.canwrite) {
+    TuneIoParameters(updater);
+  }
+
+  if (params.canwrite && !DEBUG_ERASE) {
+    // The erased blocks don't carry any data that the update depends on, so the discards can run
+    // in the background until a later command touches the same blocks. If the update gets
+    // interrupted, the last command file may already cover an erase whose discard never reached
+    // the device; that only leaves stale data in unused blocks.
+    int fd = params.fd.get();
+    params.discards = std::make_unique<DiscardQueue>(
+        BLOCKSIZE, [fd](uint64_t offset, uint64_t size) {
+          return discard_blocks(fd, static_cast<off64_t>(offset), size, true /* force */);
+        });
+  }
+
   // Possibly do return early on retry, by checking the marker. If the update on this partition has
   // been finished (but interrupted at a later point), there could be leftover on /cache that would
   // fail the no-op retry.
@@ -1858,6 +2031,10 @@ static Value* PerformBlockImageUpdate(const char* name, State* state,
       continue;
     }
 
+    if (cmd_type != Command::Type::ERASE && !WaitForPendingDiscards(params, line, cmdindex)) {
+      goto pbiudone;
+    }
+
     if (performer(params) == -1) {
       LOG(ERROR) << "failed to execute command [" << line << "]";
       if (cmd_type == Command::Type::COMPUTE_HASH_TREE && failure_type == kNoCause) {
@@ -1866,6 +2043,8 @@ static Value* PerformBlockImageUpdate(const char* name, State* state,
       goto pbiudone;
     }
 
+    TrimBuffer(params);
+
     // In verify mode, check if the commands before the saved last_command_index have been executed
     // correctly. If some target blocks have unexpected contents, delete the last command file so
     // that we will resume the update from the first command in the transfer list.
@@ -1899,9 +2078,15 @@ static Value* PerformBlockImageUpdate(const char* name, State* state,
     }
   }
 
+  if (params.discards && !params.discards->Finish()) {
+    LOG(ERROR) << "failed to discard the erased blocks";
+    goto pbiudone;
+  }
+
   rc = 0;
 
 pbiudone:
+  MemoryBudget::Get().SetUsage(MemoryConsumer::kTransferBuffer, 0);
   if (params.canwrite) {
     pthread_mutex_lock(&params.nti.mu);
     if (params.nti.receiver_available) {
@@ -1918,7 +2103,7 @@ pbiudone:
     if (rc == 0) {
       LOG(INFO) << "wrote " << params.written << " blocks; expected " << total_blocks;
       LOG(INFO) << "stashed " << params.stashed << " blocks";
-      LOG(INFO) << "max alloc needed was " << params.buffer.size();
+      LOG(INFO) << "max alloc needed was " << params.maxalloc;
 
       const char* partition = strrchr(block_device_path.c_str(), '/');
       if (partition != nullptr && *(partition + 1) != 0) {
@@ -2021,8 +2206,7 @@ pbiudone:
  * additional hashes before the range parameters, which are used to check if the command has already
  * been completed and verify the integrity of the source data.
  */
-Value* BlockImageVerifyFn(const char* name, State* state,
-                          const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* BlockImageVerifyFn(const char* name, State* state, const ExprArgs& argv) {
   // Commands which are not allowed are set to nullptr to skip them completely.
   const CommandMap command_map{
     // clang-format off
@@ -2044,8 +2228,7 @@ Value* BlockImageVerifyFn(const char* name, State* state,
   return PerformBlockImageUpdate(name, state, argv, command_map, true);
 }
 
-Value* BlockImageUpdateFn(const char* name, State* state,
-                          const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* BlockImageUpdateFn(const char* name, State* state, const ExprArgs& argv) {
   const CommandMap command_map{
     // clang-format off
     { Command::Type::ABORT,             PerformCommandAbort },
@@ -2065,7 +2248,7 @@ Value* BlockImageUpdateFn(const char* name, State* state,
   return PerformBlockImageUpdate(name, state, argv, command_map, false);
 }
 
-Value* RangeSha1Fn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* RangeSha1Fn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 2) {
     ErrorAbort(state, kArgsParsingFailure, "range_sha1 expects 2 arguments, got %zu", argv.size());
     return StringValue("");
@@ -2139,8 +2322,7 @@ Value* RangeSha1Fn(const char* name, State* state, const std::vector<std::unique
 // 1st block of each partition and check for mounting time/count. It return string "t"
 // if executes successfully and an empty string otherwise.
 
-Value* CheckFirstBlockFn(const char* name, State* state,
-                         const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* CheckFirstBlockFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 1) {
     ErrorAbort(state, kArgsParsingFailure, "check_first_block expects 1 argument, got %zu",
                argv.size());
@@ -2204,8 +2386,7 @@ Value* CheckFirstBlockFn(const char* name, State* state,
   return StringValue("t");
 }
 
-Value* BlockImageRecoverFn(const char* name, State* state,
-                           const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* BlockImageRecoverFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 2) {
     ErrorAbort(state, kArgsParsingFailure, "block_image_recover expects 2 arguments, got %zu",
                argv.size());
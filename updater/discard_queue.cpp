@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "private/discard_queue.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <android-base/logging.h>
+
+DiscardQueue::DiscardQueue(size_t block_size, Discarder discarder, size_t batch_blocks)
+    : block_size_(block_size),
+      discarder_(std::move(discarder)),
+      batch_blocks_(batch_blocks),
+      worker_(&DiscardQueue::WorkerLoop, this) {}
+
+DiscardQueue::~DiscardQueue() {
+  Finish();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  worker_.join();
+}
+
+void DiscardQueue::Coalesce(std::vector<Range>* ranges) {
+  if (ranges->size() < 2) return;
+  std::sort(ranges->begin(), ranges->end());
+  auto out = ranges->begin();
+  for (auto it = ranges->begin() + 1; it != ranges->end(); ++it) {
+    if (it->first <= out->second) {
+      out->second = std::max(out->second, it->second);
+    } else {
+      *++out = *it;
+    }
+  }
+  ranges->erase(out + 1, ranges->end());
+}
+
+bool DiscardQueue::Overlaps(const std::vector<Range>& ranges, const RangeSet& blocks) {
+  // 'ranges' is coalesced (therefore sorted), so each block range needs a single lookup.
+  for (const auto& [begin, end] : blocks) {
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), begin,
+                               [](size_t block, const Range& r) { return block < r.second; });
+    if (it != ranges.end() && it->first < end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void DiscardQueue::Add(const RangeSet& blocks) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& range : blocks) {
+    queued_.push_back(range);
+    queued_blocks_ += range.second - range.first;
+  }
+  if (queued_blocks_ >= batch_blocks_) {
+    SubmitLocked();
+  }
+}
+
+bool DiscardQueue::Barrier(const RangeSet& blocks) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  Coalesce(&queued_);
+  if (Overlaps(queued_, blocks)) {
+    SubmitLocked();
+  }
+  if (Overlaps(submitted_, blocks)) {
+    barrier_waits_++;
+    cv_.wait(lock, [this, &blocks] { return !Overlaps(submitted_, blocks); });
+  }
+  return !failed_;
+}
+
+bool DiscardQueue::Finish() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  SubmitLocked();
+  cv_.wait(lock, [this] { return submitted_.empty(); });
+  return !failed_;
+}
+
+bool DiscardQueue::busy() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !queued_.empty() || !submitted_.empty();
+}
+
+size_t DiscardQueue::discards_issued() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return discards_issued_;
+}
+
+size_t DiscardQueue::barrier_waits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return barrier_waits_;
+}
+
+void DiscardQueue::SubmitLocked() {
+  if (queued_.empty()) return;
+  submitted_.insert(submitted_.end(), queued_.begin(), queued_.end());
+  Coalesce(&submitted_);
+  queued_.clear();
+  queued_blocks_ = 0;
+  cv_.notify_all();
+}
+
+void DiscardQueue::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stopping_ || !submitted_.empty(); });
+    if (submitted_.empty()) {
+      return;
+    }
+
+    // Keep the range in submitted_ while discarding it, so that Barrier() keeps waiting on it.
+    Range range = submitted_.front();
+    lock.unlock();
+    bool success = discarder_(static_cast<uint64_t>(range.first) * block_size_,
+                              static_cast<uint64_t>(range.second - range.first) * block_size_);
+    lock.lock();
+
+    discards_issued_++;
+    if (!success) {
+      LOG(ERROR) << "Failed to discard blocks [" << range.first << ", " << range.second << ")";
+      failed_ = true;
+    }
+    // Other ranges may have been merged in meanwhile; drop only the blocks we've just discarded.
+    std::vector<Range> remaining;
+    for (const auto& r : submitted_) {
+      if (r.second <= range.first || r.first >= range.second) {
+        remaining.push_back(r);
+        continue;
+      }
+      if (r.first < range.first) remaining.emplace_back(r.first, range.first);
+      if (r.second > range.second) remaining.emplace_back(range.second, r.second);
+    }
+    submitted_ = std::move(remaining);
+    cv_.notify_all();
+  }
+}
@@ -33,8 +33,7 @@
 #include "otautil/paths.h"
 #include "private/utils.h"
 
-static std::vector<std::string> ReadStringArgs(const char* name, State* state,
-                                               const std::vector<std::unique_ptr<Expr>>& argv,
+static std::vector<std::string> ReadStringArgs(const char* name, State* state, const ExprArgs& argv,
                                                const std::vector<std::string>& arg_names) {
   if (argv.size() != arg_names.size()) {
     ErrorAbort(state, kArgsParsingFailure, "%s expects %zu arguments, got %zu", name,
@@ -63,8 +62,7 @@ static std::vector<std::string> ReadStringArgs(const char* name, State* state,
   return ret;
 }
 
-Value* UnmapPartitionFn(const char* name, State* state,
-                        const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* UnmapPartitionFn(const char* name, State* state, const ExprArgs& argv) {
   auto args = ReadStringArgs(name, state, argv, { "name" });
   if (args.empty()) return StringValue("");
 
@@ -73,8 +71,7 @@ Value* UnmapPartitionFn(const char* name, State* state,
                                                                 : StringValue("");
 }
 
-Value* MapPartitionFn(const char* name, State* state,
-                      const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* MapPartitionFn(const char* name, State* state, const ExprArgs& argv) {
   auto args = ReadStringArgs(name, state, argv, { "name" });
   if (args.empty()) return StringValue("");
 
@@ -86,8 +83,7 @@ Value* MapPartitionFn(const char* name, State* state,
 
 static constexpr char kMetadataUpdatedMarker[] = "/dynamic_partition_metadata.UPDATED";
 
-Value* UpdateDynamicPartitionsFn(const char* name, State* state,
-                                 const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* UpdateDynamicPartitionsFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 1) {
     ErrorAbort(state, kArgsParsingFailure, "%s expects 1 arguments, got %zu", name, argv.size());
     return StringValue("");
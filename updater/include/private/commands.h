@@ -135,6 +135,21 @@ class SourceInfo {
     return hash_;
   }
 
+  // The source blocks read from the block device, excluding the stashed ones.
+  const RangeSet& ranges() const {
+    return ranges_;
+  }
+
+  // Where the blocks in ranges() go in the loaded source buffer. Empty if they fill the buffer in
+  // order.
+  const RangeSet& location() const {
+    return location_;
+  }
+
+  const std::vector<StashInfo>& stashes() const {
+    return stashes_;
+  }
+
   size_t blocks() const {
     return blocks_;
   }
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "otautil/rangeset.h"
+
+// Queues block ranges to be discarded, and issues the discards from a background thread so that
+// the caller doesn't wait on the device for every range. Queued ranges are coalesced, so adjacent
+// ranges from consecutive erase commands end up in a single discard call.
+//
+// The caller must call Barrier() with the blocks a later command is going to read or write, which
+// waits for any overlapping discard to complete first. Discards for disjoint blocks keep running in
+// the background.
+class DiscardQueue {
+ public:
+  // Discards 'size' bytes at 'offset'. Returns false on failure.
+  using Discarder = std::function<bool(uint64_t offset, uint64_t size)>;
+
+  // The number of queued blocks that triggers handing a batch to the worker thread.
+  static constexpr size_t kDefaultBatchBlocks = 32768;
+
+  DiscardQueue(size_t block_size, Discarder discarder,
+               size_t batch_blocks = kDefaultBatchBlocks);
+
+  // Waits for all the queued discards to finish.
+  ~DiscardQueue();
+
+  DiscardQueue(const DiscardQueue&) = delete;
+  DiscardQueue& operator=(const DiscardQueue&) = delete;
+
+  // Queues the given blocks for discard.
+  void Add(const RangeSet& blocks);
+
+  // Waits until none of the given blocks is pending discard. Returns false if any discard has
+  // failed so far.
+  bool Barrier(const RangeSet& blocks);
+
+  // Issues all the queued discards and waits for them to finish. Returns false if any of them has
+  // failed.
+  bool Finish();
+
+  // Returns whether there are discards that haven't completed yet.
+  bool busy() const;
+
+  // The number of discard calls issued so far.
+  size_t discards_issued() const;
+
+  // The number of times Barrier() had to wait for the worker thread.
+  size_t barrier_waits() const;
+
+ private:
+  // Coalesces 'ranges' in place, so that they're sorted and no two of them overlap or touch.
+  static void Coalesce(std::vector<Range>* ranges);
+
+  static bool Overlaps(const std::vector<Range>& ranges, const RangeSet& blocks);
+
+  // Hands the queued ranges to the worker thread. Requires mutex_ held.
+  void SubmitLocked();
+
+  void WorkerLoop();
+
+  const size_t block_size_;
+  const Discarder discarder_;
+  const size_t batch_blocks_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+
+  // Ranges queued by Add() but not handed to the worker yet.
+  std::vector<Range> queued_;
+  size_t queued_blocks_{ 0 };
+  // Ranges handed to the worker, including the ones it's discarding right now.
+  std::vector<Range> submitted_;
+
+  bool failed_{ false };
+  bool stopping_{ false };
+  size_t discards_issued_{ 0 };
+  size_t barrier_waits_{ 0 };
+
+  std::thread worker_;
+};
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "private/commands.h"
+
+// The costs of executing a transfer list in a given order.
+struct TransferListStats {
+  // Peak number of blocks held in the stash, including the blocks stashed temporarily by commands
+  // whose source and target overlap. This is what goes into the transfer list header.
+  size_t stash_max_blocks{ 0 };
+  // Peak number of stash entries alive at the same time.
+  size_t stash_max_entries{ 0 };
+  // Total number of blocks written to the stash by the stash commands.
+  size_t stashed_blocks{ 0 };
+  // Total distance, in blocks, that the device offset moves between consecutive range accesses.
+  uint64_t seek_blocks{ 0 };
+
+  bool operator<(const TransferListStats& other) const;
+};
+
+std::ostream& operator<<(std::ostream& os, const TransferListStats& stats);
+
+// Computes the stats of executing the given commands in order.
+TransferListStats ComputeTransferListStats(const std::vector<Command>& commands);
+
+// Rewrites the commands in 'transfer_list' into an order that respects all the block and stash
+// dependencies between them, preferring orders that keep fewer blocks stashed for shorter and move
+// less between source and target ranges. Stashes whose blocks stay intact until their last use in
+// the new order are dropped, and their consumers read the blocks from the partition instead. The
+// original order is kept if the rewrite doesn't improve on it. Returns false on error, with the
+// details in 'err'.
+bool OptimizeTransferList(const TransferList& transfer_list, std::vector<Command>* commands,
+                          std::string* err);
+
+// Replays both command sequences on a model of the partition that tracks where each block's data
+// comes from, and returns whether every move/bsdiff/imgdiff command loads the same source data and
+// the partition ends up with the same contents. Sets 'err' on mismatch.
+bool CheckTransferListsEquivalent(const std::vector<Command>& expected,
+                                  const std::vector<Command>& actual, std::string* err);
+
+// Returns the text of a transfer list with the given commands, and the header from 'transfer_list'
+// with the stash limits recomputed for the new commands.
+std::string FormatTransferList(const TransferList& transfer_list,
+                               const std::vector<Command>& commands);
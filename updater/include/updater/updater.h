@@ -37,7 +37,8 @@ class Updater : public UpdaterInterface {
 
   ~Updater() override;
 
-  // Memory-maps the OTA package and opens it as a zip file. Also sets up the command pipe and
+  // Memory-maps the OTA package and opens it as a zip file. A package over the MappingLimits is
+  // mapped a window at a time instead. Also sets up the command pipe and
   // UpdaterRuntime.
   bool Init(int fd, const std::string_view package_filename, bool is_retry);
 
@@ -62,12 +63,9 @@ class Updater : public UpdaterInterface {
   std::string GetResult() const override {
     return result_;
   }
-  uint8_t* GetMappedPackageAddress() const override {
-    return mapped_package_.addr;
-  }
-  size_t GetMappedPackageLength() const override {
-    return mapped_package_.length;
-  }
+  const uint8_t* GetPackageData(uint64_t offset, size_t size) const override;
+  uint64_t GetPackageLength() const override;
+  void ReleasePackageData(uint64_t offset, size_t size) const override;
 
  private:
   friend class UpdaterTestBase;
@@ -85,6 +83,10 @@ class Updater : public UpdaterInterface {
   std::unique_ptr<UpdaterRuntimeInterface> runtime_;
 
   MemMapping mapped_package_;
+  // Holds the package instead of |mapped_package_| when it's over the limits. Accessing a window
+  // updates the cache, hence mutable.
+  mutable MappedWindows package_windows_;
+  bool windowed_package_{ false };
   ZipArchiveHandle package_handle_{ nullptr };
   std::string updater_script_;
 
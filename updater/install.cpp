@@ -82,7 +82,7 @@ static bool UpdateBlockDeviceNameForPartition(UpdaterInterface* updater, Partiti
 
 // This is the updater side handler for ui_print() in edify script. Contents will be sent over to
 // the recovery side for on-screen display.
-Value* UIPrintFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* UIPrintFn(const char* name, State* state, const ExprArgs& argv) {
   std::vector<std::string> args;
   if (!ReadArgs(state, argv, &args)) {
     return ErrorAbort(state, kArgsParsingFailure, "%s(): Failed to parse the argument(s)", name);
@@ -97,8 +97,7 @@ Value* UIPrintFn(const char* name, State* state, const std::vector<std::unique_p
 //   Extracts a single package_file from the update package and writes it to dest_file,
 //   overwriting existing files if necessary. Without the dest_file argument, returns the
 //   contents of the package file as a binary blob.
-Value* PackageExtractFileFn(const char* name, State* state,
-                            const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* PackageExtractFileFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() < 1 || argv.size() > 2) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 1 or 2 args, got %zu", name,
                       argv.size());
@@ -200,8 +199,7 @@ Value* PackageExtractFileFn(const char* name, State* state,
 // For example, patch_partition_check(
 //     "EMMC:/dev/block/boot:12342568:8aaacf187a6929d0e9c3e9e46ea7ff495b43424d",
 //     "EMMC:/dev/block/boot:12363048:06b0b16299dcefc94900efed01e0763ff644ffa4")
-Value* PatchPartitionCheckFn(const char* name, State* state,
-                             const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* PatchPartitionCheckFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 2) {
     return ErrorAbort(state, kArgsParsingFailure,
                       "%s(): Invalid number of args (expected 2, got %zu)", name, argv.size());
@@ -241,8 +239,7 @@ Value* PatchPartitionCheckFn(const char* name, State* state,
 //     "EMMC:/dev/block/boot:12342568:8aaacf187a6929d0e9c3e9e46ea7ff495b43424d",
 //     "EMMC:/dev/block/boot:12363048:06b0b16299dcefc94900efed01e0763ff644ffa4",
 //     package_extract_file("boot.img.p"))
-Value* PatchPartitionFn(const char* name, State* state,
-                        const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* PatchPartitionFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 3) {
     return ErrorAbort(state, kArgsParsingFailure,
                       "%s(): Invalid number of args (expected 3, got %zu)", name, argv.size());
@@ -284,7 +281,7 @@ Value* PatchPartitionFn(const char* name, State* state,
 // mount(fs_type, partition_type, location, mount_point, mount_options)
 
 //    fs_type="ext4"   partition_type="EMMC"    location=device
-Value* MountFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* MountFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 4 && argv.size() != 5) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 4-5 args, got %zu", name,
                       argv.size());
@@ -331,7 +328,7 @@ Value* MountFn(const char* name, State* state, const std::vector<std::unique_ptr
 }
 
 // is_mounted(mount_point)
-Value* IsMountedFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* IsMountedFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 1) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 1 arg, got %zu", name, argv.size());
   }
@@ -354,7 +351,7 @@ Value* IsMountedFn(const char* name, State* state, const std::vector<std::unique
   return StringValue(mount_point);
 }
 
-Value* UnmountFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* UnmountFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 1) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 1 arg, got %zu", name, argv.size());
   }
@@ -389,7 +386,7 @@ Value* UnmountFn(const char* name, State* state, const std::vector<std::unique_p
 //    if fs_size == 0, then make fs uses the entire partition.
 //    if fs_size > 0, that is the size to use
 //    if fs_size < 0, then reserve that many bytes at the end of the partition (not for "f2fs")
-Value* FormatFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* FormatFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 5) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 5 args, got %zu", name,
                       argv.size());
@@ -480,8 +477,7 @@ Value* FormatFn(const char* name, State* state, const std::vector<std::unique_pt
   return nullptr;
 }
 
-Value* ShowProgressFn(const char* name, State* state,
-                      const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* ShowProgressFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 2) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 2 args, got %zu", name,
                       argv.size());
@@ -510,8 +506,7 @@ Value* ShowProgressFn(const char* name, State* state,
   return StringValue(frac_str);
 }
 
-Value* SetProgressFn(const char* name, State* state,
-                     const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* SetProgressFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 1) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 1 arg, got %zu", name, argv.size());
   }
@@ -533,7 +528,7 @@ Value* SetProgressFn(const char* name, State* state,
   return StringValue(frac_str);
 }
 
-Value* GetPropFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* GetPropFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 1) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 1 arg, got %zu", name, argv.size());
   }
@@ -553,8 +548,7 @@ Value* GetPropFn(const char* name, State* state, const std::vector<std::unique_p
 //   interprets 'file' as a getprop-style file (key=value pairs, one
 //   per line. # comment lines, blank lines, lines without '=' ignored),
 //   and returns the value for 'key' (or "" if it isn't defined).
-Value* FileGetPropFn(const char* name, State* state,
-                     const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* FileGetPropFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 2) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 2 args, got %zu", name,
                       argv.size());
@@ -600,8 +594,7 @@ Value* FileGetPropFn(const char* name, State* state,
 }
 
 // apply_patch_space(bytes)
-Value* ApplyPatchSpaceFn(const char* name, State* state,
-                         const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* ApplyPatchSpaceFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 1) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 1 args, got %zu", name,
                       argv.size());
@@ -625,7 +618,7 @@ Value* ApplyPatchSpaceFn(const char* name, State* state,
   return StringValue("");
 }
 
-Value* WipeCacheFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* WipeCacheFn(const char* name, State* state, const ExprArgs& argv) {
   if (!argv.empty()) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects no args, got %zu", name,
                       argv.size());
@@ -635,7 +628,7 @@ Value* WipeCacheFn(const char* name, State* state, const std::vector<std::unique
   return StringValue("t");
 }
 
-Value* RunProgramFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* RunProgramFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() < 1) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects at least 1 arg", name);
   }
@@ -652,7 +645,7 @@ Value* RunProgramFn(const char* name, State* state, const std::vector<std::uniqu
 
 // read_file(filename)
 //   Reads a local file 'filename' and returns its contents as a string Value.
-Value* ReadFileFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* ReadFileFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 1) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 1 arg, got %zu", name, argv.size());
   }
@@ -677,7 +670,7 @@ Value* ReadFileFn(const char* name, State* state, const std::vector<std::unique_
 // write_value(value, filename)
 //   Writes 'value' to 'filename'.
 //   Example: write_value("960000", "/sys/devices/system/cpu/cpu0/cpufreq/scaling_max_freq")
-Value* WriteValueFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* WriteValueFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 2) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 2 args, got %zu", name,
                       argv.size());
@@ -711,7 +704,7 @@ Value* WriteValueFn(const char* name, State* state, const std::vector<std::uniqu
 // property.  It can be "recovery" to boot from the recovery
 // partition, or "" (empty string) to boot from the regular boot
 // partition.
-Value* RebootNowFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* RebootNowFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 2) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 2 args, got %zu", name,
                       argv.size());
@@ -727,12 +720,13 @@ Value* RebootNowFn(const char* name, State* state, const std::vector<std::unique
   // Zero out the 'command' field of the bootloader message. Leave the rest intact.
   bootloader_message boot;
   std::string err;
-  if (!read_bootloader_message_from(&boot, filename, &err)) {
+  auto misc = MiscPartition::Open(filename, true, &err);
+  if (!misc || !misc->ReadBootloaderMessage(&boot, &err)) {
     LOG(ERROR) << name << "(): Failed to read from \"" << filename << "\": " << err;
     return StringValue("");
   }
   memset(boot.command, 0, sizeof(boot.command));
-  if (!write_bootloader_message_to(boot, filename, &err)) {
+  if (!misc->WriteBootloaderMessage(boot, &err) || !misc->Commit(&err)) {
     LOG(ERROR) << name << "(): Failed to write to \"" << filename << "\": " << err;
     return StringValue("");
   }
@@ -752,7 +746,7 @@ Value* RebootNowFn(const char* name, State* state, const std::vector<std::unique
 // ("/misc" in the fstab), which is where this value is stored.  The
 // second argument is the string to store; it should not exceed 31
 // bytes.
-Value* SetStageFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* SetStageFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 2) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 2 args, got %zu", name,
                       argv.size());
@@ -771,12 +765,13 @@ Value* SetStageFn(const char* name, State* state, const std::vector<std::unique_
   // package installation.
   bootloader_message boot;
   std::string err;
-  if (!read_bootloader_message_from(&boot, filename, &err)) {
+  auto misc = MiscPartition::Open(filename, true, &err);
+  if (!misc || !misc->ReadBootloaderMessage(&boot, &err)) {
     LOG(ERROR) << name << "(): Failed to read from \"" << filename << "\": " << err;
     return StringValue("");
   }
   strlcpy(boot.stage, stagestr.c_str(), sizeof(boot.stage));
-  if (!write_bootloader_message_to(boot, filename, &err)) {
+  if (!misc->WriteBootloaderMessage(boot, &err) || !misc->Commit(&err)) {
     LOG(ERROR) << name << "(): Failed to write to \"" << filename << "\": " << err;
     return StringValue("");
   }
@@ -786,7 +781,7 @@ Value* SetStageFn(const char* name, State* state, const std::vector<std::unique_
 
 // Return the value most recently saved with SetStageFn.  The argument
 // is the block device for the misc partition.
-Value* GetStageFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* GetStageFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 1) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 1 arg, got %zu", name, argv.size());
   }
@@ -807,7 +802,7 @@ Value* GetStageFn(const char* name, State* state, const std::vector<std::unique_
   return StringValue(boot.stage);
 }
 
-Value* WipeBlockDeviceFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* WipeBlockDeviceFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 2) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 2 args, got %zu", name,
                       argv.size());
@@ -830,7 +825,7 @@ Value* WipeBlockDeviceFn(const char* name, State* state, const std::vector<std::
   return StringValue(status == 0 ? "t" : "");
 }
 
-Value* EnableRebootFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* EnableRebootFn(const char* name, State* state, const ExprArgs& argv) {
   if (!argv.empty()) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects no args, got %zu", name,
                       argv.size());
@@ -839,7 +834,7 @@ Value* EnableRebootFn(const char* name, State* state, const std::vector<std::uni
   return StringValue("t");
 }
 
-Value* Tune2FsFn(const char* name, State* state, const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* Tune2FsFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.empty()) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects args, got %zu", name, argv.size());
   }
@@ -858,8 +853,7 @@ Value* Tune2FsFn(const char* name, State* state, const std::vector<std::unique_p
   return StringValue("t");
 }
 
-Value* AddSlotSuffixFn(const char* name, State* state,
-                       const std::vector<std::unique_ptr<Expr>>& argv) {
+Value* AddSlotSuffixFn(const char* name, State* state, const ExprArgs& argv) {
   if (argv.size() != 1) {
     return ErrorAbort(state, kArgsParsingFailure, "%s() expects 1 arg, got %zu", name, argv.size());
   }
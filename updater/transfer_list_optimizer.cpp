@@ -0,0 +1,753 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "updater/transfer_list_optimizer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include "otautil/rangeset.h"
+#include "private/commands.h"
+
+using namespace std::string_literals;
+
+bool TransferListStats::operator<(const TransferListStats& other) const {
+  return std::tie(stash_max_blocks, stashed_blocks, seek_blocks) <
+         std::tie(other.stash_max_blocks, other.stashed_blocks, other.seek_blocks);
+}
+
+std::ostream& operator<<(std::ostream& os, const TransferListStats& stats) {
+  os << "stash_max_blocks " << stats.stash_max_blocks << ", stash_max_entries "
+     << stats.stash_max_entries << ", stashed_blocks " << stats.stashed_blocks << ", seek_blocks "
+     << stats.seek_blocks;
+  return os;
+}
+
+static bool ReadsSource(const Command& command) {
+  return command.type() == Command::Type::MOVE || command.type() == Command::Type::BSDIFF ||
+         command.type() == Command::Type::IMGDIFF;
+}
+
+// Returns the block numbers in the given RangeSet, in order.
+static std::vector<size_t> ExpandBlocks(const RangeSet& ranges) {
+  std::vector<size_t> result;
+  result.reserve(ranges.blocks());
+  for (const auto& [begin, end] : ranges) {
+    for (size_t block = begin; block < end; block++) {
+      result.push_back(block);
+    }
+  }
+  return result;
+}
+
+// Returns the partition blocks that the given command reads.
+static std::vector<const RangeSet*> ReadRanges(const Command& command) {
+  std::vector<const RangeSet*> result;
+  if (ReadsSource(command)) {
+    result.push_back(&command.source().ranges());
+  } else if (command.type() == Command::Type::STASH) {
+    result.push_back(&command.stash().ranges());
+  } else if (command.type() == Command::Type::COMPUTE_HASH_TREE) {
+    result.push_back(&command.hash_tree_info().source_ranges());
+  }
+  result.erase(std::remove_if(result.begin(), result.end(),
+                              [](const RangeSet* ranges) { return !*ranges; }),
+               result.end());
+  return result;
+}
+
+// Returns the partition blocks that the given command writes, or nullptr if it writes none.
+static const RangeSet* WriteRanges(const Command& command) {
+  switch (command.type()) {
+    case Command::Type::BSDIFF:
+    case Command::Type::ERASE:
+    case Command::Type::IMGDIFF:
+    case Command::Type::MOVE:
+    case Command::Type::NEW:
+    case Command::Type::ZERO:
+      return &command.target().ranges();
+    case Command::Type::COMPUTE_HASH_TREE:
+      return &command.hash_tree_info().hash_tree_ranges();
+    default:
+      return nullptr;
+  }
+}
+
+// Returns the first block the given command accesses, which is where the device offset goes when
+// the command starts.
+static size_t FirstBlock(const Command& command) {
+  auto reads = ReadRanges(command);
+  if (!reads.empty()) return (*reads[0])[0].first;
+  const RangeSet* writes = WriteRanges(command);
+  if (writes != nullptr && *writes) return (*writes)[0].first;
+  return 0;
+}
+
+TransferListStats ComputeTransferListStats(const std::vector<Command>& commands) {
+  TransferListStats stats;
+  std::map<std::string, size_t> live_stashes;
+  size_t live_blocks = 0;
+  size_t head = 0;
+
+  auto seek = [&stats, &head](const RangeSet& ranges) {
+    for (const auto& [begin, end] : ranges) {
+      stats.seek_blocks += begin > head ? begin - head : head - begin;
+      head = end;
+    }
+  };
+
+  for (const auto& command : commands) {
+    for (const RangeSet* ranges : ReadRanges(command)) {
+      seek(*ranges);
+    }
+    if (const RangeSet* ranges = WriteRanges(command); ranges != nullptr) {
+      seek(*ranges);
+    }
+
+    if (command.type() == Command::Type::STASH) {
+      // Stashing an existing id is a no-op for the executor.
+      if (live_stashes.emplace(command.stash().id(), command.stash().blocks()).second) {
+        live_blocks += command.stash().blocks();
+        stats.stashed_blocks += command.stash().blocks();
+      }
+    } else if (command.type() == Command::Type::FREE) {
+      if (auto it = live_stashes.find(command.stash().id()); it != live_stashes.end()) {
+        live_blocks -= it->second;
+        live_stashes.erase(it);
+      }
+    } else if (ReadsSource(command) &&
+               command.source().ranges().Overlaps(command.target().ranges())) {
+      // The executor stashes the whole overlapping source, including the blocks it loaded from
+      // stashes, for the duration of the command.
+      stats.stash_max_blocks =
+          std::max(stats.stash_max_blocks, live_blocks + command.source().blocks());
+    }
+    stats.stash_max_blocks = std::max(stats.stash_max_blocks, live_blocks);
+    stats.stash_max_entries = std::max(stats.stash_max_entries, live_stashes.size());
+  }
+  return stats;
+}
+
+namespace {
+
+// Tracks, for each partition block, the last command that wrote it and the commands that read it
+// since, to derive the ordering constraints between commands. Blocks are kept in segments that get
+// split as needed, since commands mostly access long ranges.
+class BlockAccessTracker {
+ public:
+  using EdgeFn = std::function<void(uint32_t from)>;
+
+  void Read(const RangeSet& ranges, uint32_t command, const EdgeFn& add_edge) {
+    for (const auto& [begin, end] : ranges) {
+      ForEachSegment(begin, end, [&](Segment& segment) {
+        if (segment.writer != kNone) add_edge(segment.writer);
+        if (segment.readers.empty() || segment.readers.back() != command) {
+          segment.readers.push_back(command);
+        }
+      });
+    }
+  }
+
+  void Write(const RangeSet& ranges, uint32_t command, const EdgeFn& add_edge) {
+    for (const auto& [begin, end] : ranges) {
+      ForEachSegment(begin, end, [&](Segment& segment) {
+        if (segment.writer != kNone) add_edge(segment.writer);
+        for (uint32_t reader : segment.readers) {
+          add_edge(reader);
+        }
+        segment.writer = command;
+        segment.readers.clear();
+      });
+    }
+  }
+
+ private:
+  static constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+
+  struct Segment {
+    size_t end;
+    uint32_t writer;
+    std::vector<uint32_t> readers;
+  };
+
+  // Makes sure that no segment spans across 'block'.
+  void SplitAt(size_t block) {
+    auto it = segments_.upper_bound(block);
+    if (it == segments_.begin()) return;
+    --it;
+    if (it->first < block && it->second.end > block) {
+      Segment tail = it->second;
+      it->second.end = block;
+      segments_.emplace(block, std::move(tail));
+    }
+  }
+
+  template <typename Fn>
+  void ForEachSegment(size_t begin, size_t end, Fn fn) {
+    SplitAt(begin);
+    SplitAt(end);
+    size_t current = begin;
+    auto it = segments_.lower_bound(begin);
+    while (current < end) {
+      if (it == segments_.end() || it->first > current) {
+        size_t gap_end = (it == segments_.end()) ? end : std::min(end, it->first);
+        it = segments_.emplace_hint(it, current, Segment{ gap_end, kNone, {} });
+      }
+      fn(it->second);
+      current = it->second.end;
+      ++it;
+    }
+  }
+
+  std::map<size_t, Segment> segments_;
+};
+
+// The dependency graph between the commands of a transfer list. An edge a -> b means that a must
+// be executed before b.
+struct DependencyGraph {
+  std::vector<std::vector<uint32_t>> successors;
+  std::vector<uint32_t> in_degree;
+};
+
+DependencyGraph BuildDependencyGraph(const std::vector<Command>& commands) {
+  DependencyGraph graph;
+  graph.successors.resize(commands.size());
+  graph.in_degree.resize(commands.size());
+
+  // last_edge_to[a] == b means that a -> b has been added already.
+  std::vector<uint32_t> last_edge_to(commands.size(), std::numeric_limits<uint32_t>::max());
+  uint32_t current = 0;
+  auto add_edge = [&](uint32_t from) {
+    if (from == current || last_edge_to[from] == current) return;
+    last_edge_to[from] = current;
+    graph.successors[from].push_back(current);
+    graph.in_degree[current]++;
+  };
+
+  BlockAccessTracker blocks;
+
+  // For each stash id, the last stash or free command, and the commands that loaded the stash
+  // since then.
+  struct StashState {
+    std::optional<uint32_t> last_update;
+    std::vector<uint32_t> loads;
+  };
+  std::unordered_map<std::string, StashState> stashes;
+
+  std::optional<uint32_t> last_new;
+  std::optional<uint32_t> last_abort;
+
+  for (current = 0; current < commands.size(); current++) {
+    const Command& command = commands[current];
+
+    for (const RangeSet* ranges : ReadRanges(command)) {
+      blocks.Read(*ranges, current, add_edge);
+    }
+    if (const RangeSet* ranges = WriteRanges(command); ranges != nullptr) {
+      blocks.Write(*ranges, current, add_edge);
+    }
+
+    if (command.type() == Command::Type::STASH || command.type() == Command::Type::FREE) {
+      auto& state = stashes[command.stash().id()];
+      if (state.last_update) add_edge(*state.last_update);
+      for (uint32_t load : state.loads) {
+        add_edge(load);
+      }
+      state.last_update = current;
+      state.loads.clear();
+    } else if (ReadsSource(command)) {
+      for (const auto& stash : command.source().stashes()) {
+        auto& state = stashes[stash.id()];
+        if (state.last_update) add_edge(*state.last_update);
+        state.loads.push_back(current);
+      }
+    }
+
+    // New data is streamed from the package in order.
+    if (command.type() == Command::Type::NEW) {
+      if (last_new) add_edge(*last_new);
+      last_new = current;
+    }
+
+    // Nothing moves across an abort.
+    if (last_abort) add_edge(*last_abort);
+    if (command.type() == Command::Type::ABORT) {
+      for (uint32_t i = 0; i < current; i++) {
+        add_edge(i);
+      }
+      last_abort = current;
+    }
+  }
+  return graph;
+}
+
+// Picks a topological order of the commands. Frees go out as soon as possible, and stashes as late
+// as possible, so that stashed data stays around for the shortest time; loads of stashes go ahead
+// of the other commands to unlock their frees. Within each class, the command that starts closest
+// to where the previous one ended goes next.
+std::vector<uint32_t> ScheduleCommands(const std::vector<Command>& commands,
+                                       DependencyGraph graph) {
+  enum Class { kLoadsStash, kOther, kStash, kNumClasses };
+  std::vector<uint32_t> ready_frees;
+  std::set<std::pair<size_t, uint32_t>> ready[kNumClasses];
+
+  auto make_ready = [&](uint32_t i) {
+    const Command& command = commands[i];
+    if (command.type() == Command::Type::FREE) {
+      ready_frees.push_back(i);
+    } else if (command.type() == Command::Type::STASH) {
+      ready[kStash].emplace(FirstBlock(command), i);
+    } else if (ReadsSource(command) && !command.source().stashes().empty()) {
+      ready[kLoadsStash].emplace(FirstBlock(command), i);
+    } else {
+      ready[kOther].emplace(FirstBlock(command), i);
+    }
+  };
+
+  for (uint32_t i = 0; i < commands.size(); i++) {
+    if (graph.in_degree[i] == 0) make_ready(i);
+  }
+
+  std::vector<uint32_t> order;
+  order.reserve(commands.size());
+  size_t head = 0;
+  while (order.size() < commands.size()) {
+    uint32_t next;
+    if (!ready_frees.empty()) {
+      next = ready_frees.back();
+      ready_frees.pop_back();
+    } else {
+      auto* candidates = std::find_if(std::begin(ready), std::end(ready),
+                                      [](const auto& set) { return !set.empty(); });
+      CHECK(candidates != std::end(ready)) << "cyclic dependencies in the transfer list";
+      // The closest start at or after the head, or the closest one before it.
+      auto it = candidates->lower_bound({ head, 0 });
+      if (it == candidates->end() ||
+          (it != candidates->begin() && head - std::prev(it)->first < it->first - head)) {
+        --it;
+      }
+      next = it->second;
+      candidates->erase(it);
+    }
+
+    order.push_back(next);
+    const Command& command = commands[next];
+    if (const RangeSet* ranges = WriteRanges(command); ranges != nullptr && *ranges) {
+      head = ranges->crbegin()->second;
+    } else if (auto reads = ReadRanges(command); !reads.empty()) {
+      head = reads.back()->crbegin()->second;
+    }
+
+    for (uint32_t successor : graph.successors[next]) {
+      if (--graph.in_degree[successor] == 0) make_ready(successor);
+    }
+  }
+  return order;
+}
+
+// Rewrites 'consumer' to read the blocks of the stash 'id' (whose contents were read from
+// 'stash_ranges') directly from the partition. Fails if that would read any block twice, or read
+// blocks that the command writes (which would make the executor stash them anyway).
+bool InlineStash(const Command& consumer, const std::string& id, const RangeSet& stash_ranges,
+                 Command* result) {
+  const SourceInfo& source = consumer.source();
+
+  // (position in the source buffer, partition block) for each block read from the partition.
+  std::vector<std::pair<size_t, size_t>> blocks;
+  auto add_blocks = [&blocks](const RangeSet& partition_blocks, const RangeSet& location) {
+    std::vector<size_t> positions = ExpandBlocks(location);
+    std::vector<size_t> numbers = ExpandBlocks(partition_blocks);
+    for (size_t i = 0; i < numbers.size(); i++) {
+      blocks.emplace_back(positions[i], numbers[i]);
+    }
+  };
+
+  if (source.ranges()) {
+    RangeSet in_order(std::vector<Range>{ { 0, source.ranges().blocks() } });
+    add_blocks(source.ranges(), source.location() ? source.location() : in_order);
+  }
+  std::vector<std::string> kept_stashes;
+  for (const auto& stash : source.stashes()) {
+    if (stash.id() == id) {
+      if (stash.blocks() != stash_ranges.blocks()) return false;
+      add_blocks(stash_ranges, stash.ranges());
+    } else {
+      kept_stashes.push_back(stash.id() + ":" + stash.ranges().ToString());
+    }
+  }
+
+  std::sort(blocks.begin(), blocks.end());
+  std::vector<size_t> partition_blocks;
+  for (const auto& [position, block] : blocks) {
+    partition_blocks.push_back(block);
+  }
+  std::sort(partition_blocks.begin(), partition_blocks.end());
+  if (std::adjacent_find(partition_blocks.begin(), partition_blocks.end()) !=
+      partition_blocks.end()) {
+    return false;
+  }
+
+  // Compress back into ranges, keeping the order of the positions.
+  std::vector<Range> src_ranges;
+  std::vector<Range> src_location;
+  for (const auto& [position, block] : blocks) {
+    if (!src_ranges.empty() && src_ranges.back().second == block &&
+        src_location.back().second == position) {
+      src_ranges.back().second++;
+      src_location.back().second++;
+      continue;
+    }
+    if (!src_ranges.empty() && src_ranges.back().second == block) {
+      src_ranges.back().second++;
+    } else {
+      src_ranges.emplace_back(block, block + 1);
+    }
+    if (!src_location.empty() && src_location.back().second == position) {
+      src_location.back().second++;
+    } else {
+      src_location.emplace_back(position, position + 1);
+    }
+  }
+  RangeSet new_ranges(std::move(src_ranges));
+  RangeSet new_location(std::move(src_location));
+  if (new_ranges.Overlaps(consumer.target().ranges())) {
+    return false;
+  }
+
+  // Keep everything up to <src_block_count>.
+  std::vector<std::string> tokens = android::base::Split(consumer.cmdline(), " ");
+  size_t prefix = consumer.type() == Command::Type::MOVE ? 4 : 7;
+  CHECK_GT(tokens.size(), prefix);
+  tokens.resize(prefix);
+  tokens.push_back(new_ranges.ToString());
+  bool contiguous = new_location.size() == 1 && new_location[0].first == 0 &&
+                    new_location[0].second == source.blocks();
+  if (!kept_stashes.empty() || !contiguous) {
+    tokens.push_back(new_location.ToString());
+    tokens.insert(tokens.end(), kept_stashes.begin(), kept_stashes.end());
+  }
+
+  std::string err;
+  *result = Command::Parse(android::base::Join(tokens, " "), consumer.index(), &err);
+  if (!*result) {
+    LOG(ERROR) << "Failed to rewrite [" << consumer.cmdline() << "]: " << err;
+    return false;
+  }
+  return true;
+}
+
+// Drops the stashes that are no longer needed in the given order, i.e. whose blocks aren't written
+// between the stash command and the last command loading it.
+void InlineStashes(std::vector<Command>* commands) {
+  struct StashUses {
+    size_t stashes = 0;
+    size_t frees = 0;
+    size_t stash_index;
+    size_t free_index;
+    std::vector<size_t> loads;
+  };
+  std::map<std::string, StashUses> uses;
+  for (size_t i = 0; i < commands->size(); i++) {
+    const Command& command = (*commands)[i];
+    if (command.type() == Command::Type::STASH) {
+      auto& use = uses[command.stash().id()];
+      use.stashes++;
+      use.stash_index = i;
+    } else if (command.type() == Command::Type::FREE) {
+      auto& use = uses[command.stash().id()];
+      use.frees++;
+      use.free_index = i;
+    } else if (ReadsSource(command)) {
+      for (const auto& stash : command.source().stashes()) {
+        auto& loads = uses[stash.id()].loads;
+        if (loads.empty() || loads.back() != i) loads.push_back(i);
+      }
+    }
+  }
+
+  std::vector<bool> dropped(commands->size(), false);
+  for (const auto& [id, use] : uses) {
+    if (use.stashes != 1 || use.frees != 1 || use.free_index < use.stash_index) continue;
+
+    const RangeSet& stash_ranges = (*commands)[use.stash_index].stash().ranges();
+    size_t last_load = use.loads.empty() ? use.stash_index : use.loads.back();
+    bool intact = true;
+    for (size_t i = use.stash_index + 1; i < last_load && intact; i++) {
+      const RangeSet* writes = WriteRanges((*commands)[i]);
+      intact = writes == nullptr || !writes->Overlaps(stash_ranges);
+    }
+    if (!intact) continue;
+
+    std::vector<Command> rewritten;
+    for (size_t load : use.loads) {
+      Command command;
+      if (!InlineStash((*commands)[load], id, stash_ranges, &command)) break;
+      rewritten.push_back(std::move(command));
+    }
+    if (rewritten.size() != use.loads.size()) continue;
+
+    for (size_t i = 0; i < use.loads.size(); i++) {
+      (*commands)[use.loads[i]] = std::move(rewritten[i]);
+    }
+    dropped[use.stash_index] = true;
+    dropped[use.free_index] = true;
+  }
+
+  std::vector<Command> result;
+  for (size_t i = 0; i < commands->size(); i++) {
+    if (!dropped[i]) result.push_back(std::move((*commands)[i]));
+  }
+  *commands = std::move(result);
+}
+
+// A model of the partition for CheckTransferListsEquivalent(), where each block holds a token that
+// identifies where its data came from, instead of the data itself.
+class SymbolicPartition {
+ public:
+  bool Execute(const Command& command, std::string* err) {
+    switch (command.type()) {
+      case Command::Type::MOVE:
+      case Command::Type::BSDIFF:
+      case Command::Type::IMGDIFF: {
+        std::vector<uint64_t> buffer;
+        if (!LoadSource(command.source(), &buffer, err)) return false;
+        uint64_t digest = Digest(buffer);
+        loads_.emplace_back(
+            android::base::StringPrintf("%d %s %zu", static_cast<int>(command.type()),
+                                        command.target().ranges().ToString().c_str(),
+                                        command.patch().offset()),
+            digest);
+        std::vector<size_t> target = ExpandBlocks(command.target().ranges());
+        for (size_t i = 0; i < target.size(); i++) {
+          uint64_t token = command.type() == Command::Type::MOVE
+                               ? buffer[i]
+                               : Mix(Mix(digest, command.patch().offset()), i);
+          Set(target[i], token);
+        }
+        return true;
+      }
+      case Command::Type::STASH: {
+        // The executor keeps the existing stash (with the same contents) if there's one.
+        if (stashes_.count(command.stash().id()) == 0) {
+          stashes_[command.stash().id()] = GetAll(command.stash().ranges());
+        }
+        return true;
+      }
+      case Command::Type::FREE:
+        stashes_.erase(command.stash().id());
+        return true;
+      case Command::Type::NEW:
+        for (const auto& [begin, end] : command.target().ranges()) {
+          for (size_t block = begin; block < end; block++) {
+            Set(block, Mix(kNewData, new_data_blocks_++));
+          }
+        }
+        return true;
+      case Command::Type::ZERO:
+      case Command::Type::ERASE:
+        for (const auto& [begin, end] : command.target().ranges()) {
+          for (size_t block = begin; block < end; block++) {
+            Set(block, command.type() == Command::Type::ZERO ? kZero : kErased);
+          }
+        }
+        return true;
+      case Command::Type::COMPUTE_HASH_TREE: {
+        const auto& info = command.hash_tree_info();
+        uint64_t digest = Digest(GetAll(info.source_ranges()));
+        std::vector<size_t> hash_tree = ExpandBlocks(info.hash_tree_ranges());
+        for (size_t i = 0; i < hash_tree.size(); i++) {
+          Set(hash_tree[i], Mix(digest, i));
+        }
+        return true;
+      }
+      case Command::Type::ABORT:
+        return true;
+      default:
+        *err = "unexpected command "s + command.cmdline();
+        return false;
+    }
+  }
+
+  // The loaded source digests, keyed by the command that loaded them.
+  std::vector<std::pair<std::string, uint64_t>> SortedLoads() const {
+    auto result = loads_;
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  uint64_t Get(size_t block) const {
+    return block < blocks_.size() ? blocks_[block] : Mix(kOriginal, block);
+  }
+
+  size_t size() const {
+    return blocks_.size();
+  }
+
+ private:
+  static constexpr uint64_t kOriginal = 1;
+  static constexpr uint64_t kNewData = 2;
+  static constexpr uint64_t kZero = 3;
+  static constexpr uint64_t kErased = 4;
+
+  static uint64_t Mix(uint64_t a, uint64_t b) {
+    // splitmix64 finalizer over the combined value.
+    uint64_t x = a * 0x9e3779b97f4a7c15ULL + b + 0x632be59bd9b4e019ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  static uint64_t Digest(const std::vector<uint64_t>& tokens) {
+    uint64_t digest = tokens.size();
+    for (uint64_t token : tokens) {
+      digest = Mix(digest, token);
+    }
+    return digest;
+  }
+
+  void Set(size_t block, uint64_t token) {
+    while (blocks_.size() <= block) {
+      blocks_.push_back(Mix(kOriginal, blocks_.size()));
+    }
+    blocks_[block] = token;
+  }
+
+  std::vector<uint64_t> GetAll(const RangeSet& ranges) const {
+    std::vector<uint64_t> result;
+    for (const auto& [begin, end] : ranges) {
+      for (size_t block = begin; block < end; block++) {
+        result.push_back(Get(block));
+      }
+    }
+    return result;
+  }
+
+  bool LoadSource(const SourceInfo& source, std::vector<uint64_t>* buffer, std::string* err) const {
+    buffer->assign(source.blocks(), 0);
+    if (source.ranges()) {
+      std::vector<uint64_t> tokens = GetAll(source.ranges());
+      std::vector<size_t> positions = ExpandBlocks(source.location());
+      for (size_t i = 0; i < tokens.size(); i++) {
+        (*buffer)[source.location() ? positions[i] : i] = tokens[i];
+      }
+    }
+    for (const auto& stash : source.stashes()) {
+      auto it = stashes_.find(stash.id());
+      if (it == stashes_.end() || it->second.size() != stash.blocks()) {
+        *err = "missing stash " + stash.id();
+        return false;
+      }
+      std::vector<size_t> positions = ExpandBlocks(stash.ranges());
+      for (size_t i = 0; i < positions.size(); i++) {
+        (*buffer)[positions[i]] = it->second[i];
+      }
+    }
+    return true;
+  }
+
+  std::vector<uint64_t> blocks_;
+  std::map<std::string, std::vector<uint64_t>> stashes_;
+  uint64_t new_data_blocks_{ 0 };
+  std::vector<std::pair<std::string, uint64_t>> loads_;
+};
+
+}  // namespace
+
+bool OptimizeTransferList(const TransferList& transfer_list, std::vector<Command>* commands,
+                          std::string* err) {
+  const std::vector<Command>& original = transfer_list.commands();
+  std::vector<uint32_t> order = ScheduleCommands(original, BuildDependencyGraph(original));
+
+  std::vector<Command> reordered;
+  reordered.reserve(order.size());
+  for (uint32_t i : order) {
+    reordered.push_back(original[i]);
+  }
+  InlineStashes(&reordered);
+
+  if (!CheckTransferListsEquivalent(original, reordered, err)) {
+    *err = "reordered transfer list doesn't match the original: " + *err;
+    return false;
+  }
+
+  TransferListStats before = ComputeTransferListStats(original);
+  TransferListStats after = ComputeTransferListStats(reordered);
+  LOG(INFO) << "original order: " << before;
+  LOG(INFO) << "optimized order: " << after;
+  if (!(after < before)) {
+    LOG(INFO) << "Keeping the original order";
+    *commands = original;
+    return true;
+  }
+  *commands = std::move(reordered);
+  return true;
+}
+
+bool CheckTransferListsEquivalent(const std::vector<Command>& expected,
+                                  const std::vector<Command>& actual, std::string* err) {
+  SymbolicPartition expected_partition;
+  for (const auto& command : expected) {
+    if (!expected_partition.Execute(command, err)) return false;
+  }
+  SymbolicPartition actual_partition;
+  for (const auto& command : actual) {
+    if (!actual_partition.Execute(command, err)) return false;
+  }
+
+  if (expected_partition.SortedLoads() != actual_partition.SortedLoads()) {
+    *err = "commands load different source data";
+    return false;
+  }
+  size_t size = std::max(expected_partition.size(), actual_partition.size());
+  for (size_t block = 0; block < size; block++) {
+    if (expected_partition.Get(block) != actual_partition.Get(block)) {
+      *err = android::base::StringPrintf("block %zu has different contents", block);
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string FormatTransferList(const TransferList& transfer_list,
+                               const std::vector<Command>& commands) {
+  TransferListStats stats = ComputeTransferListStats(commands);
+  std::vector<std::string> lines{
+    std::to_string(transfer_list.version()),
+    std::to_string(transfer_list.total_blocks()),
+    std::to_string(stats.stash_max_entries),
+    std::to_string(stats.stash_max_blocks),
+  };
+  for (const auto& command : commands) {
+    lines.push_back(command.cmdline());
+  }
+  return android::base::Join(lines, "\n") + "\n";
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+
+#include "private/commands.h"
+#include "updater/transfer_list_optimizer.h"
+
+void Usage(std::string_view name) {
+  LOG(INFO) << "Usage: " << name << " <input_transfer_list> <output_transfer_list>";
+}
+
+int main(int argc, char** argv) {
+  android::base::InitLogging(argv, &android::base::StderrLogger);
+
+  if (argc != 3) {
+    Usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::string content;
+  if (!android::base::ReadFileToString(argv[1], &content)) {
+    PLOG(ERROR) << "Failed to read " << argv[1];
+    return EXIT_FAILURE;
+  }
+
+  std::string err;
+  TransferList transfer_list = TransferList::Parse(content, &err);
+  if (!transfer_list) {
+    LOG(ERROR) << "Failed to parse " << argv[1] << ": " << err;
+    return EXIT_FAILURE;
+  }
+
+  // OptimizeTransferList() checks the result against the original order before returning it.
+  std::vector<Command> commands;
+  if (!OptimizeTransferList(transfer_list, &commands, &err)) {
+    LOG(ERROR) << "Failed to optimize " << argv[1] << ": " << err;
+    return EXIT_FAILURE;
+  }
+
+  if (!android::base::WriteStringToFile(FormatTransferList(transfer_list, commands), argv[2])) {
+    PLOG(ERROR) << "Failed to write " << argv[2];
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
@@ -44,8 +44,7 @@ void Usage(std::string_view name) {
             << " --ota_package <ota_package>";
 }
 
-Value* SimulatorPlaceHolderFn(const char* name, State* /* state */,
-                              const std::vector<std::unique_ptr<Expr>>& /* argv */) {
+Value* SimulatorPlaceHolderFn(const char* name, State* /* state */, const ExprArgs& /* argv */) {
   LOG(INFO) << "Skip function " << name << " in host simulation";
   return StringValue("t");
 }
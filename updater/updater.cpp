@@ -17,6 +17,7 @@
 #include "updater/updater.h"
 
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include <string>
@@ -25,6 +26,7 @@
 #include <android-base/strings.h>
 
 #include "edify/updater_runtime_interface.h"
+#include "otautil/memory_budget.h"
 
 Updater::~Updater() {
   if (package_handle_) {
@@ -42,13 +44,29 @@ bool Updater::Init(int fd, const std::string_view package_filename, bool is_retr
 
   setlinebuf(cmd_pipe_.get());
 
-  if (!mapped_package_.MapFile(std::string(package_filename))) {
-    LOG(ERROR) << "failed to map package " << package_filename;
-    return false;
+  // Size the budgets of the large allocations below against the memory available at start.
+  MemoryBudget::Get().Init();
+
+  std::string filename(package_filename);
+  MappingLimits limits;
+  int open_err;
+  if (mapped_package_.MapFile(filename, limits)) {
+    open_err = OpenArchiveFromMemory(mapped_package_.addr, mapped_package_.length,
+                                     filename.c_str(), &package_handle_);
+  } else {
+    // libziparchive reads the entries of a package file through its own fd, which leaves only the
+    // patch data of block_image_update() to be mapped, a window at a time. A block map has no
+    // such fd; recovery installs block maps over the limits through FUSE instead.
+    if (filename[0] == '@' || !package_windows_.Open(filename, limits)) {
+      LOG(ERROR) << "failed to map package " << package_filename;
+      return false;
+    }
+    LOG(INFO) << "Mapping package " << package_filename << " (" << package_windows_.length()
+              << " bytes) in windows of " << limits.window_size << " bytes";
+    windowed_package_ = true;
+    open_err = OpenArchive(filename.c_str(), &package_handle_);
   }
-  if (int open_err = OpenArchiveFromMemory(mapped_package_.addr, mapped_package_.length,
-                                           std::string(package_filename).c_str(), &package_handle_);
-      open_err != 0) {
+  if (open_err != 0) {
     LOG(ERROR) << "failed to open package " << package_filename << ": "
                << ErrorCodeString(open_err);
     return false;
@@ -62,13 +80,49 @@ bool Updater::Init(int fd, const std::string_view package_filename, bool is_retr
   return true;
 }
 
+const uint8_t* Updater::GetPackageData(uint64_t offset, size_t size) const {
+  if (windowed_package_) {
+    return package_windows_.Access(offset, size);
+  }
+  if (offset > mapped_package_.length || size > mapped_package_.length - offset) {
+    LOG(ERROR) << "Package data at " << offset << " (" << size << " bytes) is out of bounds";
+    return nullptr;
+  }
+  return mapped_package_.addr + offset;
+}
+
+uint64_t Updater::GetPackageLength() const {
+  return windowed_package_ ? package_windows_.length() : mapped_package_.length;
+}
+
+void Updater::ReleasePackageData(uint64_t offset, size_t size) const {
+  // The windows are bounded already, and may hold data read into anonymous memory that can't be
+  // dropped.
+  if (windowed_package_ || size == 0) {
+    return;
+  }
+  // The package is mapped read-only from a file, so the pages are read back in from the file if
+  // they're accessed again.
+  static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  const uint8_t* data = GetPackageData(offset, size);
+  if (data == nullptr) {
+    return;
+  }
+  uintptr_t begin = reinterpret_cast<uintptr_t>(data) & ~(page_size - 1);
+  uintptr_t end = reinterpret_cast<uintptr_t>(data) + size;
+  if (madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED) == -1) {
+    PLOG(WARNING) << "Failed to release " << size << " bytes of mapped package";
+  }
+}
+
 bool Updater::RunUpdate() {
   CHECK(runtime_);
 
   // Parse the script.
-  std::unique_ptr<Expr> root;
+  ExprArena arena;
+  Expr* root;
   int error_count = 0;
-  int error = ParseString(updater_script_, &root, &error_count);
+  int error = ParseString(updater_script_, &arena, &root, &error_count);
   if (error != 0 || error_count > 0) {
     LOG(ERROR) << error_count << " parse errors";
     return false;
@@ -28,6 +28,7 @@
 #include <selinux/selinux.h>
 
 #include "edify/expr.h"
+#include "otautil/async_logger.h"
 #include "updater/blockimg.h"
 #include "updater/dynamic_partitions.h"
 #include "updater/install.h"
@@ -54,8 +55,8 @@ int main(int argc, char** argv) {
   setbuf(stderr, nullptr);
 
   // We don't have logcat yet under recovery. Update logs will always be written to stdout
-  // (which is redirected to recovery.log).
-  android::base::InitLogging(argv, &UpdaterLogger);
+  // (which is redirected to recovery.log), in the background as block OTAs log per command.
+  android::base::InitLogging(argv, StartAsyncLogging(&UpdaterLogger));
 
   // Run the libcrypto KAT(known answer tests) based self tests.
   if (BORINGSSL_self_test() != 1) {